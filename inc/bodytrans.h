@@ -7,6 +7,9 @@
  *	12-apr-95	no more ARGS  - defer math stuff to stdinc.h
  *      31-dec-02       gcc3/SINGLEPREC
  *      24-sep-04       added macro defining r as specified in man page  WD
+ *      18-oct-2026     added btbits()
+ *      18-oct-2026     added btreval(), btieval()
+ *      18-oct-2026     added btmeval()
  */
 
 #ifndef _bodytrans_h
@@ -25,6 +28,10 @@ typedef int  (*iproc_body)(Body *, real, int);
 
 extern rproc_body btrtrans(string expr);
 extern iproc_body btitrans(string expr);
+extern int        btbits(string expr);
+extern void       btreval(rproc_body f, Body *btab, int n, real t, int i0, real *res);
+extern void       btieval(iproc_body f, Body *btab, int n, real t, int i0, int *res);
+extern void       btmeval(rproc_body *f, int nf, Body *btab, int n, real t, int i0, real **res);
 
 #ifndef _bodytransc_h
 /*
@@ -0,0 +1,39 @@
+/*
+ * fie.h	function parser and evaluator (see fie.c, nemofie.c)
+ *
+ *  The classic interface has one "current" expression (inifie/dofie),
+ *  with savefie/loadfie to juggle several.  A fie context holds its own
+ *  compiled code, so any number of them can be used side by side, and
+ *  evalfie may be called from several threads at the same time.
+ *
+ *  18-oct-26	created for fie contexts		PJT
+ *  18-oct-26	newfies: several expressions in one context	PJT
+ */
+
+#ifndef _h_fie
+#define _h_fie
+
+typedef struct fie_context {
+    string expr;	    /* the expression(s), as given, comma separated */
+    int    npar;	    /* highest %n referenced, or < 0 if parse error */
+    int    nexpr;	    /* number of expressions, i.e. results per set */
+    int    ran;		    /* uses random numbers (not evaluated in parallel) */
+    int    nnode;	    /* operations left after folding and sharing */
+    void  *prog;	    /* the compiled code */
+} fie_context, *fieptr;
+
+/* classic interface, one current expression */
+int  inifie  (string);
+void dofie   (real *, int *, real *, real *);
+void dmpfie  (void);
+int  savefie (int);
+int  loadfie (int);
+
+/* fie contexts: compile once (not thread safe), evaluate concurrently */
+fieptr newfie  (string);
+fieptr newfies (string *, int, int);
+void   evalfie (fieptr, real *, int, real *, real);
+void   dumpfie (fieptr);
+void   freefie (fieptr);
+
+#endif
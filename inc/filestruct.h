@@ -5,6 +5,11 @@
  *     12-apr-95  prototypes without ARGS       PJT
  *      2-jun-05  blocked I/O as a flavor of random I/O     PJT
  *     11-dec-09  half precision type                       PJT
+ *     18-oct-26  get_data_mapped for zero-copy input          PJT
+ *     18-oct-26  get_index_seek for indexed access by time    PJT
+ *     18-oct-26  size_t offsets/lengths for random/blocked access  PJT
+ *     18-oct-26  put_zip to write compressed plural items      PJT
+ *     18-oct-26  get_data_open/next/close cursors for chunked input  PJT
  */
 #ifndef _filestruct_h
 #define _filestruct_h
@@ -71,11 +76,13 @@ extern string get_string ( stream str, string tag );
 extern void get_data ( stream, string, string, void *, int, ...);
 
 extern void get_data_coerced ( stream, string, string, void *, int, ...);
+extern void *get_data_mapped ( stream, string, string, int, ...);
 			 
 extern void get_data_sub ( stream, string, string, void *, int *, bool);
 		     
 extern bool get_tag_ok ( stream, string);
 extern bool skip_item ( stream);
+extern int get_index_seek ( stream, string, string, double);
 extern string *list_tags ( stream);
 extern string get_type ( stream, string);
 extern int *get_dims ( stream, string);
@@ -85,13 +92,21 @@ extern void strclose ( stream);
 
 extern void get_data_set     ( stream , string , string , int,  ...);
 extern void get_data_tes     ( stream , string  );
-extern void get_data_ran     ( stream , string , void *, int , int );
-extern void get_data_blocked ( stream , string , void *, int);
+extern void get_data_ran     ( stream , string , void *, size_t , size_t );
+extern void get_data_blocked ( stream , string , void *, size_t );
+
+typedef struct _datcursor *datcursor;
+
+extern datcursor get_data_open ( stream, string, string, size_t *);
+extern size_t get_data_next    ( datcursor, void *, size_t );
+extern void get_data_close     ( datcursor );
 
 extern void put_data_set     ( stream , string , string , int,  ...);
 extern void put_data_tes     ( stream , string );
-extern void put_data_ran     ( stream , string , void *, int , int  );
-extern void put_data_blocked ( stream , string , void *, int );
+extern void put_data_ran     ( stream , string , void *, size_t , size_t );
+extern void put_data_blocked ( stream , string , void *, size_t );
+
+extern void put_zip ( stream, bool );
 
 extern bool qsf ( stream );
 #endif
@@ -0,0 +1,38 @@
+/*
+ * histogram.h:  1, 2 or 3 dimensional histograms, with uniform bins or
+ *               given bin edges along each axis, accumulated in parallel
+ *
+ * 18-oct-26	created, shared by tabhist, ccdhist and snapgrid	PJT
+ */
+
+#ifndef _h_histogram
+#define _h_histogram
+
+#define MAXHDIM 3
+
+typedef struct hist_axis {
+    int n;                  /* number of bins */
+    real lo, hi;            /* range: bins include their lower edge, the last one also hi */
+    real *edge;             /* edge[n+1] if the bins are not uniform, else NULL */
+    int nlut;               /* lookup table for given edges: */
+    int *lut;               /* lut[j] is the bin of lo + j*(hi-lo)/nlut */
+} HistAxis;
+
+typedef struct histogram {
+    int ndim;               /* 1, 2 or 3 */
+    HistAxis ax[MAXHDIM];   /* the axes */
+    long ncell;             /* number of cells, the product of the ax[].n */
+    real *count;            /* count[ix + nx*(iy + ny*iz)] */
+    real under, over;       /* weight below lo, or (if not) above hi, along any axis */
+} Histogram, *HistogramPtr;
+
+void ini_histogram  (Histogram *, int);                        /* ndim */
+void uniform_histogram(Histogram *, int, int, real, real);     /* axis, n, lo, hi */
+void edges_histogram(Histogram *, int, int, real *);           /* axis, n, edge[n+1] */
+void reset_histogram(Histogram *);                             /* allocates count */
+void index_histogram(Histogram *, int, real *, real *, real *, long *);
+void accum_histogram(Histogram *, long, real *, real *, real *, real *);
+void merge_histogram(Histogram *, Histogram *);                /* adds the 2nd to the 1st */
+void free_histogram (Histogram *);
+
+#endif
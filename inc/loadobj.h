@@ -2,6 +2,8 @@
 /* File: loadobj.h                                             */
 /* Last modified on Sat Nov 23 08:54:34 1985 by roberts        */
 /* 22-feb-94  ansi header PJT                                  */
+/* 18-oct-26  objcache PJT                                     */
+/* 18-oct-26  objreplica, cachedir PJT                         */
 /* ----------------------------------------------------------- */
 /*     This package is used to implement dynamic loading of    */
 /* functions from object files.  Any references in the         */
@@ -25,4 +27,9 @@ extern void mysymbols (string);
 /* from mapsys.c: */
 extern void mapsys    (string);
 
+/* from objcache.c: */
+extern string objcache   (string);
+extern string objreplica (string, int);
+extern string cachedir   (string);
+
 #endif
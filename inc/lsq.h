@@ -5,5 +5,11 @@
 
 void lsq_zero(int n, real *mat, real *vec);
 void lsq_accum(int n, real *mat, real *vec, real *a, real w);
+void lsq_block(int n, real *mat, real *vec, long m, real *a, real *w);
 void lsq_solve(int n, real *mat, real *vec, real *sol);
 void lsq_cfill(int n, real * mat, int c, real *vec);
+
+void lsq_qr_zero(int n, real *r);
+void lsq_qr_accum(int n, real *r, real *a, real w);
+void lsq_qr_block(int n, real *r, long m, real *a, real *w);
+void lsq_qr_solve(int n, real *r, real *sol);
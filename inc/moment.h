@@ -1,11 +1,13 @@
 /*
  * moment.h	data stucture to aid in moment & minmax calculations
+ *
+ * 18-oct-26	merge_moment; Quantile sketch	PJT
  */
 
 
 typedef struct moment {
     int mom;		    /* highest moment (use -1 if minmax is all) */
-    int n;		    /* number of data accumulated so far */
+    long n;		    /* number of data accumulated so far */
     int ndat;               /* max number of data for moving moments */
     int idat;               /* index to last written data for moving moments */
     real *dat;              /* data[ndata] if moving moments used */
@@ -20,6 +22,7 @@ void ini_moment   (Moment *, int, int);		/* allocates */
 void accum_moment (Moment *, real, real);	/* accumulates */
 void decr_moment  (Moment *, real, real);	/* decrements (dangerous) */
 void reset_moment (Moment *);       	        /* resets */
+void merge_moment (Moment *, Moment *);         /* adds the 2nd to the 1st */
 void free_moment  (Moment *);                   /* frees allocs from ini_ */
 
 real show_moment  (Moment *, int);     /* general case to peek at (special) values */
@@ -51,3 +54,29 @@ real sigma_robust_moment(Moment *);
 real median_robust_moment(Moment *);
 void robust_range(Moment *, real *range);
 
+/*
+ * A Quantile sketch keeps a bounded number of the data, in levels where
+ * each item stands for 2^level data, such that any quantile is found with
+ * a rank error below eps*n.  Sketches of parts of the data can be merged.
+ */
+
+#define MAXQLEV 64
+
+typedef struct quantile {
+    real eps;               /* rank error bound, as a fraction of n */
+    int k;                  /* capacity of each level */
+    int nlev;               /* number of levels in use */
+    int cnt[MAXQLEV];       /* number of items in each level */
+    real *lev[MAXQLEV];     /* lev[h][k] items of weight 2^h */
+    unsigned long long odd; /* which half the next compaction of level h keeps */
+    double n;               /* number of data accumulated so far */
+    real datamin, datamax;  /* min & max of data */
+} Quantile, *QuantilePtr;
+
+void ini_quantile   (Quantile *, real);             /* eps */
+void accum_quantile (Quantile *, real);
+void merge_quantile (Quantile *, Quantile *);      /* adds the 2nd to the 1st */
+void free_quantile  (Quantile *);
+real get_quantile   (Quantile *, real);             /* 0 <= p <= 1 */
+bool exact_quantile (Quantile *);                   /* all data still kept? */
+void moment_quantile(Quantile *, real, real, Moment *);  /* items in [lo,hi] */
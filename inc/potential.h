@@ -4,6 +4,9 @@
  *
  *	jul 1987:	original implementation
  *	sep 2001:	added C++ support, including const'ing 
+ *	oct 2026:	potproc_double_n, n positions per call
+ *	oct 2026:	potential contexts, newpotential()
+ *	oct 2026:	potential_points
  */
 
 #ifndef _potential_h
@@ -19,6 +22,23 @@ typedef struct a_potential {
 
 typedef void (*potproc_double)(const int *, const double *, double *, double *, const double *);
 typedef void (*potproc_float) (const int *, const float *,  float *,  float *,  const float *);
+/* n positions at once: pos and acc are ndim blocks of n, i.e. all x, all y,.. */
+typedef void (*potproc_double_n)(const int *, const int *, const double *, double *, double *, const double *);
+
+/* a potential with its own parameters, or a sum of them; see newpotential() */
+typedef struct pot_context {
+    string name;		/* potname, potpars and potfile as given */
+    string pars;
+    string file;
+    int    npar;		/* parameters, after inipotential */
+    double *par;
+    real   omega;		/* pattern speed */
+    potproc_double   pot;	/* the potential */
+    potproc_double_n pot_n;	/* or its array version, if present */
+    int    ncomp;		/* a sum of ncomp components if > 0 */
+    struct pot_context **comp;
+} pot_context, *potptr;
+
 #ifdef SINGLEPREC
 typedef potproc_float potproc_real;
 #else
@@ -33,10 +53,17 @@ extern "C" {
 potproc_real   get_potential        (const string, const string, const string);
 potproc_float  get_potential_float  (const string, const string, const string);
 potproc_double get_potential_double (const string, const string, const string);
+potproc_double_n get_potential_double_n (const string, const string, const string);
+void           potential_points     (potproc_double, const int *, const int *,
+				     const double *, double *, double *, const double *);
 proc           get_inipotential     (void);
 real           get_pattern          (void);
 void           set_pattern          (real);
 
+potptr newpotential  (const string, const string, const string);
+void   evalpotential (potptr, int, int, const double *, double *, double *, double);
+void   freepotential (potptr);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -0,0 +1,24 @@
+/*
+ * potential_n:    helper for potential_double_n, the array version of
+ *                 potential_double
+ *
+ *  potential_double_n(int *ndim, int *n, double *pos, double *acc,
+ *                     double *pot, double *time)
+ *  evaluates n positions at once; pos and acc are stored by coordinate
+ *  (all n x's, then all y's, then all z's), pot has n values.
+ *
+ *  By including this file, potential_n_points() evaluates them one at a
+ *  time with potential_double(), for the cases an array version does not
+ *  handle itself (e.g. *ndim != 3).  It is potential_points(3NEMO), from
+ *  the program that loaded the potential.
+ *
+ *  18-oct-2026	  created, for the vectorized plummer, log, ...	PJT
+ *  18-oct-2026	  use potential_points()			PJT
+ */
+
+#include <potential.h>
+
+extern void potential_double(int *,double *,double *,double *,double *);
+
+#define potential_n_points(ndim,n,pos,acc,pot,time) \
+	potential_points((potproc_double) potential_double,ndim,n,pos,acc,pot,time)
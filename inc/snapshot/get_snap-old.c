@@ -14,6 +14,13 @@
  *       2-apr-02 add UdotIntTag for ZENO	pjt
  *      30-may-07 allocate() needs size_t args for > 44.7M      pjt
  *    14-feb-2017 added get_snap_nbody()                        pjt
+ *    18-oct-2026 use get_data_mapped() to avoid a copy if possible   pjt
+ *    18-oct-2026 get_snap_by_t() seeks via the item index if available pjt
+ *    18-oct-2026 get_snap_mask to skip particle items not needed   pjt
+ *    18-oct-2026 support the SoaBody layout of <snapshot/soabody.h>    pjt
+ *    18-oct-2026 accept Nobj written as a LongType                   pjt
+ *    18-oct-2026 get_snap_open/next/close for input in batches of bodies pjt
+ *    18-oct-2026 the number of bodies is a SnapCount (see snapshot.h)  pjt
  */
 
 /*
@@ -31,7 +38,8 @@
  *
  *	stream instr;
  *	Body *btab = NULL;
- *	int nbody, bits;
+ *	SnapCount nbody;
+ *	int bits;
  *	real tsnap;
  *
  *	get_snap(instr, &btab, &nbody, &tsnap, &bits);
@@ -58,8 +66,91 @@
  *
  * Look at the definition of the standard function(s) you are replacing to
  * find out what arguments to expect.
+ * (5) By default all particle items found are read; a program which only
+ * needs a few can clear the others from get_snap_mask, e.g.
+ *
+ *	get_snap_mask = MassBit | PhaseSpaceBit | btbits(expr);
+ *
+ * and items not in the mask are skipped without being decoded or copied.
+ * (6) With <snapshot/soabody.h> instead of <snapshot/body.h> the bodies
+ * are stored as separate columns (structure of arrays), see that file.
+ * (7) Programs that can handle the bodies one batch at a time can use
+ * get_snap_open, get_snap_next and get_snap_close (see below) instead,
+ * and then only need memory for a batch, whatever the number of bodies.
+ */
+
+/*
+ * SNAP_DIM: the number of bodies as the (int) first dimension of an item.
+ */
+
+#ifndef snap_dim
+
+#define snap_dim  _snap_dim
+
+local int
+_snap_dim(SnapCount nbody)
+{
+    if ((int) nbody != nbody)
+	error("snap_dim: %ld bodies do not fit in one item", (long) nbody);
+    return (int) nbody;
+}
+
+#endif
+
+/*
+ * GET_SNAP_MASK: bit flags of the particle items to be read.
  */
+
+#ifndef get_snap_mask
+
+#define get_snap_mask  _get_snap_mask
+
+local int _get_snap_mask = ~0;
+
+#endif
 
+/*
+ * GET_SNAP_BUFFER: point to the data of an item in a memory mapped input
+ * file, or else allocate a buffer and read (and coerce) the data into it.
+ * Returns TRUE if the buffer was allocated and needs to be freed.
+ */
+
+#ifndef get_snap_buffer
+
+#define get_snap_buffer  _get_snap_buffer
+
+local bool
+_get_snap_buffer(instr, tag, typ, bufptr, nbody, ndim)
+stream instr;			/* input stream, of course */
+string tag;			/* tag of the item */
+string typ;			/* type wanted in the buffer */
+void **bufptr;			/* pointer to returned buffer */
+SnapCount nbody;		/* number of bodies */
+int ndim;			/* number of reals per body (1, NDIM, 2*NDIM) */
+{
+    size_t len = (size_t)nbody * ndim * (streq(typ,IntType) ? sizeof(int) : sizeof(real));
+    int n = snap_dim(nbody);
+
+    if (ndim == 1)
+	*bufptr = get_data_mapped(instr, tag, typ, n, 0);
+    else if (ndim == NDIM)
+	*bufptr = get_data_mapped(instr, tag, typ, n, NDIM, 0);
+    else
+	*bufptr = get_data_mapped(instr, tag, typ, n, 2, NDIM, 0);
+    if (*bufptr != NULL)			/* zero-copy access */
+	return FALSE;
+    *bufptr = allocate(len);
+    if (ndim == 1)
+	get_data_coerced(instr, tag, typ, *bufptr, n, 0);
+    else if (ndim == NDIM)
+	get_data_coerced(instr, tag, typ, *bufptr, n, NDIM, 0);
+    else
+	get_data_coerced(instr, tag, typ, *bufptr, n, 2, NDIM, 0);
+    return TRUE;
+}
+
+#endif
+
 /*
  * GET_SNAP_PARAMETERS: worker routine to input snapshot parameters.
  */
@@ -73,24 +164,39 @@ local void
 _get_snap_parameters(instr, btptr, nbptr, tsptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 real *tsptr;			/* pointer to time of input */
 int *ifptr;			/* pointer to input bit flags */
 {
-    int nbody;
+    SnapCount nbody = 0;
+    long lnbody;
+    int inbody;
+    string type;
 
     if (get_tag_ok(instr, ParametersTag)) {
 	get_set(instr, ParametersTag);
-	if (get_tag_ok(instr,NobjTag))
-	  get_data(instr, NobjTag, IntType, &nbody, 0);
-	else if (get_tag_ok(instr,NBodyTag)) {
-	  get_data(instr, NBodyTag, IntType, &nbody, 0);
-	  warning("Reading a ZENO file with NBody=%d",nbody);
+	if (get_tag_ok(instr,NobjTag)) {
+	  type = get_type(instr, NobjTag);
+	  if (streq(type, LongType)) {		/* 64-bit writers */
+	    get_data(instr, NobjTag, LongType, &lnbody, 0);
+	    nbody = (SnapCount) lnbody;
+	    if (nbody != lnbody)
+	      error("get_snap_parameters: %s = %ld too large for this program",
+		    NobjTag, lnbody);
+	  } else {
+	    get_data(instr, NobjTag, IntType, &inbody, 0);
+	    nbody = inbody;
+	  }
+	  free(type);
+	} else if (get_tag_ok(instr,NBodyTag)) {
+	  get_data(instr, NBodyTag, IntType, &inbody, 0);
+	  nbody = inbody;
+	  warning("Reading a ZENO file with NBody=%d",inbody);
 	} else
 	  error("Cannot find Nobj or NBody in snapshot");
 	if (*btptr != NULL && nbody > *nbptr)	/* bigger than expected? */
-	    error("get_snap_parameters: %s = %d is too big now %d\n",
-		  NobjTag, nbody, *nbptr);
+	    error("get_snap_parameters: %s = %ld is too big now %ld\n",
+		  NobjTag, (long) nbody, (long) *nbptr);
 	*nbptr = nbody;				/* set input value */
 	if (get_tag_ok(instr, TimeTag)) {	/* time data specified? */
 	    get_data_coerced(instr, TimeTag, RealType, tsptr, 0);
@@ -141,19 +247,19 @@ local void
 _get_snap_mass(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Mass
     real *mbuf, *mp;
     Body *bp;
+    bool alloc;
 
-    if (get_tag_ok(instr, MassTag)) {
-        mbuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
-	get_data_coerced(instr, MassTag, RealType, mbuf, *nbptr, 0);
+    if ((get_snap_mask & MassBit) && get_tag_ok(instr, MassTag)) {
+	alloc = get_snap_buffer(instr, MassTag, RealType, (void **) &mbuf, *nbptr, 1);
 	for (bp = *btptr, mp = mbuf; bp < *btptr + *nbptr; bp++)
 	    Mass(bp) = *mp++;
-	free(mbuf);
+	if (alloc) free(mbuf);
 	*ifptr |= MassBit;
     }
 #endif
@@ -173,24 +279,26 @@ local void
 _get_snap_phase(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Phase
     real *rvbuf, *rvp;
     Body *bp;
+    bool alloc;
 
+    if ((get_snap_mask & (PhaseSpaceBit|PosBit|VelBit)) == 0)
+	return;
     if (get_tag_ok(instr, PhaseSpaceTag)) {
-        rvbuf = (real *) allocate((size_t)(*nbptr) * 2 * NDIM * sizeof(real));
-	get_data_coerced(instr, PhaseSpaceTag, RealType, rvbuf,
-			 *nbptr, 2, NDIM, 0);
+	alloc = get_snap_buffer(instr, PhaseSpaceTag, RealType, (void **) &rvbuf,
+				*nbptr, 2*NDIM);
 	for (bp = *btptr, rvp = rvbuf; bp < *btptr + *nbptr; bp++) {
 	    SETV(Phase(bp)[0], rvp);
 	    rvp += NDIM;
 	    SETV(Phase(bp)[1], rvp);
 	    rvp += NDIM;
 	}
-	free(rvbuf);
+	if (alloc) free(rvbuf);
 	*ifptr |= PhaseSpaceBit;
     } else if (get_tag_ok(instr, PosTag) || get_tag_ok(instr, VelTag)) {
       real *rbuf, *vbuf, *rp, *vp;
@@ -198,10 +306,10 @@ int *ifptr;			/* pointer to input bit flags */
       vbuf = (real *) allocate((size_t)(*nbptr) * 2 * NDIM * sizeof(real));
       if (get_tag_ok(instr,PosTag))
 	  get_data_coerced(instr, PosTag, RealType, rbuf,
-		       *nbptr, NDIM, 0);
+		       snap_dim(*nbptr), NDIM, 0);
       if (get_tag_ok(instr,VelTag))
 	  get_data_coerced(instr, VelTag, RealType, vbuf,
-		       *nbptr, NDIM, 0);
+		       snap_dim(*nbptr), NDIM, 0);
       for (bp = *btptr, rp=rbuf, vp=vbuf; bp < *btptr + *nbptr; bp++) {
 	SETV(Phase(bp)[0], rp);
 	rp += NDIM;
@@ -212,6 +320,33 @@ int *ifptr;			/* pointer to input bit flags */
       free(vbuf);
       *ifptr |= PhaseSpaceBit;
     }
+#elif defined(SoaBody)
+    real *rvbuf, *rvp;
+    Body *bp;
+    bool alloc;
+
+    if ((get_snap_mask & (PhaseSpaceBit|PosBit|VelBit)) == 0)
+	return;
+    if (get_tag_ok(instr, PhaseSpaceTag)) {
+	alloc = get_snap_buffer(instr, PhaseSpaceTag, RealType, (void **) &rvbuf,
+				*nbptr, 2*NDIM);
+	for (bp = *btptr, rvp = rvbuf; bp < *btptr + *nbptr; bp++) {
+	    SETV(Pos(bp), rvp);
+	    rvp += NDIM;
+	    SETV(Vel(bp), rvp);
+	    rvp += NDIM;
+	}
+	if (alloc) free(rvbuf);
+	*ifptr |= PhaseSpaceBit;
+    } else if (get_tag_ok(instr, PosTag) || get_tag_ok(instr, VelTag)) {
+	if (get_tag_ok(instr,PosTag))		/* straight into the columns */
+	    get_data_coerced(instr, PosTag, RealType, Pos(*btptr),
+			     snap_dim(*nbptr), NDIM, 0);
+	if (get_tag_ok(instr,VelTag))
+	    get_data_coerced(instr, VelTag, RealType, Vel(*btptr),
+			     snap_dim(*nbptr), NDIM, 0);
+	*ifptr |= PhaseSpaceBit;
+    }
 #endif
 }
 
@@ -229,19 +364,19 @@ local void
 _get_snap_phi(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Phi
     real *pbuf, *pp;
     Body *bp;
+    bool alloc;
 
-    if (get_tag_ok(instr, PotentialTag)) {
-        pbuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
-	get_data_coerced(instr, PotentialTag, RealType, pbuf, *nbptr, 0);
+    if ((get_snap_mask & PotentialBit) && get_tag_ok(instr, PotentialTag)) {
+	alloc = get_snap_buffer(instr, PotentialTag, RealType, (void **) &pbuf, *nbptr, 1);
 	for (bp = *btptr, pp = pbuf; bp < *btptr + *nbptr; bp++)
 	    Phi(bp) = *pp++;
-	free(pbuf);
+	if (alloc) free(pbuf);
 	*ifptr |= PotentialBit;
     }
 #endif
@@ -261,22 +396,22 @@ local void
 _get_snap_acc(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Acc
     real *abuf, *ap;
     Body *bp;
+    bool alloc;
 
-    if (get_tag_ok(instr, AccelerationTag)) {
-        abuf = (real *) allocate((size_t)(*nbptr) * NDIM * sizeof(real));
-	get_data_coerced(instr, AccelerationTag, RealType, abuf,
-			 *nbptr, NDIM, 0);
+    if ((get_snap_mask & AccelerationBit) && get_tag_ok(instr, AccelerationTag)) {
+	alloc = get_snap_buffer(instr, AccelerationTag, RealType, (void **) &abuf,
+				*nbptr, NDIM);
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++) {
 	    SETV(Acc(bp), ap);
 	    ap += NDIM;
 	}
-	free(abuf);
+	if (alloc) free(abuf);
 	*ifptr |= AccelerationBit;
     }
 #endif
@@ -296,19 +431,19 @@ local void
 _get_snap_aux(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Aux
     real *abuf, *ap;
     Body *bp;
+    bool alloc;
 
-    if (get_tag_ok(instr, AuxTag)) {
-        abuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
-	get_data_coerced(instr, AuxTag, RealType, abuf, *nbptr, 0);
+    if ((get_snap_mask & AuxBit) && get_tag_ok(instr, AuxTag)) {
+	alloc = get_snap_buffer(instr, AuxTag, RealType, (void **) &abuf, *nbptr, 1);
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++)
 	    Aux(bp) = *ap++;
-	free(abuf);
+	if (alloc) free(abuf);
 	*ifptr |= AuxBit;
     }
 #endif
@@ -328,19 +463,19 @@ local void
 _get_snap_key(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Key
     int *kbuf, *kp;
     Body *bp;
+    bool alloc;
 
-    if (get_tag_ok(instr, KeyTag)) {
-        kbuf = (int *) allocate((size_t)(*nbptr) * sizeof(int));
-	get_data(instr, KeyTag, IntType, kbuf, *nbptr, 0);
+    if ((get_snap_mask & KeyBit) && get_tag_ok(instr, KeyTag)) {
+	alloc = get_snap_buffer(instr, KeyTag, IntType, (void **) &kbuf, *nbptr, 1);
 	for (bp = *btptr, kp = kbuf; bp < *btptr + *nbptr; bp++)
 	    Key(bp) = *kp++;
-	free(kbuf);
+	if (alloc) free(kbuf);
 	*ifptr |= KeyBit;
     }
 #endif
@@ -360,19 +495,19 @@ local void
 _get_snap_dens(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Dens
     real *abuf, *ap;
     Body *bp;
+    bool alloc;
 
-    if (get_tag_ok(instr, DensityTag)) {
-        abuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
-	get_data_coerced(instr, DensityTag, RealType, abuf, *nbptr, 0);
+    if ((get_snap_mask & DensBit) && get_tag_ok(instr, DensityTag)) {
+	alloc = get_snap_buffer(instr, DensityTag, RealType, (void **) &abuf, *nbptr, 1);
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++)
 	    Dens(bp) = *ap++;
-	free(abuf);
+	if (alloc) free(abuf);
 	*ifptr |= DensBit;
     }
 #endif
@@ -393,7 +528,7 @@ local void
 _get_snap_uint(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Uint
@@ -402,7 +537,7 @@ int *ifptr;			/* pointer to input bit flags */
 
     if (get_tag_ok(instr, UdotIntTag)) {
         abuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
-	get_data_coerced(instr, UdotIntTag, RealType, abuf, *nbptr, 0);
+	get_data_coerced(instr, UdotIntTag, RealType, abuf, snap_dim(*nbptr), 0);
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++)
 	    Dens(bp) = *ap++;
 	free(abuf);
@@ -425,19 +560,19 @@ local void
 _get_snap_eps(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
 #ifdef Eps
     real *abuf, *ap;
     Body *bp;
+    bool alloc;
 
-    if (get_tag_ok(instr, EpsTag)) {
-        abuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
-	get_data_coerced(instr, EpsTag, RealType, abuf, *nbptr, 0);
+    if ((get_snap_mask & EpsBit) && get_tag_ok(instr, EpsTag)) {
+	alloc = get_snap_buffer(instr, EpsTag, RealType, (void **) &abuf, *nbptr, 1);
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++)
 	    Eps(bp) = *ap++;
-	free(abuf);
+	if (alloc) free(abuf);
 	*ifptr |= EpsBit;
     }
 #endif
@@ -458,12 +593,16 @@ local void
 _get_snap_particles(instr, btptr, nbptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ifptr;			/* pointer to input bit flags */
 {
     if (get_tag_ok(instr, ParticlesTag)) {
 	if (*btptr == NULL) {
+#ifdef SoaBody
+	  *btptr = soa_alloc((size_t)(*nbptr));
+#else
   	  *btptr = (Body *) allocate((size_t)(*nbptr) * sizeof(Body));
+#endif
 	}
 	get_set(instr, ParticlesTag);
 	get_snap_csys(instr, ifptr);
@@ -510,7 +649,7 @@ local int
 _get_snap(instr, btptr, nbptr, tsptr, ifptr)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 real *tsptr;			/* pointer to time of input */
 int *ifptr;			/* pointer to input bit flags */
 {
@@ -544,12 +683,15 @@ local int
 _get_snap_by_t(instr, btptr, nbptr, tsptr, ifptr, times)
 stream instr;			/* input stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 real *tsptr;			/* pointer to time of input */
 int *ifptr;			/* pointer to input bit flags */
 string times;
 {
     *ifptr = 0;
+    if (! streq(times, "all") &&		/* jump to the next one in range */
+	  get_index_seek(instr, SnapShotTag, times, TimeFuzz) == 0)
+	return 0;
     if (get_tag_ok(instr, SnapShotTag)) {
 	get_set(instr, SnapShotTag);
 	get_snap_parameters(instr, btptr, nbptr, tsptr, ifptr);
@@ -566,6 +708,262 @@ string times;
 
 #endif
 
+/*
+ * GET_SNAP_OPEN, GET_SNAP_NEXT, GET_SNAP_CLOSE: snapshot input in batches
+ * of bodies, using cursors (see get_data_open) on the particle items:
+ *
+ *	while (get_snap_open(instr, &nbody, &tsnap, &bits, times)) {
+ *	    while ((n = get_snap_next(instr, btab, nbatch)) > 0)
+ *		<process the n bodies in btab>;
+ *	    get_snap_close(instr);
+ *	}
+ *
+ * where btab has room for nbatch bodies. get_snap_open returns 0 if there
+ * are no more snapshots (in range); if the snapshot is not in the range
+ * of times, or has no particles, get_snap_next returns 0 right away.
+ * Only one snapshot can be open at a time.  These routines are only
+ * compiled if GET_SNAP_CURSOR is defined before this file is included.
+ */
+
+#if defined(GET_SNAP_CURSOR) && !defined(get_snap_open)
+
+#ifndef TimeFuzz
+#define TimeFuzz  0.001			/* slop allowed in time comparison  */
+#endif
+
+#define get_snap_open   _get_snap_open
+#define get_snap_next   _get_snap_next
+#define get_snap_close  _get_snap_close
+
+local struct {
+    bool      particles;		/* particle set opened */
+    datcursor mass, phase, pos, vel, phi, acc, aux, key, dens, eps;
+    real     *buf;			/* batch of data of one item */
+    size_t    nbuf;			/* its length in bodies */
+} _get_snap_batch;
+
+local datcursor
+_get_snap_cursor(instr, tag, typ, bit, ifptr)
+stream instr;			/* input stream, of course */
+string tag;			/* tag of the item */
+string typ;			/* type wanted */
+int bit;			/* bit flag of the item */
+int *ifptr;			/* pointer to input bit flags */
+{
+    if ((get_snap_mask & bit) == 0 || ! get_tag_ok(instr, tag))
+	return NULL;
+    *ifptr |= bit;
+    return get_data_open(instr, tag, typ, NULL);
+}
+
+local int
+_get_snap_open(instr, nbptr, tsptr, ifptr, times)
+stream instr;			/* input stream, of course */
+SnapCount *nbptr;		/* pointer to number of bodies */
+real *tsptr;			/* pointer to time of input */
+int *ifptr;			/* pointer to input bit flags */
+string times;			/* range of times, or "all" */
+{
+    Body *btab = NULL;
+    int bits = 0;
+
+    *ifptr = 0;
+    _get_snap_batch.particles = FALSE;
+    if (! streq(times, "all") &&		/* jump to the next one in range */
+	  get_index_seek(instr, SnapShotTag, times, TimeFuzz) == 0)
+	return 0;
+    if (! get_tag_ok(instr, SnapShotTag))
+	return 0;
+    get_set(instr, SnapShotTag);
+    get_snap_parameters(instr, &btab, nbptr, tsptr, ifptr);
+    if ((streq(times, "all") ||
+	   (*ifptr & TimeBit && within(*tsptr, times, TimeFuzz))) &&
+	  get_tag_ok(instr, ParticlesTag)) {
+	get_set(instr, ParticlesTag);
+	_get_snap_batch.particles = TRUE;
+	get_snap_csys(instr, ifptr);
+#ifdef Mass
+	_get_snap_batch.mass = _get_snap_cursor(instr, MassTag, RealType, MassBit, &bits);
+#endif
+#if defined(Phase) || defined(SoaBody)
+	if (get_snap_mask & (PhaseSpaceBit|PosBit|VelBit)) {
+	    if (get_tag_ok(instr, PhaseSpaceTag))
+		_get_snap_batch.phase = get_data_open(instr, PhaseSpaceTag, RealType, NULL);
+	    else {				/* detect split Pos/Vel */
+		if (get_tag_ok(instr, PosTag))
+		    _get_snap_batch.pos = get_data_open(instr, PosTag, RealType, NULL);
+		if (get_tag_ok(instr, VelTag))
+		    _get_snap_batch.vel = get_data_open(instr, VelTag, RealType, NULL);
+	    }
+	    if (_get_snap_batch.phase || _get_snap_batch.pos || _get_snap_batch.vel)
+		bits |= PhaseSpaceBit;
+	}
+#endif
+#ifdef Phi
+	_get_snap_batch.phi = _get_snap_cursor(instr, PotentialTag, RealType, PotentialBit, &bits);
+#endif
+#ifdef Acc
+	_get_snap_batch.acc = _get_snap_cursor(instr, AccelerationTag, RealType, AccelerationBit, &bits);
+#endif
+#ifdef Aux
+	_get_snap_batch.aux = _get_snap_cursor(instr, AuxTag, RealType, AuxBit, &bits);
+#endif
+#ifdef Key
+	_get_snap_batch.key = _get_snap_cursor(instr, KeyTag, IntType, KeyBit, &bits);
+#endif
+#ifdef Dens
+	_get_snap_batch.dens = _get_snap_cursor(instr, DensityTag, RealType, DensBit, &bits);
+#endif
+#ifdef Eps
+	_get_snap_batch.eps = _get_snap_cursor(instr, EpsTag, RealType, EpsBit, &bits);
+#endif
+	*ifptr |= bits;
+    }
+    return 1;
+}
+
+/*
+ * _GET_SNAP_ROWS: read the next batch of an item into the buffer, and
+ * check that all items deliver the same number of bodies.
+ */
+
+local void *
+_get_snap_rows(dcp, nbatch, nptr)
+datcursor dcp;			/* cursor of the item */
+int nbatch;			/* maximum number of bodies */
+int *nptr;			/* number of bodies, -1 if not known yet */
+{
+    int n;
+
+    n = (int) get_data_next(dcp, _get_snap_batch.buf, (size_t) nbatch);
+    if (*nptr >= 0 && n != *nptr)
+	error("get_snap_next: particle items of different length");
+    *nptr = n;
+    return _get_snap_batch.buf;
+}
+
+local int
+_get_snap_next(instr, btab, nbatch)
+stream instr;			/* input stream, of course */
+Body *btab;			/* body array, of length nbatch */
+int nbatch;			/* number of bodies wanted */
+{
+    int i, n = -1;
+    real *rp;
+    Body *bp;
+
+    if (! _get_snap_batch.particles)
+	return 0;
+    if (_get_snap_batch.nbuf < (size_t) nbatch) {
+	if (_get_snap_batch.buf != NULL)
+	    free(_get_snap_batch.buf);
+	_get_snap_batch.buf = (real *) allocate((size_t) nbatch * 2 * NDIM * sizeof(real));
+	_get_snap_batch.nbuf = nbatch;
+    }
+#ifdef Mass
+    if (_get_snap_batch.mass) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.mass, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++)
+	    Mass(bp) = *rp++;
+    }
+#endif
+#if defined(Phase) || defined(SoaBody)
+    if (_get_snap_batch.phase) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.phase, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++) {
+	    SETV(Pos(bp), rp);
+	    rp += NDIM;
+	    SETV(Vel(bp), rp);
+	    rp += NDIM;
+	}
+    }
+    if (_get_snap_batch.pos) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.pos, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++, rp += NDIM)
+	    SETV(Pos(bp), rp);
+    }
+    if (_get_snap_batch.vel) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.vel, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++, rp += NDIM)
+	    SETV(Vel(bp), rp);
+    }
+#endif
+#ifdef Phi
+    if (_get_snap_batch.phi) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.phi, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++)
+	    Phi(bp) = *rp++;
+    }
+#endif
+#ifdef Acc
+    if (_get_snap_batch.acc) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.acc, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++, rp += NDIM)
+	    SETV(Acc(bp), rp);
+    }
+#endif
+#ifdef Aux
+    if (_get_snap_batch.aux) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.aux, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++)
+	    Aux(bp) = *rp++;
+    }
+#endif
+#ifdef Key
+    if (_get_snap_batch.key) {
+	int *kp = (int *) _get_snap_rows(_get_snap_batch.key, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++)
+	    Key(bp) = *kp++;
+    }
+#endif
+#ifdef Dens
+    if (_get_snap_batch.dens) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.dens, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++)
+	    Dens(bp) = *rp++;
+    }
+#endif
+#ifdef Eps
+    if (_get_snap_batch.eps) {
+	rp = (real *) _get_snap_rows(_get_snap_batch.eps, nbatch, &n);
+	for (bp = btab, i = 0; i < n; bp++, i++)
+	    Eps(bp) = *rp++;
+    }
+#endif
+    return n < 0 ? 0 : n;
+}
+
+local void
+_get_snap_uncursor(dcp)
+datcursor *dcp;
+{
+    if (*dcp != NULL)
+	get_data_close(*dcp);
+    *dcp = NULL;
+}
+
+local void
+_get_snap_close(instr)
+stream instr;			/* input stream, of course */
+{
+    _get_snap_uncursor(&_get_snap_batch.mass);
+    _get_snap_uncursor(&_get_snap_batch.phase);
+    _get_snap_uncursor(&_get_snap_batch.pos);
+    _get_snap_uncursor(&_get_snap_batch.vel);
+    _get_snap_uncursor(&_get_snap_batch.phi);
+    _get_snap_uncursor(&_get_snap_batch.acc);
+    _get_snap_uncursor(&_get_snap_batch.aux);
+    _get_snap_uncursor(&_get_snap_batch.key);
+    _get_snap_uncursor(&_get_snap_batch.dens);
+    _get_snap_uncursor(&_get_snap_batch.eps);
+    if (_get_snap_batch.particles)
+	get_tes(instr, ParticlesTag);
+    _get_snap_batch.particles = FALSE;
+    get_tes(instr, SnapShotTag);
+}
+
+#endif
+
 /*
  * GET_SNAP_NBODY: get the number of bodies in a snapshot
  */
@@ -574,12 +972,12 @@ string times;
 
 #define get_snap_nbody  _get_snap_nbody
 
-local int
+local SnapCount
 _get_snap_nbody(instr)
 stream instr;
 {
   Body *btab = NULL;
-  int nbody = 0;
+  SnapCount nbody = 0;
   real tsnap;
   int bits;
   
@@ -587,8 +985,10 @@ stream instr;
   if (!get_tag_ok(instr, SnapShotTag))
     return -1;
   get_snap(instr, &btab, &nbody, &tsnap, &bits);
-  dprintf(0,"get_nbody: %d %f %d\n",nbody,tsnap,bits);
-  free(btab);
+  dprintf(0,"get_nbody: %ld %f %d\n",(long)nbody,tsnap,bits);
+#ifndef SoaBody
+  free(btab);				/* the SoaBody table is reused */
+#endif
   return nbody;
 }
 
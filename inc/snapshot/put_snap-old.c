@@ -11,6 +11,9 @@
  *      29-sep-05  fix for gcc4 supplying default prototypes
  *                 ** only potcode needed this,but we clearly need better solution for this **
  *      30-may-07  allocate() needs size_t argument casting for > 44.7M particles
+ *      18-oct-26  support the SoaBody layout of <snapshot/soabody.h>    PJT
+ *      18-oct-26  the number of bodies is a SnapCount (see snapshot.h), and
+ *                 Nobj is written as a LongType if it does not fit an int PJT
  */
 
 /*
@@ -28,7 +31,8 @@
  *
  *	stream outstr;
  *	Body *btab;
- *	int nbody, bits;
+ *	SnapCount nbody;
+ *	int bits;
  *	real tsnap;
  *
  *	bits = <required_bits>;
@@ -53,8 +57,28 @@
  * find out what arguments to expect.
  */
 
+/*
+ * SNAP_DIM: the number of bodies as the (int) first dimension of an item.
+ */
+
+#ifndef snap_dim
+
+#define snap_dim  _snap_dim
+
+local int
+_snap_dim(SnapCount nbody)
+{
+    if ((int) nbody != nbody)
+	error("snap_dim: %ld bodies do not fit in one item", (long) nbody);
+    return (int) nbody;
+}
+
+#endif
+
 /*
  * PUT_SNAP_PARAM: worker routine to output snapshot parameters.
+ * Nobj is written as an IntType, or as a LongType if the number of
+ * bodies does not fit in an int; get_snap reads either.
  */
 
 #ifndef put_snap_param
@@ -65,12 +89,18 @@ local void
 _put_snap_param(outstr, btptr, nbptr, tsptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 real *tsptr;			/* pointer to time of output */
 int *ofptr;			/* pointer to output bit flags */
 {
+    int inbody = (int) *nbptr;
+    long lnbody = (long) *nbptr;
+
     put_set(outstr, ParametersTag);
-    put_data(outstr, NobjTag, IntType, nbptr, 0);
+    if (inbody == lnbody)
+	put_data(outstr, NobjTag, IntType, &inbody, 0);
+    else
+	put_data(outstr, NobjTag, LongType, &lnbody, 0);
     if (*ofptr & TimeBit)
 	put_data(outstr, TimeTag, RealType, tsptr, 0);
     put_tes(outstr, ParametersTag);
@@ -110,7 +140,7 @@ local void
 _put_snap_mass(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     real *mbuf, *mp;
@@ -121,7 +151,7 @@ int *ofptr;			/* pointer to output bit flags */
         mbuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
 	for (bp = *btptr, mp = mbuf; bp < *btptr + *nbptr; bp++)
 	    *mp++ = Mass(bp);;
-	put_data(outstr, MassTag, RealType, mbuf, *nbptr, 0);
+	put_data(outstr, MassTag, RealType, mbuf, snap_dim(*nbptr), 0);
 	free(mbuf);
 #else
 	error("put_snap_mass: Mass undefined");
@@ -143,7 +173,7 @@ local void
 _put_snap_phase(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     real *rvbuf, *rvp;
@@ -158,7 +188,17 @@ int *ofptr;			/* pointer to output bit flags */
 	    SETV(rvp, Phase(bp)[1]);
 	    rvp += NDIM;
 	}
-	put_data(outstr, PhaseSpaceTag, RealType, rvbuf, *nbptr, 2, NDIM, 0);
+	put_data(outstr, PhaseSpaceTag, RealType, rvbuf, snap_dim(*nbptr), 2, NDIM, 0);
+	free(rvbuf);
+#elif defined(SoaBody)
+        rvbuf = (real *) allocate((size_t)(*nbptr) * 2 * NDIM * sizeof(real));
+	for (bp = *btptr, rvp = rvbuf; bp < *btptr + *nbptr; bp++) {
+	    SETV(rvp, Pos(bp));
+	    rvp += NDIM;
+	    SETV(rvp, Vel(bp));
+	    rvp += NDIM;
+	}
+	put_data(outstr, PhaseSpaceTag, RealType, rvbuf, snap_dim(*nbptr), 2, NDIM, 0);
 	free(rvbuf);
 #else
 	error("put_snap_phase: Phase undefined");
@@ -180,7 +220,7 @@ local void
 _put_snap_phi(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     real *pbuf, *pp;
@@ -191,7 +231,7 @@ int *ofptr;			/* pointer to output bit flags */
         pbuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
 	for (bp = *btptr, pp = pbuf; bp < *btptr + *nbptr; bp++)
 	    *pp++ = Phi(bp);
-	put_data(outstr, PotentialTag, RealType, pbuf, *nbptr, 0);
+	put_data(outstr, PotentialTag, RealType, pbuf, snap_dim(*nbptr), 0);
 	free(pbuf);
 #else
 	error("put_snap_phi: Potential undefined");
@@ -213,7 +253,7 @@ local void
 _put_snap_acc(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     real *abuf, *ap;
@@ -226,7 +266,7 @@ int *ofptr;			/* pointer to output bit flags */
 	    SETV(ap, Acc(bp));
 	    ap += NDIM;
 	}
-	put_data(outstr, AccelerationTag, RealType, abuf, *nbptr, NDIM, 0);
+	put_data(outstr, AccelerationTag, RealType, abuf, snap_dim(*nbptr), NDIM, 0);
 	free(abuf);
 #else
 	error("put_snap_acc: Acceleration undefined");
@@ -248,7 +288,7 @@ local void
 _put_snap_aux(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     real *abuf, *ap;
@@ -259,7 +299,7 @@ int *ofptr;			/* pointer to output bit flags */
         abuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++)
 	    *ap++ = Aux(bp);;
-	put_data(outstr, AuxTag, RealType, abuf, *nbptr, 0);
+	put_data(outstr, AuxTag, RealType, abuf, snap_dim(*nbptr), 0);
 	free(abuf);
 #else
 	error("put_snap_aux: Aux undefined");
@@ -281,7 +321,7 @@ local void
 _put_snap_key(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     int  *kbuf, *kp;
@@ -292,7 +332,7 @@ int *ofptr;			/* pointer to output bit flags */
         kbuf = (int *) allocate((size_t)(*nbptr) * sizeof(int));
 	for (bp = *btptr, kp = kbuf; bp < *btptr + *nbptr; bp++)
 	    *kp++ = Key(bp);;
-	put_data(outstr, KeyTag, IntType, kbuf, *nbptr, 0);
+	put_data(outstr, KeyTag, IntType, kbuf, snap_dim(*nbptr), 0);
 	free(kbuf);
 #else
 	error("put_snap_key: Key undefined");
@@ -315,7 +355,7 @@ local void
 _put_snap_dens(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     real *abuf, *ap;
@@ -326,7 +366,7 @@ int *ofptr;			/* pointer to output bit flags */
         abuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++)
 	    *ap++ = Dens(bp);;
-	put_data(outstr, DensityTag, RealType, abuf, *nbptr, 0);
+	put_data(outstr, DensityTag, RealType, abuf, snap_dim(*nbptr), 0);
 	free(abuf);
 #else
 	error("put_snap_dens: Dens undefined");
@@ -349,7 +389,7 @@ local void
 _put_snap_eps(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     real *abuf, *ap;
@@ -360,7 +400,7 @@ int *ofptr;			/* pointer to output bit flags */
         abuf = (real *) allocate((size_t)(*nbptr) * sizeof(real));
 	for (bp = *btptr, ap = abuf; bp < *btptr + *nbptr; bp++)
 	    *ap++ = Eps(bp);;
-	put_data(outstr, EpsTag, RealType, abuf, *nbptr, 0);
+	put_data(outstr, EpsTag, RealType, abuf, snap_dim(*nbptr), 0);
 	free(abuf);
 #else
 	error("put_snap_eps: Eps undefined");
@@ -382,7 +422,7 @@ local void
 _put_snap_body(outstr, btptr, nbptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 int *ofptr;			/* pointer to output bit flags */
 {
     if (*ofptr & (MassBit | PhaseSpaceBit | PotentialBit |
@@ -437,7 +477,7 @@ local void
 _put_snap(outstr, btptr, nbptr, tsptr, ofptr)
 stream outstr;			/* output stream, of course */
 Body **btptr;			/* pointer to body array */
-int *nbptr;			/* pointer to number of bodies */
+SnapCount *nbptr;		/* pointer to number of bodies */
 real *tsptr;			/* pointer to time of output */
 int *ofptr;			/* pointer to output bit flags */
 {
@@ -7,11 +7,24 @@
  *      nov-2003        removed Yanc tags (YANC is also called gyrfalcON now)
  *      feb-2004        added some new SPH stuff (GasDensity, NPartners, NSPHPartners)
  *      may-2010        added in a few tag from atos.c for handling its' SPH 
+ *      oct-2026        SnapCount, the type of the number of bodies
  */
 
 #ifndef _snapshot_h
 #define _snapshot_h
 
+/*
+ * The number of bodies given to get_snap and put_snap (a pointer to it)
+ * is an int, unless a program defines SnapCount, e.g. as a long, before
+ * it includes this file.  An item holds at most INT_MAX bodies, as the
+ * dimensions of an item are ints; the Nobj parameter is written as an
+ * int if the count fits, else as a long.
+ */
+
+#ifndef SnapCount
+#define SnapCount int
+#endif
+
 /*
  * Item tags for SnapShot components. 
  * !! see also some ZENO compatibility components below !!
@@ -0,0 +1,100 @@
+/*
+ * SOABODY.H: Structure-of-arrays alternative to body.h, with the same
+ * accessor macros.  Each component is kept in its own contiguous column,
+ * and a Body is merely a one byte handle whose offset from the start of
+ * the body table is the index into the columns.  Loops like
+ *
+ *	for (bp = btab; bp < btab+nbody; bp++)
+ *	    SMULVS(Pos(bp), 2.0);
+ *
+ * thus only touch the positions, and can be vectorized by the compiler.
+ *
+ * Restrictions: there is only one body table per program, which must be
+ * allocated with soa_alloc() (get_snap does this for you), so only one
+ * table of bodies can be live at a time: a get_snap with a NULL table
+ * returns the same handles again, overwriting the data; bodies cannot
+ * be copied or swapped by assignment (*bp = *bq); Phase(b) is not defined,
+ * use Pos(b) and Vel(b); and compiled bodytrans(5NEMO) functions, which
+ * assume body.h, cannot be used.
+ *
+ *	18-oct-2026	created					PJT
+ *	18-oct-2026	soa_alloc reuses a table that is big enough	PJT
+ */
+#ifndef _soabody_h
+#define _soabody_h
+
+#define _body_h_dens
+
+typedef char body;		/* handle: offset in the body table */
+
+typedef struct {
+    body   *base;		/* the handles, as returned to the user */
+    size_t  nbody;		/* length of the columns            */
+    real   *mass;		/* mass of bodies		    */
+    vector *pos;		/* positions                        */
+    vector *vel;		/* velocities                       */
+    real   *phi;		/* gravitational potential	    */
+    vector *acc;	 	/* gravitational acceleration	    */
+    real   *aux;		/* misc. real value assoc. w. body  */
+    int    *key;		/* misc. int. value assoc. w. body  */
+    real   *dens;		/* density associated w. body       */
+    real   *eps;                /* softening length w. body         */
+} soatable;
+
+local soatable soa_bodies = { NULL, 0 };
+
+#define Body     body
+#define SoaBody			/* tells get_snap/put_snap about the columns */
+
+#define SoaIndex(b)  ((size_t)((b) - soa_bodies.base))
+
+#define Mass(b)  (soa_bodies.mass[SoaIndex(b)])
+#define Pos(b)   (soa_bodies.pos[SoaIndex(b)])
+#define Vel(b)   (soa_bodies.vel[SoaIndex(b)])
+#define Phi(b)   (soa_bodies.phi[SoaIndex(b)])
+#define Acc(b)   (soa_bodies.acc[SoaIndex(b)])
+#define Aux(b)   (soa_bodies.aux[SoaIndex(b)])
+#define Key(b)   (soa_bodies.key[SoaIndex(b)])
+#define Dens(b)  (soa_bodies.dens[SoaIndex(b)])
+#define Eps(b)   (soa_bodies.eps[SoaIndex(b)])
+
+/*
+ * SOA_ALLOC: allocate the body table for nbody bodies, and return the
+ * handles.  If the table is already big enough it is reused as it is, so
+ * handles obtained before stay valid; only if it has to grow is the old
+ * table freed, which leaves all old handles dangling.  New columns are
+ * zeroed, and since memory for large columns is only mapped in when
+ * touched, unused components cost (almost) nothing.
+ */
+
+local Body *soa_alloc(size_t nbody)
+{
+    if (soa_bodies.base != NULL) {
+	if (nbody <= soa_bodies.nbody)
+	    return soa_bodies.base;
+	free(soa_bodies.base);
+	free(soa_bodies.mass);
+	free(soa_bodies.pos);
+	free(soa_bodies.vel);
+	free(soa_bodies.phi);
+	free(soa_bodies.acc);
+	free(soa_bodies.aux);
+	free(soa_bodies.key);
+	free(soa_bodies.dens);
+	free(soa_bodies.eps);
+    }
+    soa_bodies.nbody = nbody;
+    soa_bodies.base = (body *)   allocate(nbody * sizeof(body));
+    soa_bodies.mass = (real *)   allocate(nbody * sizeof(real));
+    soa_bodies.pos  = (vector *) allocate(nbody * sizeof(vector));
+    soa_bodies.vel  = (vector *) allocate(nbody * sizeof(vector));
+    soa_bodies.phi  = (real *)   allocate(nbody * sizeof(real));
+    soa_bodies.acc  = (vector *) allocate(nbody * sizeof(vector));
+    soa_bodies.aux  = (real *)   allocate(nbody * sizeof(real));
+    soa_bodies.key  = (int *)    allocate(nbody * sizeof(int));
+    soa_bodies.dens = (real *)   allocate(nbody * sizeof(real));
+    soa_bodies.eps  = (real *)   allocate(nbody * sizeof(real));
+    return soa_bodies.base;
+}
+
+#endif
@@ -48,6 +48,7 @@
  *    jul-20    add cputime2()                                      PJT
  *    oct-21    deal with error() in the GNU C library              PJT
  *              programs linking with e.g. gnuastro will otherwise barf
+ *    oct-26    bswap() count is a size_t                           PJT
  */
 
 #ifndef _stdinc_h      /* protect against re-entry */
@@ -623,9 +624,9 @@ extern double log2(double);
 #endif
 
   /* cores/bswap.c */
-extern void bswap(void *vdat, int len, int cnt);
-extern void bswap_litend(void *vdat, int len, int cnt);
-extern void bswap_bigend(void *vdat, int len, int cnt);
+extern void bswap(void *vdat, int len, size_t cnt);
+extern void bswap_litend(void *vdat, int len, size_t cnt);
+extern void bswap_bigend(void *vdat, int len, size_t cnt);
 #define bswapr(p,cnt)  bswap(p,sizeof(real),cnt)
 #define bswapd(p,cnt)  bswap(p,sizeof(double),cnt)
 #define bswapf(p,cnt)  bswap(p,sizeof(float),cnt)
@@ -2,6 +2,9 @@
  *  various support for table I/O
  *
  *  feb-2022     Table I/O - V2.0
+ *  oct-2026     mode=2: mapped tables, table_parse
+ *  oct-2026     sidecar cache of the parsed columns ($NEMOTABCACHE)
+ *  oct-2026     table_stream
  *
  *  Additional support is given via burststring.c and extstring.c
  *  Deprecation messages added to old routine
@@ -30,6 +33,7 @@ void parse(int, string, double *, int);
 void strinsert(string, string, int);
 int iscomment(string);
 void sanitize(string);
+bool ispipe(stream);
 
 //  For a new table system we need a table struct, and each table
 //  will have some columns, with properties that we hide in another
@@ -45,7 +49,7 @@ typedef struct {
    
 typedef struct {
   
-  int  mode;        // I/O mode  (0=streaming, 1=all-in-memory, ...)
+  int  mode;        // I/O mode  (0=all-in-memory, 1=streaming, 2=mapped, <0 keeps comments)
   int  type;        // type of table (SSV, TSV, CSV, ECSV, ipac, ....)
   size_t  nh;       // number of header/comment rows
   size_t  nr;       // number of rows
@@ -61,6 +65,14 @@ typedef struct {
 
   size_t linelen;   // see Posix getline(3)
   char  *line;      // see Posix getline(3)
+
+  char  *map;       // mode=2: the mapped file, lines[] point into it
+  size_t mapsize;
+  char  *tail;      // mode=2: copy of a last line without newline
+  size_t next;      // mode=2: next line for table_line()
+  char  *cache;     // mode=2: the mapped sidecar cache of the parsed columns
+  size_t cachesize;
+  string cname;     // mode=2: sidecar to write in table_md2cr
   
 } table, *tableptr;
 
@@ -77,6 +89,14 @@ string  table_row(tableptr tptr, int row);
 string *table_rowsp(tableptr tptr, int row);
 mdarray2 table_md2rc(table *t, int nrow, int *rows, int ncol, int *cols);  // a[row][col]
 mdarray2 table_md2cr(table *t, int ncol, int *cols, int nrow, int *rows);  // a[col][row]
+int     table_parse(string line, real *val, int nmax);
+int     table_parse_cols(string line, int ncol, int *cols, real *val);
+int     table_lines(tableptr tptr, int nmax, string *lines);
+
+typedef void (*table_setup)(void *arg, int nc, int nthread);
+typedef void (*table_accum)(void *arg, int thread, long row, real *val);
+long    table_stream(tableptr tptr, int *ncol, int *cols,
+		     table_setup setup, table_accum accum, void *arg, long *nrow);
 
 
 
@@ -3,6 +3,7 @@
  *          
  *
  *	 8-feb-2011 V1.0 :  cloned off tabhist, finally         PJT
+ *	18-oct-2026 V1.2 :  use the histogram() engine          PJT
  * 
  * TODO:
  *     option to do dual-pass to subtract the mean before computing
@@ -21,6 +22,7 @@
 #include <yapp.h>
 #include <axis.h>
 #include <mdarray.h>
+#include <histogram.h>
 
 /**************** COMMAND LINE PARAMETERS **********************/
 
@@ -46,7 +48,7 @@ string defv[] = {
     "dual=f\n             Dual pass for large number",
     "blankval=\n          if used, use this as blankval",
     "scale=1\n            Scale factor for data",
-    "VERSION=1.1a\n	  11-mar-2022 PJT",
+    "VERSION=1.2\n	  18-oct-2026 PJT",
     NULL
 };
 
@@ -104,7 +106,6 @@ local iproc  mysort, getsort();
 local real  xtrans(real), ytrans(real);
 local void  setparams(void), read_data(void), histogram(void);
 local iproc getsort(string name);
-local int   ring_index(int n, real *r, real rad);
 
 extern int minmax(int n, real *array, real *amin, real *amax);
 
@@ -242,6 +243,21 @@ local void read_data()
 }
 
 
+/*
+ * HIST_SETUP: the bins of histogram h, given by bins= or uniform in [lo,hi]
+ */
+
+local void hist_setup(Histogram *h, real lo, real hi)
+{
+  ini_histogram(h,1);
+  if (Qbin) {
+    if (bins[0] > bins[1]) error("reverse indexing not yet implemented");
+    edges_histogram(h,0,nsteps,bins);
+  } else
+    uniform_histogram(h,0,nsteps,lo,hi > lo ? hi : lo+1.0);   /* lo=hi: all in the 1st bin */
+  reset_histogram(h);
+}
+
 local void histogram(void)
 {
   int i,j,k, l, kmin, kmax, lcount = 0;
@@ -249,6 +265,7 @@ local void histogram(void)
   real xdat,ydat,xplt,yplt,dx,r,sum,sigma2, q, qmax;
   real mean, sigma, skew, kurt, lmin, lmax, median;
   Moment m;
+  Histogram hist;
 
   if (Qint) warning("new feature integrate=t");
 
@@ -270,30 +287,17 @@ local void histogram(void)
     dprintf (0,"min and max value in range : [%g : %g]\n",lmin,lmax);
   } 
   
-  for (k=0; k<nsteps; k++)
-    count[k] = 0;		/* init histogram */
-  under = over = 0;
-  
   ini_moment(&m,4,0);
-  for (i=0; i<npt; i++) {
-    if (Qbin) {
-      k=ring_index(nsteps,bins,x[i]);
-    } else {
-      if (xmax != xmin)
-	k = (int) floor((x[i]-xmin)/(xmax-xmin)*nsteps);
-      else
-	k = 0;
-      dprintf(1,"%d k=%d %g\n",i,k,x[i]);
-    }
-    if (k==nsteps && x[i]==xmax) k--;     /* include upper edge */
-    if (k<0)       { under++; continue; }
-    if (k>=nsteps) { over++;  continue; }
-    count[k] = count[k] + (Qint ? x[i] : 1);
-    dprintf (4,"%d : %f %d\n",i,x[i],k);
+  hist_setup(&hist, xmin, xmax);
+  accum_histogram(&hist, npt, x, NULL, NULL, Qint ? x : NULL);
+  for (k=0; k<nsteps; k++)
+    count[k] = hist.count[k];
+  under = hist.under;
+  over  = hist.over;
+  for (i=0; i<npt; i++)
     accum_moment(&m,x[i],1.0);
-  }
-  if (under > 0) error("bug: under = %d",under);
-  if (over  > 0) error("bug: over = %d",over);
+  if (under > 0) error("bug: under = %g",under);
+  if (over  > 0) error("bug: over = %g",over);
   under = Nunder;
   over  = Nover;
 
@@ -391,21 +395,13 @@ local void histogram(void)
   if (lcount > 0) {
     warning("Recompute histogram because of outlier removals");
     /* recompute histogram if we've lost some outliers */
+    reset_histogram(&hist);
+    accum_histogram(&hist, npt, x, NULL, NULL, Qint ? x : NULL);
     for (k=0; k<nsteps; k++)
-      count[k] = 0;		/* init histogram */
-    under = over = 0;
-    for (i=0; i<npt; i++) {
-      if (xmax != xmin)
-	k = (int) floor((x[i]-xmin)/(xmax-xmin)*nsteps);
-      else
-	k = 0;
-      if (k==nsteps && x[i]==xmax) k--;     /* include upper edge */
-      if (k<0)       { under++; continue; }
-      if (k>=nsteps) { over++;  continue; }
-      count[k] = count[k] + (Qint ? x[i] : 1);
-      dprintf (4,"%d : %f %d\n",i,x[i],k);
-    }
-    if (under > 0 || over > 0) error("under=%d over=%d in recomputed histo",under,over);
+      count[k] = hist.count[k];
+    under = hist.under;
+    over  = hist.over;
+    if (under > 0 || over > 0) error("under=%g over=%g in recomputed histo",under,over);
   }
   
   dprintf (3,"Histogram values : \n");
@@ -612,27 +608,6 @@ local iproc getsort(string name)
 }
 
 
-/* index into an array --- stolen from velfit.c */
-
-local
-int ring_index(int n, real *r, real rad)
-{
-  int i;
-  
-  if (r[0] < r[1]) {
-    if (rad < r[0]) return -1;
-    if (rad > r[n-1]) return -2;
-    for (i=0;i<n;i++)
-      if (rad >= r[i] && rad < r[i+1]) return i;
-    error("ring_index: should never gotten here %g in [%g : %g]",
-	  rad,r[0],r[n-1]);
-  } else {
-    error("reverse indexing not yet implemented");
-    //Must return a value in this path.
-  }
-
-}
-
 void nemo_main()
 {
     setparams();			/* read the parameters */
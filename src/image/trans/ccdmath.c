@@ -25,10 +25,15 @@
  *      26-aug-04       3.2  fix bad error in setting crpix for cube generation   PJT
  *      10-may-05       3.2a use the wcs routines that have moved to wcsio.c      PJT
  *      25-dec-2020     3.3  allow a map to replicated its 3rd dimension OTF      PJT
+ *      18-oct-2026     3.4  evaluate rows/columns with a fie context, shared
+ *                           over np= threads                                PJT
  *
  *       because of the float/real conversions and
  *       to eliminate excessive memory usage, operations 'fie' are
- *       done on a column by column basis.
+ *       done on a column by column basis (row by row for new maps).
+ *       The expression is compiled once into a fie context, after which
+ *       the columns are independent, and are divided over the threads,
+ *       unless random numbers are used.
  *                      
  */
 
@@ -39,6 +44,7 @@
 #include <filestruct.h>
 #include <strlib.h>
 #include <image.h>
+#include <fie.h>
 
 string defv[] = {
   "in=\n           Input file(s), separated by comma's (optional)",
@@ -50,7 +56,7 @@ string defv[] = {
   "cdelt=\n        Override/Set cdelt (1,1,1)",
   "seed=0\n        Random seed",
   "replicate=f\n   Allow files in 2D to replicate along 3rd dimension",
-  "VERSION=3.3\n   25-dec-2020 PJT",
+  "VERSION=3.4\n   18-oct-2026 PJT",
   NULL,
 };
 
@@ -76,15 +82,14 @@ int nwcs = 0;
 
 bool Qrepl;
 
+fieptr fptr;                    /* the compiled fie= expression */
+
 local int set_axis(string var, int n, double *xvar, double defvar);
 local int fie_remap(char *fie, bool map_create);
 local void do_create(int nx, int ny, int nz);
 local void do_combine(void);
 
 extern  int debug_level;		/* see initparam() */
-extern    void    dmpfien();
-extern    int     inifien();
-extern    void    dofien();
 
 extern string *burststring(string,string);
 
@@ -134,11 +139,11 @@ void nemo_main ()
     fie = scopy(getparam("fie"));
     if (fie_remap(fie,mapgen) < 0)      /* remap %x,%y,%z to %1,%2,%3 */
         error("syntax error in fie = %s",fie);
-    noper = inifien(fie);                   /* highest parameter # needed */
-    if (debug_level >= 5)  dmpfien();        /* debug output from inifie */
-    if (noper < 0)
-         error ("Error in parsing fie expression %s\n inifie returned %d",
-                 getparam("fie"),noper);
+    fptr = newfie(fie);                      /* compile it */
+    if (fptr == NULL)
+         error ("Error in parsing fie expression %s",getparam("fie"));
+    noper = fptr->npar;                     /* highest parameter # needed */
+    if (debug_level >= 5)  dumpfie(fptr);    /* debug output from newfie */
 
     outstr = stropen (getparam("out"),"w");  /* open output file first ... */
 
@@ -241,12 +246,14 @@ local int fie_remap(char *fie, bool map_create)
 /*
  *  create new map from scratch, using %x and %y as position parameters 
  *		0..nx-1 and 0..ny-1
+ *  Each row is evaluated in one call, with the 5 parameters
+ *  (%x,%y,%z,%w,%r) as nx-long vectors.
  */
 local void do_create(int nx, int ny,int nz)
 {
-    double m_min, m_max, total;
-    real   fin[5], fout;
-    int    ix, iy, iz;
+    double m_min, m_max, total, c0[MAXNAX];
+    real   *fin, *fout;
+    int    ix, iy, iz, j;
     int    badvalues;
     
     m_min = HUGE; m_max = -HUGE;
@@ -257,40 +264,47 @@ local void do_create(int nx, int ny,int nz)
       if (!create_cube (&iptr[0], nx, ny, nz))	/* create default empty image */
         error("Could not create 3D image from scratch");
       wcs_f2i(3,crpix,crval,cdelt,iptr[0]);
-
-      for (iz=0; iz<nz; iz++) {
-        fin[2] = iz-crpix[2]+1;   /* crpix is 1 for first pixel (FITS convention) */
-        for (iy=0; iy<ny; iy++) {
-	  fin[1] = iy-crpix[1]+1;
-	  for (ix=0; ix<nx; ix++) {
-	    fin[0] = ix-crpix[0]+1;
-	    fin[3] = sqrt(sqr(fin[0])+sqr(fin[1]));              /* w */
-	    fin[4] = sqrt(sqr(fin[0])+sqr(fin[1])+sqr(fin[2]));  /* r */
-	    dofien (fin, 1, &fout, 0.0);   /* do the work --- see: fie.3 */
-	    CubeValue(iptr[0],ix,iy,iz) = fout;
-	    m_min = MIN(m_min,fout);         /* and check for new minmax */
-	    m_max = MAX(m_max,fout);
-	    total += fout;                   /* add up totals */
-	  }
-        }
-      }
+      for (j=0; j<MAXNAX; j++)  /* crpix is 1 for first pixel (FITS convention) */
+        c0[j] = crpix[j];
     } else {
       if (!create_image (&iptr[0], nx, ny))	
         error("Could not create 2D image from scratch");
       wcs_f2i(2,crpix,crval,cdelt,iptr[0]);
+      for (j=0; j<MAXNAX; j++)  /* a 2D map just uses the pixel index */
+        c0[j] = 1.0;
+      nz = 1;
+    }
 
-      for (iy=0; iy<ny; iy++) {
-	fin[1] = iy;
-	for (ix=0; ix<nx; ix++) {
-	  fin[0] = ix;
-	  dofien (fin, 1, &fout, 0.0);   /* do the work --- see: fie.3 */
-	  MapValue(iptr[0],ix,iy) = fout;
-	  m_min = MIN(m_min,fout);         /* and check for new minmax */
-	  m_max = MAX(m_max,fout);
-	  total += fout;                   /* add up totals */
-	}
+#if _OPENMP
+#pragma omp parallel private(fin,fout,ix,iy,iz) reduction(min:m_min) reduction(max:m_max) reduction(+:total) if (!fptr->ran)
+#endif
+    {
+      fin = (real *) allocate(5*nx*sizeof(real));
+      fout = (real *) allocate(nx*sizeof(real));
+#if _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (j=0; j<nz*ny; j++) {         /* all rows of all planes */
+        iz = j / ny;
+        iy = j % ny;
+        for (ix=0; ix<nx; ix++) {
+          fin[ix]      = ix-c0[0]+1;                                    /* x */
+          fin[ix+nx]   = iy-c0[1]+1;                                    /* y */
+          fin[ix+2*nx] = iz-c0[2]+1;                                    /* z */
+          fin[ix+3*nx] = sqrt(sqr(fin[ix])+sqr(fin[ix+nx]));             /* w */
+          fin[ix+4*nx] = sqrt(sqr(fin[ix])+sqr(fin[ix+nx])+sqr(fin[ix+2*nx])); /* r */
+        }
+        evalfie(fptr, fin, nx, fout, 0.0);   /* do the work --- see: fie.3 */
+        for (ix=0; ix<nx; ix++) {
+          CubeValue(iptr[0],ix,iy,iz) = fout[ix];
+          m_min = MIN(m_min,fout[ix]);       /* and check for new minmax */
+          m_max = MAX(m_max,fout[ix]);
+          total += fout[ix];                 /* add up totals */
+        }
       }
-    } 
+      free(fin);
+      free(fout);
+    }
     
     MapMin(iptr[0]) = m_min;
     MapMax(iptr[0]) = m_max;
@@ -301,15 +315,15 @@ local void do_create(int nx, int ny,int nz)
     if (badvalues)
     	warning ("There were %d bad operations in dofie",badvalues);
 }
-
+
 /* 
- *  combine input maps into an output map  -- still 2D only
+ *  combine input maps into an output map, one (ix,iz) column at a time
  */
 local void do_combine()
 {
     double m_min, m_max, total;
     real  *fin, *fout;
-    int    k, ix, iy, iz, nx, ny, nz, offset;
+    int    j, k, ix, iy, iz, nx, ny, nz, offset;
     int    badvalues;
     
     m_min = HUGE; m_max = -HUGE;
@@ -326,11 +340,18 @@ local void do_combine()
 	warning("Not enough WCS information given (%d/3 keywords) to replace it",nwcs);
     }
 
-    fin = (real *) allocate(nimage*ny*sizeof(real)); 
-    fout = (real *) allocate(ny*sizeof(real));
-        
-    for (iz=0; iz<nz; iz++)
-    for (ix=0; ix<nx; ix++) {
+#if _OPENMP
+#pragma omp parallel private(fin,fout,k,ix,iy,iz,offset) reduction(min:m_min) reduction(max:m_max) reduction(+:total) if (!fptr->ran)
+#endif
+    {
+      fin = (real *) allocate(nimage*ny*sizeof(real)); 
+      fout = (real *) allocate(ny*sizeof(real));
+#if _OPENMP
+#pragma omp for schedule(static)
+#endif
+      for (j=0; j<nz*nx; j++) {
+        iz = j / nx;
+        ix = j % nx;
         for (k=0; k<nimage; k++) {       /* prepare input column buffer */
             offset = ny*k;
             for (iy=0; iy<ny; iy++) {
@@ -340,16 +361,17 @@ local void do_combine()
                 fin[iy+offset] = CubeValue(iptr[k],ix,iy,iz);
 	    }
         }
-        dofien (fin, ny, fout, 0.0); /* do the work --- see: nemofie.3 */
+        evalfie(fptr, fin, ny, fout, 0.0); /* do the work --- see: fie.3 */
         for (iy=0; iy<ny; iy++) {             /* write buffer back to map-0 */
             CubeValue(iptr[0],ix,iy,iz) = (real) fout[iy];
             m_min = MIN(m_min,fout[iy]);         /* and check for new minmax */
             m_max = MAX(m_max,fout[iy]);
             total += fout[iy];
         }
+      }
+      free(fin);
+      free(fout);    
     }
-    free(fin);
-    free(fout);    
 
     MapMin(iptr[0]) = m_min;
     MapMax(iptr[0]) = m_max;
@@ -361,4 +383,3 @@ local void do_combine()
     	warning("There were %d bad operations in dofie",badvalues);
     
 }
-
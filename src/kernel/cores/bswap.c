@@ -30,6 +30,9 @@
  *      30-sep-03  testing memcpy, and improved the testing
  *      20-sep-05  little and big endian versions
  *      14-may-12  optionally use the ffswapX routines from cfitsio
+ *      18-oct-26  cnt is a size_t, for more than 2^31 items
+ *      18-oct-26  gcc: byte-swap builtins in loops that vectorize (byte
+ *                 shuffles), large arrays split over the np= threads
  */
 
 //#define HAVE_CFITSIO
@@ -39,8 +42,13 @@
 #if defined(HAVE_CFITSIO)
 #include "fitsio2.h"
 #endif
+#if _OPENMP
+#include <omp.h>
+#endif
+
+#define MINPAR  65536     /* fewer items are not worth starting threads */
 
-void bswap(void *vdat, int len, int cnt)
+void bswap(void *vdat, int len, size_t cnt)
 {
     char tmp, *dat = (char *) vdat;
     int k;
@@ -60,6 +68,42 @@ void bswap(void *vdat, int len, int cnt)
             dat[len-1-k] = tmp;
         }
     }
+#elif defined(__GNUC__)
+    size_t i;
+
+    if (len==1)
+	return;
+    else if (len==2) {		/* memcpy: dat need not be aligned */
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (cnt > MINPAR)
+#endif
+	for (i=0; i<cnt; i++) {
+	    unsigned short v;
+	    memcpy(&v, dat+2*i, 2);  v = __builtin_bswap16(v);  memcpy(dat+2*i, &v, 2);
+	}
+    } else if (len==4) {
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (cnt > MINPAR)
+#endif
+	for (i=0; i<cnt; i++) {
+	    unsigned int v;
+	    memcpy(&v, dat+4*i, 4);  v = __builtin_bswap32(v);  memcpy(dat+4*i, &v, 4);
+	}
+    } else if (len==8) {
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (cnt > MINPAR)
+#endif
+	for (i=0; i<cnt; i++) {
+	    unsigned long long v;
+	    memcpy(&v, dat+8*i, 8);  v = __builtin_bswap64(v);  memcpy(dat+8*i, &v, 8);
+	}
+    } else {  /* the general SLOOOOOOOOOWE case */
+        for(k=0; k<len/2; k++) {
+            tmp = dat[k];
+            dat[k] = dat[len-1-k];
+            dat[len-1-k] = tmp;
+        }
+    }
 #else
     if (len==1)
 	return;
@@ -96,7 +140,7 @@ void bswap(void *vdat, int len, int cnt)
  * bswap_bigend:   bswap only if the source data was big endian
  */
 
-void bswap_bigend(void *vdat, int len, int cnt)
+void bswap_bigend(void *vdat, int len, size_t cnt)
 {
 #if !defined(WORDS_BIGENDIAN)
   bswap(vdat,len,cnt);
@@ -107,7 +151,7 @@ void bswap_bigend(void *vdat, int len, int cnt)
  * bswap_litend:   bswap only if the source data was little endian
  */
 
-void bswap_litend(void *vdat, int len, int cnt)
+void bswap_litend(void *vdat, int len, size_t cnt)
 {
 #if defined(WORDS_BIGENDIAN)
   bswap(vdat,len,cnt);
@@ -157,7 +201,7 @@ void byteswap_doubles(double *a)
   memcpy(a,c,8);
 }
 
-typedef void  (*bswap_proc)(void *, int, int);
+typedef void  (*bswap_proc)(void *, int, size_t);
 
 
 void nemo_main(void)
@@ -5,35 +5,73 @@
  *
  *  work done IN SITU; either starting from the bottom upwards, or
  *  top downwards.
+ *  If source and destination do not overlap, and the number of elements
+ *  is large, the work is split over the np= (OpenMP) threads, in simple
+ *  loops the compiler can vectorize (cvtps2pd and friends).
  *
  *
  *     25-may-91  written for some new code?     PJT
- *     25-feb-92  amazing, had to make gcc2.0 happy PJT 
+ *     25-feb-92  amazing, had to make gcc2.0 happy PJT
  *     19-aug-92  added illegal address protection, <nemoinc>
  *                added convert_f2d but never tested...      PJT
  *     20-jun-01  gcc3
  *     11-dec-09  half-precision code added   PJT
+ *     18-oct-26  size_t counts; OpenMP for large non-overlapping arrays,
+ *                F16C for halfp input if compiled with -mf16c    PJT
  */
 
 #include <stdinc.h>
+#if _OPENMP
+#include <omp.h>
+#endif
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
-int convert_d2f(int n,double *from, float *to)
+#define MINPAR  65536     /* fewer elements are not worth starting threads */
+
+/* DISJOINT: TRUE if the from and to arrays do not overlap */
+
+#define DISJOINT(from,to,n)  ((char *)((to)+(n)) <= (char *)(from) || \
+			      (char *)((from)+(n)) <= (char *)(to))
+
+int convert_d2f(size_t n,double *from, float *to)
 {
+    size_t i;
+
     if (from==NULL) error("convert_d2f: illegal from=NULL address");
     if (to==NULL)   error("convert_d2f: illegal to=NULL address");
     if (n<1) return 0;
 
-    while(n--)                     /* can be done in situ */
-	*to++ = *from++;
+    if (DISJOINT(from,to,n)) {
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (n > MINPAR)
+#endif
+	for (i=0; i<n; i++)
+	    to[i] = from[i];
+    } else
+	while(n--)                     /* can be done in situ */
+	    *to++ = *from++;
     return 1;
 }
 
-int convert_f2d(int n,float *from,double *to)
+int convert_f2d(size_t n,float *from,double *to)
 {
+    size_t i;
+
     if (from==NULL) error("convert_f2d: illegal from=NULL address");
     if (to==NULL)   error("convert_f2d: illegal to=NULL address");
     if (n<1) return 0;
 
+    if (DISJOINT(from,to,n)) {
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (n > MINPAR)
+#endif
+	for (i=0; i<n; i++)
+	    to[i] = from[i];
+	return 1;
+    }
+
     from = from+n-1;               /* find the address at top */
     to = to+n-1;
 
@@ -42,9 +80,11 @@ int convert_f2d(int n,float *from,double *to)
     return 1;
 }
 
-/* 
- * needs: ieeehalfprecision.c 
+/*
+ * needs: ieeehalfprecision.c
  * http://www.mathworks.com/matlabcentral/fileexchange/23173
+ * These are done in chunks of MINPAR elements, so the chunks can be
+ * handed to different threads.
  */
 
 extern int singles2halfp(void *target, void *source, int numel);
@@ -52,22 +92,59 @@ extern int doubles2halfp(void *target, void *source, int numel);
 extern int halfp2singles(void *target, void *source, int numel);
 extern int halfp2doubles(void *target, void *source, int numel);
 
-int convert_h2f(int n,halfp *from,float *to)
+typedef int (*halfproc)(void *, void *, int);
+
+local int convert_halfp(halfproc fn, size_t n, void *from, int flen,
+			void *to, int tlen)
 {
-  return halfp2singles(to,from,n);
+    size_t k, off, nchunk = (n + MINPAR - 1) / MINPAR;
+    int ret = 0;
+
+    if (nchunk < 2 || !((char *)to + n*tlen <= (char *)from ||
+			(char *)from + n*flen <= (char *)to))
+	return (*fn)(to, from, (int) n);	/* small or in situ */
+    ret = (*fn)(to, from, MINPAR);	/* first call checks IEEE format */
+#if _OPENMP
+#pragma omp parallel for schedule(static) private(off) reduction(|:ret)
+#endif
+    for (k=1; k<nchunk; k++) {
+	off = k * MINPAR;
+	ret |= (*fn)((char *)to + off*tlen, (char *)from + off*flen,
+		     (int) (n-off < MINPAR ? n-off : MINPAR));
+    }
+    return ret;
+}
+
+int convert_h2f(size_t n,halfp *from,float *to)
+{
+#if defined(__F16C__)
+  size_t i;
+
+  if (DISJOINT(from,to,n)) {
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (n > MINPAR)
+#endif
+    for (i=0; i < n/8; i++)
+      _mm256_storeu_ps(to+8*i, _mm256_cvtph_ps(_mm_loadu_si128((__m128i *)(from+8*i))));
+    for (i=n-n%8; i<n; i++)
+      to[i] = _cvtsh_ss((unsigned short) from[i]);
+    return 0;
+  }
+#endif
+  return convert_halfp(halfp2singles,n,from,sizeof(halfp),to,sizeof(float));
 }
 
-int convert_h2d(int n,halfp *from,double *to)
+int convert_h2d(size_t n,halfp *from,double *to)
 {
-  return halfp2doubles(to,from,n);
+  return convert_halfp(halfp2doubles,n,from,sizeof(halfp),to,sizeof(double));
 }
 
-int convert_d2h(int n,double *from,halfp *to)
+int convert_d2h(size_t n,double *from,halfp *to)
 {
-  return doubles2halfp(to,from,n);  
+  return convert_halfp(doubles2halfp,n,from,sizeof(double),to,sizeof(halfp));
 }
 
-int convert_f2h(int n,float *from,halfp *to)
+int convert_f2h(size_t n,float *from,halfp *to)
 {
-  return singles2halfp(to,from,n);  
+  return convert_halfp(singles2halfp,n,from,sizeof(float),to,sizeof(halfp));
 }
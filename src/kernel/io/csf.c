@@ -16,6 +16,7 @@
  *			a fixed NULL vs. 0 warning
  *      11-dec-09   V1.6  experimenting with half precision 
  *      19-apr-23   V1.8  allow raw "cp" style copy using blocksize=
+ *      18-oct-26   V1.9  convert=zip/unzip to (re)compress plural items
  */
 
 #include <stdinc.h>
@@ -29,10 +30,10 @@ string defv[] = {
     "out=???\n		Output file",
     "item=\n		Top level selection items [default: all]",
     "select=\n          Selection numbers (1...) [default: all]",
-    "convert=\n		Conversion options {d2f,f2d,i2f,f2i,d2i,i2d,h2d,d2h}",
+    "convert=\n		Conversion options {d2f,f2d,i2f,f2i,d2i,i2d,h2d,d2h,zip,unzip}",
     "blocksize=0\n      If selected, use raw I/O with this blocksize, bypassing structured I/O",
     "headline=\n        Add additional headline",
-    "VERSION=1.8a\n	18-dec-2023 PJT",
+    "VERSION=1.9\n	18-oct-2026 PJT",
     NULL,
 };
 
@@ -98,6 +99,12 @@ void nemo_main(void)
         dprintf(1,"\n\n");
     }
     outstr = stropen(getparam("out"), "w");
+    for (i=0; cvt[i]!=NULL; i++) {	/* compression of the output */
+	if (streq(cvt[i],"zip"))
+	    put_zip(outstr, TRUE);
+	else if (streq(cvt[i],"unzip"))
+	    put_zip(outstr, FALSE);
+    }
     if (hasvalue("headline"))
       put_string(outstr, HeadlineTag, getparam("headline"));
     cntrd = 0;      /* keep track of items read */
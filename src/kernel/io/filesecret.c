@@ -43,10 +43,27 @@
  * V 3.4  12-dec-09   pjt    support the new halfp type for I/O (see also csf)
  *        27-Sep-10   jcl    MINGW32/WINDOWS support
  *   3.5   8-jun-13   pjt    eltcnt type fixed for 64bit so it handles > 2B
+ *   3.6  18-oct-26   pjt    mmap() seekable input, get_data_mapped() for zero-copy
+ *   3.7  18-oct-26   pjt    get_index_seek() using a sidecar index of top level sets
+ *   3.8  18-oct-26   pjt    size_t element counts and offsets throughout (> 2^31 elements)
+ *   3.9  18-oct-26   pjt    f2d/d2f coercion via convert_XXX (np= threads), and
+ *                           in blocks instead of per element from disk
+ *   3.10 18-oct-26   pjt    $NEMOPREFETCH: read ahead the next top level set
+ *   3.11 18-oct-26   pjt    compressed plural items (ZipMagic), put_zip()/$NEMOZIP
+ *   3.12 18-oct-26   pjt    get_data_open/next/close: cursors for chunked input
+ *   3.13 18-oct-26   pjt    strtable a hash with atomic slots, swap mode per stream:
+ *                           different threads can now use different streams
+ *        18-oct-26   pjt    only map data aligned to its element size
+ *        18-oct-26   pjt    $NEMOPREFETCH renamed $NEMOREADAHEAD, it is only a hint
+ *        18-oct-26   pjt    get_data_mapped reports (debug=2) when it does not copy
+ *        18-oct-26   pjt    a damaged .nemoidx is warned about and not used; it
+ *                           now records its number of entries (IndexVersion 2)
+ *        18-oct-26   pjt    released strtable slots are recycled, the swap notice
+ *                           is given once (atomic); TESTBED threaded stream test
+ *        18-oct-26   pjt    $NEMOREADAHEAD removed again, a hint is not a read ahead
  *
- *  Although the SWAP test is done on input for every item - for deferred
- *  input it may fail if in the mean time another file was read which was
- *  not in swap mode => Perhaps better to HardCode (#define)???
+ *  The SWAP test is done on input for every item, and remembered per stream,
+ *  so deferred input is read in the mode of its own file.
  *
  *  array of strings ??
  *                                  
@@ -55,6 +72,12 @@
 #include <stdinc.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#if !defined(__MINGW32__)
+#include <sys/mman.h>
+#endif
 #include <strlib.h>
 #include <filestruct.h>
 #include <extstring.h>
@@ -62,12 +85,16 @@
 #include <stdarg.h>
 
 
-extern int convert_d2f(int, double *, float  *);
-extern int convert_f2d(int, float  *, double *);
-extern int convert_h2f(int, halfp  *, float  *);
-extern int convert_h2d(int, halfp  *, double *);
-extern int convert_f2h(int, float  *, halfp  *);
-extern int convert_d2h(int, double *, halfp  *);
+extern int convert_d2f(size_t, double *, float  *);
+extern int convert_f2d(size_t, float  *, double *);
+extern int convert_h2f(size_t, halfp  *, float  *);
+extern int convert_h2d(size_t, halfp  *, double *);
+extern int convert_f2h(size_t, float  *, halfp  *);
+extern int convert_d2h(size_t, double *, halfp  *);
+extern size_t lz_pack(void *, size_t, void *, size_t);
+extern bool lz_unpack(void *, size_t, void *, size_t);
+extern void byte_shuffle(byte *, byte *, size_t, int);
+extern void byte_unshuffle(byte *, byte *, size_t, int);
 #ifdef __MINGW32__
 #define fseeko fseek
 #define ftello ftell
@@ -285,6 +312,20 @@ void put_tes(stream str, string tag)
     }
 }
 
+/*
+ * PUT_ZIP: select if plural items written from now on are compressed.
+ * By default this is decided by $NEMOZIP. Items smaller than ZipMinLen
+ * bytes, and items written with put_data_set(), are never compressed.
+ */
+
+void put_zip(stream str, bool zip)
+{
+    strstkptr sspt;
+
+    sspt = findstream(str);
+    sspt->ss_zip = zip ? 1 : -1;
+}
+
 /*
  * PUT_STRING: write string to a structured file.
  */
@@ -401,8 +442,8 @@ void put_data_ran(
     stream str,
     string tag,
     void *dat,
-    int offset,
-    int length)
+    size_t offset,
+    size_t length)
 {
     itemptr ipt;
     strstkptr sspt;
@@ -429,11 +470,11 @@ void put_data_blocked(
     stream str,
     string tag,
     void *dat,
-    int length)
+    size_t length)
 {
     itemptr ipt;
     strstkptr sspt;
-    int offset;
+    size_t offset;
 
     sspt = findstream(str);
     ipt = sspt->ss_ran;
@@ -604,6 +645,55 @@ void get_data_sub(
 	freeitem(ipt, TRUE);			/*   yes, free saved item   */
 }
 
+/*
+ * GET_DATA_MAPPED: return a pointer to the data of an item, without
+ * copying, if the input stream is memory mapped, the type matches exactly,
+ * the data is aligned to its element size and no byte swapping is needed.
+ * Otherwise NULL is returned, and the item is left for a subsequent
+ * get_data() or get_data_coerced().
+ * The data is read-only, must not be freed, and is valid until strclose().
+ * Synopsis: dat = get_data_mapped(str, tag, typ, dimN, ..., dim1, 0)
+ */
+void *get_data_mapped(stream str, string tag, string typ, int dim1, ...)
+{
+    va_list ap;
+    int dim[MaxVecDim], n = 0;
+    strstkptr sspt;
+    itemptr ipt;
+    void *dat;
+
+    dim[0] = dim1;
+    va_start(ap, dim1);				/* access argument list     */
+    while (dim[n++] > 0) {			/* loop reading dimensions  */
+	if (n >= MaxVecDim)			/*   no room for any more?  */
+	    error("get_data_mapped: item %s: too many dims", tag);
+	dim[n] = va_arg(ap, int);		/*   else get next argument */
+    } 
+    va_end(ap);
+
+    sspt = findstream(str);			/* access assoc. info	    */
+    ipt = scantag(sspt, tag);			/* scan input for tag	    */
+    if (ipt == NULL)				/* check input succeeded    */
+	error("get_data_mapped: at EOF");
+    if (! ItemMap(ipt) || ! streq(typ, ItemTyp(ipt))) {
+	if (sspt->ss_stp == -1)			/* was input at top level?  */
+	    sspt->ss_stk[0] = ipt;		/*   put back for next time */
+	return NULL;				/* caller needs to copy     */
+    }
+    if (dim[0] != 0 && ItemDim(ipt) != NULL &&	/* check layout of data     */
+	  ! xstreq(dim, ItemDim(ipt), sizeof(int)))
+	error("get_data_mapped: item %s: dimensions don't match", tag);
+    else if (dim[0] == 0 && ItemDim(ipt) != NULL)
+	error("get_data_mapped: item %s: can't copy plural to scalar", tag);
+    else if (dim[0] != 0 && ItemDim(ipt) == NULL)
+	error("get_data_mapped: item %s: can't copy scalar to plural", tag);
+    dat = ItemDat(ipt);
+    dprintf(2,"get_data_mapped: %s, no copy\n", tag);
+    if (sspt->ss_stp == -1)			/* was input at top level?  */
+	freeitem(ipt, TRUE);			/*   yes, mapping stays     */
+    return dat;
+}
+
 /************************************************************************/
 /*                          USER INPUT FUNCTIONS (RANDOM)               */
 /************************************************************************/
@@ -668,8 +758,8 @@ void get_data_ran(
     stream str,
     string tag,
     void *dat,
-    int offset,
-    int length
+    size_t offset,
+    size_t length
 ) {
     itemptr ipt;
     strstkptr sspt;
@@ -685,11 +775,11 @@ void get_data_blocked(
     stream str,
     string tag,
     void *dat,
-    int length
+    size_t length
 ) {
     itemptr ipt;
     strstkptr sspt;
-    int offset;
+    size_t offset;
 
     sspt = findstream(str);
     ipt = sspt->ss_ran;
@@ -702,6 +792,76 @@ void get_data_blocked(
 
 #endif
 
+
+/************************************************************************/
+/*                          USER INPUT FUNCTIONS (CURSOR)               */
+/************************************************************************/
+
+/*
+ * GET_DATA_OPEN: open a cursor on a plural item, whose data can then be
+ * read, coerced to type typ, in chunks of rows with get_data_next().
+ * A row is a slice of the first dimension, e.g. one body of a
+ * PhaseSpace[nbody][2][3] item. The number of rows is returned in *nrow.
+ * Unlike get_data_set(), any number of cursors can be open at the same
+ * time, and within a set they must be closed before get_tes().
+ * Synopsis: dcp = get_data_open(str, tag, typ, &nrow)
+ */
+
+datcursor get_data_open(stream str, string tag, string typ, size_t *nrow)
+{
+    strstkptr sspt;
+    itemptr ipt;
+    datcursor dcp;
+
+    sspt = findstream(str);			/* access assoc. info	    */
+    ipt = scantag(sspt, tag);			/* scan input for tag	    */
+    if (ipt == NULL)				/* check input succeeded    */
+	error("get_data_open: at EOF");
+    if (ItemDim(ipt) == NULL)
+	error("get_data_open: item %s: not a plural item", tag);
+    dcp = (datcursor) allocate(sizeof(struct _datcursor));
+    dcp->dc_copy = copyfun(ItemTyp(ipt), typ);
+    if (dcp->dc_copy == NULL)
+	error("get_data_open: item %s: types %s, %s don't convert",
+	      tag, ItemTyp(ipt), typ);
+    dcp->dc_str = str;
+    dcp->dc_ipt = ipt;
+    dcp->dc_own = (sspt->ss_stp == -1);		/* from top level: ours     */
+    dcp->dc_nrow = (size_t) ItemDim(ipt)[0];
+    dcp->dc_row = eltcnt(ipt, 1);
+    dcp->dc_next = 0;
+    if (nrow != NULL)
+	*nrow = dcp->dc_nrow;
+    return dcp;
+}
+
+/*
+ * GET_DATA_NEXT: read the next (at most) n rows into dat; returns the
+ * number of rows read, 0 when all have been read.
+ */
+
+size_t get_data_next(datcursor dcp, void *dat, size_t n)
+{
+    if (n > dcp->dc_nrow - dcp->dc_next)	/* not that many left?      */
+	n = dcp->dc_nrow - dcp->dc_next;
+    if (n > 0)
+	(dcp->dc_copy)(dat, dcp->dc_next * dcp->dc_row, n * dcp->dc_row,
+		       dcp->dc_ipt, dcp->dc_str);
+    dcp->dc_next += n;
+    return n;
+}
+
+/*
+ * GET_DATA_CLOSE: close a cursor.
+ */
+
+void get_data_close(datcursor dcp)
+{
+    if (dcp->dc_own)				/* taken from top level?    */
+	freeitem(dcp->dc_ipt, TRUE);
+    free(dcp);
+}
+
 
 /*
  * GET_STRING: read a string from a structured file.
@@ -871,6 +1031,60 @@ bool skip_item(
     }
 }
 
+/*
+ * GET_INDEX_SEEK: use the index of top level items to position the input
+ * at the next set named tag whose time (see IndexTimeTag in filesecret.h)
+ * is within the range times.  Returns 1 if positioned, 0 if there is
+ * no such set left (the input is then positioned at EOF), and -1 if no
+ * index is available (pipes, or no valid sidecar and $NEMOINDEX not set),
+ * in which case the input is left untouched.
+ */
+
+int get_index_seek(
+    stream str,			/* input stream obtained from stropen */
+    string tag,			/* tag of the set to look for */
+    string times,		/* range of times, see within(3NEMO) */
+    double fuzz)		/* fuzz for within() */
+{
+    strstkptr sspt;
+    itemptr ipt;
+    idxentptr ixp;
+    off_t cur;
+
+    sspt = findstream(str);			/* lookup associated entry  */
+    if (sspt->ss_stp != -1)			/* only at top level        */
+	return -1;
+    if (loadindex(sspt) < 0)			/* no index available       */
+	return -1;
+    ipt = sspt->ss_stk[0];			/* pending item, if any     */
+    if (ipt != NULL && streq(ItemTyp(ipt), SetType))
+	cur = ItemPos(ipt);			/*   its header position    */
+    else
+	cur = ftello(str);
+    for (ixp = sspt->ss_idx; ixp < sspt->ss_idx + sspt->ss_nidx; ixp++) {
+	if (ixp->ix_pos < cur || ! streq(ixp->ix_tag, tag) || ! ixp->ix_hastime)
+	    continue;
+	if (within(ixp->ix_time, times, fuzz))
+	    break;
+    }
+    if (ipt != NULL && ixp < sspt->ss_idx + sspt->ss_nidx &&
+	    streq(ItemTyp(ipt), SetType) && ixp->ix_pos == cur)
+	return 1;				/* pending item is the one  */
+    if (ipt != NULL) {				/* flush pending item       */
+	freeitem(ipt, TRUE);
+	sspt->ss_stk[0] = NULL;
+    }
+    if (ixp == sspt->ss_idx + sspt->ss_nidx) {	/* nothing left in range    */
+	dprintf(1,"get_index_seek: no more %s for times=%s\n", tag, times);
+	safeseek(str, 0, 2);
+	return 0;
+    }
+    dprintf(1,"get_index_seek: %s at %ld time=%g\n",
+	    tag, (long) ixp->ix_pos, ixp->ix_time);
+    safeseek(str, ixp->ix_pos, 0);
+    return 1;
+}
+
 /************************************************************************/
 /*                                OUTPUT                                */
 /************************************************************************/
@@ -906,6 +1120,8 @@ local bool writeitem(stream str, itemptr ipt)
 
 local bool putitem(stream str, itemptr ipt)
 {
+    if (zipping(str, ipt))			/* compressed plural item?  */
+	return (putzip(str, ipt));		/*   writes header and data */
     if (! puthdr(str, ipt))                     /* write item header        */
         return (FALSE);
     if (! streq(ItemTyp(ipt), SetType) && ! streq(ItemTyp(ipt), TesType))
@@ -924,7 +1140,8 @@ local bool puthdr(stream str, itemptr ipt)
     short num;
 
     
-    num = (ItemDim(ipt) == NULL) ? SingMagic : PlurMagic;
+    num = (ItemDim(ipt) == NULL) ? SingMagic :
+	  (ItemZip(ipt) == NULL ? PlurMagic : ZipMagic);
     						/* determine magic number   */
     if (fwrite((char *)&num, sizeof(short), 1, str) != 1)
 	return (FALSE);				/* return FALSE on failure  */
@@ -942,6 +1159,12 @@ local bool puthdr(stream str, itemptr ipt)
         if (! putxstr(str, ItemDim(ipt), sizeof(int)))
 	    return (FALSE);                     /*   write vect dims        */
     }
+    if (ItemZip(ipt) != NULL) {			/* a compressed item?       */
+	if (fwrite(&ItemZip(ipt)->zt_codec, sizeof(int), 3, str) != 3 ||
+	    fwrite(ItemZip(ipt)->zt_zlen, sizeof(int), ItemZip(ipt)->zt_nchunk,
+		   str) != (size_t) ItemZip(ipt)->zt_nchunk)
+	    return (FALSE);			/*   write the chunk table  */
+    }
     return(TRUE);                               /* indicate success         */
 }
 
@@ -959,6 +1182,99 @@ local bool putdat(stream str, itemptr ipt)
     return (fwrite((char*)ItemDat(ipt), sizeof(byte), len, str) == len);
 						/* write data to stream   */
 }
+
+/*
+ * ZIPPING: decide if a data item is to be written compressed.
+ */
+
+local bool zipping(stream str, itemptr ipt)
+{
+    strstkptr sspt;
+    string env;
+
+    if (ItemDim(ipt) == NULL || ItemDat(ipt) == NULL ||
+	  datlen(ipt, 0) < ZipMinLen)		/* only big plural items    */
+	return FALSE;
+    sspt = findstream(str);
+    if (sspt->ss_zip == 0) {			/* first time: decide       */
+	env = getenv("NEMOZIP");
+	sspt->ss_zip = (env != NULL && *env != 0 && ! streq(env, "0")) ? 1 : -1;
+    }
+    return sspt->ss_zip > 0;
+}
+
+/*
+ * ZIPCHUNK: compress n bytes of elements of size bytes; returns the
+ * compressed chunk in new space, or a copy of the raw data if it did not
+ * compress. NULL if out of memory.
+ */
+
+local byte *zipchunk(byte *src, size_t n, int size, int *zlen)
+{
+    byte *tmp, *out;
+    size_t zn;
+
+    tmp = (byte *) malloc(n);
+    out = (byte *) malloc(n);
+    if (tmp == NULL || out == NULL) {
+	free(tmp);
+	free(out);
+	return NULL;
+    }
+    byte_shuffle(tmp, src, n/size, size);
+    zn = lz_pack(out, n-1, tmp, n);		/* must be smaller than raw */
+    if (zn == 0) {				/* incompressible: store    */
+	memcpy(out, src, n);
+	zn = n;
+    }
+    free(tmp);
+    *zlen = (int) zn;
+    return out;
+}
+
+/*
+ * PUTZIP: write a plural item compressed, in chunks that are compressed
+ * in parallel (np=).
+ */
+
+local bool putzip(stream str, itemptr ipt)
+{
+    ziptabptr ztp;
+    byte *src = (byte *) ItemDat(ipt);
+    size_t dlen, off;
+    int k, size, nbad = 0;
+    bool ok;
+
+    dlen = datlen(ipt, 0);
+    size = ItemLen(ipt);
+    ztp = (ziptabptr) allocate(sizeof(ziptab));
+    ztp->zt_codec = ZipShuffle | ZipLZ;
+    ztp->zt_chunk = (ZipChunk / size) * size;
+    ztp->zt_nchunk = (int) ((dlen + ztp->zt_chunk - 1) / ztp->zt_chunk);
+    ztp->zt_zlen = (int *) allocate(ztp->zt_nchunk * sizeof(int));
+    ztp->zt_buf = (byte **) allocate(ztp->zt_nchunk * sizeof(byte *));
+#if _OPENMP
+#pragma omp parallel for schedule(dynamic) private(off) reduction(+:nbad)
+#endif
+    for (k=0; k<ztp->zt_nchunk; k++) {
+	off = (size_t) k * ztp->zt_chunk;
+	ztp->zt_buf[k] = zipchunk(src + off, MIN(dlen - off, (size_t) ztp->zt_chunk),
+				  size, &ztp->zt_zlen[k]);
+	if (ztp->zt_buf[k] == NULL) nbad++;
+    }
+    if (nbad)
+	error("putzip: item %s: no memory to compress", ItemTag(ipt));
+    ItemZip(ipt) = ztp;
+    ok = puthdr(str, ipt);			/* header with chunk table  */
+    for (k=0; ok && k<ztp->zt_nchunk; k++)	/* followed by the chunks   */
+	ok = fwrite(ztp->zt_buf[k], 1, ztp->zt_zlen[k], str) ==
+	     (size_t) ztp->zt_zlen[k];
+    dprintf(2,"putzip: %s %lu -> %ld bytes\n", ItemTag(ipt),
+	    (unsigned long) dlen, (long) ziplen(ztp));
+    ItemZip(ipt) = NULL;
+    freeziptab(ztp);
+    return ok;
+}
 
 /************************************************************************/
 /*                                 INPUT                                */
@@ -992,11 +1308,15 @@ local itemptr scantag(strstkptr sspt, string tag)
 local itemptr nextitem(strstkptr sspt)
 {
     itemptr ipt;
+    off_t pos;
 
     if (sspt->ss_stk[0] != NULL)		/* pending item exists?     */
 	ipt = sspt->ss_stk[0];			/*   then use it	    */
     else {					/* nothing pending?	    */
+	pos = ftello(sspt->ss_str);		/*   where it starts        */
 	ipt = readitem(sspt->ss_str, NULL);	/*   read next item in      */
+	if (ipt != NULL && streq(ItemTyp(ipt), SetType))
+	    ItemPos(ipt) = pos;			/*   see get_index_seek()   */
 	sspt->ss_stk[0] = ipt;			/*   and save for later     */
     }
     return (ipt);				/* supply item to caller    */
@@ -1065,6 +1385,14 @@ local itemptr getitem(stream str)
     return (ipt);                               /* return resulting item */
 }
 
+/* FIRSTTIME: TRUE only the first time it is asked, even between threads */
+
+#if defined(__GNUC__)
+#define FirstTime(f)  __atomic_exchange_n(&(f), FALSE, __ATOMIC_RELAXED)
+#else
+#define FirstTime(f)  ((f) ? ((f) = FALSE, TRUE) : FALSE)
+#endif
+
 /*
  * GETHDR: read a item header from a stream.
  */
@@ -1074,29 +1402,31 @@ local itemptr gethdr(stream str)
     short num;
     string typ, tag;
     int *dim, *ip;  /* ISSWAP */
+    itemptr ipt;
+    strstkptr sspt;
     permanent bool firsttime = TRUE;
 
     if (fread(&num, sizeof(short), 1, str) != 1)/* read magic number*/
 	return NULL;				/*   return NULL on EOF     */
-    if (num == SingMagic || num == PlurMagic) {	/* new-style magic number?  */
+    sspt = findstream(str);
+    if (num == SingMagic || num == PlurMagic || num == ZipMagic) {
 	typ = (string) getxstr(str, sizeof(char));
 						/*   read type string       */
 	if (typ == NULL)			/*   check for EOF          */
 	    error("gethdr: EOF reading type");
-        swap = FALSE;
+        sspt->ss_swap = FALSE;
     }
 #if defined(CHKSWAP)
     else {        /* ISSWAP */
         bswap((char *)&num,sizeof(short int),1);        /* swap the bytes */
-        if (num == SingMagic || num == PlurMagic) {    /* test the swapped */
-            if (firsttime)
+        if (num == SingMagic || num == PlurMagic || num == ZipMagic) {
+            if (FirstTime(firsttime))
                 fprintf(stderr,"[filestruct: reading swapped]");
 	    typ = (string) getxstr(str, sizeof(char));
 						/*   read type string       */
 	    if (typ == NULL)			/*   check for EOF          */
 	        error("gethdr: EOF reading type");
-            swap = TRUE;
-            firsttime = FALSE;
+            sspt->ss_swap = TRUE;
         } else {
             bswap(&num,sizeof(short int),1);
             error("gethdr: bad magic: %o", num);
@@ -1113,12 +1443,12 @@ local itemptr gethdr(stream str)
 	    error("gethdr: EOF reading tag");
     } else
 	tag = NULL;				/*   item is not tagged     */
-    if (num == PlurMagic) {			/* are dimensions next?     */
+    if (num == PlurMagic || num == ZipMagic) {	/* are dimensions next?     */
 	dim = (int *) getxstr(str, sizeof(int));
 	if (dim == NULL)			/*   check for EOF          */
 	    error("gethdr: EOF reading dimensions");
 #if defined(CHKSWAP)
-        if (swap) {     /* ISSWAP */
+        if (sspt->ss_swap) {     /* ISSWAP */
             ip = dim;
             while (*ip) {
                 bswap((char *)ip,sizeof(int),1);
@@ -1128,8 +1458,64 @@ local itemptr gethdr(stream str)
 #endif
     } else
 	dim = NULL;
-    return (makeitem(typ, tag, NULL, dim));	/* return item less data    */
+    ipt = makeitem(typ, tag, NULL, dim);	/* item less data           */
+    if (num == ZipMagic)			/* followed by chunk table? */
+	ItemZip(ipt) = getziptab(str);
+    return (ipt);				/* return item less data    */
 } /* gethdr */
+
+/*
+ * GETZIPTAB: read the chunk table of a compressed item.
+ */
+
+local ziptabptr getziptab(stream str)
+{
+    ziptabptr ztp;
+    int k;
+
+    ztp = (ziptabptr) allocate(sizeof(ziptab));
+    if (fread(&ztp->zt_codec, sizeof(int), 3, str) != 3)
+	error("getziptab: EOF reading chunk table");
+#if defined(CHKSWAP)
+    if (findstream(str)->ss_swap) bswap(&ztp->zt_codec, sizeof(int), 3);
+#endif
+    if ((ztp->zt_codec & ~(ZipShuffle|ZipLZ)) || ztp->zt_chunk <= 0 ||
+	  ztp->zt_nchunk < 0)
+	error("getziptab: bad chunk table (codec=%d chunk=%d nchunk=%d)",
+	      ztp->zt_codec, ztp->zt_chunk, ztp->zt_nchunk);
+    ztp->zt_zlen = (int *) allocate((ztp->zt_nchunk + 1) * sizeof(int));
+    saferead(ztp->zt_zlen, sizeof(int), ztp->zt_nchunk, str);
+    for (k=0; k<ztp->zt_nchunk; k++)
+	if (ztp->zt_zlen[k] <= 0 || ztp->zt_zlen[k] > ztp->zt_chunk)
+	    error("getziptab: bad length %d of chunk %d", ztp->zt_zlen[k], k);
+    return ztp;
+}
+
+/*
+ * ZIPLEN: length of the compressed data on disk.
+ */
+
+local off_t ziplen(ziptabptr ztp)
+{
+    off_t len = 0;
+    int k;
+
+    for (k=0; k<ztp->zt_nchunk; k++)
+	len += ztp->zt_zlen[k];
+    return len;
+}
+
+local void freeziptab(ziptabptr ztp)
+{
+    int k;
+
+    if (ztp->zt_buf != NULL)
+	for (k=0; k<ztp->zt_nchunk; k++)
+	    free(ztp->zt_buf[k]);
+    free(ztp->zt_buf);
+    free(ztp->zt_zlen);
+    free(ztp);
+}
 /*
  * GETHDR: read a item header from a stream.
  */
@@ -1143,13 +1529,13 @@ bool qsf(stream str)
 
     if (fread(&num, sizeof(short), 1, str) != 1)/* read magic number        */
 	return FALSE;				/*   return NULL on EOF     */
-    if (num == SingMagic || num == PlurMagic) {	/* new-style magic number?  */
+    if (num == SingMagic || num == PlurMagic || num == ZipMagic) {
         return TRUE;
     }
 #if defined(CHKSWAP)
     else {
         bswap(&num,sizeof(short int),1);        /* swap the bytes */
-        if (num == SingMagic || num == PlurMagic) {    /* test the swapped */
+        if (num == SingMagic || num == PlurMagic || num == ZipMagic) {
             return TRUE;
         } else {
             return FALSE;
@@ -1171,18 +1557,50 @@ bool qsf(stream str)
 local void getdat(itemptr ipt, stream str)
 {
     size_t dlen, elen;
+    strstkptr sspt;
+#if defined(MMAP)
+    off_t pos;
+#endif
 
+    sspt = findstream(str);
     elen = eltcnt(ipt, 0);
     dlen = elen * ItemLen(ipt);                 /* count bytes of data	    */
+    if (ItemZip(ipt) != NULL) {			/* compressed item?         */
+	if ((dlen + ItemZip(ipt)->zt_chunk - 1) / ItemZip(ipt)->zt_chunk !=
+	      (size_t) ItemZip(ipt)->zt_nchunk)
+	    error("getdat: item %s: chunk table does not match dimensions",
+		  ItemTag(ipt));
+	ItemZip(ipt)->zt_swap = sspt->ss_swap;
+	if (! strseek(str))			/*   pipe: decode right now */
+	    unzipdat(ipt, str, TRUE);
+	else {					/*   else defer like others */
+	    ItemDat(ipt) = NULL;
+	    ItemPos(ipt) = ftello(str);
+	    safeseek(str, ziplen(ItemZip(ipt)), 1);
+	}
+	return;
+    }
+#if defined(MMAP)
+    if (dlen > MaxReadNow && ! sspt->ss_swap) {	/* worth mapping?           */
+	pos = ftello(str);
+	if (mapstream(sspt) && pos + (off_t) dlen <= sspt->ss_maplen &&
+	      (uintptr_t) (sspt->ss_map + pos) % ItemLen(ipt) == 0) {
+	    ItemDat(ipt) = sspt->ss_map + pos;	/*   aligned: point into it */
+	    ItemMap(ipt) = TRUE;		/*   not ours to free       */
+	    ItemPos(ipt) = pos;
+	    safeseek(str, dlen, 1);		/*   skip over data	    */
+	    return;
+	}
+    }
+#endif
 #if 0
     if (dlen <= MaxReadNow) {			/* small enough to read?    */
 #else
     if (dlen <= MaxReadNow || !strseek(str)) {  /* force read               */
 #endif
-	if(dlen<0) error("get_dat: dlen=%d",dlen);   
 	ItemDat(ipt) = (byte *) calloc(dlen,1);	/*   then alloc space now   */
 	if (ItemDat(ipt) == NULL)		/*   did alloc fail?	    */
-	    error("getdat: no memory (%d bytes)", dlen);
+	    error("getdat: no memory (%lu bytes)", (unsigned long) dlen);
 	saferead(ItemDat(ipt), ItemLen(ipt), elen, str);
 						/*   read data in now       */
     } else {					/* too big, so skip now     */
@@ -1191,6 +1609,94 @@ local void getdat(itemptr ipt, stream str)
 	safeseek(str, dlen, 1);			/*   skip over data	    */
     }
 } /* getdat */
+
+/*
+ * UNZIPCHUNK: decode one chunk of n bytes; returns FALSE if corrupt.
+ */
+
+local bool unzipchunk(byte *dst, size_t n, byte *src, size_t zn, int codec, int size)
+{
+    byte *tmp;
+    bool ok;
+
+    if (zn == n) {				/* stored as is             */
+	memcpy(dst, src, n);
+	return TRUE;
+    }
+    if (! (codec & ZipLZ))
+	return FALSE;
+    if (! (codec & ZipShuffle))
+	return lz_unpack(dst, n, src, zn);
+    tmp = (byte *) malloc(n);
+    if (tmp == NULL)
+	return FALSE;
+    ok = lz_unpack(tmp, n, src, zn);
+    if (ok)
+	byte_unshuffle(dst, tmp, n/size, size);
+    free(tmp);
+    return ok;
+}
+
+/*
+ * UNZIPDAT: decompress the data of an item into core, using the np=
+ * threads for the chunks. With now=TRUE the compressed data is read
+ * from the current position (pipes), otherwise from the mapping or
+ * from where getdat() left it.
+ */
+
+local void unzipdat(itemptr ipt, stream str, bool now)
+{
+    ziptabptr ztp = ItemZip(ipt);
+    size_t dlen, zlen, *zoff;
+    byte *zdat = NULL, *zbuf = NULL, *dat;
+    off_t oldpos;
+    int k, nbad = 0;
+#if defined(MMAP)
+    strstkptr sspt;
+#endif
+
+    dlen = datlen(ipt, 0);
+    zlen = ziplen(ztp);
+#if defined(MMAP)
+    if (! now) {
+	sspt = findstream(str);
+	if (mapstream(sspt) && ItemPos(ipt) + (off_t) zlen <= sspt->ss_maplen)
+	    zdat = (byte *) sspt->ss_map + ItemPos(ipt);
+    }
+#endif
+    if (zdat == NULL) {				/* not mapped: read it      */
+	zdat = zbuf = (byte *) allocate(zlen + 1);
+	oldpos = now ? 0 : ftello(str);
+	if (! now)
+	    safeseek(str, ItemPos(ipt), 0);
+	if (fread(zbuf, 1, zlen, str) != zlen)
+	    error("unzipdat: item %s: error reading %lu bytes",
+		  ItemTag(ipt), (unsigned long) zlen);
+	if (! now)
+	    safeseek(str, oldpos, 0);
+    }
+    zoff = (size_t *) allocate((ztp->zt_nchunk + 1) * sizeof(size_t));
+    for (k=0; k<ztp->zt_nchunk; k++)		/* where the chunks start   */
+	zoff[k+1] = zoff[k] + ztp->zt_zlen[k];
+    dat = (byte *) allocate(dlen + 1);
+#if _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:nbad)
+#endif
+    for (k=0; k<ztp->zt_nchunk; k++)
+	if (! unzipchunk(dat + (size_t) k * ztp->zt_chunk,
+			 MIN(dlen - (size_t) k * ztp->zt_chunk, (size_t) ztp->zt_chunk),
+			 zdat + zoff[k], ztp->zt_zlen[k], ztp->zt_codec, ItemLen(ipt)))
+	    nbad++;
+    if (nbad)
+	error("unzipdat: item %s: %d corrupt chunks", ItemTag(ipt), nbad);
+#if defined(CHKSWAP)
+    if (ztp->zt_swap)
+	bswap(dat, ItemLen(ipt), dlen / ItemLen(ipt));
+#endif
+    free(zoff);
+    free(zbuf);
+    ItemDat(ipt) = dat;				/* now like any item in core */
+}
 
 /*
  * COPYFUN: select copy routine for given data types.
@@ -1211,22 +1717,24 @@ local copyproc copyfun(string srctyp, string destyp)
  * COPYDATA - copy real or virtual data to assigned memory space
  */
 
+#define MaxCopyBlock  65536		/* elements read at once for coercion */
+
 local void copydata(
     void *vdat,
-    int off,
-    int len,
+    size_t off,
+    size_t len,
     itemptr ipt,
     stream str)
 {
     char *src, *dat = (char *) vdat;
     off_t oldpos;
       
+    if (ItemDat(ipt) == NULL && ItemZip(ipt) != NULL)
+	unzipdat(ipt, str, FALSE);		/* compressed: decode first */
     off *= ItemLen(ipt);                        /* offset bytes from start  */
     if (ItemDat(ipt) != NULL) {			/* data already in core?    */
 	src = (char *) ItemDat(ipt) + off;	/*   get pointer to source  */
-    	len *= ItemLen(ipt);			/* number of bytes to copy  */
-	while (--len >= 0)			/*   loop copying data      */
-	    *dat++ = *src++;			/*     byte by byte         */
+	memcpy(dat, src, len * ItemLen(ipt));
     } else {					/* time to read data in     */
 	oldpos = ftello(str);                   /*   save current place     */
 	safeseek(str, ItemPos(ipt) + off, 0);   /*   seek back to data      */
@@ -1237,80 +1745,76 @@ local void copydata(
 
 local void copydata_f2d(
     double *dat,
-    int off,
-    int len,
+    size_t off,
+    size_t len,
     itemptr ipt,
     stream str)
 {
     float *src;
     off_t oldpos;
+    size_t n;
       
+    if (ItemDat(ipt) == NULL && ItemZip(ipt) != NULL)
+	unzipdat(ipt, str, FALSE);		/* compressed: decode first */
     off *= ItemLen(ipt);
     if (ItemDat(ipt) != NULL) {			/* data already in core?    */
-	src = (float *) ItemDat(ipt) + off;	/*   get pointer to source  */
-	/*    	len *= ItemLen(ipt);		==> BUG */
-	while (--len >= 0)			/*   loop converting data   */
-	    *dat++ = (double) *src++;		/*     float to double      */
+	src = (float *) ((char *) ItemDat(ipt) + off);	/* source ptr  */
+	convert_f2d(len, src, dat);		/*   float to double        */
     } else {					/* time to read data in     */
 	oldpos = ftello(str);                   /*   save this position     */
 	safeseek(str, ItemPos(ipt) + off, 0);	/*   seek back to data      */
-	while (--len >= 0)			/*   loop reading data      */
-	    *dat++ = (double) getflt(str);	/*     float to double      */
+	src = (float *) allocate(MaxCopyBlock * sizeof(float));
+	for ( ; len > 0; len -= n, dat += n) {	/*   loop reading blocks    */
+	    n = len < MaxCopyBlock ? len : MaxCopyBlock;
+	    saferead(src, sizeof(float), n, str);
+	    convert_f2d(n, src, dat);		/*     float to double      */
+	}
+	free(src);
 	safeseek(str, oldpos, 0);               /*   reset file pointer     */
     }
 } /* copydata_f2d */
 
 local void copydata_d2f(
     float *dat,
-    int off,
-    int len,
+    size_t off,
+    size_t len,
     itemptr ipt,
     stream str)
 {
     double *src;
     off_t oldpos;
+    size_t n;
       
+    if (ItemDat(ipt) == NULL && ItemZip(ipt) != NULL)
+	unzipdat(ipt, str, FALSE);		/* compressed: decode first */
     off *= ItemLen(ipt);
     if (ItemDat(ipt) != NULL) {			/* data already in core?    */
-	src = (double *) ItemDat(ipt) + off;	/*   get pointer to source  */
-    	/* len *= ItemLen(ipt);		BUG <===	*/
-	while (--len >= 0)			/*   loop converting data   */
-	    *dat++ = (float) *src++;		/*     double to float      */
+	src = (double *) ((char *) ItemDat(ipt) + off);	/* source ptr  */
+	convert_d2f(len, src, dat);		/*   double to float        */
     } else {					/* time to read data in     */
 	oldpos = ftello(str);                   /*   save this position     */
 	safeseek(str, ItemPos(ipt) + off, 0);	/*   seek back to data      */
-	while (--len >= 0)			/*   loop reading data      */
-	    *dat++ = (float) getdbl(str);	/*     double to float      */
+	src = (double *) allocate(MaxCopyBlock * sizeof(double));
+	for ( ; len > 0; len -= n, dat += n) {	/*   loop reading blocks    */
+	    n = len < MaxCopyBlock ? len : MaxCopyBlock;
+	    saferead(src, sizeof(double), n, str);
+	    convert_d2f(n, src, dat);		/*     double to float      */
+	}
+	free(src);
 	safeseek(str, oldpos, 0);               /*   reset file pointer     */
     }
 } /* copydata_d2f */
 
-local float getflt(stream str)
-{
-    float x;
-
-    saferead((char *)&x, sizeof(float), 1, str);
-    return x; 
-}
-
-local double getdbl(stream str)
-{
-    double x;
-
-    saferead((char *)&x, sizeof(double), 1, str);
-    return x;
-}
-
 local void saferead(
     void *dat,
     int siz,
-    int cnt,
+    size_t cnt,
     stream str)
 {
     if (fread(dat, siz, cnt, str) != cnt)
-	error("saferead: error calling fread %d*%d bytes", siz, cnt);
+	error("saferead: error calling fread %d*%lu bytes", siz, (unsigned long) cnt);
 #if defined(CHKSWAP)
-    if (swap) bswap(dat,siz,cnt);
+    if (findstream(str)->ss_swap) bswap(dat,siz,cnt);
 #endif
 }
 
@@ -1330,21 +1834,20 @@ local void safeseek(
 
 /*
  * ELTCNT: compute number of basic elements in subspace of item.
- *  @todo:    long vs. size_t
  */
 
-local long eltcnt(
+local size_t eltcnt(
     itemptr ipt,            	/* pointer to item w/ possible vector dims */
     int skp)                	/* num of dims to skip, starting with dimN */
 {
     register int *ip;
-    register long prod;
+    register size_t prod;
 
     prod = 1;                                   /* scalers have one         */
     if (ItemDim(ipt) != NULL) {                 /* a vectorized item?       */
         for (ip = ItemDim(ipt); *ip != 0; ip++) /*   loop over dimensions   */
             if (--skp < 0)                      /*     past 1st skp dims?   */
-                prod *= *ip;                    /*       include this dim   */
+                prod *= (size_t) *ip;           /*       include this dim   */
     }
     return prod;				/* return product of dims   */
 }
@@ -1384,6 +1887,7 @@ local itemptr makeitem(
 	ItemDim(ipt) = NULL;			/*   clear out dimensions   */
     ItemDat(ipt) = dat;				/* set pointer to data      */
     ItemPos(ipt) = 0;				/* clear out file position  */
+    ItemMap(ipt) = FALSE;			/* data is not mapped       */
     return (ipt);                               /* return complete item     */
 }
 
@@ -1409,8 +1913,10 @@ local void freeitem(
         free(ItemTag(ipt));                     /*   then free copy of tag  */
     if (flg && ItemDim(ipt) != NULL)
         free(ItemDim(ipt));
-    if (flg && ItemDat(ipt) != NULL)
+    if (flg && ItemDat(ipt) != NULL && ! ItemMap(ipt))
         free(ItemDat(ipt));
+    if (ItemZip(ipt) != NULL)			/* chunk table is ours      */
+	freeziptab(ItemZip(ipt));
     free(ipt);                                  /* free item itself         */
 }
 
@@ -1473,37 +1979,71 @@ local string findtype(string *a, string type)
 /************************************************************************/
 
 /*
- * FINDSTREAM: scan strtable for entry associated with stream.
+ * FINDSTREAM: find the strtable entry associated with stream.
  * If none is found, a new entry is initialized.
- * The table is small, no hash table is needed, although a quick
- * lookup is provided by first comparing it with the one used in 
- * the previous findstream() call.
- * A small degrading in performance may be the result in alternating I/O
+ * The table is an open addressing hash on the stream pointer, whose
+ * slots are claimed and released with atomic operations, so different
+ * threads can do I/O on different streams at the same time (one stream
+ * should still be used by one thread at a time). A released slot is
+ * marked DeadStream, not NULL, so entries further down the probe
+ * sequence are still found. Claims and releases (one per open and close)
+ * are serialized by a spin lock, and a release turns its slot, and any
+ * dead slots before it, back into NULL when the next slot is NULL, such
+ * that the table does not fill up with dead slots. Lookups need no lock.
  */
 
-local strstk strtable[StrTabLen], *last = NULL;
+#define DeadStream  ((stream) 1)
+
+#if defined(__GNUC__)
+local char strtable_lock = 0;
+#define LockTable()         while (__atomic_test_and_set(&strtable_lock, __ATOMIC_ACQUIRE))
+#define UnlockTable()       __atomic_clear(&strtable_lock, __ATOMIC_RELEASE)
+#define LoadStream(s)       __atomic_load_n(&(s)->ss_str, __ATOMIC_ACQUIRE)
+#define StoreStream(s,n)    __atomic_store_n(&(s)->ss_str, n, __ATOMIC_RELEASE)
+#else
+#define LockTable()
+#define UnlockTable()
+#define LoadStream(s)       ((s)->ss_str)
+#define StoreStream(s,n)    ((s)->ss_str = (n))
+#endif
+
+local strstk strtable[StrTabLen];
+
+local int strhash(stream str)
+{
+    return (int) ((((size_t) str >> 4) * 2654435761U) % StrTabLen);
+}
 
 local strstkptr findstream(stream str)
 {
     strstkptr stfree, sspt;
-
-    if (last!=NULL && last->ss_str == str)
-        return(last);
-    stfree = NULL;				/* remember free slot	    */
-    for (sspt = strtable; sspt < strtable+StrTabLen; sspt++) {
-						/* loop over the table	    */
-	if (sspt->ss_str == str) {		/*   found that stream?	    */
-            last = sspt;
-	    return (sspt);			/*     then return slot	    */
-        }
-	if (stfree == NULL && sspt->ss_str == NULL)
-						/*   first empty slot?	    */
-	    stfree = sspt;			/*     save free slot ptr   */
+    stream old;
+    int h, i;
+
+    h = strhash(str);
+    for (i = 0; i < StrTabLen; i++) {		/* probe the table          */
+	sspt = strtable + (h + i) % StrTabLen;
+	old = LoadStream(sspt);
+	if (old == str)				/*   found that stream?     */
+	    return (sspt);			/*     then return slot     */
+	if (old == NULL)			/*   never used: not here   */
+	    break;
+    }
+    stfree = NULL;
+    LockTable();
+    for (i = 0; i < StrTabLen && stfree == NULL; i++) {
+	sspt = strtable + (h + i) % StrTabLen;	/* claim first free slot    */
+	old = LoadStream(sspt);
+	if (old == NULL || old == DeadStream) {
+	    StoreStream(sspt, str);
+	    stfree = sspt;
+	}
     }
+    UnlockTable();
     if (stfree == NULL)				/* no free slot left?	    */
       error("findstream: no free slots, StrTabLen=%d",StrTabLen);
 
-    stfree->ss_str = str;			/* init saved stream	    */
+
     stfree->ss_stk[0] = NULL;			/* clear pending item	    */
     stfree->ss_stp = -1;			/* empty item stack	    */
     stfree->ss_seek = TRUE;			/* permit seeks on stream   */
@@ -1511,10 +2051,38 @@ local strstkptr findstream(stream str)
     stfree->ss_ran = NULL;                      /* mark as no item random   */
     stfree->ss_pos = 0L;                        /* set at start of file     */
 #endif
-    last = stfree;                              /* mark for quick access    */
+#if defined(MMAP)
+    stfree->ss_map = NULL;                      /* not mapped (yet)         */
+    stfree->ss_maplen = 0;
+#endif
+    stfree->ss_idx = NULL;                      /* no index (yet)           */
+    stfree->ss_nidx = IdxNotTried;
+    stfree->ss_zip = 0;
+    stfree->ss_swap = FALSE;
     return (stfree);				/* return new slot	    */
 }
 
+/*
+ * RELEASESTREAM: mark a slot dead; if the next slot in the probe
+ * sequence is unused no lookup can pass this slot, so it and the
+ * dead slots before it become unused again.
+ */
+
+local void releasestream(strstkptr sspt)
+{
+    int i;
+
+    LockTable();
+    StoreStream(sspt, DeadStream);
+    i = sspt - strtable;
+    while (LoadStream(strtable + (i + 1) % StrTabLen) == NULL &&
+	   LoadStream(strtable + i) == DeadStream) {
+	StoreStream(strtable + i, NULL);
+	i = (i + StrTabLen - 1) % StrTabLen;
+    }
+    UnlockTable();
+}
+
 local void ss_push(strstkptr sspt, itemptr ipt)
 {
     if (sspt->ss_stp++ == SetStkLen)		/* check stack overflow	    */
@@ -1528,6 +2096,317 @@ local void ss_pop(strstkptr sspt)
 	error("ss_pop: stream stack underflow");
     sspt->ss_stp--;				/* bump stack pointer	    */
 }
+
+/*
+ * INPUTFILE: check if a stream is a seekable regular file that is not
+ * open for writing, i.e. one that will not change under our feet.
+ * Pipes, scratch files etc. do not qualify.
+ */
+
+local bool inputfile(stream str, struct stat *st)
+{
+    int fd, flags;
+
+    if (! strseek(str))				/* only for seekable files  */
+	return FALSE;
+    fd = fileno(str);
+    flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || (flags & O_ACCMODE) != O_RDONLY)
+	return FALSE;				/* could still be written   */
+    if (fstat(fd, st) != 0 || ! S_ISREG(st->st_mode) || st->st_size == 0)
+	return FALSE;
+    return TRUE;
+}
+
+#if defined(MMAP)
+/*
+ * MAPSTREAM: map the whole input file read-only, the first time it is
+ * needed. Only input files (see inputfile) qualify; the others use the
+ * normal fread() path.
+ * Returns TRUE if sspt->ss_map is valid.
+ */
+
+local bool mapstream(strstkptr sspt)
+{
+    struct stat st;
+    int fd;
+    void *map;
+
+    if (sspt->ss_maplen != 0)			/* tried before?            */
+	return sspt->ss_maplen > 0;
+    sspt->ss_maplen = -1;			/* assume the worst         */
+    if (! inputfile(sspt->ss_str, &st))
+	return FALSE;
+    fd = fileno(sspt->ss_str);
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	dprintf(1,"mapstream: mmap failed, using fread\n");
+	return FALSE;
+    }
+    (void) madvise(map, st.st_size, MADV_SEQUENTIAL);
+    sspt->ss_map = (char *) map;
+    sspt->ss_maplen = st.st_size;
+    dprintf(2,"mapstream: mapped %ld bytes\n", (long) st.st_size);
+    return TRUE;
+}
+#endif
+
+/************************************************************************/
+/*                              ITEM INDEX                              */
+/************************************************************************/
+
+/*
+ * LOADINDEX: make the index of top level items available, the first time
+ * it is needed. A valid sidecar file is always used; otherwise the file
+ * is scanned, and the sidecar written, only if $NEMOINDEX is set (and not 0).
+ * Returns the number of entries, or -1 if no index is available.
+ */
+
+local int loadindex(strstkptr sspt)
+{
+    struct stat st;
+    string name, env;
+    char iname[MAXPATHLEN];
+
+    if (sspt->ss_nidx != IdxNotTried)		/* tried before?            */
+	return sspt->ss_nidx;
+    sspt->ss_nidx = -1;				/* assume the worst         */
+    if (! inputfile(sspt->ss_str, &st))
+	return -1;
+    name = strname(sspt->ss_str);
+    if (name == NULL || strlen(name) + strlen(IndexExt) >= MAXPATHLEN)
+	return -1;
+    sprintf(iname, "%s%s", name, IndexExt);
+    sspt->ss_nidx = readindex(iname, &st, &sspt->ss_idx);
+    if (sspt->ss_nidx >= 0)
+	return sspt->ss_nidx;
+    env = getenv("NEMOINDEX");
+    if (env == NULL || *env == 0 || streq(env, "0"))
+	return -1;
+    sspt->ss_nidx = scanindex(sspt->ss_str, &sspt->ss_idx);
+    writeindex(iname, &st, sspt->ss_idx, sspt->ss_nidx);
+    return sspt->ss_nidx;
+}
+
+/*
+ * READINDEX: read a sidecar index; returns -1 if it does not exist, is
+ * stale, i.e. does not match the size and mtime of the input file, or is
+ * damaged.  A damaged sidecar is only warned about: the input is then read
+ * sequentially, as without an index.
+ */
+
+local int readindex(string name, struct stat *st, idxentptr *tab)
+{
+    FILE *fp;
+    char line[MaxTagLen + 64 + 16 * MaxVecDim], magic[16], tag[MaxTagLen+1];
+    char typ[8];
+    int version, i, n, nidx, ndim, hastime = 0;
+    long long size, mtime, pos, last = -1;
+    idxentptr ixp;
+    string bad = NULL;
+
+    fp = fopen(name, "r");
+    if (fp == NULL)
+	return -1;
+    if (fgets(line, sizeof(line), fp) == NULL ||
+	  sscanf(line, "%15s %d %lld %lld %d", magic, &version, &size, &mtime,
+		 &nidx) != 5 ||
+	  ! streq(magic, IndexMagic) || version != IndexVersion ||
+	  size != (long long) st->st_size || mtime != (long long) st->st_mtime) {
+	dprintf(1,"readindex: %s is stale, ignored\n", name);
+	fclose(fp);
+	return -1;
+    }
+    *tab = (idxentptr) allocate((nidx > 0 ? nidx : 1) * sizeof(idxent));
+    for (n = 0; n < nidx && bad == NULL; n++) {
+	ixp = *tab + n;
+	if (fscanf(fp, "%lld %65s %7s %d", &pos, tag, typ, &ndim) != 4) {
+	    bad = "truncated";
+	    break;
+	}
+	if (pos <= last || pos >= size) {
+	    bad = "bad offset";
+	    break;
+	}
+	if (ndim < 0 || ndim >= MaxVecDim) {
+	    bad = "bad ndim";
+	    break;
+	}
+	last = pos;
+	ixp->ix_pos = pos;
+	ixp->ix_tag = scopy(tag);
+	ixp->ix_typ = scopy(typ);
+	ixp->ix_dim = NULL;
+	if (ndim > 0) {
+	    ixp->ix_dim = (int *) allocate((ndim+1) * sizeof(int));
+	    for (i = 0; i < ndim; i++)
+		if (fscanf(fp, "%d", &ixp->ix_dim[i]) != 1)
+		    bad = "bad dimensions";
+	    ixp->ix_dim[ndim] = 0;
+	}
+	if (fscanf(fp, "%d %lg", &hastime, &ixp->ix_time) != 2)
+	    bad = "bad time";
+	ixp->ix_hastime = (hastime != 0);
+    }
+    if (bad == NULL && (nidx < 0 || fscanf(fp, " %c", line) != EOF))
+	bad = "bad count";
+    fclose(fp);
+    if (bad != NULL) {
+	warning("readindex: %s: %s, reading without it", name, bad);
+	dropindex(*tab, n);
+	*tab = NULL;
+	return -1;
+    }
+    dprintf(1,"readindex: %s with %d items\n", name, n);
+    return n;
+}
+
+/*
+ * WRITEINDEX: write a sidecar index, atomically via a rename; failure
+ * (e.g. a read-only directory) is not fatal, the index is simply not kept.
+ */
+
+local void writeindex(string name, struct stat *st, idxentptr tab, int n)
+{
+    FILE *fp;
+    char tname[MAXPATHLEN+32];
+    idxentptr ixp;
+    int *dp;
+
+    sprintf(tname, "%s.%d", name, (int) getpid());
+    fp = fopen(tname, "w");
+    if (fp == NULL) {
+	dprintf(1,"writeindex: cannot write %s\n", tname);
+	return;
+    }
+    fprintf(fp, "%s %d %lld %lld %d\n", IndexMagic, IndexVersion,
+	    (long long) st->st_size, (long long) st->st_mtime, n);
+    for (ixp = tab; ixp < tab + n; ixp++) {
+	fprintf(fp, "%lld %s %s %d", (long long) ixp->ix_pos, ixp->ix_tag,
+		ixp->ix_typ, ixp->ix_dim ? xstrlen(ixp->ix_dim, sizeof(int)) - 1 : 0);
+	for (dp = ixp->ix_dim; dp != NULL && *dp != 0; dp++)
+	    fprintf(fp, " %d", *dp);
+	fprintf(fp, " %d %.17g\n", ixp->ix_hastime ? 1 : 0, ixp->ix_time);
+    }
+    if (fclose(fp) != 0 || rename(tname, name) != 0) {
+	dprintf(1,"writeindex: failed to create %s\n", name);
+	unlink(tname);
+	return;
+    }
+    dprintf(1,"writeindex: %s with %d items\n", name, n);
+}
+
+/*
+ * SCANINDEX: scan all top level item headers of an input file, skipping
+ * over the data.  The file position is restored afterwards.
+ */
+
+local int scanindex(stream str, idxentptr *tab)
+{
+    itemptr ipt;
+    idxentptr ixp;
+    off_t oldpos, pos;
+    int n = 0, nmax = 0;
+
+    oldpos = ftello(str);
+    safeseek(str, 0, 0);
+    *tab = NULL;
+    for (;;) {
+	pos = ftello(str);
+	ipt = gethdr(str);
+	if (ipt == NULL)			/* EOF */
+	    break;
+	if (n == nmax) {
+	    nmax = (nmax == 0) ? 64 : 2*nmax;
+	    *tab = (idxentptr) reallocate(*tab, nmax * sizeof(idxent));
+	}
+	ixp = *tab + n++;
+	ixp->ix_pos = pos;
+	ixp->ix_tag = scopy(ItemTag(ipt) ? ItemTag(ipt) : "");
+	ixp->ix_typ = scopy(ItemTyp(ipt));
+	ixp->ix_dim = ItemDim(ipt) ? (int *) copxstr(ItemDim(ipt), sizeof(int)) : NULL;
+	ixp->ix_hastime = FALSE;
+	ixp->ix_time = 0.0;
+	if (streq(ItemTyp(ipt), SetType))
+	    scanset(str, ixp);			/* find the time */
+	else if (! streq(ItemTyp(ipt), TesType))
+	    skipdat(str, ipt);			/* skip over data */
+	freeitem(ipt, TRUE);
+    }
+    safeseek(str, oldpos, 0);
+    dprintf(1,"scanindex: %d top level items\n", n);
+    return n;
+}
+
+/*
+ * SCANSET: skip over the remainder of a set, noting the time value if
+ * one is found in its IndexSetTag subset.
+ */
+
+local void scanset(stream str, idxentptr ixp)
+{
+    itemptr ipt;
+    int depth = 1;
+    bool inpar = FALSE;
+    float ftime;
+
+    while (depth > 0) {
+	ipt = gethdr(str);
+	if (ipt == NULL)
+	    error("scanset: set %s: unexpected EOF", ixp->ix_tag);
+	if (streq(ItemTyp(ipt), SetType)) {
+	    depth++;
+	    inpar = (depth == 2 && streq(ItemTag(ipt), IndexSetTag));
+	} else if (streq(ItemTyp(ipt), TesType)) {
+	    depth--;
+	    inpar = FALSE;
+	} else if (inpar && ItemDim(ipt) == NULL && streq(ItemTag(ipt), IndexTimeTag)
+		   && streq(ItemTyp(ipt), DoubleType)) {
+	    saferead(&ixp->ix_time, sizeof(double), 1, str);
+	    ixp->ix_hastime = TRUE;
+	} else if (inpar && ItemDim(ipt) == NULL && streq(ItemTag(ipt), IndexTimeTag)
+		   && streq(ItemTyp(ipt), FloatType)) {
+	    saferead(&ftime, sizeof(float), 1, str);
+	    ixp->ix_time = ftime;
+	    ixp->ix_hastime = TRUE;
+	} else
+	    skipdat(str, ipt);			/* skip over data */
+	freeitem(ipt, TRUE);
+    }
+}
+
+/*
+ * SKIPDAT: skip over the data of an item whose header was just read.
+ */
+
+local void skipdat(stream str, itemptr ipt)
+{
+    safeseek(str, ItemZip(ipt) != NULL ? ziplen(ItemZip(ipt)) : (off_t) datlen(ipt, 0), 1);
+}
+
+local void freeindex(strstkptr sspt)
+{
+    if (sspt->ss_idx != NULL)			/* built or loaded before?  */
+	dropindex(sspt->ss_idx, sspt->ss_nidx);
+    sspt->ss_idx = NULL;
+    sspt->ss_nidx = IdxNotTried;
+}
+
+/*
+ * DROPINDEX: free the first n entries of an index, and the index itself.
+ */
+
+local void dropindex(idxentptr tab, int n)
+{
+    idxentptr ixp;
+
+    for (ixp = tab; ixp < tab + n; ixp++) {
+	free(ixp->ix_tag);
+	free(ixp->ix_typ);
+	if (ixp->ix_dim) free(ixp->ix_dim);
+    }
+    free(tab);
+}
 
 /************************************************************************/
 /*			USER STREAM CONTROL FUNCTIONS			*/
@@ -1546,9 +2425,85 @@ void strclose(stream str)
 	error("strclose: not at top level");
     if (sspt->ss_stk[0] != NULL)		/* anything on the stack?   */
 	freeitem(sspt->ss_stk[0], TRUE);	/*   free bottom item	    */
-    sspt->ss_str = NULL;			/* remove from strtable	    */
-    last = NULL;                                /* also removed quick access*/
+#if defined(MMAP)
+    if (sspt->ss_map != NULL)			/* release the mapping      */
+	munmap(sspt->ss_map, sspt->ss_maplen);
+    sspt->ss_map = NULL;
+    sspt->ss_maplen = 0;
+#endif
+    freeindex(sspt);				/* and the index            */
+    releasestream(sspt);			/* remove from strtable	    */
     strdelete(str,FALSE);                       /* delete file if scratch   */
     fclose(str);				/* and close it up for sure */
 }
 
+
+#if defined(TESTBED)
+
+#include <getparam.h>
+
+string defv[] = {
+    "nfile=16\n         Number of files to write and read back",
+    "nloop=200\n        Number of times each file is read back",
+    "n=1000\n           Length of the data array in each file",
+    "root=fstest\n      Root name of the (scratch) files",
+    "VERSION=1.0\n      18-oct-26 PJT",
+    NULL,
+};
+
+string usage = "threaded test of the filestruct stream table";
+
+void nemo_main(void)
+{
+    int nfile = getiparam("nfile");
+    int nloop = getiparam("nloop");
+    int n = getiparam("n");
+    string root = getparam("root");
+    int i, k, ndead = 0, nused = 0, nerr = 0;
+    double *data = (double *) allocate(n * sizeof(double));
+    char name[256];
+    stream str;
+
+    for (k = 0; k < nfile; k++) {		/* write the files, in serial */
+	for (i = 0; i < n; i++)
+	    data[i] = k + i / (double) n;
+	sprintf(name, "%s.%d", root, k);
+	str = stropen(name, "w!");
+	put_data(str, "Index", IntType, &k, 0);
+	put_data(str, "Data", DoubleType, data, n, 0);
+	strclose(str);
+    }
+    free(data);
+
+#if _OPENMP
+#pragma omp parallel for schedule(dynamic) private(i,str,name) reduction(+:nerr)
+#endif
+    for (k = 0; k < nfile * nloop; k++) {	/* and read them back, threaded */
+	int idx;
+	double *buf = (double *) allocate(n * sizeof(double));
+	sprintf(name, "%s.%d", root, k % nfile);
+	str = stropen(name, "r");
+	get_data(str, "Index", IntType, &idx, 0);
+	get_data(str, "Data", DoubleType, buf, n, 0);
+	if (idx != k % nfile) nerr++;
+	for (i = 0; i < n; i++)
+	    if (buf[i] != idx + i / (double) n) nerr++;
+	strclose(str);
+	free(buf);
+    }
+
+    for (i = 0; i < StrTabLen; i++) {		/* all streams closed: empty table */
+	if (strtable[i].ss_str == DeadStream) ndead++;
+	else if (strtable[i].ss_str != NULL) nused++;
+    }
+    for (k = 0; k < nfile; k++) {
+	sprintf(name, "%s.%d", root, k);
+	unlink(name);
+    }
+    printf("%d opens: %d errors, %d slots in use, %d dead slots\n",
+	   nfile * nloop, nerr, nused, ndead);
+    if (nerr || nused || ndead)
+	error("stream table test failed");
+}
+
+#endif
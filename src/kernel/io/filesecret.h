@@ -12,11 +12,25 @@
  *   3.5   8-jun-13   element counter type fixed to handle > 2B
  *   3.6  11-apr-19   increase StrTabLen from 64 to 1024 (Linux now handles 1024)
  *                    check with  'ulimit -n'
+ *   3.7  18-oct-26   memory mapped input for seekable regular files
+ *   3.8  18-oct-26   index of top level items (sidecar file)
+ *   3.9  18-oct-26   size_t element counts in copydata, saferead, eltcnt
+ *        18-oct-26   coercion in blocks, getflt/getdbl gone
+ *   3.10 18-oct-26   read ahead of top level sets ($NEMOPREFETCH)
+ *   3.11 18-oct-26   compressed plural items (ZipMagic)
+ *   3.12 18-oct-26   cursors for chunked input of plural items
+ *   3.13 18-oct-26   swap mode per stream, strtable is a hash (thread safe)
+ *        18-oct-26   $NEMOPREFETCH renamed $NEMOREADAHEAD, only a hint
+ *        18-oct-26   slots of closed streams are recycled
+ *        18-oct-26   $NEMOREADAHEAD (and ss_readahead) removed
  */
  
 #define RANDOM  /* allow random access */
 #define CHKSWAP /* allow mixed endian datasets - 
                    this can be dangerous if you are multi-plexing them */
+#if !defined(__MINGW32__)
+#define MMAP    /* map seekable input files, deferred items point into it */
+#endif
 
 /*
  * New-style magic numbers, for (bigendian) FITS type machines (like SUN)
@@ -25,6 +39,30 @@
 
 #define SingMagic  ((011<<8) + 0222)		/* singular items */
 #define PlurMagic  ((013<<8) + 0222)		/* plural items */
+#define ZipMagic   ((015<<8) + 0222)		/* compressed plural items */
+
+/*
+ * ZIPTAB: chunk table of a compressed plural item. On disk it follows
+ * the dimensions as the ints codec, chunk, nchunk and zlen[nchunk],
+ * followed by the compressed chunks. Each chunk holds chunk bytes of
+ * data (the last one possibly less), byte shuffled by element and LZ
+ * compressed (see lzblock.c); a chunk with zlen equal to its raw length
+ * is stored as is. Chunks are independent, and decoded in parallel.
+ */
+
+#define ZipShuffle  1			/* codec: bytes were shuffled */
+#define ZipLZ       2			/* codec: LZ compressed */
+#define ZipChunk    (1<<20)		/* raw bytes per chunk */
+#define ZipMinLen   1024		/* smaller items are not compressed */
+
+typedef struct {
+  int     zt_codec;		/* ZipShuffle | ZipLZ */
+  int     zt_chunk;		/* raw bytes per chunk */
+  int     zt_nchunk;		/* number of chunks */
+  int    *zt_zlen;		/* compressed bytes of each chunk */
+  bool    zt_swap;		/* read in swapped mode ? */
+  byte  **zt_buf;		/* output only: the compressed chunks */
+} ziptab, *ziptabptr;
 
 /*
  * ITEM: structure representing data-token.
@@ -38,6 +76,8 @@ typedef struct {
   void  *itemdat;		/* the real goodies, if any, or NULL */
   off_t  itempos;		/* where the item began in stream (i/o) */
   off_t  itemoff;               /* RAN/SEQ offset where the current data ptr is */
+  bool   itemmap;               /* itemdat points into a file mapping */
+  ziptabptr itemzip;            /* chunk table if compressed, or NULL */
 } item, *itemptr;    
 
 #define ItemTyp(ip)  ((ip)->itemtyp)
@@ -47,7 +87,48 @@ typedef struct {
 #define ItemDat(ip)  ((ip)->itemdat)
 #define ItemPos(ip)  ((ip)->itempos)
 #define ItemOff(ip)  ((ip)->itemoff)
+#define ItemMap(ip)  ((ip)->itemmap)
+#define ItemZip(ip)  ((ip)->itemzip)
+
+
+/*
+ * IDXENT: entry in the index of the top level items of an input file,
+ * used by get_index_seek() to jump to a set with a given time.
+ * The time is taken from IndexTimeTag inside the IndexSetTag subset.
+ * The index is kept in a sidecar file, with the file name + IndexExt,
+ * and validated by the size and modification time of the input file.
+ */
 
+#define IndexSetTag  "Parameters"
+#define IndexTimeTag "Time"
+#define IndexExt     ".nemoidx"
+#define IndexMagic   "#NEMOIDX"
+#define IndexVersion 2
+#define IdxNotTried  (-2)          /* ss_nidx before the index was looked for */
+
+typedef struct {
+  off_t   ix_pos;                 /* file offset of the item header */
+  string  ix_tag;                 /* tag of the item */
+  string  ix_typ;                 /* type of the item */
+  int    *ix_dim;                 /* dimensions, or NULL */
+  bool    ix_hastime;             /* is ix_time valid ? */
+  double  ix_time;                /* time found in the set */
+} idxent, *idxentptr;
+
+/*
+ * DATCURSOR: state of a cursor opened with get_data_open(), reading
+ * a plural item in chunks of rows (slices of the first dimension).
+ */
+
+struct _datcursor {
+  stream   dc_str;                /* stream the item came from */
+  itemptr  dc_ipt;                /* the item */
+  bool     dc_own;                /* item taken from the top level, free it */
+  void   (*dc_copy)(void *, size_t, size_t, itemptr, stream);
+  size_t   dc_row;                /* elements per row */
+  size_t   dc_nrow;               /* number of rows */
+  size_t   dc_next;               /* next row to be read */
+};
 
 /*
  * STRSTK: structure used to associate stream with item stack.
@@ -66,6 +147,14 @@ typedef struct {
   off_t   ss_pos;                 /* tail of file, in case random access */
   itemptr ss_ran;                 /* pointer to random access item */
 #endif
+#if defined(MMAP)
+  char   *ss_map;                 /* read-only mapping of the input file */
+  off_t   ss_maplen;              /* its length; 0=not tried -1=not mappable */
+#endif
+  idxentptr ss_idx;               /* index of top level items */
+  int     ss_nidx;                /* its length (can be 0); -1=no index */
+  int     ss_zip;                 /* compress output? 0=not decided 1=yes -1=no */
+  bool    ss_swap;                /* input read in swapped mode ? */
 } strstk, *strstkptr;
 
 /*
@@ -81,9 +170,9 @@ typedef struct {
  *    replaces the old "proc" type unsafe stuff  (for 
  *    good practice for C, but needed for C++)
  */
-typedef void (*copyproc)  (void *,   int, int, itemptr, stream);
-typedef void (*copyproc_d)(double *, int, int, itemptr, stream);
-typedef void (*copyproc_f)(float *,  int, int, itemptr, stream);
+typedef void (*copyproc)  (void *,   size_t, size_t, itemptr, stream);
+typedef void (*copyproc_d)(double *, size_t, size_t, itemptr, stream);
+typedef void (*copyproc_f)(float *,  size_t, size_t, itemptr, stream);
 
 
 /*
@@ -96,6 +185,8 @@ local bool writeitem   ( stream str, itemptr ipt );
 local bool putitem     ( stream str, itemptr ipt );
 local bool puthdr      ( stream str, itemptr ipt );
 local bool putdat      ( stream str, itemptr ipt );
+local bool zipping     ( stream str, itemptr ipt );
+local bool putzip      ( stream str, itemptr ipt );
 local itemptr scantag  ( strstkptr sspt, string tag );
 local itemptr nextitem ( strstkptr sspt );
 local itemptr finditem ( strstkptr sspt, string tag );
@@ -103,15 +194,18 @@ local itemptr readitem ( stream str, itemptr first );
 local itemptr getitem  ( stream str );
 local itemptr gethdr   ( stream str );
 local void getdat      ( itemptr ipt, stream str );
+local ziptabptr getziptab ( stream str );
+local void skipdat     ( stream str, itemptr ipt );
+local off_t ziplen     ( ziptabptr ztp );
+local void unzipdat    ( itemptr ipt, stream str, bool now );
+local void freeziptab  ( ziptabptr ztp );
 local copyproc copyfun ( string srctyp, string destyp );
-local void copydata    ( void *dat,   int off, int len, itemptr ipt, stream str );
-local void copydata_f2d( double *dat, int off, int len, itemptr ipt, stream str );
-local void copydata_d2f( float  *dat, int off, int len, itemptr ipt, stream str );
-local float getflt     ( stream str );
-local double getdbl    ( stream str );
-local void saferead    ( void *dat, int siz, int cnt, stream str );
+local void copydata    ( void *dat,   size_t off, size_t len, itemptr ipt, stream str );
+local void copydata_f2d( double *dat, size_t off, size_t len, itemptr ipt, stream str );
+local void copydata_d2f( float  *dat, size_t off, size_t len, itemptr ipt, stream str );
+local void saferead    ( void *dat, int siz, size_t cnt, stream str );
 local void safeseek    ( stream str, off_t offset, int key );
-local long eltcnt      ( itemptr ipt, int skp );
+local size_t eltcnt    ( itemptr ipt, int skp );
 local size_t datlen    ( itemptr ipt, int skp );
 local itemptr makeitem ( string typ, string tag, void *dat, int *dim );
 local void freeitem    ( itemptr ipt, bool flg);
@@ -119,10 +213,16 @@ local int baselen      ( string typ );
 local strstkptr findstream ( stream str );
 local void ss_push     ( strstkptr sspt, itemptr ipt );
 local void ss_pop      ( strstkptr sspt );
-local string findtype  ( string *a, string type );
-
-
-#if defined(CHKSWAP)
- local bool swap=FALSE;
+local bool inputfile   ( stream str, struct stat *st );
+#if defined(MMAP)
+local bool mapstream   ( strstkptr sspt );
 #endif
+local int  loadindex   ( strstkptr sspt );
+local int  readindex   ( string name, struct stat *st, idxentptr *tab );
+local void writeindex  ( string name, struct stat *st, idxentptr tab, int n );
+local int  scanindex   ( stream str, idxentptr *tab );
+local void scanset     ( stream str, idxentptr ixp );
+local void freeindex   ( strstkptr sspt );
+local void dropindex   ( idxentptr tab, int n );
+local string findtype  ( string *a, string type );
 
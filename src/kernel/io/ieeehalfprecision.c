@@ -65,8 +65,8 @@
 
 #define  INT16_TYPE          short
 #define UINT16_TYPE unsigned short
-#define  INT32_TYPE          long
-#define UINT32_TYPE unsigned long
+#define  INT32_TYPE          int     /* was long, which is 64 bits on LP64 - PJT */
+#define UINT32_TYPE unsigned int
 
 // Prototypes -----------------------------------------------------------------
 
@@ -0,0 +1,189 @@
+/*
+ *  block compression for structured files (see filesecret.c):
+ *	lz_pack		compress a block, LZ4 block format
+ *	lz_unpack	decompress a block, with full bounds checking
+ *	byte_shuffle	group the bytes of the elements by significance
+ *	byte_unshuffle	and back
+ *
+ *  The LZ77 coder follows the (public) LZ4 block format: a sequence of
+ *  token, literals, 2 byte little endian offset, and match length, where
+ *  the last sequence has literals only.  Only a greedy single-probe hash
+ *  is used, which is fast and compresses shuffled numerical data well
+ *  enough; blocks that do not compress are stored by the caller.
+ *  Shuffling first puts e.g. all the exponent bytes of an array of floats
+ *  next to each other, which is what makes particle data compressible.
+ *
+ *     18-oct-26  written for compressed plural items     PJT
+ */
+
+#include <stdinc.h>
+
+#define MINMATCH      4
+#define LASTLITERALS  5		/* the last 5 bytes are always literals */
+#define MFLIMIT      12		/* no match starts in the last 12 bytes */
+#define MAXOFFSET 65535
+#define HASHLOG      14
+
+local unsigned int read32(byte *p)
+{
+    unsigned int v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+local int hash4(unsigned int v)
+{
+    return (int) ((v * 2654435761U) >> (32 - HASHLOG));
+}
+
+local byte *putlen(byte *op, size_t len)	/* length continuation bytes */
+{
+    for ( ; len >= 255; len -= 255)
+	*op++ = 255;
+    *op++ = (byte) len;
+    return op;
+}
+
+/*
+ * LZ_PACK: compress n bytes from src into dst, which has room for cap
+ * bytes. Returns the compressed length, or 0 if it did not fit.
+ */
+
+size_t lz_pack(void *vdst, size_t cap, void *vsrc, size_t n)
+{
+    byte *src = (byte *) vsrc, *dst = (byte *) vdst;
+    byte *ip = src, *anchor = src, *iend = src + n, *ref, *p, *q, *op = dst;
+    byte *oend = dst + cap, *token;
+    unsigned int htab[1<<HASHLOG];
+    size_t lit, mlen;
+    int h;
+
+    if (n > MFLIMIT) {
+	memset(htab, 0, sizeof(htab));
+	while (ip < iend - MFLIMIT) {
+	    h = hash4(read32(ip));
+	    ref = src + htab[h];
+	    htab[h] = (unsigned int) (ip - src);
+	    if (ref >= ip || ip - ref > MAXOFFSET || read32(ref) != read32(ip)) {
+		ip += 1 + ((ip - anchor) >> 6);	/* skip faster if no luck */
+		continue;
+	    }
+	    while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+		ip--;				/* extend the match back */
+		ref--;
+	    }
+	    p = ip + MINMATCH;			/* and forward */
+	    q = ref + MINMATCH;
+	    while (p < iend - LASTLITERALS && *p == *q) {
+		p++;
+		q++;
+	    }
+	    lit = ip - anchor;
+	    mlen = p - ip - MINMATCH;
+	    if (op + lit + lit/255 + mlen/255 + 6 > oend)
+		return 0;
+	    token = op++;
+	    *token = (byte) ((lit < 15 ? lit : 15) << 4);
+	    if (lit >= 15)
+		op = putlen(op, lit - 15);
+	    memcpy(op, anchor, lit);
+	    op += lit;
+	    *op++ = (byte) ((ip - ref) & 0xff);
+	    *op++ = (byte) ((ip - ref) >> 8);
+	    *token |= (byte) (mlen < 15 ? mlen : 15);
+	    if (mlen >= 15)
+		op = putlen(op, mlen - 15);
+	    anchor = ip = p;
+	}
+    }
+    lit = iend - anchor;			/* last literals */
+    if (op + lit + lit/255 + 2 > oend)
+	return 0;
+    *op++ = (byte) ((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15)
+	op = putlen(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+    return op - dst;
+}
+
+/*
+ * LZ_UNPACK: decompress zn bytes from src into exactly n bytes at dst.
+ * Returns FALSE if the data is corrupt.
+ */
+
+bool lz_unpack(void *vdst, size_t n, void *vsrc, size_t zn)
+{
+    byte *ip = (byte *) vsrc, *iend = ip + zn, *op = (byte *) vdst;
+    byte *dst = op, *oend = op + n, *ref;
+    size_t len, off;
+    int token, b;
+
+    while (ip < iend) {
+	token = *ip++;
+	len = token >> 4;			/* literals */
+	if (len == 15)
+	    do {
+		if (ip >= iend) return FALSE;
+		b = *ip++;
+		len += b;
+	    } while (b == 255);
+	if (len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+	    return FALSE;
+	memcpy(op, ip, len);
+	op += len;
+	ip += len;
+	if (ip == iend)				/* last sequence */
+	    break;
+	if (iend - ip < 2)
+	    return FALSE;
+	off = ip[0] | (ip[1] << 8);		/* match */
+	ip += 2;
+	if (off == 0 || off > (size_t)(op - dst))
+	    return FALSE;
+	len = token & 15;
+	if (len == 15)
+	    do {
+		if (ip >= iend) return FALSE;
+		b = *ip++;
+		len += b;
+	    } while (b == 255);
+	len += MINMATCH;
+	if (len > (size_t)(oend - op))
+	    return FALSE;
+	ref = op - off;
+	if (off >= len) {
+	    memcpy(op, ref, len);
+	    op += len;
+	} else					/* overlapping: repeat pattern */
+	    while (len--)
+		*op++ = *ref++;
+    }
+    return op == oend;
+}
+
+/*
+ * BYTE_SHUFFLE: transpose n elements of size bytes each, such that
+ * byte b of element i goes to dst[b*n+i].  BYTE_UNSHUFFLE undoes it.
+ */
+
+void byte_shuffle(byte *dst, byte *src, size_t n, int size)
+{
+    size_t i;
+    int b;
+
+    for (b=0; b<size; b++)
+	for (i=0; i<n; i++)
+	    dst[b*n+i] = src[i*size+b];
+}
+
+void byte_unshuffle(byte *dst, byte *src, size_t n, int size)
+{
+    size_t i;
+    int b;
+
+    for (b=0; b<size; b++)
+	for (i=0; i<n; i++)
+	    dst[i*size+b] = src[b*n+i];
+}
@@ -44,6 +44,7 @@
  *      27-Sep-10    MINGW32/WINDOWS i/o support                        jcl
  *      18-oct-10    assume unlink/dup in unistd.h                      pjt
  *      19-oct-10    unlimited number of open files                     wd
+ *      18-oct-26    file list guarded by a spin lock (threads)          pjt
  */
 #include <stdinc.h>
 #include <strlib.h>
@@ -81,6 +82,20 @@ local struct flist_element {
 
 typedef struct flist_element fentry;
 
+/*
+ * the list is short and only held briefly, so a spin lock is enough to
+ * let different threads open and close files at the same time
+ */
+
+#if defined(__GNUC__)
+local char flist_lock = 0;
+#define LockList()    while (__atomic_test_and_set(&flist_lock, __ATOMIC_ACQUIRE))
+#define UnlockList()  __atomic_clear(&flist_lock, __ATOMIC_RELEASE)
+#else
+#define LockList()
+#define UnlockList()
+#endif
+
 /* possible URL command getters are:  @todo should make this a 'set' function
  *     curl -s <URL>
  *     wget -q -O -  <URL>
@@ -133,12 +148,14 @@ stream stropen(const_string name, string mode)
 	    error("stropen: cannot open f.d. %d for %s\n",
 		  fds, inflag ? "input" : "output");
 	fe = (fentry*) allocate(sizeof(fentry));
-	fe->next = flist;
-	flist = fe;                /* hook into the list */
 	fe->name = scopy(name);
 	fe->str = res;
 	fe->scratch = FALSE;
 	fe->seek = FALSE;
+	LockList();
+	fe->next = flist;
+	flist = fe;                /* hook into the list */
+	UnlockList();
     } else {                                    /* regular file */
         strncpy(tempname,name,MAXPATHLEN);
         if (streq(mode,"s")) {          /* scratch mode */
@@ -199,12 +216,14 @@ stream stropen(const_string name, string mode)
                      tempname, inflag ? "input" : "output");
         }
 	fe = (fentry*) allocate(sizeof(fentry));
-	fe->next = flist;
-	flist = fe;                /* hook into the list */
 	fe->name = scopy(tempname);
 	fe->str = res;
 	fe->scratch = streq(mode,"s");
 	fe->seek = canSeek;
+	LockList();
+	fe->next = flist;
+	flist = fe;                /* hook into the list */
+	UnlockList();
     }
     return res;
 }
@@ -225,10 +244,13 @@ int strdelete( stream str, bool scratch)
 {
     fentry*fe,**pfe;
     int retval=1;
+    LockList();
     for(pfe=&flist,fe=flist;  fe;
 	pfe=&(fe->next),
 	    fe=fe->next) {                /* loop list of all entries */
 	if (str == fe->str ) {            /* if match found */
+	    *pfe = fe->next;              /* link previous to next */
+	    UnlockList();
             if (fe->name == NULL) 
                 error("strdelete: no file name");
             if (scratch || fe->scratch) {
@@ -239,11 +261,11 @@ int strdelete( stream str, bool scratch)
                 }
             }
 	    free(fe->name);               /* free space for name */
-	    *pfe = fe->next;              /* link previous to next */
 	    free(fe);                     /* free this entry */
             return retval;
         }
     }
+    UnlockList();
     warning("strdelete: No matching file found in ftable");
     return retval;
 }
@@ -258,9 +280,11 @@ string strname(stream str)
 {
     fentry*fe;
 
+    LockList();
     for(fe=flist; fe; fe=fe->next)   /* check all entries */
-	if (str == fe->str) return(fe->name);
-    return(NULL);
+	if (str == fe->str) break;
+    UnlockList();
+    return fe ? fe->name : NULL;
 }
 
 /* 
@@ -272,8 +296,11 @@ bool strseek(stream str)
 {
     fentry*fe;
 
+    LockList();
     for(fe=flist; fe; fe=fe->next)   /* check all entries */
-	if (str == fe->str) return fe->seek;
+	if (str == fe->str) break;
+    UnlockList();
+    if (fe) return fe->seek;
     error("Bad search in strseek");
     return FALSE;	/* Never Reached */
 }
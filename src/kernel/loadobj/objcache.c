@@ -0,0 +1,280 @@
+/*
+ * OBJCACHE: cache of shared objects compiled on the fly from C source,
+ *	     e.g. potential(5NEMO) and bodytrans(5NEMO) functions
+ *
+ *	string objcache(string cfile)
+ *	string objreplica(string obj, int copy)
+ *	string cachedir(string sub)
+ *
+ *  Objects are stored under a key made from the contents of the source
+ *  file, the compiler settings ($NEMOLIB/makedefs and $CFLAGS) and the
+ *  NEMO version, so any number of processes can share one compiled copy.
+ *  The first process to need an object compiles it in a directory of its
+ *  own, holding a lock (fcntl, which also works over NFS) on the key,
+ *  and renames it into place; the others wait for that lock and then find
+ *  the object.  Files in the cache are never modified after they appear,
+ *  so they can be loaded while others are being compiled, and the cache
+ *  can be removed at any time.  Note that files #include'd by the source
+ *  are not part of the key.
+ *
+ *  The cache is $NEMOCACHE/obj, or else $HOME/.cache/nemo/obj; cachedir()
+ *  gives other directories next to it, for other kinds of cached files.
+ *
+ *  A shared object can only be loaded once per process, so all its users
+ *  share its static data.  objreplica() returns an identical copy under
+ *  another name, which loads as a separate object with its own data.
+ *
+ *  18-oct-26	created					PJT
+ *  18-oct-26	objreplica				PJT
+ *  18-oct-26	cachedir, e.g. for tabulated potentials	PJT
+ *  18-oct-26	check names for truncation, quiet compile notice	PJT
+ */
+
+#include <stdinc.h>
+#include <loadobj.h>
+#include <strlib.h>
+#include <version.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+
+#define MAXPATH  1024
+
+typedef unsigned long long hash64;		/* FNV-1a */
+
+#define FNV_INIT   0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+local hash64 hash_bytes(hash64 h, char *buf, size_t n)
+{
+    while (n--) {
+	h ^= (unsigned char) *buf++;
+	h *= FNV_PRIME;
+    }
+    return h;
+}
+
+local hash64 hash_string(hash64 h, string s)	/* NULL same as "" */
+{
+    if (s == NULL) s = "";
+    return hash_bytes(h, s, strlen(s)+1);
+}
+
+local bool hash_file(hash64 *h, string name)
+{
+    char buf[8192];
+    size_t n;
+    FILE *fp;
+
+    fp = fopen(name, "r");
+    if (fp == NULL) return FALSE;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+	*h = hash_bytes(*h, buf, n);
+    fclose(fp);
+    *h = hash_bytes(*h, "", 1);
+    return TRUE;
+}
+
+local bool copy_file(string from, string to)
+{
+    char buf[8192];
+    size_t n;
+    FILE *fi, *fo;
+    bool ok = TRUE;
+
+    if ((fi = fopen(from, "r")) == NULL) return FALSE;
+    if ((fo = fopen(to, "w")) == NULL) {
+	fclose(fi);
+	return FALSE;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fi)) > 0)
+	if (fwrite(buf, 1, n, fo) != n) ok = FALSE;
+    fclose(fi);
+    if (fclose(fo) != 0) ok = FALSE;
+    return ok;
+}
+
+local void make_dir(string dir)			/* mkdir -p */
+{
+    char path[MAXPATH], *cp;
+
+    strcpy(path, dir);
+    for (cp = path+1; *cp; cp++)
+	if (*cp == '/') {
+	    *cp = 0;
+	    (void) mkdir(path, 0777);
+	    *cp = '/';
+	}
+    if (mkdir(path, 0777) < 0 && errno != EEXIST)
+	error("objcache: cannot create %s", dir);
+}
+
+/*
+ * PATHNAME: format a file name (or command) into buf of size n,
+ * refusing names that do not fit.
+ */
+
+local void pathname(char *buf, size_t n, string fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, n, fmt, ap);
+    va_end(ap);
+    if (len < 0 || len >= n)
+	error("objcache: name too long: %.64s...", buf);
+}
+
+/*
+ * CACHEDIR: return the (allocated) name of directory sub of the cache,
+ * creating it if need be.
+ */
+
+string cachedir(string sub)
+{
+    char dir[MAXPATH];
+    string cp;
+
+    if ((cp = getenv("NEMOCACHE")) != NULL && *cp)
+	pathname(dir, sizeof(dir), "%.900s/%.100s", cp, sub);
+    else if ((cp = getenv("HOME")) != NULL && *cp)
+	pathname(dir, sizeof(dir), "%.900s/.cache/nemo/%.100s", cp, sub);
+    else
+	pathname(dir, sizeof(dir), "/tmp/nemo-cache-%d/%.100s", (int) getuid(), sub);
+    make_dir(dir);
+    dprintf(1,"cachedir: using %s\n", dir);
+    return scopy(dir);
+}
+
+local string cache_dir(void)
+{
+    permanent string dir = NULL;
+
+    if (dir == NULL) dir = cachedir("obj");
+    return dir;
+}
+
+/*
+ * COMPILE: compile cfile with the NEMO rules into the cache as obj,
+ * working in a private directory next to it, so the final rename is
+ * atomic.  The directory of cfile is added to the include path.
+ */
+
+local bool compile(string cfile, string key, string dir, string obj)
+{
+    char tmp[MAXPATH], src[MAXPATH], inc[MAXPATH], cmd[3*MAXPATH+128];
+    string cp;
+
+    pathname(tmp, sizeof(tmp), "%s/tmp.%s.%d", dir, key, (int) getpid());
+    make_dir(tmp);
+    pathname(src, sizeof(src), "%s/%s.c", tmp, key);
+    if (!copy_file(cfile, src))
+	error("objcache: cannot copy %s to %s", cfile, src);
+    if (*cfile == '/')
+	pathname(inc, sizeof(inc), "%s", cfile);
+    else if (getcwd(inc, MAXPATH/2) != NULL)
+	pathname(inc+strlen(inc), sizeof(inc)-strlen(inc), "/%s", cfile);
+    else
+	strcpy(inc, ".");
+    if ((cp = strrchr(inc, '/')) != NULL) *cp = 0;
+    pathname(cmd, sizeof(cmd), "cd '%s' && make -f $NEMOLIB/Makefile.lib LOCAL_INC=-I'%s' %s.so > %s.log 2>&1",
+	    tmp, inc, key, key);
+    dprintf(1,"[objcache: compiling %s]\n", cfile);
+    dprintf(1,"%s\n", cmd);
+    if (system(cmd) != 0) {
+	warning("objcache: could not compile %s, see %s/%s.log", cfile, tmp, key);
+	return FALSE;
+    }
+    pathname(cmd, sizeof(cmd), "%s/%s.so", tmp, key);
+    if (rename(cmd, obj) < 0)
+	error("objcache: cannot move %s to %s", cmd, obj);
+    pathname(cmd, sizeof(cmd), "%s/%s.c", dir, key);		/* keep the source with it */
+    (void) rename(src, cmd);
+    pathname(cmd, sizeof(cmd), "rm -rf '%s'", tmp);
+    (void) system(cmd);
+    return TRUE;
+}
+
+/*
+ * OBJCACHE: return the name of the shared object compiled from cfile,
+ * compiling it first if not in the cache, or NULL if that failed.
+ */
+
+string objcache(string cfile)
+{
+    char key[32], obj[MAXPATH], lock[MAXPATH];
+    string dir, nemolib;
+    hash64 h = FNV_INIT;
+    struct flock fl;
+    bool ok = TRUE;
+    int fd;
+
+    nemolib = getenv("NEMOLIB");
+    if (nemolib == NULL)
+	error("objcache: $NEMOLIB not set, cannot compile %s", cfile);
+    if (!hash_file(&h, cfile))
+	error("objcache: cannot read %s", cfile);
+    h = hash_string(h, NEMO_VERSION);
+    h = hash_string(h, nemolib);
+    h = hash_string(h, getenv("CFLAGS"));
+    pathname(obj, sizeof(obj), "%.900s/makedefs", nemolib);
+    (void) hash_file(&h, obj);
+    pathname(key, sizeof(key), "%016llx", h);
+
+    dir = cache_dir();
+    pathname(obj, sizeof(obj), "%s/%s.so", dir, key);
+    if (access(obj, R_OK) == 0) {
+	dprintf(1,"objcache: %s for %s\n", obj, cfile);
+	return scopy(obj);
+    }
+
+    pathname(lock, sizeof(lock), "%s/%s.lock", dir, key);
+    fd = open(lock, O_CREAT | O_RDWR, 0666);
+    if (fd < 0)
+	error("objcache: cannot open %s", lock);
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = 0;
+    fl.l_len = 0;
+    while (fcntl(fd, F_SETLKW, &fl) < 0)
+	if (errno != EINTR)
+	    error("objcache: cannot lock %s", lock);
+    if (access(obj, R_OK) == 0)
+	dprintf(1,"objcache: %s compiled by another process\n", obj);
+    else
+	ok = compile(cfile, key, dir, obj);
+    close(fd);					/* releases the lock */
+    return ok ? scopy(obj) : NULL;
+}
+
+/*
+ * OBJREPLICA: return the name of copy number copy (1,2,...) of the shared
+ * object obj, made in the cache if not there yet.
+ */
+
+string objreplica(string obj, int copy)
+{
+    char key[32], rep[MAXPATH], tmp[MAXPATH];
+    string dir;
+    hash64 h = FNV_INIT;
+
+    if (!hash_file(&h, obj))
+	error("objreplica: cannot read %s", obj);
+    pathname(key, sizeof(key), "%016llx", h);
+    dir = cache_dir();
+    pathname(rep, sizeof(rep), "%s/%s.%d.so", dir, key, copy);
+    if (access(rep, R_OK) == 0) {
+	dprintf(1,"objreplica: %s for %s\n", rep, obj);
+	return scopy(rep);
+    }
+    pathname(tmp, sizeof(tmp), "%s/tmp.%s.%d.%d.so", dir, key, copy, (int) getpid());
+    if (!copy_file(obj, tmp))
+	error("objreplica: cannot copy %s to %s", obj, tmp);
+    if (rename(tmp, rep) < 0)			/* identical, whoever wins */
+	error("objreplica: cannot move %s to %s", tmp, rep);
+    dprintf(1,"objreplica: %s for %s\n", rep, obj);
+    return scopy(rep);
+}
@@ -42,11 +42,26 @@
  *             13-nov-03 make it understand NULL          pjt
  *              2-jan-21 squash some gcc warnings         pjt
  *              3-apr-23 add the range function           pjt
+ *             18-oct-26 dofie runs blocks of parameter sets, and
+ *                       keeps its stack local (reentrant)        pjt
+ *             18-oct-26 fie contexts (newfie/evalfie), which can be
+ *                       evaluated concurrently; OpenMP over blocks pjt
+ *             18-oct-26 contexts are graphs, with constant folding and
+ *                       common subexpressions; newfies for several pjt
+ *             18-oct-26 the stack use of the code is checked by inifie,
+ *                       no error() in the (parallel) evaluation    pjt
+ *             18-oct-26 $NEMOFIE=row evaluates contexts with the
+ *                       stack code, one set at a time             pjt
  *
  */
 #include <stdinc.h>   /* stdinc is NEMO's stdio =- uses real{float/double} */
 #include <ctype.h>
 #include <math.h>
+#include <strlib.h>
+#include <fie.h>
+#if _OPENMP
+#include <omp.h>
+#endif
 
 extern double xrandom(double,double);
 
@@ -78,13 +93,17 @@ extern double xrandom(double,double);
 static char *mnem[] = { "HLT","ADD","SUB","MUL","DIV","NEG","PWR","LDP",
                         "LDC","FIE" };
 
-static union { byte opcode[bid];
-        double c;        } fiecode[maxfiecode];
+typedef union { byte opcode[bid];
+        double c;        } fieword;
+
+static fieword fiecode[maxfiecode];
 
 static int codeptr = 0;
 static int opcodeptr = 0;
 static int npar = 0;
 static int have_null = 0;
+static int have_ran = 0;	/* code uses random numbers */
+static char *codecheck = "no expression";	/* NULL if the code is fine */
 
 static void fie_gencode(int opc);
 static void fie_genconst(double cst);
@@ -94,9 +113,9 @@ static void fie_expression(void);
 static void fie_term(void);
 static void fie_factor(void);
 static void fie_function(void);
+static char *fie_check(fieword *code);
 static void fie_error(void);
 static void fie_null(void);
-static void fie_push(double r);
 static double fie_pi(void);
 static double fie_rad(double arg1);
 static double fie_deg(double arg1);
@@ -112,7 +131,6 @@ static double fie_ran(void);
 static double fie_ranu(double arg1, double arg2);
 static double fie_rang(double arg1, double arg2);
 static double fie_ranp(double arg1);
-static double fie_pop(void);
 
 static void fie_gencode(int opc)
 {
@@ -294,6 +312,7 @@ int inifie(char *expr)			/* PJT: now int instead of short */
 	errorpos = 0;
 	codeptr = 0;
 	npar = 0;
+	have_ran = 0;
 	opcodeptr = 0;
 	ch = ' ';
 	fie_nextsym();
@@ -305,6 +324,7 @@ int inifie(char *expr)			/* PJT: now int instead of short */
 		        if (!parused[i]) errorpos = 0; */
 		}
 	fie_gencode(hlt);
+	codecheck = fie_check(fiecode);
 	return(errorpos);
 }
 
@@ -374,6 +394,8 @@ static void fie_function()
 		}
 		if (sym == rpar) fie_nextsym(); else fie_error();
 	}
+	if (f >= 41 && f <= 43) have_ran = 1;	/* RANU, RANG, RANP */
+	if (f == 49) fie_null();		/* NULL: warn now, not in parallel */
 	fie_gencode( fie + f );
 }
 
@@ -384,7 +406,7 @@ static void fie_error()
 	sym = end;
 }
 
-void dmpfie(void)
+static void fie_dump(fieword *fiecode)
 {
 	int c,o,opc,op;
 
@@ -410,14 +432,12 @@ void dmpfie(void)
 		printf("\n");
 	} while (opc != hlt);
 }
-		
-
 
-#define stackmax 20
-
-static double stack[stackmax];
-
-static int sp;
+void dmpfie(void)
+{
+	fie_dump(fiecode);
+}
+		
 
 
 static void fie_null(void)
@@ -426,11 +446,6 @@ static void fie_null(void)
   warning("fie_null: i've seen null");
 }
 
-static void fie_push(double r)
-{
-	stack[++sp] = r;
-}
-
 static double fie_pi()
 {
 	double val;
@@ -573,167 +588,717 @@ static double fie_ranp(double arg1)
 	return(val);
 }
 	
-static double fie_pop()
+/*
+ * DOFIE evaluates the code for a block of (up to) FIEBLOCK parameter sets
+ * at a time: each stack entry is a vector, and each instruction a loop
+ * over that vector, so the code is decoded once per block instead of once
+ * per parameter set, and most loops can be vectorized.  Stack entries
+ * point either into the data (parameters are not copied) or to a row of
+ * the local stack.  An error (e.g.
+ * the sqrt of a negative number) marks just that parameter set as bad.
+ * All evaluator state is local, so dofie can be called concurrently, as
+ * long as nobody changes the code (inifie, loadfie) at the same time.
+ * Expressions with random numbers are done one set at a time, to draw
+ * the random numbers in the same order as before.
+ */
+
+#define stackmax 20
+#define FIEBLOCK 512
+
+#define EACH     for (k = 0; k < n; k++)
+#define BAD(k)   { if (!bad[k]) { bad[k] = 1; nbad++; } r[k] = 0.0; }
+#define A0       a[0][k]
+#define A1       a[1][k]
+#define A2       a[2][k]
+#define A3       a[3][k]
+
+#define MINPAR   (4*FIEBLOCK)   /* fewer sets are not worth starting threads */
+
+/*
+ * FIE_CHECK: follow the stack depth through the code, as fie_block will,
+ * such that fie_block, which runs in parallel, never needs to call
+ * error(); returns NULL if the code is fine, else what is wrong with it.
+ */
+
+static char *fie_check(fieword *code)
 {
-	return( stack[sp--] );
+	int c = 0, o = 0, opc, narg, sp = 0;
+
+	do {
+		opc = code[c].opcode[o++];
+		if (o == bid) { c++ ; o = 0; }
+		narg = (opc >= fie) ? nargs[opc-fie] :
+		       (opc >= add && opc <= pwr && opc != neg) ? 2 :
+		       (opc == neg) ? 1 : 0;
+		if (sp < narg)
+			return "stack underflow, bad expression?";
+		sp -= narg;
+		if (opc != hlt) {
+			if (sp == stackmax)
+				return "expression too complex";
+			sp++;
+		}
+		if (opc == ldp) {
+			o++;
+			if (o == bid) { c++ ; o = 0; }
+		} else if (opc == ldc) {
+			if (o != 0) c++;
+			c++;
+			o = 0;
+		}
+	} while (opc != hlt && opc != err && c < maxfiecode);
+	if (opc != hlt || sp != 1)
+		return "stack error, bad expression?";
+	return NULL;
 }
 
-void dofie(real *data, int *nop, real *results, real *errorval)
+/*
+ * FIE_OP: one operation (not ldp, ldc or hlt) on n values: r = opc(a[]),
+ * where an error marks the value in bad. Returns the number of values
+ * that became bad.
+ */
+
+static int fie_op(int opc, double **a, double *r, char *bad, int n,
+		  double undef)
+{
+	double *s = a[1];
+	int    k, p, nbad = 0;
+
+	switch (opc){
+	case add: EACH r[k] = A0 + s[k]; break;
+	case sub: EACH r[k] = A0 - s[k]; break;
+	case mul: EACH r[k] = A0 * s[k]; break;
+	case div: EACH if (s[k] == 0.0) BAD(k)
+		       else r[k] = A0 / s[k];
+		  break;
+	case neg: EACH r[k] = -A0; break;
+	case pwr: EACH {
+			if (A0 >= 0) r[k] = pow(A0,s[k]);
+			else {
+				p = (int) s[k];
+				if (fabs(s[k] - p) <= 0.000001)
+					r[k] = ((p % 2 == 0) ? 1 : -1) *
+					       pow(fabs(A0),s[k]);
+				else BAD(k);
+			}
+		  }
+		  break;
+	default:  switch(opc-fie){
+		  case  0: EACH r[k] = sin(A0); break;
+		  case  1: EACH if (fabs(A0) > 1) BAD(k)
+			        else r[k] = asin(A0);
+		  	   break;
+		  case  2: EACH if (fabs(A0) > 70) BAD(k)
+			        else r[k] = sinh(A0);
+		           break;
+		  case  3: EACH r[k] = cos(A0); break;
+		  case  4: EACH if (fabs(A0) > 1) BAD(k)
+			        else r[k] = acos(A0);
+		  	   break;
+		  case  5: EACH if (fabs(A0) > 70) BAD(k)
+			        else r[k] = cosh(A0);
+		           break;
+		  case  6: EACH r[k] = tan(A0); break;
+		  case  7: EACH r[k] = atan(A0); break;
+		  case  8: EACH if (fabs(A0) > 70) BAD(k)
+			        else r[k] = tanh(A0);
+		           break;
+		  case  9: EACH r[k] = atan2(A0,A1); break;
+		  case 10: EACH r[k] = fie_rad(A0); break;
+		  case 11: EACH r[k] = fie_deg(A0); break;
+		  case 12: EACH r[k] = fie_pi(); break;
+		  case 13: EACH if (fabs(A0) > 70) BAD(k)
+			        else r[k] = exp(A0);
+		           break;
+		  case 14: EACH if (A0 > 0) r[k] = log(A0);
+			        else BAD(k);
+		  	   break;
+		  case 15: EACH if (A0 > 0) r[k] = log10(A0);
+			        else BAD(k);
+		           break;
+		  case 16: EACH if (A0 < 0) BAD(k)
+			        else r[k] = sqrt(A0);
+		  	   break;
+		  case 17: EACH r[k] = fabs(A0); break;
+		  case 18: EACH r[k] = fie_sinc(A0); break;
+		  case 19: EACH r[k] = 2.997925e+8; break;
+		  case 20: EACH r[k] = 6.6732e-11; break;
+		  case 21: EACH r[k] = 1.99e30; break;
+		  case 22: EACH r[k] = fie_erf(A0); break;
+		  case 23: EACH r[k] = fie_erfc(A0); break;
+		  case 24: EACH r[k] = 1.380622e-23; break;
+		  case 25: EACH r[k] = 6.6256196e-34; break;
+		  case 26: EACH r[k] = 3.086e16; break;
+		  case 27: EACH r[k] = 5.66961e-8; break;
+		  case 28: EACH r[k] = fie_max(A0,A1); break;
+		  case 29: EACH r[k] = fie_min(A0,A1); break;
+		  case 30: EACH if (A1 == 0.0) BAD(k)
+			        else r[k] = fie_mod(A0,A1);
+		           break;
+		  case 31: EACH r[k] = fie_int(A0); break;
+		  case 32: EACH r[k] = fie_int(A0+0.5); break;
+		  case 33: EACH r[k] = fie_sign(A0); break;
+		  case 34: EACH r[k] = undef; break;             // UNDEF
+		  case 35: EACH r[k] = A0 >  A1 ? A2 : A3; break; // IFGT
+		  case 36: EACH r[k] = A0 <  A1 ? A2 : A3; break; // IFLT
+		  case 37: EACH r[k] = A0 >= A1 ? A2 : A3; break; // IFGE
+		  case 38: EACH r[k] = A0 <= A1 ? A2 : A3; break; // IFLE
+		  case 39: EACH r[k] = A0 == A1 ? A2 : A3; break; // IFEQ
+		  case 40: EACH r[k] = A0 != A1 ? A2 : A3; break; // IFNE
+		  case 41: EACH r[k] = fie_ranu(A0,A1); break;
+		  case 42: EACH r[k] = fie_rang(A0,A1); break;
+		  case 43: EACH if (A0 < 0) BAD(k)
+			        else r[k] = fie_ranp(A0);
+		  	   break;
+		  case 44: EACH r[k] = sin(PI*A0/180.0); break;
+		  case 45: EACH r[k] = cos(PI*A0/180.0); break;
+		  case 46: EACH r[k] = tan(PI*A0/180.0); break;
+		  case 47: EACH r[k] = asinh(A0);        break;
+		  case 48: EACH r[k] = (A1 <= A0 && A0 <= A2) ? 1.0 : 0.0; // RANGE
+    			           break;
+	          case 49: EACH r[k] = 0.0; break;  // NULL , by defintion the final
+		  default: EACH BAD(k); break;
+		  }
+		  break;
+	}
+	return nbad;
+}
+
+static void fie_block(fieword *fiecode, real *data, int nop, int i0, int n,
+		      real *results, double undef)
 {
-	int iop, i, c, o, opc;
-	double undef = *errorval;
-	double s,r;
-	double params[MAXPAR], arg[maxarg];
+	double stk[stackmax][FIEBLOCK], *row[stackmax], *a[maxarg], *r;
+	char   bad[FIEBLOCK];
+	int    c, o, opc, narg, sp, k, p, nbad;
 
-	for ( iop = 1 ; iop <= *nop ; iop++ ){
-		
+	for (k = 0; k < n; k++) bad[k] = 0;
+	nbad = 0;
 	c = 0;
 	o = 0;
 	sp = 0;
-	for (i=1; i<=npar; i++) {
-		params[i] = data[iop + *nop * (i-1) - 1];
-	}
-	
 	do {
 		opc = fiecode[c].opcode[o++];
 		if (o == bid) { c++ ; o = 0; }
-		if (opc >= fie){
-			int narg = nargs[opc-fie], n;
-			for ( n=1 ; n<=narg ; n++ ) arg[narg-n] = fie_pop();
+		narg = (opc >= fie) ? nargs[opc-fie] :
+		       (opc >= add && opc <= pwr && opc != neg) ? 2 :
+		       (opc == neg) ? 1 : 0;
+		for (p = 0; p < narg; p++)		/* fie_check: sp >= narg */
+			a[p] = row[sp-narg+p];
+		sp -= narg;
+		if (opc != hlt) {			/* result goes on top */
+			r = row[sp] = stk[sp];
+			sp++;
 		}
 		switch (opc){
 		case hlt: break;
-		case add: fie_push(fie_pop()+fie_pop()); break;
-		case sub: r = fie_pop();
-			  fie_push(fie_pop()-r);
-			  break;
-		case mul: fie_push(fie_pop()*fie_pop()); break;
-		case div: r = fie_pop();
-			  if (r == 0.0) opc = err;
-			  else fie_push(fie_pop()/r);
-			  break;
-		case neg: fie_push(-fie_pop()); break;
-		case pwr: r = fie_pop();
-		          s = fie_pop();
-		          if (s >= 0) fie_push(pow(s,r));
-		          else {
-				int t;
-		          	int p = (int) r;
-		          	double epsilon = 0.000001;
-		          	if (fabs(r - p) <= epsilon){
-		          		t = (p % 2 == 0) ? 1 : -1;
-		          		fie_push( t * pow(fabs(s),r) );
-		          	} else opc = err;
-		          }
-			  break;
-		case ldp: opc = fiecode[c].opcode[o++];
+		case ldp: p = fiecode[c].opcode[o++];
 			  if (o == bid) { c++ ; o = 0; }
-			  fie_push( params[opc] );
+			  if (p < 1)
+				EACH r[k] = 0.0;
+			  else {
+#if defined(SINGLEPREC)
+				EACH r[k] = data[i0 + k + nop*(p-1)];
+#else
+				row[sp-1] = data + i0 + nop*(p-1);  /* no copy */
+#endif
+			  }
 			  break;
-		case ldc: if (o != 0) c++;	
-			  fie_push(fiecode[c++].c);
+		case ldc: if (o != 0) c++;
+			  EACH r[k] = fiecode[c].c;
+			  c++;
 			  o = 0;
 			  break;
-		default:  switch(opc-fie){
-			  case  0: fie_push(sin(arg[0])); break;
-			  case  1: if (fabs(arg[0]) > 1) opc = err;
-			  	   else fie_push(asin(arg[0]));    
-			  	   break;
-			  case  2: if (fabs(arg[0]) > 70) opc = err;
-			  	   else fie_push(sinh(arg[0]));
-			           break;
-			  case  3: fie_push(cos(arg[0])); break;
-			  case  4: if (fabs(arg[0]) > 1) opc = err;
-			  	   else fie_push(acos(arg[0]));
-			  	   break;
-			  case  5: if (fabs(arg[0]) > 70) opc = err;
-			  	   else fie_push(cosh(arg[0]));
-			           break;
-			  case  6: fie_push(tan(arg[0])); break;
-			  case  7: fie_push(atan(arg[0])); break;
-			  case  8: if (fabs(arg[0]) > 70) opc = err;
-			  	   else fie_push(tanh(arg[0]));
-			           break;
-			  case  9: fie_push(atan2(arg[0],arg[1])); break;
-			  case 10: fie_push(fie_rad(arg[0])); break;
-			  case 11: fie_push(fie_deg(arg[0])); break;
-			  case 12: fie_push(fie_pi()); break;
-			  case 13: if (fabs(arg[0]) > 70) opc =err;
-			  	   else fie_push(exp(arg[0]));
-			           break;
-			  case 14: if (arg[0] > 0) fie_push(log(arg[0]));
-			  	   else opc = err;
-			  	   break;
-			  case 15: if (arg[0] > 0) fie_push(log10(arg[0]));
-			           else opc = err;
-			           break;
-			  case 16: if (arg[0] < 0) opc = err;
-			  	   else fie_push(sqrt(arg[0]));
-			  	   break;
-			  case 17: fie_push(fabs(arg[0])); break;
-			  case 18: fie_push(fie_sinc(arg[0])); break;
-			  case 19: fie_push( 2.997925e+8 ); break;
-			  case 20: fie_push( 6.6732e-11 ); break;
-			  case 21: fie_push( 1.99e30 ); break;
-			  case 22: fie_push(fie_erf(arg[0])); break;
-			  case 23: fie_push(fie_erfc(arg[0])); break;
-			  case 24: fie_push( 1.380622e-23 ); break;
-			  case 25: fie_push( 6.6256196e-34 ); break;
-			  case 26: fie_push( 3.086e16 ); break;
-			  case 27: fie_push( 5.66961e-8 ); break;
-			  case 28: fie_push(fie_max(arg[0],arg[1])); break;
-			  case 29: fie_push(fie_min(arg[0],arg[1])); break;
-			  case 30: if (arg[1] == 0.0) opc = err;
-				   else fie_push(fie_mod(arg[0],arg[1]));
-			           break;
-			  case 31: fie_push(fie_int(arg[0])); break;
-			  case 32: fie_push(fie_int(arg[0]+0.5)); break;
-			  case 33: fie_push(fie_sign(arg[0])); break;
-			  case 34: fie_push(undef); break;                    // UNDEF
-			  case 35: if (arg[0] > arg[1]) fie_push(arg[2]);     // IFGT
-			           else fie_push(arg[3]);
-			           break;
-			  case 36: if (arg[0] < arg[1]) fie_push(arg[2]);     // IFLT
-			           else fie_push(arg[3]);
-			           break;
-			  case 37: if (arg[0] >= arg[1]) fie_push(arg[2]);    // IFGE
-			           else fie_push(arg[3]);
-			           break;
-			  case 38: if (arg[0] <= arg[1]) fie_push(arg[2]);    // IFLE
-			           else fie_push(arg[3]);
-			           break;
-			  case 39: if (arg[0] == arg[1]) fie_push(arg[2]);    // IFEQ
-			           else fie_push(arg[3]);
-			           break;
-			  case 40: if (arg[0] != arg[1]) fie_push(arg[2]);    // IFNE
-			           else fie_push(arg[3]);
-			           break;
-			  case 41: fie_push(fie_ranu(arg[0],arg[1])); break;
-			  case 42: fie_push(fie_rang(arg[0],arg[1])); break;
-			  case 43: if (arg[0] < 0) opc = err;
-			  	   else fie_push(fie_ranp(arg[0]));
-			  	   break;
-			  case 44: fie_push(sin(PI*arg[0]/180.0)); break;
-			  case 45: fie_push(cos(PI*arg[0]/180.0)); break;
-			  case 46: fie_push(tan(PI*arg[0]/180.0)); break;
-			  case 47: fie_push(asinh(arg[0]));        break;
-			  case 48: if (arg[1] <= arg[0] &&                    // RANGE
-				       arg[0] <= arg[2])  fie_push(1.0);
-				   else fie_push(0.0);
-    			           break;
-		          case 49: fie_null(); break;                         // NULL , by defintion the final
-			  default: opc = err; break;
-			  }
+		default:  nbad += fie_op(opc, a, r, bad, n, undef);
 			  break;
 		}
+		if (nbad == n) opc = err;		/* all bad, no need to go on */
 	} while ((opc != hlt) && (opc != err));
-	if (opc == err)
-		results[iop-1] = *errorval;
+	for (k = 0; k < n; k++)
+		results[k] = bad[k] ? undef : row[sp-1][k];
+}
+
+/*
+ * FIE_RUN: evaluate code for all nop parameter sets, block by block;
+ * the blocks are shared over the OpenMP threads, unless random numbers
+ * are drawn, which must be done one set at a time and in order.
+ */
+
+static void fie_run(fieword *code, int ran, real *data, int nop,
+		    real *results, double undef)
+{
+	int i;
+
+	if (ran) {
+		for (i = 0; i < nop; i++)
+			fie_block(code, data, nop, i, 1, results + i, undef);
+		return;
+	}
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (nop > MINPAR)
+#endif
+	for (i = 0; i < nop; i += FIEBLOCK)
+		fie_block(code, data, nop, i, MIN(FIEBLOCK, nop - i),
+			  results + i, undef);
+}
+
+void dofie(real *data, int *nop, real *results, real *errorval)
+{
+	if (codecheck)
+		error("dofie: %s", codecheck);
+	fie_run(fiecode, have_ran, data, *nop, results, *errorval);
+}
+
+/*
+ * Fie contexts hold their expression(s) as a graph, one node per
+ * operation, in which operations on constants are done at compile time
+ * (constant folding), and an operation on the same operands as an earlier
+ * one, in the same or in another expression, refers to that one (common
+ * subexpressions).  The graph is evaluated a block of parameter sets at
+ * a time, in one pass for all expressions; each node gets a row of a
+ * register, which is reused after the last use of the node.  Errors are
+ * kept per node, and pass on to all nodes using it.
+ * Nodes drawing random numbers are never shared, and with random numbers
+ * the sets are done one at a time, and nodes only shared within an
+ * expression, which keeps the draws in the same order as dofie would.
+ */
+
+#define lnk     (-2)	/* graph only: the result of an earlier expression */
+
+typedef struct {
+	int    opc;		/* opcode, as in the stack code */
+	int    narg;		/* number of operands */
+	int    arg[maxarg];	/* operand nodes */
+	int    p;		/* parameter (ldp) */
+	double c;		/* constant (ldc) */
+	int    expr;		/* expression the node was made for */
+	int    reg;		/* register with its values */
+} fienode;
+
+typedef struct {
+	int      nnode, maxnode;
+	fienode *node;
+	int      nexpr, *root;	/* node with the result of each expression */
+	int      nreg;
+	int      ran;
+	int      nlink, npar;
+	fieword *code;		/* $NEMOFIE=row: stack code of each expression */
+} fieprog;
+
+static bool fie_foldable(int opc)	/* TRUE if opc(constants) is constant */
+{
+	if (opc >= add && opc <= pwr) return true;
+	if (opc < fie) return false;
+	opc -= fie;
+	return opc != 34 && (opc < 41 || opc > 43) && opc != 49;
+}
+
+static int fie_addnode(fieprog *fp, fienode *nd, int first)
+{
+	fienode *np;
+	double v[maxarg], *a[maxarg], r;
+	char bad = 0;
+	int i, j;
+
+	for (j = 0; j < nd->narg; j++)
+		if (fp->node[nd->arg[j]].opc != ldc) break;
+	if (j == nd->narg && (fie_foldable(nd->opc) || nd->opc == lnk)) {
+		for (j = 0; j < nd->narg; j++) {
+			v[j] = fp->node[nd->arg[j]].c;
+			a[j] = &v[j];
+		}
+		if (nd->opc == lnk)
+			r = v[0];
+		else
+			fie_op(nd->opc, a, &r, &bad, 1, 0.0);
+		if (!bad) {			/* fold */
+			nd->opc = ldc;
+			nd->c = r;
+			nd->narg = 0;
+		}
+	}
+	if (nd->opc < fie + 41 || nd->opc > fie + 43) 	/* not random */
+		for (i = first; i < fp->nnode; i++) {
+			np = &fp->node[i];
+			if (np->opc == nd->opc && np->narg == nd->narg &&
+			    np->p == nd->p &&
+			    memcmp(&np->c, &nd->c, sizeof(double)) == 0) {
+				for (j = 0; j < nd->narg; j++)
+					if (np->arg[j] != nd->arg[j]) break;
+				if (j == nd->narg) return i;
+			}
+		}
+	if (fp->nnode == fp->maxnode) {
+		fp->maxnode = 2*fp->maxnode + 64;
+		fp->node = (fienode *) reallocate(fp->node,
+						  fp->maxnode*sizeof(fienode));
+	}
+	fp->node[fp->nnode] = *nd;
+	return fp->nnode++;
+}
+
+/*
+ * FIE_GRAPH: add the current (inifie) code as expression e; a %p with
+ * nlink < p <= nlink+e is the result of expression p-nlink-1.
+ */
+
+static void fie_graph(fieprog *fp, int e, int nlink, int first)
+{
+	int stk[maxfiecode*bid], sp = 0, c = 0, o = 0, opc, p, j;
+	fienode nd;
+
+	for (;;) {
+		opc = fiecode[c].opcode[o++];
+		if (o == bid) { c++ ; o = 0; }
+		if (opc == hlt) break;
+		memset(&nd, 0, sizeof(nd));
+		nd.opc = opc;
+		nd.expr = e;
+		if (opc == ldp) {
+			p = fiecode[c].opcode[o++];
+			if (o == bid) { c++ ; o = 0; }
+			if (p < 1)
+				nd.opc = ldc;
+			else if (nlink >= 0 && p > nlink && p <= nlink + e) {
+				nd.opc = lnk;
+				nd.narg = 1;
+				nd.arg[0] = fp->root[p - nlink - 1];
+			} else
+				nd.p = p;
+		} else if (opc == ldc) {
+			if (o != 0) c++;
+			nd.c = fiecode[c++].c;
+			o = 0;
+		} else {
+			nd.narg = (opc >= fie) ? nargs[opc-fie] :
+				  (opc == neg) ? 1 : 2;
+			if (sp < nd.narg)
+				error("newfie: stack underflow, bad expression?");
+			sp -= nd.narg;
+			for (j = 0; j < nd.narg; j++)
+				nd.arg[j] = stk[sp+j];
+		}
+		stk[sp++] = fie_addnode(fp, &nd, first);
+	}
+	if (sp != 1)
+		error("newfie: stack error (%d), bad expression?", sp);
+	fp->root[e] = stk[0];
+}
+
+/*
+ * FIE_REGS: drop the nodes not needed (operands of folded nodes),
+ * and give the others a register; the results keep theirs.
+ */
+
+static void fie_regs(fieprog *fp)
+{
+	int *live, *last, *newi, *freereg, nfree = 0, i, j, k, n = 0;
+
+	live = (int *) allocate(4 * (fp->nnode+1) * sizeof(int));
+	last = live + fp->nnode + 1;
+	newi = last + fp->nnode + 1;
+	freereg = newi + fp->nnode + 1;
+	for (i = 0; i < fp->nexpr; i++) {
+		live[fp->root[i]] = 1;
+		last[fp->root[i]] = fp->nnode;
+	}
+	for (i = fp->nnode-1; i >= 0; i--)
+		if (live[i])
+			for (j = 0; j < fp->node[i].narg; j++) {
+				k = fp->node[i].arg[j];
+				live[k] = 1;
+				if (last[k] < i) last[k] = i;
+			}
+	fp->nreg = 0;
+	for (i = 0; i < fp->nnode; i++) {
+		if (!live[i]) continue;
+		fp->node[n] = fp->node[i];
+		fp->node[n].reg = nfree > 0 ? freereg[--nfree] : fp->nreg++;
+		for (j = 0; j < fp->node[n].narg; j++) {
+			k = fp->node[n].arg[j];
+			fp->node[n].arg[j] = newi[k];
+			if (last[k] == i) {		/* its last use */
+				last[k] = -1;
+				freereg[nfree++] = fp->node[newi[k]].reg;
+			}
+		}
+		newi[i] = n++;
+	}
+	fp->nnode = n;
+	for (i = 0; i < fp->nexpr; i++)
+		fp->root[i] = newi[fp->root[i]];
+	free(live);
+}
+
+/*
+ * FIE_GBLOCK: evaluate the graph for the n sets i0.. of data; results
+ * of expression e go to results[e*nop + i].
+ */
+
+typedef struct {
+	double *buf;		/* register rows */
+	char   *bbuf;		/* their bad flags, plus a row of zeros */
+	double **row;		/* values of each node */
+	char   **brow;		/* and their bad flags */
+	char   *ebad;		/* expressions gone bad (random numbers) */
+} fiework;
+
+static void fie_gblock(fieprog *fp, real *data, int nop, int i0, int n,
+		       real *results, double undef, fiework *w, int nb)
+{
+	fienode *nd;
+	double *a[maxarg], *r;
+	char   *b, *none = w->bbuf + fp->nreg * nb;
+	int    i, j, k, nbad;
+
+	if (fp->ran)
+		for (i = 0; i < fp->nexpr; i++) w->ebad[i] = 0;
+	for (i = 0; i < fp->nnode; i++) {
+		nd = &fp->node[i];
+		r = w->buf + nd->reg * nb;
+		w->row[i] = r;
+		w->brow[i] = none;
+		switch (nd->opc) {
+		case ldp:
+#if defined(SINGLEPREC)
+			EACH r[k] = data[i0 + k + nop*(nd->p - 1)];
+#else
+			w->row[i] = data + i0 + nop*(nd->p - 1);  /* no copy */
+#endif
+			break;
+		case ldc:
+			EACH r[k] = nd->c;
+			break;
+		case lnk:
+			a[0] = w->row[nd->arg[0]];
+			b = w->brow[nd->arg[0]];
+			EACH r[k] = b[k] ? undef : a[0][k];
+			break;
+		default:
+			b = w->brow[i] = w->bbuf + nd->reg * nb;
+			if (fp->ran && w->ebad[nd->expr]) {
+				b[0] = 1;	/* dofie would have stopped */
+				r[0] = 0.0;
+				break;
+			}
+			memset(b, 0, n);
+			for (j = 0, nbad = 0; j < nd->narg; j++) {
+				a[j] = w->row[nd->arg[j]];
+				if (w->brow[nd->arg[j]] != none) {
+					EACH b[k] |= w->brow[nd->arg[j]][k];
+					nbad++;
+				}
+			}
+			nbad += fie_op(nd->opc, a, r, b, n, undef);
+			if (nbad == 0)
+				w->brow[i] = none;	/* all good: skip the checks */
+			else if (fp->ran && b[0])
+				w->ebad[nd->expr] = 1;
+			break;
+		}
+	}
+	for (j = 0; j < fp->nexpr; j++) {
+		r = w->row[fp->root[j]];
+		b = w->brow[fp->root[j]];
+		if (b == none)
+			EACH results[j*nop + i0 + k] = r[k];
+		else
+			EACH results[j*nop + i0 + k] = b[k] ? undef : r[k];
+	}
+}
+
+static void fie_grun(fieprog *fp, real *data, int nop, real *results,
+		     double undef)
+{
+	fiework w;
+	int i, nb = fp->ran ? 1 : MIN(FIEBLOCK, nop);
+
+	if (nop < 1) return;
+#if _OPENMP
+#pragma omp parallel private(w,i) if (nop > MINPAR && !fp->ran)
+#endif
+	{
+		w.buf = (double *) allocate(fp->nreg * nb * sizeof(double));
+		w.bbuf = (char *) allocate((fp->nreg+1) * nb);
+		w.row = (double **) allocate(fp->nnode * sizeof(double *));
+		w.brow = (char **) allocate(fp->nnode * sizeof(char *));
+		w.ebad = (char *) allocate(fp->nexpr);
+#if _OPENMP
+#pragma omp for schedule(static)
+#endif
+		for (i = 0; i < nop; i += nb)
+			fie_gblock(fp, data, nop, i, MIN(nb, nop - i),
+				   results, undef, &w, nb);
+		free(w.buf);
+		free(w.bbuf);
+		free(w.row);
+		free(w.brow);
+		free(w.ebad);
+	}
+}
+
+/*
+ * FIE_RROW: the reference for fie_grun, with $NEMOFIE=row: each set is
+ * done with the stack code of each expression in turn, the way dofie
+ * did it, feeding a result to the later expressions that use it.
+ */
+
+static void fie_rrow(fieprog *fp, real *data, int nop, real *results,
+		     double undef)
+{
+	real *x, r;
+	int i, e, p, nx = MAX(fp->npar, fp->nlink + fp->nexpr);
+
+	x = (real *) allocate((nx+1) * sizeof(real));
+	for (i = 0; i < nop; i++) {
+		for (p = 1; p <= fp->npar; p++)
+			if (fp->nlink < 0 || p <= fp->nlink ||
+			    p > fp->nlink + fp->nexpr)
+				x[p-1] = data[i + nop*(p-1)];
+		for (e = 0; e < fp->nexpr; e++) {
+			fie_block(fp->code + e*maxfiecode, x, 1, 0, 1, &r, undef);
+			results[i + e*nop] = r;
+			if (fp->nlink >= 0) x[fp->nlink + e] = r;
+		}
+	}
+	free(x);
+}
+
+/*
+ * NEWFIES: compile nexpr expressions into one context, which computes
+ *          all of them in one pass; returns NULL if any of them could
+ *          not be parsed.  If nlink >= 0, expression e can use the result
+ *          of an earlier expression j as parameter %(nlink+1+j), like
+ *          tabmath's new columns.  The current inifie code is left alone.
+ *          The parser is not reentrant, so contexts should be created
+ *          from one thread only.
+ * NEWFIE:  the same for one expression.
+ * EVALFIE: like dofie, for a context; the results of expression e go to
+ *          results[e*nop ...].  Any number of threads can evaluate
+ *          (the same or different) contexts at the same time.
+ *          With $NEMOFIE=row contexts are evaluated one set at a time
+ *          with the stack code instead, as a check on the graph.
+ * DUMPFIE, FREEFIE: show the graph, and release the context.
+ */
+
+fieptr newfies(string *expr, int nexpr, int nlink)
+{
+	fieword save[maxfiecode];
+	int sav_codeptr = codeptr, sav_opcodeptr = opcodeptr,
+	    sav_npar = npar, sav_ran = have_ran;
+	int e, n, len = 0;
+	string env;
+	fieptr f;
+	fieprog *fp;
+
+	memcpy(save, fiecode, sizeof(fiecode));
+	f = (fieptr) allocate(sizeof(fie_context));
+	fp = (fieprog *) allocate(sizeof(fieprog));
+	f->prog = fp;
+	f->nexpr = fp->nexpr = nexpr;
+	fp->root = (int *) allocate(nexpr * sizeof(int));
+	fp->nlink = nlink;
+	env = getenv("NEMOFIE");
+	if (env && streq(env, "row"))
+		fp->code = (fieword *) allocate(nexpr * sizeof(fiecode));
+	for (e = 0; e < nexpr; e++) {			/* check them all */
+		len += strlen(expr[e]) + 1;
+		n = inifie(expr[e]);
+		if (n < 0) {
+			dprintf(1,"newfie: syntax error at position %d in %s\n",
+				-n, expr[e]);
+			f->npar = n;
+			break;
+		}
+		f->npar = MAX(f->npar, n);
+		fp->ran |= have_ran;
+	}
+	if (f->npar >= 0)
+		for (e = 0; e < nexpr; e++) {
+			inifie(expr[e]);
+			fie_graph(fp, e, nlink, fp->ran ? fp->nnode : 0);
+			if (fp->code)
+				memcpy(fp->code + e*maxfiecode, fiecode,
+				       sizeof(fiecode));
+		}
+	memcpy(fiecode, save, sizeof(fiecode));
+	codeptr = sav_codeptr;
+	opcodeptr = sav_opcodeptr;
+	npar = sav_npar;
+	have_ran = sav_ran;
+	if (f->npar < 0) {
+		freefie(f);
+		return NULL;
+	}
+	fie_regs(fp);
+	fp->npar = f->npar;
+	f->ran = fp->ran;
+	f->nnode = fp->nnode;
+	f->expr = (string) allocate(len);
+	for (e = 0; e < nexpr; e++) {
+		if (e) strcat(f->expr, ",");
+		strcat(f->expr, expr[e]);
+	}
+	return f;
+}
+
+fieptr newfie(string expr)
+{
+	return newfies(&expr, 1, -1);
+}
+
+void evalfie(fieptr f, real *data, int nop, real *results, real errorval)
+{
+	fieprog *fp = (fieprog *) f->prog;
+
+	if (fp->code)
+		fie_rrow(fp, data, nop, results, errorval);
 	else
-		results[iop-1] = fie_pop();
+		fie_grun(fp, data, nop, results, errorval);
+}
+
+void dumpfie(fieptr f)
+{
+	fieprog *fp = (fieprog *) f->prog;
+	fienode *nd;
+	int i, j;
+
+	for (i = 0; i < fp->nnode; i++) {
+		nd = &fp->node[i];
+		printf("  %3d  r%-3d", i, nd->reg);
+		if (nd->opc == lnk)
+			printf("   LNK");
+		else if (nd->opc >= fie)
+			printf("   %s", functs[nd->opc-fie]);
+		else
+			printf("   %s", mnem[nd->opc]);
+		if (nd->opc == ldp)
+			printf("   %d", nd->p);
+		else if (nd->opc == ldc)
+			printf("   %f", nd->c);
+		for (j = 0; j < nd->narg; j++)
+			printf("   %d", nd->arg[j]);
+		for (j = 0; j < fp->nexpr; j++)
+			if (fp->root[j] == i) printf("   -> %d", j+1);
+		printf("\n");
 	}
 }
-
+
+void freefie(fieptr f)
+{
+	fieprog *fp;
+
+	if (f == NULL) return;
+	fp = (fieprog *) f->prog;
+	if (fp) {
+		free(fp->node);
+		free(fp->root);
+		if (fp->code) free(fp->code);
+		free(fp);
+	}
+	free(f->expr);
+	free(f);
+}
+
 /* 
  * SAVEFIE, LOADFIE:  Quickly save and load fie's when multiple fie's
  *                    have to be 'online'
@@ -743,6 +1308,7 @@ void dofie(real *data, int *nop, real *results, real *errorval)
 static struct fie_slot {
     char            fiecode[bid*maxfiecode];
     int             npar;
+    int             have_ran;
     int             codeptr;
     int             opcodeptr;
     int             slot;
@@ -789,6 +1355,7 @@ int savefie(int slot)
     
     bcopy(fiecode,psfie->fiecode,bid*maxfiecode);
     psfie->npar = npar;
+    psfie->have_ran = have_ran;
     psfie->codeptr = codeptr;
     psfie->opcodeptr = opcodeptr;
     if (slot==0)
@@ -818,8 +1385,10 @@ int loadfie(int slot)
         if (psfie->slot == slot) {
             bcopy(psfie->fiecode,fiecode,bid*maxfiecode);
             npar = psfie->npar;
+            have_ran = psfie->have_ran;
             codeptr = psfie->codeptr;
             opcodeptr = psfie->opcodeptr;
+            codecheck = fie_check(fiecode);
             dprintf(1,"LOADFIE: slot %d, npar=%d codeptr=%d opcodeptr=%d ###\n",
                     slot, npar, codeptr, opcodeptr);
             return(1);      /* OK, found slot */
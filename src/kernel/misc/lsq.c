@@ -1,6 +1,7 @@
 /*
  *  Linear Least Squares Fitting:  lsq_zero, lsq_accum, lsq_solve, lsq_cfill
- *	using normalized equations
+ *	using normalized equations, lsq_block for many data at once,
+ *	and lsq_qr_* using an orthogonal (QR) factorization instead
  *
  *	29-sep-90	Created			Peter Teuben
  *	 8-dec-90	Isolated matinv.c	PJT
@@ -10,9 +11,17 @@
  *	13-jun-94       some error() calls for obvious mistakes PJT
  *	22-jan-95	ansi prototypes				pjt
  *      16-feb-97       extern proto instead of nested		pjt
+ *	18-oct-26	lsq_block, lsq_qr_zero/accum/block/solve	PJT
+ *	18-oct-26	no shared write of the thread count	PJT
  */
 
 #include <stdinc.h>
+#include <lsq.h>
+#if _OPENMP
+#include <omp.h>
+#endif
+
+#define MINPAR  20000		/* fewer rows are done serially */
 
 extern void matinv(real *, int, int,real *);
 
@@ -53,6 +62,96 @@ void lsq_accum(int n, real *mat, real *vec, real *a, real w)
     }
 }
 
+/*
+ *  SYRK_ROWS:   add m rows of a[] to the upper triangle p[i*n+j] (j>=i)
+ *               of a normal matrix and to v[], 4 rows per update.
+ */
+
+local void syrk_rows(int n, real *p, real *v, long m, real *a, real *w)
+{
+    long k;
+    int i, j, n1 = n+1;
+    real *a0, *a1, *a2, *a3, b0, b1, b2, b3, w0, w1, w2, w3, *pi;
+
+    for (k=0; k+4<=m; k+=4) {
+        a0 = a + k*n1;  a1 = a0 + n1;  a2 = a1 + n1;  a3 = a2 + n1;
+        if (w) {
+            w0 = w[k];  w1 = w[k+1];  w2 = w[k+2];  w3 = w[k+3];
+        } else
+            w0 = w1 = w2 = w3 = 1.0;
+        for (i=0; i<n; i++) {
+            b0 = a0[i]*w0;  b1 = a1[i]*w1;  b2 = a2[i]*w2;  b3 = a3[i]*w3;
+            v[i] += b0*a0[n] + b1*a1[n] + b2*a2[n] + b3*a3[n];
+            pi = p + i*n;
+            for (j=i; j<n; j++)
+                pi[j] += b0*a0[j] + b1*a1[j] + b2*a2[j] + b3*a3[j];
+        }
+    }
+    for (; k<m; k++) {
+        a0 = a + k*n1;
+        w0 = w ? w[k] : 1.0;
+        for (i=0; i<n; i++) {
+            b0 = a0[i]*w0;
+            v[i] += b0*a0[n];
+            pi = p + i*n;
+            for (j=i; j<n; j++)
+                pi[j] += b0*a0[j];
+        }
+    }
+}
+
+/*
+ *  LSQ_BLOCK:   accumulate m rows of a design matrix a[m*(n+1)], each
+ *               row as the a[] of lsq_accum, with weights w[] (1 if NULL).
+ *               Only the upper triangle is computed, and with OpenMP a
+ *               large block is split over the threads, each adding its
+ *               rows to a private matrix; these are added to mat[] and
+ *               vec[] in a fixed order, so results do not depend on timing.
+ */
+
+void lsq_block(int n, real *mat, real *vec, long m, real *a, real *w)
+	       /* DIM: mat[n*n]  vec[n]  a[m*(n+1)]  w[m] */
+{
+    int i, j, t, nt = 1, np = n*n + n;
+    real *part, *p, *v;
+
+    if (n<1) error("lsq_block: n=%d",n);
+    if (m<1) return;
+#if _OPENMP
+    if (m > MINPAR) nt = omp_get_max_threads();
+#endif
+    part = (real *) allocate(nt*np*sizeof(real));
+#if _OPENMP
+#pragma omp parallel private(t) num_threads(nt)
+#endif
+    {
+        long k0, k1;
+        int nth = 1;		/* threads we really got, maybe fewer than nt */
+
+        t = 0;
+#if _OPENMP
+        t = omp_get_thread_num();
+        nth = omp_get_num_threads();
+#endif
+        k0 = m*t/nth;
+        k1 = m*(t+1)/nth;
+        syrk_rows(n, part+t*np, part+t*np+n*n, k1-k0, a+k0*(n+1), w ? w+k0 : NULL);
+    }
+    for (t=0; t<nt; t++) {
+        p = part + t*np;
+        v = p + n*n;
+        for (i=0; i<n; i++) {
+            vec[i] += v[i];
+            mat[i*n+i] += p[i*n+i];
+            for (j=i+1; j<n; j++) {
+                mat[i*n+j] += p[i*n+j];
+                mat[j*n+i] += p[i*n+j];
+            }
+        }
+    }
+    free(part);
+}
+
 /*
  *  LSQ_SOLVE:	solve 'sol' for  mat*sol=vec assuming lsq_accum filled
  *		the 'mat' and 'vec' properly.
@@ -89,21 +188,167 @@ void lsq_cfill(int n, real * mat, int c, real *vec)
        mat[off+i] = vec[i];
 }
 
+/*
+ *  LSQ_QR_*:    the same problem, but solved by an orthogonal (QR)
+ *               factorization of the design matrix, which does not square
+ *               its condition number as the normal equations do, hence
+ *               better for e.g. high order polynomials.  Each (weighted)
+ *               row is rotated (Givens) into an upper triangular matrix
+ *               r[(n+1)*(n+1)], whose last column is the rotated r.h.s.;
+ *               r[n*(n+1)+n] is then sqrt of the weighted sum of the
+ *               squared residuals of the solution.
+ */
+
+void lsq_qr_zero(int n, real *r)
+{
+    int i;
+
+    if (n<1) error("lsq_qr_zero: n=%d",n);
+    for (i=0; i<(n+1)*(n+1); i++)
+        r[i] = 0.0;
+}
+
+/* rotate row x[] (zero before x[i0]) into r[]; x[] is destroyed */
+
+local void qr_row(int n, real *r, real *x, int i0)
+{
+    int i, j, n1 = n+1;
+    real c, s, d, t, *ri;
+
+    for (i=i0; i<=n; i++) {
+        if (x[i] == 0.0) continue;
+        ri = r + i*n1;
+        d = sqrt(ri[i]*ri[i] + x[i]*x[i]);
+        c = ri[i]/d;
+        s = x[i]/d;
+        ri[i] = d;
+        for (j=i+1; j<=n; j++) {
+            t = ri[j];
+            ri[j] = c*t + s*x[j];
+            x[j]  = c*x[j] - s*t;
+        }
+    }
+}
+
+local void qr_rows(int n, real *r, long m, real *a, real *w)
+{
+    long k;
+    int j, n1 = n+1;
+    real x[n1], sw = 1.0;
+
+    for (k=0; k<m; k++, a+=n1) {
+        if (w) {
+            if (w[k] <= 0.0) continue;
+            sw = sqrt(w[k]);
+        }
+        for (j=0; j<=n; j++)
+            x[j] = a[j]*sw;
+        qr_row(n, r, x, 0);
+    }
+}
+
+void lsq_qr_accum(int n, real *r, real *a, real w)
+	       /* DIM: r[(n+1)*(n+1)]  a[n+1] */
+{
+    if (n<1) error("lsq_qr_accum: n=%d",n);
+    qr_rows(n, r, 1, a, &w);
+}
+
+/*
+ *  LSQ_QR_BLOCK: as lsq_block, the threads each rotating their rows into
+ *               a private triangle, whose rows are then rotated into r[].
+ */
+
+void lsq_qr_block(int n, real *r, long m, real *a, real *w)
+	       /* DIM: r[(n+1)*(n+1)]  a[m*(n+1)]  w[m] */
+{
+    int i, j, t, nt = 1, n1 = n+1, np = n1*n1;
+    real *part = NULL, *p, x[n1];
+
+    if (n<1) error("lsq_qr_block: n=%d",n);
+    if (m<1) return;
+#if _OPENMP
+    if (m > MINPAR) nt = omp_get_max_threads();
+#endif
+    if (nt > 1)
+        part = (real *) allocate((nt-1)*np*sizeof(real));
+#if _OPENMP
+#pragma omp parallel private(t) num_threads(nt)
+#endif
+    {
+        long k0, k1;
+        int nth = 1;		/* threads we really got, maybe fewer than nt */
+
+        t = 0;
+#if _OPENMP
+        t = omp_get_thread_num();
+        nth = omp_get_num_threads();
+#endif
+        k0 = m*t/nth;
+        k1 = m*(t+1)/nth;
+        qr_rows(n, t==0 ? r : part+(t-1)*np, k1-k0, a+k0*n1, w ? w+k0 : NULL);
+    }
+    for (t=1; t<nt; t++) {
+        p = part + (t-1)*np;
+        for (i=0; i<=n; i++) {
+            for (j=0; j<=n; j++)
+                x[j] = j<i ? 0.0 : p[i*n1+j];
+            qr_row(n, r, x, i);
+        }
+    }
+    if (part) free(part);
+}
+
+/*
+ *  LSQ_QR_SOLVE: solve 'sol' from the triangle accumulated in r[]
+ *               by back substitution; r[] is not changed.
+ */
+
+void lsq_qr_solve(int n, real *r, real *sol)
+{
+    int i, j, n1 = n+1;
+    real s;
+
+    if (n<1) error("lsq_qr_solve: n=%d",n);
+    for (i=0; i<n; i++)
+        if (r[i*n1+i] == 0.0) {
+            dprintf(1,"lsq_qr_solve: singular matrix of order %d",n);
+            return;
+        }
+    for (i=n-1; i>=0; i--) {
+        s = r[i*n1+n];
+        for (j=i+1; j<n; j++)
+            s -= r[i*n1+j] * sol[j];
+        sol[i] = s / r[i*n1+i];
+    }
+}
+
 #if defined(TESTBED)
 
 #include <getparam.h>
 
 string defv[] = {
-        "VERSION=0",
+        "n=100000\n     Number of points for a polynomial fit",
+        "order=3\n      Order of the polynomial",
+        "x=1\n          Range of x, from 0 to x",
+        "VERSION=1.0\n  18-oct-2026 PJT",
 	NULL,
 };
 
+#define MAXORD 16
+
 real mat[2*2];
 real vec[2];
 real sol[2];
 
-nemo_main()
+void nemo_main()
 {
+    int i, j, order = getiparam("order"), n1 = order+2;
+    long k, n = getiparam("n");
+    real xmax = getdparam("x"), x, *a, sum;
+    real m[MAXORD*MAXORD], v[MAXORD], s[MAXORD], r[(MAXORD+1)*(MAXORD+1)];
+    double cpu;
+
     mat[0] = 2;
     mat[1] = 1;
     mat[2] = 2;
@@ -112,6 +357,45 @@ nemo_main()
     vec[1] = 1;
     lsq_solve(2,mat,vec,sol);
     printf("sol = %g %g\n",sol[0],sol[1]);
+
+    /* y = 1 + x + x^2 + ... x^order, exactly */
+    if (order < 0 || order >= MAXORD) error("order=%d not in 0..%d",order,MAXORD-1);
+    a = (real *) allocate(n*n1*sizeof(real));
+    for (k=0; k<n; k++) {
+        x = xmax*k/n;
+        a[k*n1] = 1.0;
+        sum = 1.0;
+        for (j=1; j<=order; j++) {
+            a[k*n1+j] = a[k*n1+j-1] * x;
+            sum += a[k*n1+j];
+        }
+        a[k*n1+order+1] = sum;
+    }
+
+    cpu = cputime();
+    lsq_zero(order+1, m, v);
+    for (k=0; k<n; k++)
+        lsq_accum(order+1, m, v, a+k*n1, 1.0);
+    lsq_solve(order+1, m, v, s);
+    printf("accum: %6.3f sec:", (cputime()-cpu)*60);
+    for (i=0; i<=order; i++) printf(" %g", s[i]);
+    printf("\n");
+
+    cpu = cputime();
+    lsq_zero(order+1, m, v);
+    lsq_block(order+1, m, v, n, a, NULL);
+    lsq_solve(order+1, m, v, s);
+    printf("block: %6.3f sec:", (cputime()-cpu)*60);
+    for (i=0; i<=order; i++) printf(" %g", s[i]);
+    printf("\n");
+
+    cpu = cputime();
+    lsq_qr_zero(order+1, r);
+    lsq_qr_block(order+1, r, n, a, NULL);
+    lsq_qr_solve(order+1, r, s);
+    printf("qr:    %6.3f sec:", (cputime()-cpu)*60);
+    for (i=0; i<=order; i++) printf(" %g", s[i]);
+    printf("  rms=%g\n", r[(order+1)*(order+2)+order+1]/sqrt((real)n));
 }
 
 #endif
@@ -20,6 +20,8 @@
  *  12-jul-20   add min/max for robust
  *  10-oct-20   median improvement via inline sort
  *  14-nov-21   add sratio
+ *  18-oct-26   merge_moment, for partial sums done in parallel;
+ *              Quantile sketch for (streaming) medians and quartiles
  *
  * @todo    iterative robust by using a mask
  *          ? robust factor, now hardcoded at 1.5
@@ -144,6 +146,36 @@ void decr_moment(Moment *m, real x, real w)
     if (x>0) m->sump -= x;
 }
 
+/*
+ * MERGE_MOMENT: add the data accumulated in m2 to m, as if they had been
+ * accumulated in m.  Since the moments are kept as plain power sums,
+ * these are simply added; moving moments cannot be merged.
+ */
+
+void merge_moment(Moment *m, Moment *m2)
+{
+    int i;
+
+    if (m->mom != m2->mom)
+	error("merge_moment: mom=%d and %d differ",m->mom,m2->mom);
+    if (m->ndat > 0 || m2->ndat > 0)
+	error("merge_moment: cannot be used in moving moments mode");
+    if (m2->n == 0) return;
+    if (m->n == 0) {
+	m->datamin = m2->datamin;
+	m->datamax = m2->datamax;
+    } else {
+	m->datamin = MIN(m->datamin, m2->datamin);
+	m->datamax = MAX(m->datamax, m2->datamax);
+    }
+    m->n += m2->n;
+    if (m->mom < 0) return;
+    for (i=0; i <= m->mom; i++)
+	m->sum[i] += m2->sum[i];
+    m->sumn += m2->sumn;
+    m->sump += m2->sump;
+}
+
 void reset_moment(Moment *m)
 {
     int i;
@@ -362,7 +394,7 @@ real median_moment(Moment *m)
   int n;
   if (m->ndat==0)
     error("median_moment cannot be computed with ndat=%d",m->ndat);
-  dprintf(1,"median_moment: n=%d ndat=%d\n",m->n, m->ndat);
+  dprintf(1,"median_moment: n=%ld ndat=%d\n",m->n, m->ndat);
   n = MIN(m->n, m->ndat);
   return smedian(n,m->dat);
 }
@@ -529,6 +561,172 @@ real max_moment(Moment *m)
   return m->datamax;
 }                                        
 
+
+/*
+ * QUANTILE: a mergeable sketch of the data to find quantiles in bounded
+ * memory, in the spirit of the KLL and MRL sketches.  Level h holds up to
+ * k items, each standing for 2^h data.  A full level is sorted and every
+ * other item (alternating between the odd and even ones) moves up, which
+ * moves any rank by at most 2^h.  As the data in a level move up at most
+ * n/(k 2^h) times, a level adds at most n/k to the rank error, so with
+ * k = QLEV/eps the error stays below eps*n for up to QLEV levels (n up to
+ * k*2^QLEV).  Until the first compaction all data are kept, and the
+ * quantiles are exact, with the same conventions as smedian().
+ */
+
+#define QLEV  40
+
+void ini_quantile(Quantile *q, real eps)
+{
+    if (eps <= 0 || eps >= 1) error("ini_quantile: bad eps=%g",eps);
+    memset(q, 0, sizeof(Quantile));
+    q->eps = eps;
+    q->k = 2*(int)ceil(QLEV/eps/2);
+    q->nlev = 1;
+    q->lev[0] = (real *) allocate(q->k * sizeof(real));
+}
+
+void free_quantile(Quantile *q)
+{
+    int h;
+
+    for (h=0; h<q->nlev; h++)
+	free(q->lev[h]);
+    q->nlev = 0;
+}
+
+local void compact_quantile(Quantile *q, int h)
+{
+    int i, n2 = q->cnt[h]/2, off;
+    real *x = q->lev[h];
+
+    if (h+1 == MAXQLEV) error("compact_quantile: too many levels");
+    if (h+1 == q->nlev) {
+	q->lev[q->nlev++] = (real *) allocate(q->k * sizeof(real));
+	dprintf(1,"compact_quantile: level %d, n=%g\n",q->nlev-1,q->n);
+    }
+    if (q->cnt[h+1] + n2 > q->k)
+	compact_quantile(q, h+1);
+    qsort(x, q->cnt[h], sizeof(real), compar_real);
+    off = (q->odd >> h) & 1;
+    q->odd ^= 1ULL << h;
+    for (i=0; i<n2; i++)
+	q->lev[h+1][q->cnt[h+1]++] = x[2*i+off];
+    if (q->cnt[h] % 2)                 /* the odd one out stays */
+	x[0] = x[q->cnt[h]-1];
+    q->cnt[h] %= 2;
+}
+
+local void add_quantile(Quantile *q, int h, real x)
+{
+    if (q->cnt[h] == q->k)
+	compact_quantile(q, h);
+    q->lev[h][q->cnt[h]++] = x;
+}
+
+void accum_quantile(Quantile *q, real x)
+{
+    if (q->n == 0) {
+	q->datamin = q->datamax = x;
+    } else {
+	q->datamin = MIN(x, q->datamin);
+	q->datamax = MAX(x, q->datamax);
+    }
+    q->n++;
+    add_quantile(q, 0, x);
+}
+
+void merge_quantile(Quantile *q, Quantile *q2)
+{
+    int h, i;
+
+    if (q2->n == 0) return;
+    if (q->k != q2->k) error("merge_quantile: eps=%g and %g differ",q->eps,q2->eps);
+    if (q->n == 0) {
+	q->datamin = q2->datamin;
+	q->datamax = q2->datamax;
+    } else {
+	q->datamin = MIN(q->datamin, q2->datamin);
+	q->datamax = MAX(q->datamax, q2->datamax);
+    }
+    q->n += q2->n;
+    for (h=0; h<q2->nlev; h++) {
+	while (h >= q->nlev)
+	    q->lev[q->nlev++] = (real *) allocate(q->k * sizeof(real));
+	for (i=0; i<q2->cnt[h]; i++)
+	    add_quantile(q, h, q2->lev[h][i]);
+    }
+}
+
+bool exact_quantile(Quantile *q)
+{
+    return q->nlev == 1;
+}
+
+typedef struct { real x; double w; } qitem;
+
+local int compar_qitem(const void *va, const void *vb)
+{
+    real a = ((qitem *) va)->x, b = ((qitem *) vb)->x;
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/* GET_QUANTILE: the value below which a fraction p of the data are */
+
+real get_quantile(Quantile *q, real p)
+{
+    int h, i, n = 0, nk;
+    double w, wp;
+    qitem *it;
+    real *x, v;
+
+    if (q->n == 0) error("get_quantile: no data");
+    if (p <= 0) return q->datamin;
+    if (p >= 1) return q->datamax;
+    if (exact_quantile(q)) {
+	nk = q->cnt[0];
+	x = q->lev[0];
+	qsort(x, nk, sizeof(real), compar_real);
+	if (p == 0.5) return smedian(nk, x);
+	i = (int) (p*(nk+1));
+	return x[MIN(i, nk-1)];
+    }
+    for (h=0; h<q->nlev; h++)
+	n += q->cnt[h];
+    it = (qitem *) allocate(n * sizeof(qitem));
+    for (h=0, n=0; h<q->nlev; h++)
+	for (i=0; i<q->cnt[h]; i++, n++) {
+	    it[n].x = q->lev[h][i];
+	    it[n].w = ldexp(1.0, h);
+	}
+    qsort(it, n, sizeof(qitem), compar_qitem);
+    wp = p * q->n;
+    for (i=0, w=0; i<n-1; i++) {
+	w += it[i].w;
+	if (w >= wp) break;
+    }
+    v = it[i].x;
+    free(it);
+    return v;
+}
+
+/* MOMENT_QUANTILE: accumulate the items in [lo,hi], with their weights */
+
+void moment_quantile(Quantile *q, real lo, real hi, Moment *m)
+{
+    int h, i;
+    real x, w;
+
+    for (h=0; h<q->nlev; h++) {
+	w = ldexp(1.0, h);
+	for (i=0; i<q->cnt[h]; i++) {
+	    x = q->lev[h][i];
+	    if (x >= lo && x <= hi)
+		accum_moment(m, x, w);
+	}
+    }
+}
+
 #ifdef TESTBED
 #include <getparam.h>
 
@@ -539,7 +737,8 @@ string defv[] = {
     "median=f\n     Show median ?",
     "robust=f\n     Show robust mean etc.?",
     "maxsize=0\n    If > 0, size for moving moments instead\n",
-    "VERSION=0.4\n  23-apr-2013 PJT",
+    "eps=\n         If given, median from a quantile sketch with this rank error",
+    "VERSION=0.5\n  18-oct-2026 PJT",
     NULL,
 };
 
@@ -568,11 +767,15 @@ void nemo_main(void)
     bool Qminmax = getbparam("minmax");
     bool Qmedian = getbparam("median");
     bool Qrobust = getbparam("robust");
+    bool Qsketch = hasvalue("eps");
+    Quantile q;
 
     ini_moment(&m,ABS(mom),maxsize);
+    if (Qsketch) ini_quantile(&q,getrparam("eps"));
     while (fgets(line,80,instr) != NULL) {
       x = atof(line);
       accum_moment(&m,x,1.0);
+      if (Qsketch) accum_quantile(&q,x);
       if (maxsize > 0) {
 	debug_moment(1,&m);
 	printf("%d %g ",n_moment(&m),x);
@@ -591,6 +794,8 @@ void nemo_main(void)
       printf("%d %g ",n_moment(&m),x);
       if (Qminmax)
         printf("%g %g\n",min_moment(&m), max_moment(&m));
+      else if (Qmedian && Qsketch)
+	printf("%g\n",get_quantile(&q,0.5));
       else if (Qmedian)
 	printf("%g\n",median_moment(&m));
       else if (Qrobust)  {
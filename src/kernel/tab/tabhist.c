@@ -52,6 +52,10 @@
  *      10-oct-2020 7.2   using median()                        PJT
  *      11-feb-2021 7.3   added diff mean & disp                PJT
  *      29-apr-2022 8.0   converted to use table V2             PJT
+ *      18-oct-2026 8.1   mapped table, parsed in parallel      PJT
+ *      18-oct-2026 8.2   stream=t, eps=: one pass in bounded memory   PJT
+ *      18-oct-2026 8.3   use the histogram() engine                     PJT
+ *      18-oct-2026 8.4   stream=t via table_stream, one shared sketch   PJT
  *                
  * 
  * TODO:
@@ -74,6 +78,10 @@
 #include <mdarray.h>
 #include <table.h>
 #include <pyplot.h>
+#include <histogram.h>
+#if _OPENMP
+#include <omp.h>
+#endif
 
 /**************** COMMAND LINE PARAMETERS **********************/
 
@@ -113,7 +121,9 @@ string defv[] = {
     "scale=1\n                    Scale factor for data",
     "out=\n                       Optional output file to select the robust points",
     "pyplot=\n                    Template python plotting script",    
-    "VERSION=8.0c\n		  18-oct-2023 PJT",
+    "stream=f\n                   Stream the table in one pass, in bounded memory",
+    "eps=0.001\n                  Rank accuracy (fraction of npt) of median etc. with stream=t",
+    "VERSION=8.4\n		  18-oct-2026 PJT",
     NULL
 };
 
@@ -137,6 +147,8 @@ string cvsid = "$Id$";
 
 #define MAXCOORD 16
 
+#define HBUF     1024           /* values binned at a time in stream mode */
+
 local string input;			/* filename */
 local stream instr, outstr;		/* input file , optional output file */
 local table *tptr;                      /* table */
@@ -149,7 +161,7 @@ local int    nsteps;			/* number of divisions */
 local real   *x = NULL;			/* pointer to array of nmax*ncol points */
 local int    *iq = NULL;                /* boolean masking array */
 local int    nmax;			/* lines to use at all */
-local int    npt;			/* actual number of points */
+local long   npt;			/* actual number of points */
 local real   xmin, xmax;		/* actual min and max as computed */
 local real   nsigma;                    /* outlier rejection attempt */
 local bool   Qauto;			/* autoscale ? */
@@ -169,10 +181,15 @@ local bool   Qac;                       /* QAC output mode for stats */
 local bool   Qbad;
 local real   badval;
 local int    maxcount;
-local int    Nunder, Nover;             /* number of data under or over min/max */
+local long   Nunder, Nover;             /* number of data under or over min/max */
 local real   dual_mean;                 /* mean value, if dual pass used */
 local real   scale;                     /* scale factor */
 local real   bins[MAXHIST+1];           /* edges of histogram bins */
+local bool   Qstream;                   /* stream the data, no x[] ? */
+local real   eps;                       /* rank accuracy of the sketch */
+local Moment sm;                        /* moments of the streamed data */
+local Quantile sq;                      /* quantile sketch of the streamed data */
+local Histogram hist;                   /* the histogram */
 
 local string headline;			/* text string above plot */
 local char   headlines[128];            /* statistics headline  */
@@ -186,9 +203,8 @@ local int nxcoord;
 local iproc  mysort, getsort();
 
 local real  xtrans(real), ytrans(real);
-local void  setparams(void), read_data(void), histogram(void);
+local void  setparams(void), read_data(void), stream_data(void), histogram(void);
 local iproc getsort(string name);
-local int   ring_index(int n, real *r, real rad);
 
 extern real median_torben(int n, real *x, real xmin, real xmax);
 extern void minmax(int n, real *x, real *xmin, real *xmax);
@@ -208,7 +224,10 @@ void nemo_main(void)
       pyplot_hist(pstr, input, col, xrange,nsteps);
       pyplot_close(pstr);
     }
-    read_data();
+    if (Qstream)
+      stream_data();
+    else
+      read_data();
     histogram();
 }
 
@@ -286,8 +305,19 @@ local void setparams()
       sprintf(xlab2,"%s [scale *%s]",xlab,s2);
       xlab = xlab2;
     }
+    Qstream = getbparam("stream");
+    eps = getrparam("eps");
+    if (Qstream) {
+      if (nsigma > 0) error("nsigma=%g cannot be used with stream=t",nsigma);
+      if (Qdual)      error("dual=t cannot be used with stream=t");
+      if (outstr)     error("out= cannot be used with stream=t");
+      if (Qmad) {
+	warning("mad= is not available with stream=t");
+	Qmad = FALSE;
+      }
+    }
     instr = stropen (input,"r");
-    tptr = table_open(instr,0);
+    tptr = table_open(instr, Qstream ? 1 : 2);
 }
 
 
@@ -339,7 +369,7 @@ local void read_data()
       }
     }
     npt = k;
-    dprintf(0,"Under/Over flow: %d %d\n",Nunder,Nover);
+    dprintf(0,"Under/Over flow: %ld %ld\n",Nunder,Nover);
 #ifndef XHACK    
     // @todo if shared with *x, delay this free
     free_mdarray2(md2,ncol,nmax);
@@ -355,23 +385,162 @@ local void read_data()
 }
 
 
+/*
+ * HIST_SETUP: the bins of histogram h, given by bins= or uniform in [lo,hi]
+ */
+
+local void hist_setup(Histogram *h, real lo, real hi)
+{
+  ini_histogram(h,1);
+  if (Qbin) {
+    if (bins[0] > bins[1]) error("reverse indexing not yet implemented");
+    edges_histogram(h,0,nsteps,bins);
+  } else
+    uniform_histogram(h,0,nsteps,lo,hi > lo ? hi : lo+1.0);   /* lo=hi: all in the 1st bin */
+  reset_histogram(h);
+}
+
+/*
+ * STREAM_DATA: read the table a chunk of lines at a time (table_stream),
+ * each thread accumulating moments and (if the range is known in advance)
+ * histogram of its share of the lines, merged at the end.  The values are
+ * buffered per thread, HBUF at a time, and a full buffer also goes into the
+ * one quantile sketch the threads share.
+ */
+
+local bool   Qsketch;
+local int    nthread;
+local Histogram *ph = NULL;             /* per thread: histogram, */
+local Moment *pm = NULL;                /*   moments, */
+local real   *hbuf = NULL;              /*   HBUF values not binned yet */
+local int    *nhbuf = NULL;
+local long   *punder = NULL, *pover = NULL;
+
+local void flush_values(int t)
+{
+  real *hb = hbuf + t*HBUF;
+  int i;
+
+  if (nhbuf[t] == 0) return;
+  if (!Qauto) accum_histogram(&ph[t],nhbuf[t],hb,NULL,NULL,NULL);
+  if (Qsketch) {
+#if _OPENMP
+#pragma omp critical(tabhist_sketch)
+#endif
+    for (i=0; i<nhbuf[t]; i++)
+      accum_quantile(&sq,hb[i]);
+  }
+  nhbuf[t] = 0;
+}
+
+local void stream_setup(void *arg, int nc, int nt)
+{
+  int t;
+
+  nthread = nt;
+  hbuf = (real *) allocate(nt*HBUF*sizeof(real));
+  nhbuf = (int *) allocate(nt*sizeof(int));
+  punder = (long *) allocate(nt*sizeof(long));
+  pover = (long *) allocate(nt*sizeof(long));
+  ph = (Histogram *) allocate(nt*sizeof(Histogram));
+  pm = (Moment *) allocate(nt*sizeof(Moment));
+  for (t=0; t<nt; t++) {
+    if (!Qauto) hist_setup(&ph[t],xrange[0],xrange[1]);
+    ini_moment(&pm[t],4,0);
+  }
+  if (Qsketch) ini_quantile(&sq,eps);
+}
+
+local void stream_accum(void *arg, int t, long row, real *v)
+{
+  int j;
+
+  for (j=0; j<ncol; j++) {
+    v[j] *= scale;
+    if (Qmin && v[j] < xrange[0]) { punder[t]++; continue;}
+    if (Qmax && v[j] > xrange[1]) { pover[t]++;  continue;}
+    accum_moment(&pm[t],v[j],1.0);
+    hbuf[t*HBUF+nhbuf[t]++] = v[j];
+    if (nhbuf[t] == HBUF) flush_values(t);
+  }
+}
+
+local void stream_data(void)
+{
+  long nrow, bad;
+  int i, t;
+
+  Qsketch = Qauto || Qmedian || Qtorben || Qrobust;
+  dprintf(0,"Streaming %d column(s)\n",ncol);
+  bad = table_stream(tptr, &ncol, col, stream_setup, stream_accum, NULL, &nrow);
+  if (bad) error("too few columns in row %ld", bad);
+  if (nrow == 0) error("No data in %s", input);
+  if (scale != 1.0)
+    warning("Scale factor=%g\n",scale);
+
+  ini_moment(&sm,4,0);
+  if (!Qauto) hist_setup(&hist,xrange[0],xrange[1]);
+  Nunder = Nover = 0;
+  for (t=0; t<nthread; t++) {
+    flush_values(t);
+    Nunder += punder[t];
+    Nover  += pover[t];
+    merge_moment(&sm,&pm[t]);
+    if (!Qauto) {
+      merge_histogram(&hist,&ph[t]);
+      free_histogram(&ph[t]);
+    }
+  }
+  dprintf(0,"Under/Over flow: %ld %ld\n",Nunder,Nover);
+  free(hbuf);
+  free(nhbuf);
+  free(punder);
+  free(pover);
+  free(ph);
+  free(pm);
+  nmax = nrow;
+  npt = sm.n;
+  if (npt == 0) error("No data in range");
+  xmin = min_moment(&sm);
+  xmax = max_moment(&sm);
+  if (!Qmin) xrange[0] = xmin;
+  if (!Qmax) xrange[1] = xmax;
+
+  if (Qauto) {      /* range only known now: histogram of the sketch */
+    int h;
+    real *w = (real *) allocate(sq.k*sizeof(real));
+    hist_setup(&hist,xrange[0],xrange[1]);
+    for (h=0; h<sq.nlev; h++) {
+      for (i=0; i<sq.cnt[h]; i++)
+	w[i] = ldexp(1.0, h);
+      accum_histogram(&hist,sq.cnt[h],sq.lev[h],NULL,NULL,w);
+    }
+    free(w);
+    if (!exact_quantile(&sq))
+      warning("stream=t: histogram counts are approximate (%g)", eps*npt);
+  }
+}
+
+
 local void histogram(void)
 {
   int i,j,k, l, kmax, lcount = 0;
   real count[MAXHIST];
-  int under, over;
+  long under, over;
   real xdat,ydat,xplt,yplt,dx,r,sum,sigma2, q, qmax;
   real mean, sigma, skew, kurt, h3, h4, lmin, lmax, q1, q2, q3, mad=0;
   real meand, sigmad;
   real rmean, rsigma, rrange[2];
   Moment m, md;
   
-  dprintf (0,"read %d values\n",npt);
+  dprintf (0,"read %ld values\n",npt);
   dprintf (0,"min and max value in column(s)  %s: %g  %g\n",getparam("xcol"),xmin,xmax);
   if (!Qauto) {
     xmin = xrange[0];
     xmax = xrange[1];
     dprintf (0,"min and max value reset to : %g  %g\n",xmin,xmax);
+  }
+  if (!Qauto && !Qstream) {
     lmin = xmax;
     lmax = xmin;
     for (i=0; i<npt; i++) {
@@ -383,37 +552,28 @@ local void histogram(void)
     dprintf (0,"min and max value in range : %g  %g\n",lmin,lmax);
   } 
   
-  for (k=0; k<nsteps; k++)
-    count[k] = 0;		/* init histogram */
-  under = over = 0;
-  
-  ini_moment(&m,  4, Qrobust||Qmad ? npt : 0);
-  ini_moment(&md, 4, Qrobust||Qmad ? npt : 0);  
-  for (i=0; i<npt; i++) {
-    if (Qbin) {
-      k=ring_index(nsteps,bins,x[i]);
-      // dprintf(0,"%d %g -> %d\n",i,x[i],k);
-    } else {
-      if (xmax != xmin)
-	k = (int) floor((x[i]-xmin)/(xmax-xmin)*nsteps);
-      else
-	k = 0;
-      dprintf(2,"%d k=%d %g\n",i,k,x[i]);
-    }
-    if (k==nsteps && x[i]==xmax) k--;     /* include upper edge */
-    if (k<0)       { under++; continue; }
-    if (k>=nsteps) { over++;  continue; }
-    count[k] = count[k] + 1;
-    dprintf (4,"%d : %f %d\n",i,x[i],k);
-    accum_moment(&m,x[i],1.0);
-    if (i>0) {
-      accum_moment(&md,x[i]-x[i-1],1.0);
-      //printf("%d %g %g\n",i,x[i],x[i]-x[i-1]);
+  if (Qstream) {
+    m = sm;
+    ini_moment(&md, 4, 0);
+  } else {
+    ini_moment(&m,  4, Qrobust||Qmad ? npt : 0);
+    ini_moment(&md, 4, Qrobust||Qmad ? npt : 0);  
+    hist_setup(&hist, xmin, xmax);
+    accum_histogram(&hist, npt, x, NULL, NULL, NULL);
+    for (i=0; i<npt; i++) {
+      accum_moment(&m,x[i],1.0);
+      if (i>0) {
+        accum_moment(&md,x[i]-x[i-1],1.0);
+        //printf("%d %g %g\n",i,x[i],x[i]-x[i-1]);
+      }
     }
-    
   }
-  if (under > 0) error("bug: under = %d",under);
-  if (over  > 0) error("bug: over = %d",over);
+  for (k=0; k<nsteps; k++)
+    count[k] = hist.count[k];
+  under = hist.under;
+  over  = hist.over;
+  if (under > 0) error("bug: under = %ld",under);
+  if (over  > 0) error("bug: over = %ld",over);
   under = Nunder;
   over  = Nover;
 
@@ -459,7 +619,7 @@ local void histogram(void)
 	h3 = h3_moment(&m);
 	h4 = h4_moment(&m);
 	if (Qmad) mad = mad_moment(&m);
-	dprintf(1,"%d/%d: removing point %d, m/s=%g %g qmax=%g\n",
+	dprintf(1,"%d/%ld: removing point %d, m/s=%g %g qmax=%g\n",
 		lcount,npt,l,mean,sigma,qmax);
 	if (sigma <= 0) {
 	  /* RELATED TO presetting MINMAX */
@@ -471,19 +631,19 @@ local void histogram(void)
 	  kurt = kurtosis_moment(&m);
 	  h3 = h3_moment(&m);
 	  h4 = h4_moment(&m);
-	  dprintf(1,"%d/%d: LAST removing point %d, m/s=%g %g qmax=%g\n",
+	  dprintf(1,"%d/%ld: LAST removing point %d, m/s=%g %g qmax=%g\n",
 		  lcount,npt,l,mean,sigma,qmax);
 	  break;
 	  
 	}
 	
       } else
-	dprintf(1,"%d/%d: keeping point %d, m/s=%g %g qmax=%g\n",
+	dprintf(1,"%d/%ld: keeping point %d, m/s=%g %g qmax=%g\n",
 		lcount,npt,l,mean,sigma,qmax);
       
       /* if (lcount > npt/2) break; */
     } while (qmax > nsigma);
-    dprintf(0,"Removed %d/%d points for nsigma=%g\n",lcount,npt,nsigma);
+    dprintf(0,"Removed %d/%ld points for nsigma=%g\n",lcount,npt,nsigma);
     
     /* @algorithm      left shift array values from mask array */
     /* now shift all points into the array, decreasing npt */
@@ -500,14 +660,14 @@ local void histogram(void)
     free(iq);
   } /* nsigma > 0 */
   
-  if (npt != n_moment(&m))
+  if (npt != m.n)
     error("Counting error, probably in removing outliers...");
-  dprintf (0,"Number of points     : %d\n",npt);
+  dprintf (0,"Number of points     : %ld\n",npt);
   if (npt>1)
     dprintf (0,"Mean and dispersion  : %g %g %g\n",mean,sigma,sigma/sqrt(npt-1.0));
   else
     dprintf (0,"Mean and dispersion  : %g %g 0.0\n",mean,sigma);
-  if (!Qmedian) {
+  if (!Qmedian && !Qstream) {
     real sratio = sigmad/sqrt(2)/sigma;
     dprintf(0,"Diff mean and disp   : %g %g %g\n", meand, sigmad, sratio);
   }
@@ -515,7 +675,14 @@ local void histogram(void)
   if (Qmad)  dprintf (0,"MAD                  : %g\n",mad);
   dprintf (0,"Skewness and kurtosis: %g %g\n",skew,kurt);
   dprintf (0,"h3 and h4            : %g %g\n", h3, h4);
-  if (Qmedian) {
+  if (Qmedian && Qstream) {
+    q2 = get_quantile(&sq,0.5);
+    q1 = get_quantile(&sq,0.25);
+    q3 = get_quantile(&sq,0.75);
+    dprintf (0,"Median (Q2)          : %g\n",q2);
+    dprintf (0,"Q1,Q2,Q3             : %g %g %g\n",q1,q2,q3);    
+    dprintf (0,"TriMean              : %g\n",q2);
+  } else if (Qmedian) {
     q2 = smedian(npt,x);
     q1 = smedian_q1(npt,x);
     q3 = smedian_q3(npt,x);
@@ -524,11 +691,23 @@ local void histogram(void)
     dprintf (0,"Q1,Q2,Q3             : %g %g %g\n",q1,q2,q3);    
     dprintf (0,"TriMean              : %g\n",q2);
   } else if (Qtorben) {
-    q2 = median_torben(npt,x,xmin,xmax);
+    q2 = Qstream ? get_quantile(&sq,0.5) : median_torben(npt,x,xmin,xmax);
     dprintf (0,"Median_torben        : %g\n",q2);
   }
   dprintf (0,"Sum                  : %g\n",show_moment(&m,1));
-  if (Qrobust) {
+  if (Qrobust && Qstream) {
+    Moment rm;
+    q1 = get_quantile(&sq,0.25);
+    q3 = get_quantile(&sq,0.75);
+    rrange[0] = q1 - 1.5*(q3-q1);
+    rrange[1] = q3 + 1.5*(q3-q1);
+    ini_moment(&rm,2,0);
+    moment_quantile(&sq, rrange[0], rrange[1], &rm);
+    dprintf (0,"Robust N             : %ld\n",(long) show_moment(&rm,0));
+    dprintf (0,"Robust Mean Disp     : %g %g\n",mean_moment(&rm),sigma_moment(&rm));
+    dprintf (0,"Robust Range         : %g %g\n",rrange[0],rrange[1]);
+    free_moment(&rm);
+  } else if (Qrobust) {
     compute_robust_moment(&m);
     rmean  = mean_robust_moment(&m);
     rsigma = sigma_robust_moment(&m);
@@ -545,30 +724,22 @@ local void histogram(void)
   }
   if (Qac) {
     real flux = 0.0;
-    printf("QAC_STATS: %s %g %g %g %g  %g %g  %d\n",
+    printf("QAC_STATS: %s %g %g %g %g  %g %g  %ld\n",
 	   input, mean, sigma, min_moment(&m), max_moment(&m),
-	   flux, sratio_moment(&m),n_moment(&m));
+	   flux, sratio_moment(&m),m.n);
     
   }
   
   if (lcount > 0) {
     warning("Recompute histogram because of outlier removals");
     /* recompute histogram if we've lost some outliers */
+    reset_histogram(&hist);
+    accum_histogram(&hist, npt, x, NULL, NULL, NULL);
     for (k=0; k<nsteps; k++)
-      count[k] = 0;		/* init histogram */
-    under = over = 0;
-    for (i=0; i<npt; i++) {
-      if (xmax != xmin)
-	k = (int) floor((x[i]-xmin)/(xmax-xmin)*nsteps);
-      else
-	k = 0;
-      if (k==nsteps && x[i]==xmax) k--;     /* include upper edge */
-      if (k<0)       { under++; continue; }
-      if (k>=nsteps) { over++;  continue; }
-      count[k] = count[k] + 1;
-      dprintf (4,"%d : %f %d\n",i,x[i],k);
-    }
-    if (under > 0 || over > 0) error("under=%d over=%d in recomputed histo",under,over);
+      count[k] = hist.count[k];
+    under = hist.under;
+    over  = hist.over;
+    if (under > 0 || over > 0) error("under=%ld over=%ld in recomputed histo",under,over);
   }
   
   dprintf (3,"Histogram values : \n");
@@ -620,7 +791,7 @@ local void histogram(void)
     else
       r = 1.0;
     printf("  Bin    Value          Number\n");
-    printf("       Underflow   %d\n",Nunder);
+    printf("       Underflow   %ld\n",Nunder);
     for (k=0; k<nsteps; k++) {
       j = (int) (r*count[k]) + 1;
       if (ylog) printf("%3d %13.6g %13.6g ", 
@@ -630,7 +801,7 @@ local void histogram(void)
       while (j-- > 0) printf("*");
       printf("\n");
     }
-    printf("       Overflow    %d\n",Nover);
+    printf("       Overflow    %ld\n",Nover);
     stop(0);
   }
   
@@ -782,24 +953,3 @@ local iproc getsort(string name)
     error("%s: no valid sortname",name);
     return NULL;     /* better not get here ... */
 }
-
-
-/* index into an array --- stolen from velfit.c */
-
-local int ring_index(int n, real *r, real rad)
-{
-  int i;
-  
-  if (r[0] < r[1]) {
-    if (rad < r[0]) return -1;
-    if (rad > r[n]) return -2;
-    for (i=0;i<n;i++)
-      if (rad >= r[i] && rad < r[i+1]) return i;
-    error("ring_index: should never gotten here %g in [%g : %g]",
-	  rad,r[0],r[n-1]);
-  } else {
-    error("reverse indexing not yet implemented");
-  }
-  return -1;  /* NEVER REACHED */
-}
-
@@ -20,13 +20,30 @@
  * iscomment(line)			is this line a blank or comment line?
  * 
  *    1-jan-04      get_line::  changed EOF to return -1, and empty line to 0
+ *   18-oct-26      mode=2: seekable files are mapped (mmap) and split into
+ *                  lines by np= threads; table_md2cr parses the rows in
+ *                  parallel with a locale free number parser; table_parse   PJT
+ *   18-oct-26      sidecar cache of the parsed columns ($NEMOTABCACHE)   PJT
+ *   18-oct-26      table_lines, table_parse_cols for streaming tables    PJT
+ *   18-oct-26      free the copied last line of a mapped table           PJT
+ *   18-oct-26      sidecar checks inode and mtime in ns, no null masks   PJT
+ *   18-oct-26      table_stream: the chunked parallel parse of a stream  PJT
  */
  
 #include <stdinc.h>
 #include <ctype.h>
 #include <table.h>
 #include <extstring.h>
+#include <strlib.h>
 #include <mdarray.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#if _OPENMP
+#include <omp.h>
+#endif
 
 #if !defined(HUGE)
 #define HUGE 1e20
@@ -204,6 +221,492 @@ struct LineNode {        // simple linked list while reading lines
 };
 
 
+/*
+ * Mapped tables (mode=2, or -2 to keep the comment lines as well):
+ * the file is mapped privately, so the lines can be terminated in place
+ * and table_row() points into the mapping, without read() or a malloc
+ * per line.  Terminating a line writes to its page, which the kernel
+ * then copies, so in the end almost every page is a private copy and
+ * the memory used is about the size of the file, as for mode=0.
+ * A last line without a newline cannot be terminated in the file; it
+ * is copied (tptr->tail), and freed by table_close().
+ * The file is cut into one chunk per thread on line boundaries; each
+ * chunk is scanned (memchr) twice, first to count its lines, then to
+ * store them.  Lines are sanitized and comments recognized as for the
+ * lines read by table_line().
+ */
+
+#define MINMAP  (1<<20)   /* fewer bytes are not worth starting threads */
+
+/* END_LINE: length of the line s..e (e at the newline or end of file) after sanitize() */
+
+local size_t end_line(char *s, char *e, bool newline)
+{
+  size_t len = e - s;
+
+  if (len > 0 && s[len-1] == '\r') len--;
+  if (!newline && len > 0 && s[len-1] == '\r') len--;
+  return len;
+}
+
+/* IS_COMMENT: iscomment() for the line s of length len, not terminated yet */
+
+local bool is_comment(char *s, size_t len)
+{
+  if (len == 0 || *s=='#' || *s==';' || *s=='!' || *s=='/' || *s=='\0')
+    return TRUE;
+  for (; len > 0; s++, len--)
+    if (!isspace(*s)) return FALSE;
+  return TRUE;
+}
+
+/* MAP_LINES: count (lines==NULL) or store the lines between s and e */
+
+local size_t map_lines(char *s, char *e, char *end, bool all, string *lines)
+{
+  size_t n = 0, len;
+  char *nl;
+
+  while (s < e) {
+    nl = memchr(s, '\n', e-s);
+    if (nl == NULL) nl = e;
+    len = end_line(s, nl, nl < end);
+    if (all || !is_comment(s, len)) {
+      if (lines) {
+	if (s+len < end)
+	  s[len] = '\0';
+	else			/* last line, without a newline */
+	  s = strndup(s, len);
+	lines[n] = s;
+      }
+      n++;
+    }
+    s = nl + 1;
+  }
+  return n;
+}
+
+local bool map_table(tableptr tptr, bool all)
+{
+  struct stat st;
+  off_t off;
+  char *map, *beg, *end, **cut;
+  size_t *nl, size;
+  int i, nt = 1;
+
+  if (fstat(fileno(tptr->str), &st) < 0 || !S_ISREG(st.st_mode)) return FALSE;
+  if ((off = ftello(tptr->str)) < 0) return FALSE;
+  size = st.st_size;
+  if (size <= off) {
+    tptr->lines = (string *) allocate(sizeof(string));
+    return TRUE;
+  }
+  map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(tptr->str), 0);
+  if (map == MAP_FAILED) return FALSE;
+  tptr->map = map;
+  tptr->mapsize = size;
+  beg = map + off;
+  end = map + size;
+#if _OPENMP
+  if (end-beg > MINMAP) nt = omp_get_max_threads();
+#endif
+  cut = (char **) allocate((nt+1)*sizeof(char *));
+  nl  = (size_t *) allocate((nt+1)*sizeof(size_t));
+  cut[0] = beg;
+  for (i=1; i<nt; i++) {                    /* chunks start after a newline */
+    cut[i] = beg + (end-beg)/nt*i;
+    if (cut[i] < cut[i-1]) cut[i] = cut[i-1];
+    cut[i] = memchr(cut[i], '\n', end-cut[i]);
+    cut[i] = cut[i] ? cut[i]+1 : end;
+  }
+  cut[nt] = end;
+
+#if _OPENMP
+#pragma omp parallel for schedule(static,1) num_threads(nt)
+#endif
+  for (i=0; i<nt; i++)
+    nl[i+1] = map_lines(cut[i], cut[i+1], end, all, NULL);
+  nl[0] = 0;
+  for (i=0; i<nt; i++)
+    nl[i+1] += nl[i];
+
+  tptr->nr = nl[nt];
+  tptr->lines = (string *) allocate((nl[nt]+1)*sizeof(string));
+#if _OPENMP
+#pragma omp parallel for schedule(static,1) num_threads(nt)
+#endif
+  for (i=0; i<nt; i++)
+    (void) map_lines(cut[i], cut[i+1], end, all, tptr->lines + nl[i]);
+  if (tptr->nr > 0 && end[-1] != '\n') {     /* was it copied by map_lines? */
+    char *last = tptr->lines[tptr->nr-1];
+    if (last < beg || last >= end) tptr->tail = last;
+  }
+  dprintf(1,"table_open: mapped %ld bytes, %d lines, %d chunks\n",
+	  (long)(end-beg), tptr->nr, nt);
+  free(cut);
+  free(nl);
+  return TRUE;
+}
+
+
+/*
+ * Numbers in the rows are parsed by fast_atof(), which gives the same
+ * (correctly rounded) value as atof/strtod, without looking at the locale.
+ * Plain decimal numbers with at most 19 digits and a power of ten up to
+ * 22 are done in one exact multiply or divide; the others, and things
+ * like "inf" or hex numbers, are left to strtod().
+ */
+
+#define MINROW  10000     /* fewer rows are not worth starting threads */
+
+/*
+ * BAD_ROW: remember the first row with too few columns; rows are parsed
+ * in parallel, where error() cannot be called, so callers report it after
+ */
+
+local void bad_row(long *bad, long row)
+{
+#if _OPENMP
+#pragma omp critical(table_bad_row)
+#endif
+  if (*bad == 0 || row < *bad)
+    *bad = row;
+}
+#define ISSEP(c)  ((c)==' ' || (c)==',' || (c)=='\t')   /* as table_rowsp */
+
+local double pow10tab[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+local double fast_atof(char *s, char **endp)
+{
+  unsigned long long m = 0;
+  int nd = 0, e = 0, x = 0;
+  bool neg = FALSE, xneg = FALSE;
+  char *p = s, *q;
+  double v;
+
+  if (*p == '-' || *p == '+') neg = (*p++ == '-');
+  q = p;
+  while (*p == '0') p++;                    /* leading zeros don't count */
+  for (; isdigit(*p); p++, nd++)
+    m = 10*m + (*p - '0');
+  if (*p == '.') {
+    p++;
+    if (nd == 0)
+      for (; *p == '0'; p++) e--;
+    for (; isdigit(*p); p++, nd++, e--)
+      m = 10*m + (*p - '0');
+  }
+  if (p == q || (p == q+1 && *q == '.')) nd = 99;   /* no digits at all */
+  if (*p == 'e' || *p == 'E') {
+    q = p++;
+    if (*p == '-' || *p == '+') xneg = (*p++ == '-');
+    if (!isdigit(*p))
+      nd = 99;
+    for (; isdigit(*p) && x < 10000; p++)
+      x = 10*x + (*p - '0');
+    if (isdigit(*p)) nd = 99;
+    e += xneg ? -x : x;
+  }
+  if (nd > 19 || m > (1ULL<<53) || e < -22 || e > 22 || *p == 'x' || *p == 'X'
+      || isalpha(*p) || *p == '.')
+    return strtod(s, endp);
+  v = (e < 0) ? (double)m / pow10tab[-e] : (double)m * pow10tab[e];
+  if (endp) *endp = p;
+  return neg ? -v : v;
+}
+
+/* SPLIT_ROW: count the words in a line, store the first ntok of them */
+
+local int split_row(char *line, int ntok, char **tok)
+{
+  int n = 0;
+  char *cp = line;
+
+  for (;;) {
+    while (ISSEP(*cp)) cp++;
+    if (*cp == '\0') break;
+    if (n < ntok) tok[n] = cp;
+    n++;
+    while (*cp && !ISSEP(*cp)) cp++;
+  }
+  return n;
+}
+
+/*
+ * TABLE_PARSE: parse the numbers of a line with fast_atof() into val[],
+ * returning how many, or -1 if there are more than nmax, or if one is not
+ * a plain number (e.g. an expression that nemoinp would understand).
+ */
+
+int table_parse(string line, real *val, int nmax)
+{
+  int n = 0;
+  char *cp = line, *ep;
+
+  for (;;) {
+    while (ISSEP(*cp)) cp++;
+    if (*cp == '\0') return n;
+    if (n == nmax) return -1;
+    val[n++] = fast_atof(cp, &ep);
+    if (ep == cp || (*ep && !ISSEP(*ep))) return -1;
+    cp = ep;
+  }
+}
+
+/*
+ * TABLE_PARSE_COLS: parse the ncol columns cols[] (1 is the first) of a
+ * line into val[], the way table_md2cr does, and return the number of words
+ * in the line; columns beyond that are left alone.
+ */
+
+int table_parse_cols(string line, int ncol, int *cols, real *val)
+{
+  char *tok[256], **tp = tok;
+  int j, n, maxtok = 0;
+
+  for (j=0; j<ncol; j++)
+    maxtok = MAX(maxtok, cols[j]);
+  if (maxtok > 256) tp = (char **) allocate(maxtok*sizeof(char *));
+  n = split_row(line, maxtok, tp);
+  for (j=0; j<ncol; j++)
+    if (cols[j] > 0 && cols[j] <= n)
+      val[j] = fast_atof(tp[cols[j]-1], NULL);
+  if (tp != tok) free(tp);
+  return n;
+}
+
+
+/*
+ * Column cache: the parsed columns of a mapped (mode=2) table can be kept
+ * in a sidecar file, named after the table with CacheExt appended.  After
+ * a header with the size, inode and mtime (in ns) of the table, each column
+ * has a type (int, float or double: the smallest that holds all its values
+ * exactly) and the offset of its data.  The file is mapped, so only the
+ * columns asked for are read.  A valid sidecar is always used, and the table
+ * itself is then only read when its lines are asked for; a sidecar is written
+ * by table_md2cr only when $NEMOTABCACHE is set (and not 0).  Failure to
+ * write it (e.g. a read-only directory) is not fatal.  A file system that
+ * only keeps whole seconds cannot tell a table rewritten within the same
+ * second, so there is no sidecar for a table without a sub-second mtime.
+ */
+
+#define CacheExt      ".nemotab"
+#define CacheMagic    "NEMOTAB"
+#define CacheVersion  2
+
+#define CacheInt      1
+#define CacheFloat    2
+#define CacheDouble   3
+
+typedef struct {
+  char    magic[8];
+  int32_t version, ncol;
+  int64_t nrow, nextra;         // rows, and rows that had extra columns
+  int64_t size, ino;            // of the table
+  int64_t mtime, mtimens;
+} cachehead;
+
+typedef struct {
+  int32_t type, unused;
+  int64_t data;                 // offset in the file
+} cachecol;
+
+#if defined(__APPLE__)
+#define MTIME_NS(st)  ((st)->st_mtimespec.tv_nsec)
+#else
+#define MTIME_NS(st)  ((st)->st_mtim.tv_nsec)
+#endif
+
+#define ALIGN8(n)  (((n)+7) & ~(int64_t)7)
+
+local int64_t cache_bytes(int type, int64_t n)
+{
+  return type==CacheInt ? n*sizeof(int32_t) : type==CacheFloat ? n*sizeof(float) : n*sizeof(double);
+}
+
+/* CACHE_NAME: the sidecar of the table, if it is a regular file read from the start */
+
+local bool cache_name(tableptr tptr, char *cname, struct stat *st)
+{
+  string name = strname(tptr->str);
+
+  if (name == NULL || streq(name,"-") || strlen(name) + strlen(CacheExt) >= MAX_LINELEN)
+    return FALSE;
+  if (fstat(fileno(tptr->str), st) < 0 || !S_ISREG(st->st_mode) || ftello(tptr->str) != 0)
+    return FALSE;
+  if (MTIME_NS(st) == 0) {               // whole seconds: a rewrite may go unnoticed
+    dprintf(1,"table: %s has no sub-second mtime, no sidecar\n", name);
+    return FALSE;
+  }
+  sprintf(cname, "%s%s", name, CacheExt);
+  return TRUE;
+}
+
+/* READ_CACHE: map a valid sidecar, and take the table size from it */
+
+local bool read_cache(tableptr tptr, string cname, struct stat *st)
+{
+  struct stat cst;
+  cachehead *h;
+  cachecol *c;
+  char *map;
+  int fd, j;
+
+  if ((fd = open(cname, O_RDONLY)) < 0) return FALSE;
+  if (fstat(fd, &cst) < 0 || cst.st_size < sizeof(cachehead) ||
+      (map = mmap(NULL, cst.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return FALSE;
+  }
+  close(fd);
+  h = (cachehead *) map;
+  c = (cachecol *) (h+1);
+  if (strncmp(h->magic, CacheMagic, sizeof(h->magic)) != 0 || h->version != CacheVersion ||
+      h->size != (int64_t) st->st_size || h->ino != (int64_t) st->st_ino ||
+      h->mtime != (int64_t) st->st_mtime || h->mtimens != (int64_t) MTIME_NS(st) ||
+      h->ncol < 0 || h->nrow < 0 ||
+      sizeof(cachehead) + h->ncol*sizeof(cachecol) > cst.st_size) {
+    dprintf(1,"table_open: %s is stale, ignored\n", cname);
+    munmap(map, cst.st_size);
+    return FALSE;
+  }
+  for (j=0; j<h->ncol; j++)
+    if (c[j].type < CacheInt || c[j].type > CacheDouble || c[j].data < 0 ||
+	c[j].data + cache_bytes(c[j].type, h->nrow) > cst.st_size) {
+      warning("table_open: %s is corrupt, ignored", cname);
+      munmap(map, cst.st_size);
+      return FALSE;
+    }
+  tptr->cache = map;
+  tptr->cachesize = cst.st_size;
+  tptr->nr = h->nrow;
+  tptr->nc = h->ncol;
+  dprintf(1,"table_open: using %s, %d x %d\n", cname, tptr->nr, tptr->nc);
+  return TRUE;
+}
+
+/* CACHE_TYPE: the smallest type that holds all n values exactly */
+
+local int cache_type(real *x, size_t n)
+{
+  size_t i;
+  bool isint = TRUE;
+
+  for (i=0; i<n && isint; i++)
+    isint = (x[i] >= INT32_MIN && x[i] <= INT32_MAX && x[i] == (int32_t) x[i] &&
+	     !(x[i] == 0 && signbit(x[i])));
+  if (isint) return CacheInt;
+  for (i=0; i<n; i++)
+    if ((double)(float) x[i] != x[i]) return CacheDouble;
+  return CacheFloat;
+}
+
+/* WRITE_CACHE: write the sidecar for all columns a[nc][nr], atomically via a rename */
+
+local void write_cache(tableptr tptr, mdarray2 a, int nextra)
+{
+  char cname[MAX_LINELEN], tname[MAX_LINELEN+32], zero[8] = {0}, *buf = NULL;
+  struct stat st;
+  cachehead h;
+  cachecol *c;
+  int64_t off, n, nr = tptr->nr;
+  int j, nc = tptr->nc;
+  size_t i;
+  bool ok;
+  FILE *fp;
+
+  if (nc == 0 || nr == 0 || !cache_name(tptr, cname, &st)) return;
+  sprintf(tname, "%s.%d", cname, (int) getpid());
+  if ((fp = fopen(tname, "w")) == NULL) {
+    dprintf(1,"table_md2cr: cannot write %s\n", tname);
+    return;
+  }
+  memset(&h, 0, sizeof(h));
+  strcpy(h.magic, CacheMagic);
+  h.version = CacheVersion;
+  h.ncol    = nc;
+  h.nrow    = nr;
+  h.nextra  = nextra;
+  h.size    = st.st_size;
+  h.ino     = st.st_ino;
+  h.mtime   = st.st_mtime;
+  h.mtimens = MTIME_NS(&st);
+  c = (cachecol *) allocate((nc+1)*sizeof(cachecol));
+  off = ALIGN8(sizeof(h) + nc*sizeof(cachecol));
+  for (j=0; j<nc; j++) {
+    c[j].type  = cache_type(a[j], nr);
+    c[j].data  = off;
+    off = ALIGN8(off + cache_bytes(c[j].type, nr));
+  }
+  ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+       fwrite(c, sizeof(cachecol), nc, fp) == (size_t) nc;
+  n = c[0].data - (sizeof(h) + nc*sizeof(cachecol));
+  ok = ok && fwrite(zero, 1, n, fp) == (size_t) n;
+  buf  = (char *) allocate(cache_bytes(CacheDouble, nr)+8);
+  for (j=0; j<nc && ok; j++) {
+    if (c[j].type == CacheInt)
+      for (i=0; i<nr; i++) ((int32_t *)buf)[i] = (int32_t) a[j][i];
+    else if (c[j].type == CacheFloat)
+      for (i=0; i<nr; i++) ((float *)buf)[i] = (float) a[j][i];
+    else
+      for (i=0; i<nr; i++) ((double *)buf)[i] = a[j][i];
+    n = cache_bytes(c[j].type, nr);
+    memset(buf+n, 0, ALIGN8(n)-n);
+    ok = fwrite(buf, 1, ALIGN8(n), fp) == (size_t) ALIGN8(n);   // buf has room for the padding
+  }
+  free(buf);
+  free(c);
+  if (fclose(fp) != 0) ok = FALSE;               // a full disk may only show here
+  if (!ok || rename(tname, cname) != 0) {
+    warning("table_md2cr: failed to create %s", cname);
+    unlink(tname);
+    return;
+  }
+  dprintf(1,"table_md2cr: wrote %s, %d x %d\n", cname, nr, nc);
+}
+
+/* CACHE_MD2CR: the a[col][row] array, converted from the sidecar */
+
+local void cache_md2cr(tableptr tptr, int nc, int *idx, int nr, mdarray2 a)
+{
+  cachehead *h = (cachehead *) tptr->cache;
+  cachecol *c = (cachecol *) (h+1), *cj;
+  char *data;
+  int i, j;
+
+  for (j=0; j<nc; j++) {
+    if (idx[j] < 0) {
+      for (i=0; i<nr; i++) a[j][i] = i+1;
+      continue;
+    }
+    cj = &c[idx[j]];
+    data = tptr->cache + cj->data;
+#if _OPENMP
+#pragma omp parallel for schedule(static) if (nr > MINROW)
+#endif
+    for (i=0; i<nr; i++)
+      a[j][i] = cj->type == CacheInt   ? ((int32_t *)data)[i] :
+	        cj->type == CacheFloat ? ((float *)data)[i] : ((double *)data)[i];
+  }
+  if (h->nextra)
+    warning("ignoring extra column(s) in %d rows", (int) h->nextra);
+}
+
+/* NEED_LINES: a table opened from its sidecar maps its lines only when asked */
+
+local void need_lines(tableptr tptr)
+{
+  size_t nr = tptr->nr;
+
+  if (tptr->lines) return;
+  if (!map_table(tptr, FALSE) || tptr->nr != nr)
+    error("table: cannot read the lines of the table again");
+}
+
+
 table *table_open(stream instr, int mode)
 {
   tableptr tptr = (tableptr) allocate(sizeof(table));
@@ -216,9 +719,32 @@ table *table_open(stream instr, int mode)
   tptr->nc      = 0;
   tptr->linelen = 0;
   tptr->line    = NULL;
+  tptr->map     = NULL;
+  tptr->mapsize = 0;
+  tptr->tail    = NULL;
+  tptr->next    = 0;
+  tptr->cache   = NULL;
+  tptr->cname   = NULL;
   dprintf(1,"table_open - got %d chars allocated at the start\n", tptr->linelen);
 
-  if (mode <= 0) {   //  read table in memory, also separate header (comments) from body of table
+  if (mode == 2) {        //  a valid sidecar cache, or else perhaps write one later
+    char cname[MAX_LINELEN];
+    struct stat st;
+    string env = getenv("NEMOTABCACHE");
+    if (cache_name(tptr, cname, &st)) {
+      if (read_cache(tptr, cname, &st))
+	return tptr;
+      if (env != NULL && *env && !streq(env,"0"))
+	tptr->cname = scopy(cname);
+    }
+  }
+
+  if (ABS(mode) == 2 && !map_table(tptr, mode < 0)) {   //  else read in memory
+    dprintf(1,"table_open: cannot map, reading lines\n");
+    mode = tptr->mode = (mode < 0 ? -1 : 0);
+  }
+
+  if (mode <= 0 && mode != -2) {   //  read table in memory, also separate header (comments) from body of table
     // note:    mode<0 treats all lines the same
     //          mode=0 should split comments out @todo
     dprintf(1,"linked list reading of table\n");
@@ -234,7 +760,7 @@ table *table_open(stream instr, int mode)
       line = table_line(tptr);
       if (line == NULL)
 	break;
-      if (iscomment(line)) {
+      if (mode == 0 && iscomment(line)) {
 	// for now, skip them
 	continue;
       }
@@ -298,13 +824,11 @@ size_t table_nrows(tableptr tptr)
 
 size_t table_ncols(tableptr tptr)
 {
-  // if tptr->nr > 0 and nc==0, force to read a line in mode=0 and set nc
+  // if tptr->nr > 0 and nc==0, count the words of the first line to set nc
   if (tptr->nr > 0 && tptr->nc == 0) {
-    if (tptr->mode == 0) {
-      string *sp = table_rowsp(tptr,0);
+    if (tptr->mode == 0 || ABS(tptr->mode) == 2) {
+      tptr->nc = split_row(tptr->lines[0], 0, NULL);
       dprintf(1,"table_ncols: processed first line to get nc -> %d\n",tptr->nc);
-      tptr->nc = xstrlen(sp,sizeof(string)) - 1;
-      // free
     } else {
       warning("mode=1 ... does not have ncols yet");
     }
@@ -324,6 +848,19 @@ void table_close(tableptr tptr)
   // free that memory
   free(tptr->line);
   tptr->linelen = 0;
+  if (tptr->cache) {
+    munmap(tptr->cache, tptr->cachesize);
+    tptr->cache = NULL;
+  }
+  if (tptr->map) {
+    munmap(tptr->map, tptr->mapsize);
+    if (tptr->tail) free(tptr->tail);
+    tptr->tail = NULL;
+    free(tptr->lines);
+    tptr->map = NULL;
+    tptr->lines = NULL;
+    tptr->nr = 0;
+  }
   // @todo - free more
 }
 
@@ -333,6 +870,10 @@ void table_close(tableptr tptr)
  */
 string table_line(tableptr tptr)
 {
+  if (ABS(tptr->mode) == 2) {        // mapped: the next of the lines
+    need_lines(tptr);
+    return tptr->next < tptr->nr ? tptr->lines[tptr->next++] : NULL;
+  }
   ssize_t ret = getline(&(tptr->line), &(tptr->linelen), tptr->str);
   if (ret >= 0) {
     if (ret > 0) sanitize(tptr->line);
@@ -342,6 +883,95 @@ string table_line(tableptr tptr)
   return NULL;
 }
 
+/*
+ * TABLE_LINES: read the next (at most) nmax data lines of a streaming
+ * (mode=1) table into lines[], skipping comments, and return how many.
+ * lines[] must start out as NULLs; its strings are reused by the next call.
+ */
+int table_lines(tableptr tptr, int nmax, string *lines)
+{
+  string line;
+  int n = 0;
+
+  while (n < nmax && (line = table_line(tptr)) != NULL) {
+    if (iscomment(line)) continue;
+    if (lines[n]) free(lines[n]);
+    lines[n++] = strdup(line);
+  }
+  return n;
+}
+
+/*
+ * TABLE_STREAM: read the rest of a streaming (mode=1) table a chunk of
+ * lines at a time, and parse the ncol columns cols[] (1 is the first, 0 the
+ * row number) of the lines over the np= threads; accum(arg,thread,row,val)
+ * is then called for each line, by thread 0..nthread-1.  First, with the
+ * number of columns of the first line, setup(arg,nc,nthread) is called,
+ * which may still change ncol and cols[].  Returns 0, or the first row
+ * with fewer columns than the first line, after which nothing more is
+ * read.  nrow gets the number of rows read.
+ */
+
+#define TABCHUNK 65536    /* lines read at a time */
+
+long table_stream(tableptr tptr, int *ncol, int *cols,
+		  table_setup setup, table_accum accum, void *arg, long *nrow)
+{
+  string *lines = (string *) allocate(TABCHUNK*sizeof(string));
+  real *val = NULL;
+  long bad = 0, nr = 0;
+  int i, j, n, nc = -1, nt = 1, nextra = 0;
+
+#if _OPENMP
+  nt = omp_get_max_threads();
+#endif
+  while (bad == 0 && (n = table_lines(tptr, TABCHUNK, lines)) > 0) {
+    if (nc < 0) {                          // first line: the number of columns
+      nc = table_parse_cols(lines[0], 0, NULL, NULL);
+      if (setup) (*setup)(arg, nc, nt);
+      for (j=0; j<*ncol; j++) {
+	if (cols[j] < 0)  error("illegal column reference %d < 0", cols[j]);
+	if (cols[j] > nc) error("illegal column reference %d > %d", cols[j], nc);
+      }
+      val = (real *) allocate((nt * *ncol + 1)*sizeof(real));
+    }
+#if _OPENMP
+#pragma omp parallel private(i,j) num_threads(nt)
+#endif
+    {
+      int t = 0, nw;
+      real *v;
+#if _OPENMP
+      t = omp_get_thread_num();
+#endif
+      v = val + t * *ncol;
+#if _OPENMP
+#pragma omp for schedule(static) reduction(+:nextra)
+#endif
+      for (i=0; i<n; i++) {
+	nw = table_parse_cols(lines[i], *ncol, cols, v);
+	if (nw < nc) {
+	  bad_row(&bad, nr+i+1);
+	  continue;
+	}
+	if (nw > nc) nextra++;
+	for (j=0; j<*ncol; j++)
+	  if (cols[j] == 0) v[j] = nr+i+1;
+	(*accum)(arg, t, nr+i+1, v);
+      }
+    }
+    nr += n;
+  }
+  if (nextra && !bad)
+    warning("ignoring extra column(s) in %d rows", nextra);
+  for (i=0; i<TABCHUNK && lines[i]; i++)
+    free(lines[i]);
+  free(lines);
+  if (val) free(val);
+  if (nrow) *nrow = nr;
+  return bad;
+}
+
 table *table_cat(table* t1, table* t2, int mode)
 {
   tableptr tptr = (tableptr) allocate(sizeof(table));
@@ -418,6 +1048,7 @@ ssize_t table_line1(tableptr tptr, char **line, size_t *linelen, int newline)
 
 string table_row(tableptr tptr, int row)
 {
+  need_lines(tptr);
   return tptr->lines[row];
 }
 
@@ -430,6 +1061,7 @@ typedef struct lls {
 // return list of zero terminated (extstring) pointers to the words in a row
 string *table_rowsp(table *t, int row)
 {
+  need_lines(t);
   char *line = strdup(t->lines[row]);
   int ntok = 0;
   char *token = strtok(line," ,\t");
@@ -496,6 +1128,7 @@ mdarray2 table_md2rc(table *t, int nrow, int *rows, int ncol, int *cols)
   int nr = table_nrows(t);
   int nc = table_ncols(t);
   dprintf(1,"table_md2rc: table %d x %d \n",nr,nc);
+  need_lines(t);
   dprintf(1,"table_md2rc: data2 ncol=%d nrow=%d\n",ncol,nrow);
   mdarray2 a = allocate_mdarray2(nr,nc);    // a[nr][nc]
   int i,j;
@@ -512,12 +1145,54 @@ mdarray2 table_md2rc(table *t, int nrow, int *rows, int ncol, int *cols)
   return a;
 }
 
+// split the rows, and parse the n columns idx[] (0 is the first, <0 the row number)
+// into a[n][nr]; returns the number of rows with extra columns
+local int parse_rows(table *t, int nr, int n, int *idx, mdarray2 a)
+{
+  int i, j, maxtok = 0, nextra = 0;
+  long bad = 0;
+
+  need_lines(t);
+  for (j=0; j<n; j++)
+    maxtok = MAX(maxtok, idx[j]+1);
+#if _OPENMP
+#pragma omp parallel private(i,j) if (nr > MINROW)
+#endif
+  {
+    char **tok = (char **) allocate((maxtok+1)*sizeof(char *));
+    int ntok;
+#if _OPENMP
+#pragma omp for schedule(static) reduction(+:nextra)
+#endif
+    for (i=0; i<nr; i++) {
+      ntok = split_row(t->lines[i], maxtok, tok);
+      if (ntok < t->nc) {
+	bad_row(&bad, i+1);
+	continue;
+      }
+      if (ntok > t->nc) nextra++;
+      for (j=0; j<n; j++) {
+	if (idx[j] < 0)
+	  a[j][i] = i+1;
+	else
+	  a[j][i] = fast_atof(tok[idx[j]], NULL);
+      }
+    }
+    free(tok);
+  }
+  if (bad)
+    error("too few columns in row %ld, expected %d",bad,t->nc);
+  return nextra;
+}
+
 // return a data[col][row] based table
 // this is the more practical
 // note column 0 has a special meaning, it's the row number
+// the rows are split and parsed in parallel, see fast_atof(), or
+// taken from the sidecar cache
 mdarray2 table_md2cr(table *t, int ncol, int *cols, int nrow, int *rows)
 {
-  int i,j,jidx;
+  int i,j,jidx,nextra=0;
   int nr = table_nrows(t);
   int nc = table_ncols(t);
   dprintf(1,"table_md2cr: table %d x %d \n",nr,nc);
@@ -533,19 +1208,33 @@ mdarray2 table_md2cr(table *t, int ncol, int *cols, int nrow, int *rows)
   if (ncol>0) nc=ncol;
   if (nrow>0) nr=nrow;   // not supported yet  
   mdarray2 a = allocate_mdarray2(nc,nr);                  // a[nc][nr]
-
-  for (i=0; i<nr; i++) {
-    string s = table_row(t,i);
-    dprintf(1,"%d: %s\n",i,s);
-    string *sp = table_rowsp(t,i);
+  int *idx = (int *) allocate((nc+1)*sizeof(int));
+  for (j=0; j<nc; j++)
+    idx[j] = (ncol == 0 ?  j  :  cols[j]-1);
+
+  if (t->cache)                    // from the sidecar
+    cache_md2cr(t, nc, idx, nr, a);
+  else if (t->cname && nr == t->nr) {   // parse all columns, and write the sidecar
+    int nall = t->nc;
+    int *all = (int *) allocate((nall+1)*sizeof(int));
+    mdarray2 b = allocate_mdarray2(nall,nr);
+    for (j=0; j<nall; j++)
+      all[j] = j;
+    nextra = parse_rows(t, nr, nall, all, b);
+    write_cache(t, b, nextra);
     for (j=0; j<nc; j++) {
-      jidx = (ncol == 0 ?  j  :  cols[j]-1);
-      if (jidx < 0)
-	a[j][i] = i+1;
+      if (idx[j] < 0)
+	for (i=0; i<nr; i++) a[j][i] = i+1;
       else
-	a[j][i] = atof(sp[jidx]);
+	memcpy(a[j], b[idx[j]], nr*sizeof(real));
     }
-  }
+    free(all);
+    free_mdarray2(b,nall,nr);
+  } else
+    nextra = parse_rows(t, nr, nc, idx, a);
+  if (nextra)
+    warning("ignoring extra column(s) in %d rows", nextra);
+  free(idx);
 
   return a;
 }
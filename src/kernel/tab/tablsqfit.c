@@ -44,6 +44,7 @@
  *      21-nov-05  V3.4c added gauss2d
  *      16-feb-13  V3.5  added fit=slope from miriad::immerge
  *      28-may-13   4.0e fixed bug in fit=peak value
+ *      18-oct-26   4.1  fit=poly,plane: design matrix in tiles (lsq_block), added qr=
  *
  * TODO:   check 'r', wip gives slightly different numbers
  */
@@ -106,7 +107,8 @@ string defv[] = {
     "nmax=10000\n       Default max allocation",
     "mpfit=0\n          fit mode for mpfit",
     "tab=f\n            short one-line output?",
-    "VERSION=4.0e\n     28-may-2013 PJT",
+    "qr=f\n             fit=poly,plane: solve by QR instead of normal equations?",
+    "VERSION=4.1\n      18-oct-2026 PJT",
     NULL
 };
 
@@ -151,6 +153,9 @@ int order;
 int mpfit_mode;
 
 bool Qtab;                  /* do table output ? */
+bool Qqr;                   /* QR instead of normal equations for poly/plane */
+
+#define NTILE  65536        /* rows of the design matrix at a time */
 
 
 /****************************** START OF PROGRAM **********************/
@@ -211,6 +216,7 @@ void setparams()
     order = getiparam("order");
     if (order<0) error("order=%d of %s cannot be negative",order,method);
     Qtab = getbparam("tab");
+    Qqr = getbparam("qr");
 
     mpfit_mode = getiparam("mpfit");
 }
@@ -836,26 +842,44 @@ void do_imageshift()
 
 void my_poly(bool Qpoly)
 { 
-  real mat[(MAXCOL+1)*(MAXCOL+1)], vec[MAXCOL+1], sol[MAXCOL+1], a[MAXCOL+2], sum;
-  int i, j;
+  real mat[(MAXCOL+1)*(MAXCOL+1)], vec[MAXCOL+1], sol[MAXCOL+1], r[(MAXCOL+2)*(MAXCOL+2)];
+  real *a, *ai, sum;
+  int i, j, k, m, n1 = order+2;
 
   if (nycol<1) error("Need 1 value for ycol=");
   if (nxcol<order && !Qpoly) error("Need %d value(s) for xcol=",order);
+  if (order>MAXCOL) error("order=%d too large, max %d",order,MAXCOL);
 
-  lsq_zero(order+1, mat, vec);
-  for (i=0; i<npt; i++) {
-    a[0] = 1.0;
-    for (j=0; j<order; j++) {
-      if (Qpoly)
-	a[j+1] = a[j] * xcol[0].dat[i];     /* polynomial */
-      else
-	a[j+1] = xcol[j].dat[i];            /* plane */
+  a = (real *) allocate(NTILE*n1*sizeof(real));
+  if (Qqr)
+    lsq_qr_zero(order+1, r);
+  else
+    lsq_zero(order+1, mat, vec);
+  for (k=0; k<npt; k+=NTILE) {
+    m = MIN(NTILE, npt-k);
+    for (i=0; i<m; i++) {
+      ai = a + i*n1;
+      ai[0] = 1.0;
+      for (j=0; j<order; j++) {
+	if (Qpoly)
+	  ai[j+1] = ai[j] * xcol[0].dat[k+i];     /* polynomial */
+	else
+	  ai[j+1] = xcol[j].dat[k+i];             /* plane */
+      }
+      ai[order+1] = ycol[0].dat[k+i];
     }
-    a[order+1] = ycol[0].dat[i];
-    lsq_accum(order+1,mat,vec,a,1.0);
+    if (Qqr)
+      lsq_qr_block(order+1,r,m,a,NULL);
+    else
+      lsq_block(order+1,mat,vec,m,a,NULL);
+  }
+  free(a);
+  if (Qqr)
+    lsq_qr_solve(order+1,r,sol);
+  else {
+    if (order==0) printf("TEST = %g %g\n",mat[0], vec[0]);
+    lsq_solve(order+1,mat,vec,sol);
   }
-  if (order==0) printf("TEST = %g %g\n",mat[0], vec[0]);
-  lsq_solve(order+1,mat,vec,sol);
   printf("%s fit of order %d:\n", Qpoly ? "Polynomial" : "Planar" , order);
   for (j=0; j<=order; j++) printf("%g ",sol[j]);
   printf("\n");
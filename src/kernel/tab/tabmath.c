@@ -34,6 +34,10 @@
  *      31-dec-03  V3.4  added colname=
  *       1-jan-04     a  changed interface to get_line
  *      25-apr-22  V4.0  conversion to table V2 I/O
+ *      18-oct-26  V4.1  rows are evaluated in chunks, a column at a time,
+ *                       using fie contexts instead of savefie/loadfie
+ *                  b    all expressions compiled together (newfies)
+ *                  c    files are mapped, numbers parsed with table_parse
  *
  */
 
@@ -44,7 +48,9 @@
 #include <getparam.h>
 #include <table.h>
 #include <extstring.h>
+#include <strlib.h>
 #include <ctype.h>
+#include <fie.h>
 
 /**************** COMMAND LINE PARAMETERS **********************/
 
@@ -60,7 +66,7 @@ string defv[] = {                /* DEFAULT INPUT PARAMETERS */
     "colname=\n         (unchecked) commented column names to add into output",
     "comments=f\n       Pass through comments?",
     "refie=f\n          Re-FIE each output column (not used)",
-    "VERSION=4.0\n      25-apr-2022 PJT",
+    "VERSION=4.1c\n     18-oct-2026 PJT",
     NULL
 };
 
@@ -80,37 +86,60 @@ string fmt;                             /* format of new column */
 #define MAXCOL          256             /* MAXIMUM number of columns */
 #define MLINELEN       8196		/* linelength of catenated */
 #define MNEWDAT          80		/* space needed for one number */
+#define MAXROWS        8192		/* rows evaluated in one chunk */
 
 bool   keepc[MAXCOL+1];                 /* columns to keep (t/f) */
 int    ndelc;                           /* actual number of skip columns */
 
 string *fies, selfie;                   /* fie pointers */
 int    nfies;                           /* number of fie pointers */
-bool   Qfie;				/* boolean if multiple fie's loaded */
+fieptr *fptr, selptr = NULL;            /* their compiled versions */
+string *allfies;                        /* newcol= and selfie= together */
+int    nall;                            /* their number */
+fieptr allptr = NULL;                   /* and compiled for rowval columns */
+int    maxpar = 0;                      /* highest %n used by any of them */
 bool   Qrefie;                          /* recompute each columns via fie ? */
 string *colname=NULL;                   /* names of columns */
 
 bool   Qcomment;
 
+/*
+ * Data rows are buffered, and the expressions evaluated a whole column
+ * at a time (see flush_rows), which also allows evalfie to spread the
+ * work over the np= threads.  All rows in the buffer have the same
+ * number of columns.
+ */
+
+int    maxrows;                         /* rows per chunk (1 .. MAXROWS) */
+int    nrows = 0;                       /* rows in the buffer */
+int    rowval;                          /* their number of columns */
+string rowline[MAXROWS];                /* their text */
+real   *rowdat;                         /* their values [nrows][rowval] */
+real   *coldat;                         /* same, plus new columns, by column */
+real   *rownew;                         /* new columns [nrows][nfies] */
+real   *rowsel;                         /* selfie= results */
+real   *resbuf;                         /* results [nall][nrows] */
+real   *carry;                          /* all columns of the last row done */
+
 local void setparams(void);
 local void convert(int, tableptr *, stream);
+local void flush_rows(stream);
+local void eval_rows(int, int, int);
+local void put_line(stream, string, int);
 local string *burstfie(string);
 local void tab2space(char *);
 
 extern  string *burststring(string, string);
-extern  int inifie(string);
-extern void dofie(real *, int *, real *, real *);
-extern void dmpfie(void);
-extern int savefie(int);
-extern int loadfie(int);
 
 /****************************** START OF PROGRAM **********************/
 
 void nemo_main(void)
 {
     setparams();
-    for (int i=0; i<ninput; i++)  // open files in line-by-line access
-      tptr[i] = table_open(stropen(inputs[i],"r"), 1);
+    for (int i=0; i<ninput; i++) { // mapped with all lines, or a pipe line-by-line
+      stream instr = stropen(inputs[i],"r");
+      tptr[i] = table_open(instr, ispipe(instr) ? 1 : -2);
+    }
     outstr = stropen (output,"w");
     convert(ninput,tptr,outstr);
 }
@@ -147,19 +176,32 @@ local void setparams(void)
     fies = burstfie(newcol);
     nfies = xstrlen(fies,sizeof(string)) - 1;
     if(nfies)dprintf(1,"%d functions to parse\n",nfies);
+    fptr = (fieptr *) allocate((nfies+1)*sizeof(fieptr));
     for (i=0; i<nfies; i++) {
-	dprintf(1,"Saving: %s\n",fies[i]);
-        inifie(fies[i]);
-        if (savefie(i+1) < 0) error("Could not save fie[%d]: %s\n",i,fies[i]);
-	if(nemo_debug(1)) dmpfie();
+	dprintf(1,"Compiling: %s\n",fies[i]);
+        fptr[i] = newfie(fies[i]);
+        if (fptr[i] == NULL) error("Could not parse fie[%d]: %s",i,fies[i]);
+	if(nemo_debug(1)) dumpfie(fptr[i]);
+        maxpar = MAX(maxpar, fptr[i]->npar);
     }
-    Qfie = nfies > 1;
     selfie = getparam("selfie");
     if (*selfie) {
-        inifie(selfie);
-	if (savefie(nfies+1) < 0) error("Could not save selfie=%s",selfie);
-        Qfie = nfies > 0;
+        selptr = newfie(selfie);
+        if (selptr == NULL) error("Could not parse selfie=%s",selfie);
+        maxpar = MAX(maxpar, selptr->npar);
     }
+    allfies = (string *) allocate((nfies+1)*sizeof(string));
+    for (i=0; i<nfies; i++)
+        allfies[i] = fies[i];
+    if (selptr) allfies[nfies] = selfie;
+    nall = nfies + (selptr ? 1 : 0);
+    maxrows = MAXROWS;
+    rowdat = (real *) allocate(maxrows*MAXCOL*sizeof(real));
+    coldat = (real *) allocate(maxrows*(MAXCOL+nfies+maxpar)*sizeof(real));
+    rownew = (real *) allocate(maxrows*(nfies+1)*sizeof(real));
+    rowsel = (real *) allocate(maxrows*sizeof(real));
+    resbuf = (real *) allocate(maxrows*(nall+1)*sizeof(real));
+    carry  = (real *) allocate((MAXCOL+nfies+maxpar)*sizeof(real));
     init_xrandom(getparam("seed"));
     Qcomment = getbparam("comments");
     if (hasvalue("colname"))
@@ -173,12 +215,8 @@ local void convert(int ninput, tableptr *tptr, stream outstr)
 {
     char   line[MLINELEN];          /* input linelength */
     real   dval[MAXCOL];            /* number of items (values on line) */
-    real   retval;
-    char   newdat[MNEWDAT];         /* to store new column in ascii */
-    int    nval, i, nlines, one=1;
-    string *outv;                   /* pointer to vector of strings to write */
-    char   *cp, *seps=", \t";       /* column separators  */
-    real   errval=0.0;
+    int    nval = 0, i, nlines;
+    char   *cp;
 
     if (colname) {
       nval = xstrlen(colname,sizeof(string))-1;
@@ -193,7 +231,10 @@ local void convert(int ninput, tableptr *tptr, stream outstr)
 
         for(i=0; i<ninput; i++) {    /* loop over files, append all lines into one */
  	    cp = table_line(tptr[i]);
-	    if (cp==NULL) return;
+	    if (cp==NULL) {
+	      flush_rows(outstr);
+	      return;
+	    }
 	    // figure out a dynamic way to do this, not depending on MLINELEN
 	    if (i==0) strcpy(line,cp);
 	    else {
@@ -201,61 +242,154 @@ local void convert(int ninput, tableptr *tptr, stream outstr)
 	      strcat(line,cp);
 	    }
             if(iscomment(cp)) {
-	      if (Qcomment)
+	      if (Qcomment) {
+		flush_rows(outstr);
 		fprintf(outstr,"%s",cp);
-	      else
+	      } else
 		continue;	               	  /* don't use comment lines */
 	    }
         }
         dprintf(3,"LINE[%d]: (%s)\n",nlines,line);
         if (iscomment(line)) {
-	  if (Qcomment)
+	  if (Qcomment) {
+	    flush_rows(outstr);
 	    fprintf(outstr,"%s\n",line);
+	  }
 	  continue;
 	}
         nlines++;
         tab2space(line);	          /* work around a Gipsy (?) problem */
         if (nfies>0 || *selfie) {              	/* if a new column requested */
-            nval = nemoinpr(line,dval,MAXCOL);         /* split into numbers */
+            nval = table_parse(line,dval,MAXCOL);      /* split into numbers */
+            if (nval < 0)                              /* or expressions */
+                nval = nemoinpr(line,dval,MAXCOL);
 	    if (nval < 0) error("bad parsing in %s",line);
 	    /* this could contain some NULL's, so how do we measure this ??? */
             dprintf (3,"nval=%d \n",nval);
             if (nval>MAXCOL)
                 error ("Too many numbers: %s",line);
-            for(i=0; i<nfies; i++) {
-                if (Qfie) loadfie(i+1);
-                dofie(dval,&one,&dval[nval+i],&errval);
-                dprintf(3," dofie(%d) -> %g\n",i+1,dval[nval+i]); //BUG
-                strcat(line," ");
-                sprintf(newdat,fmt,dval[nval+i]);
-                dprintf (2,"newdat=%s\n",newdat);
-                strcat(line,newdat);
-            }
+	    if (nrows > 0 && nval != rowval)
+	        flush_rows(outstr);
+	    rowval = nval;
+	    rowline[nrows] = scopy(line);
+	    for (i=0; i<nval; i++)
+	        rowdat[nrows*nval+i] = dval[i];
+	    if (++nrows == maxrows)
+	        flush_rows(outstr);
+        } else
+	    put_line(outstr,line,nval);
+    } /* for(;;) */
+}
+
+/*
+ * FLUSH_ROWS: evaluate the newcol= and selfie= expressions for all
+ * buffered rows, and write the selected rows with their new columns.
+ * A new column can use the ones before it, just as when the rows were
+ * done one by one.  An expression referring to a column that is not
+ * known yet gets its value from the previous row (e.g. newcol=%1+%2 on
+ * a one column table is a running sum), which forces the rows of such
+ * a chunk to be done one at a time.
+ */
+
+local void flush_rows(stream outstr)
+{
+    char   line[MLINELEN];
+    char   newdat[MNEWDAT];         /* to store new column in ascii */
+    int    i, r, ncol = MAX(rowval+nfies, maxpar);
+    bool   Qrow = FALSE;
+
+    if (nrows == 0) return;
+    for (i=0; i<nfies; i++)
+        if (fptr[i]->npar > rowval+i) Qrow = TRUE;
+    if (selptr && selptr->npar > rowval+nfies) Qrow = TRUE;
+    dprintf(2,"flush_rows: %d rows of %d columns%s\n",nrows,rowval,
+	    Qrow ? ", row by row" : "");
+    if (Qrow)
+        for (r=0; r<nrows; r++)
+            eval_rows(r,1,ncol);
+    else
+        eval_rows(0,nrows,ncol);
+
+    for (r=0; r<nrows; r++) {
+        if (selptr && rowsel[r] == 0.0) {            /* row not selected */
+            free(rowline[r]);
+            continue;
         }
-	if (*selfie) {                             /* check if row selected */
-            if (Qfie) loadfie(nfies+1);
-            dofie(dval,&one,&retval,&errval);
-            if (retval == 0.0) continue;            
-            /* ?? but what about this stride business ?? */
-	}
-        if (ndelc==0) {                      /* nothing to skip while output */
-            strcat (line,"\n");     
-            fputs (line,outstr);
-        } else {		           /* something to skip while output */
-            outv = burststring(line,seps);
-            i=0;
-            while (outv[i]) {
-                if (keepc[i+1] && (ndelc>0 || i>=nval)) {
-                    fputs(outv[i],outstr);
-                    fputs(" ",outstr);
-                }
-                i++;
+        strcpy(line,rowline[r]);
+        free(rowline[r]);
+        for (i=0; i<nfies; i++) {
+            strcat(line," ");
+            sprintf(newdat,fmt,rownew[r*nfies+i]);
+            dprintf (3,"newdat=%s\n",newdat);
+            strcat(line,newdat);
+        }
+        put_line(outstr,line,rowval);
+    }
+    nrows = 0;
+}
+
+/*
+ * EVAL_ROWS: evaluate n buffered rows starting at r0.  All expressions
+ * are compiled together (see newfies), so subexpressions they have in
+ * common are only computed once, and %n referring to a new column of
+ * the same row uses its value directly.  The combined code depends on
+ * the number of columns, and is recompiled when that changes.
+ */
+
+local void eval_rows(int r0, int n, int ncol)
+{
+    permanent int nlink = -1;
+    int    i, j, r;
+    real   errval=0.0;
+
+    if (allptr == NULL || nlink != rowval) {
+        if (allptr) freefie(allptr);
+        nlink = rowval;
+        allptr = newfies(allfies, nall, nlink);
+        if (allptr == NULL) error("Could not parse the expressions");
+        dprintf(1,"%d expressions for %d columns: %d operations\n",
+		nall,nlink,allptr->nnode);
+        if (nemo_debug(2)) dumpfie(allptr);
+    }
+    for (j=0; j<ncol; j++)                        /* transpose */
+        for (r=0; r<n; r++)
+            coldat[r+n*j] = (j < rowval ? rowdat[(r0+r)*rowval+j] : carry[j]);
+    evalfie(allptr, coldat, n, resbuf, errval);
+    for (i=0; i<nfies; i++)
+        for (r=0; r<n; r++)
+            rownew[(r0+r)*nfies+i] = resbuf[i*n+r];
+    if (selptr)
+        for (r=0; r<n; r++)
+            rowsel[r0+r] = resbuf[nfies*n+r];
+    for (j=0; j<rowval; j++)
+        carry[j] = coldat[n-1+n*j];
+    for (i=0; i<nfies; i++)
+        carry[rowval+i] = resbuf[i*n+n-1];
+}
+
+local void put_line(stream outstr, string line, int nval)
+{
+    string *outv;                   /* pointer to vector of strings to write */
+    char   *seps=", \t";            /* column separators  */
+    int    i;
+
+    if (ndelc==0) {                      /* nothing to skip while output */
+        strcat (line,"\n");     
+        fputs (line,outstr);
+    } else {		           /* something to skip while output */
+        outv = burststring(line,seps);
+        i=0;
+        while (outv[i]) {
+            if (keepc[i+1] && (ndelc>0 || i>=nval)) {
+                fputs(outv[i],outstr);
+                fputs(" ",outstr);
             }
-            fputs("\n",outstr);
+            i++;
         }
-    } /* for(;;) */
+        fputs("\n",outstr);
+    }
 }
-
+
 /* burstfie(): to be placed with burststring() later on...
  *
  *	18-feb-92	written		PJT
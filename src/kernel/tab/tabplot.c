@@ -45,6 +45,7 @@
  *       8-jan-2020 V4.0 : template python option
  *      12-jan-2021 V4.1 : added backtrack=
  *      20-apr-2022 V5.0 : converted to table V2
+ *      18-oct-2026 V5.1 : mapped table, parsed in parallel
  */
 
 /* TODO:
@@ -115,7 +116,7 @@ string defv[] = {                /* DEFAULT INPUT PARAMETERS */
     "first=f\n           Layout first or last?",
     "readline=f\n        Interactively reading commands",
     "pyplot=\n           Template python plotting script",
-    "VERSION=5.0c\n	 22-feb-2023 PJT",
+    "VERSION=5.1\n	 18-oct-2026 PJT",
     NULL
 };
 
@@ -212,7 +213,7 @@ void setparams(void)
    
     input = getparam("in");             /* input table file */
     instr = stropen (input,"r");
-    tptr = table_open(instr,0);
+    tptr = table_open(instr,2);
     
     nxcol = nemoinpi(getparam("xcol"),xcol,MAXCOL);
     nycol = nemoinpi(getparam("ycol"),ycol,MAXCOL);
@@ -11,6 +11,9 @@
  *      16-nov-21   V1.8    added qac= and robust=                         pjt
  *       1-dec-21   V1.9    with qac/robust keep the min/max from all data PJT
  *      23-apr-22   V2.0    new table V2 interface                         PJT
+ *      18-oct-26   V2.3    mapped table, parsed in parallel               PJT
+ *      18-oct-26   V2.4    stream=t, eps=: one pass in bounded memory     PJT
+ *      18-oct-26   V2.5    stream=t via table_stream, one sketch per column PJT
  *
  *  @todo:   xcol=0 should use the first data row to figure out all columns
  *  @todo:   if not in QAC mode, robust=t doesnt work
@@ -21,9 +24,13 @@
 #include <moment.h>
 #include <table.h>
 #include <mdarray.h>
+#if _OPENMP
+#include <omp.h>
+#endif
 
 #define MAXCOL  10000
 #define MAXCOORD   16
+#define QBUF      256       /* values added to a column's sketch at a time */
 
 string defv[] = {                /* DEFAULT INPUT PARAMETERS */
     "in=???\n            Input file name (table)",
@@ -44,7 +51,9 @@ string defv[] = {                /* DEFAULT INPUT PARAMETERS */
     "robust=f\n          robust stats?",
     "qac=f\n             QAC mode listing mean,rms,min,max",
     "label=\n            QAC label",
-    "VERSION=2.2a\n	 5-oct-2022 PJT",
+    "stream=f\n          Stream the table in one pass, in bounded memory",
+    "eps=0.001\n         Rank accuracy (fraction of npt) of median etc. with stream=t",
+    "VERSION=2.5\n	 18-oct-2026 PJT",
     NULL
 };
 
@@ -60,8 +69,9 @@ local int xcol[MAXCOL], nxcol; 		        /* column numbers */
 local mdarray2  x;                              /*  x[col][row] */
 
 local Moment m[MAXCOL];
+local Quantile *q = NULL;                       /* q[col] if stream=t */
 local int    imaxdev[MAXCOL];
-local int    npt;		                /* actual number of data points */
+local long   npt;		                /* actual number of data points */
 local int   *ix;
 
 local bool   Qmedian;
@@ -69,6 +79,8 @@ local bool   Qverbose;
 local bool   Qmad;
 local bool   Qac;
 local bool   Qrobust;
+local bool   Qstream;
+local real   eps;
 local bool   Qbad;
 local real   badval;
 local int    nmax;			 	 /* lines to allocate */
@@ -87,6 +99,108 @@ extern void sortptr (real *x ,int *idx, int n);
 
 void setparams(void);
 void read_data(void);
+void stream_data(void);
+/*
+ * STREAM_DATA: read the table a chunk of lines at a time (table_stream),
+ * each thread accumulating the moments of its share of the lines, which
+ * are merged at the end.  There is one quantile sketch per column, shared
+ * by the threads, which add their values to it QBUF at a time.
+ */
+
+local bool   Qsketch;
+local int    nthread;
+local Moment *pm = NULL;                        /* pm[thread*nxcol+col] */
+local real   *qbuf = NULL;                      /* QBUF values per thread and col */
+local int    *nqbuf = NULL;
+
+local void flush_sketch(int k, int j)
+{
+    int i;
+
+#if _OPENMP
+#pragma omp critical(tabstat_sketch)
+#endif
+    for (i=0; i<nqbuf[k]; i++)
+      accum_quantile(&q[j],qbuf[k*QBUF+i]);
+    nqbuf[k] = 0;
+}
+
+local void stream_setup(void *arg, int nc, int nt)
+{
+    int i, j;
+
+    if (nxcol == 0) {
+      if (nc > MAXCOL) error("No room to select all (%d) columns; MAXCOL=%d", nc, MAXCOL);
+      nxcol = nc;
+      for (j=0; j<nxcol; j++) xcol[j] = j+1;
+    }
+    nthread = nt;
+    pm = (Moment *) allocate(nt*nxcol*sizeof(Moment));
+    for (i=0; i<nt*nxcol; i++)
+      ini_moment(&pm[i],4,0);
+    if (Qsketch) {
+      q = (Quantile *) allocate(nxcol*sizeof(Quantile));
+      for (j=0; j<nxcol; j++)
+	ini_quantile(&q[j],eps);
+      qbuf = (real *) allocate(nt*nxcol*QBUF*sizeof(real));
+      nqbuf = (int *) allocate(nt*nxcol*sizeof(int));
+    }
+}
+
+local void stream_accum(void *arg, int t, long row, real *v)
+{
+    int j, k;
+
+    for (j=0; j<nxcol; j++) {
+      if (Qbad && v[j]==badval) continue;
+      if (Qmin && v[j]<xmin) continue;
+      if (Qmax && v[j]>xmax) continue;
+      k = t*nxcol+j;
+      accum_moment(&pm[k],v[j],1.0);
+      if (Qsketch) {
+	qbuf[k*QBUF+nqbuf[k]++] = v[j];
+	if (nqbuf[k] == QBUF) flush_sketch(k,j);
+      }
+    }
+}
+
+void stream_data(void)
+{
+    long bad;
+    int j, t;
+
+    Qsketch = Qmedian || Qrobust;
+    bad = table_stream(tptr, &nxcol, xcol, stream_setup, stream_accum, NULL, &npt);
+    if (bad) error("too few columns in row %ld", bad);
+    if (npt == 0) error("No data in %s", input);
+    for (j=0; j<nxcol; j++) {
+      ini_moment(&m[j],4,0);
+      for (t=0; t<nthread; t++) {
+	merge_moment(&m[j],&pm[t*nxcol+j]);
+	if (Qsketch) flush_sketch(t*nxcol+j,j);
+      }
+    }
+    free(pm);
+    if (Qsketch) {
+      free(qbuf);
+      free(nqbuf);
+    }
+    dprintf(1,"stream_data: %ld rows, %d threads\n", npt, nthread);
+}
+
+/*
+ * ROBUST_STREAM: robust moments from the quantile sketch, using the
+ * same 1.5*IQR range as compute_robust_moment()
+ */
+
+local void robust_stream(Quantile *qj, Moment *rm)
+{
+    real q1 = get_quantile(qj,0.25), q3 = get_quantile(qj,0.75), iqr = q3-q1;
+
+    ini_moment(rm,2,0);
+    moment_quantile(qj, q1-1.5*iqr, q3+1.5*iqr, rm);
+}
+
 void stat_data(void);
 void out(string fmt);
 
@@ -94,7 +208,10 @@ void out(string fmt);
 void nemo_main(void)
 {
     setparams();
-    read_data();
+    if (Qstream)
+      stream_data();
+    else
+      read_data();
     stat_data();
 }
 
@@ -104,11 +221,15 @@ void setparams(void)
    
     input = getparam("in");             /* input table file */
     instr = stropen (input,"r");
-    tptr  = table_open(instr, 0);
-
-    nrows = table_nrows(tptr);
-    ncols = table_ncols(tptr);
-    dprintf(1,"Table: %d x %d\n", nrows, ncols);
+    Qstream = getbparam("stream");
+    tptr  = table_open(instr, Qstream ? 1 : 2);
+
+    if (!Qstream) {
+      nrows = table_nrows(tptr);
+      ncols = table_ncols(tptr);
+      dprintf(1,"Table: %d x %d\n", nrows, ncols);
+      nmax = nrows;
+    }
 
     nxcol = nemoinpi(getparam("xcol"),xcol,MAXCOL);
     if (nxcol == 0) {
@@ -118,7 +239,6 @@ void setparams(void)
     } else if (nxcol < 1) {
       error("Error parsing xcol=%s   MAXCOL=%d",getparam("xcol"),MAXCOL);
     }
-    nmax = nrows;
 
     Qverbose = getbparam("verbose");
     Qmedian = getbparam("median");
@@ -144,6 +264,14 @@ void setparams(void)
       qac_label = getparam("label");
     else
       qac_label = getparam("in");
+    eps = getrparam("eps");
+    if (Qstream) {
+      if (iter > 0) error("iter=%d cannot be used with stream=t",iter);
+      if (Qmad) {
+	warning("mad= is not available with stream=t");
+	Qmad = FALSE;
+      }
+    }
 }
 
 void read_data(void)
@@ -160,13 +288,15 @@ void stat_data(void)
     int i, j, ndat, imax, kmin, kmax;
     real median, mean, sigma, d, dmax, rrange[2];
     char fmt[20];
+    Moment rm;
     
-    ix = (int *) allocate(sizeof(int)*npt);     /* pointer array */
+    if (!Qstream) {
+      ix = (int *) allocate(sizeof(int)*npt);     /* pointer array */
 
-    ndat = 0;
-    if (Qmad || Qac || Qrobust) ndat = npt;
+      ndat = 0;
+      if (Qmad || Qac || Qrobust) ndat = npt;
 
-    for (j=0; j<nxcol; j++) {           /* initialize moments for all data */
+      for (j=0; j<nxcol; j++) {           /* initialize moments for all data */
         ini_moment(&m[j],4,ndat);
         for (i=0; i<npt; i++) {                          /* loop over rows */
 	  if (Qbad && x[j][i]==badval) continue;
@@ -174,12 +304,20 @@ void stat_data(void)
 	  if (Qmax && x[j][i]>xmax) continue;
 	  accum_moment(&m[j],x[j][i],1.0);
         }
+      }
     }
 
     // simpler one line output
     if (Qac) {   
       for (j=0; j<nxcol; j++) {
-	if (Qrobust) {
+	if (Qrobust && Qstream) {
+	  robust_stream(&q[j], &rm);
+	  printf("QAC_STATS: %s %g %g %g %g  %g %g  %ld\n",
+		 qac_label, mean_moment(&rm), sigma_moment(&rm),
+		 min_moment(&m[j]), max_moment(&m[j]),
+		 sum_moment(&m[j]), sratio_moment(&m[j]), (long) show_moment(&rm,0));
+	  free_moment(&rm);
+	} else if (Qrobust) {
 	  compute_robust_moment(&m[j]);
 	  robust_range(&m[j], rrange);
 	  printf("QAC_STATS: %s %g %g %g %g  %g %g  %d\n",
@@ -187,10 +325,10 @@ void stat_data(void)
 		 min_moment(&m[j]), max_moment(&m[j]),		 
 		 sum_moment(&m[j]), sratio_moment(&m[j]), n_robust_moment(&m[j]));
 	} else
-	  printf("QAC_STATS: %s %g %g %g %g  %g %g  %d\n",
+	  printf("QAC_STATS: %s %g %g %g %g  %g %g  %ld\n",
 		 qac_label, mean_moment(&m[j]), sigma_moment(&m[j]),
 		 min_moment(&m[j]), max_moment(&m[j]),
-		 sum_moment(&m[j]), sratio_moment(&m[j]),n_moment(&m[j]));
+		 sum_moment(&m[j]), sratio_moment(&m[j]),m[j].n);
       }
       return;
     }
@@ -201,7 +339,7 @@ void stat_data(void)
                                             /* and in verbose all iters */
             printf("npt:    ");
             for (j=0; j<nxcol; j++) {
-                sprintf(fmt," %d",n_moment(&m[j]));
+                sprintf(fmt," %ld",m[j].n);
                 out(fmt);
             }
             printf("\n");
@@ -284,6 +422,9 @@ void stat_data(void)
             if (Qmedian) {
                 printf("median: ");
                 for (j=0; j<nxcol; j++) {
+		  if (Qstream)
+		    median = get_quantile(&q[j],0.5);
+		  else {
                     sortptr(x[j],ix,npt);
                     kmin = 0;
                     kmax = npt-1;
@@ -293,6 +434,7 @@ void stat_data(void)
                         median = 0.5 * (x[j][ix[kmin+(kmax-kmin+1)/2]] +
                                         x[j][ix[kmin+(kmax-kmin+1)/2-1]]);
                     }
+		  }
                     sprintf(fmt," %g",median);
                     out(fmt);
                 }
@@ -331,7 +473,7 @@ void stat_data(void)
                   }
                 } else
                   error("Illegal outlier removal method %d",method);
-                dprintf(1,"Swapping %g and %g in %d and %d\n",
+                dprintf(1,"Swapping %g and %g in %d and %ld\n",
                         x[j][imax],x[j][npt-1],imax,npt-1);
                 SWAP(x[j][imax],x[j][npt-1]);
                 imaxdev[j] = imax;                  /* remember where */
@@ -349,7 +491,7 @@ void stat_data(void)
             }
             npt--;
 
-            dprintf(1,"Redoing %d columns %d rows\n",nxcol,npt);
+            dprintf(1,"Redoing %d columns %ld rows\n",nxcol,npt);
             for (j=0; j<nxcol; j++) {       /* redo, for min/max */
                 reset_moment(&m[j]);
                 for (i=0; i<npt; i++) {
@@ -358,7 +500,7 @@ void stat_data(void)
             }
         }
     } while (iter--);
-    free(ix);
+    if (ix) free(ix);
 }
 
 
@@ -5,6 +5,7 @@
  * public routines:
  *      rproc_body btrtrans(expr)
  *      iproc_body btitrans(expr)
+ *      int        btbits(expr)
  *
  *  -DTOOLBOX  version of this file can test and save bodytrans(5) files
  *  -DSAVE_OBJ will save bodytrans(5) files
@@ -60,11 +61,18 @@
  *  27-jul-05   add dummy loader for lazy gcc4 type linkers
  *  28-jul-06   add show= options
  *  15-Aug-09   add support for Cygwin DLL by LOADOBJDLL
+ *  18-oct-2026 add btbits() to find which snapshot items an expression needs
+ *  18-oct-2026 V4.0 expressions are interpreted (btexpr.c); cc only if $BTRCC
+ *  18-oct-2026      compiled expressions are kept in the objcache(3NEMO),
+ *                   only named functions (TOOLBOX) still go into BTNAMES
+ *  18-oct-2026      cflags only where it is used (not with LOADOBJ3)
  *
  *  Used environment variables (normally set through .cshrc/NEMORC files)
  *      NEMO        used in case NEMOOBJ was not available
  *      NEMOOBJ     normally points to $NEMO/obj/bodytrans
  *      BTRPATH     path of directories where to look for object files
+ *      BTRCC       if set, expressions not understood by btexpr() are compiled
+ *      NEMOCACHE   where compiled expressions are kept (see objcache.c)
  *	CFLAGS      if present, used in on-the-fly C compilation (only < V3)
  *
  * TODO:
@@ -80,6 +88,7 @@
 #include <unistd.h>
 #include <mathlinker.h>
 #include <bodytransc.h>
+#include <snapshot/snapshot.h>
 
 #if defined(__CYGWIN__)
 #undef LOADOBJ3
@@ -94,6 +103,8 @@ local proc   bodytrans(string,string,string);
 local void   ini_bt(void), end_bt(void), make_bt(string), show_bt(void);
 local string get_bt(string), put_bt(string,char,string);
 
+extern proc btexpr(string, string);	/* btexpr.c */
+
 void bodytrans_dummy_for_c(void);
 
 
@@ -113,6 +124,82 @@ iproc_body btitrans(string expr)
     return (iproc_body) bodytrans("int", expr, NULL);
 }
 
+/*
+ * BTBITS: return the snapshot bit flags of the body components an
+ * expression depends on, e.g. to set the get_snap_mask of a program.
+ * Names which are not known (user supplied bodytrans functions or
+ * variables) return all bits, so nothing gets left out.
+ */
+
+local struct {
+    string name;
+    int bits;
+} btvars[] = {
+    { "t",      0 },
+    { "i",      0 },
+    { "PI",     0 },    { "TWO_PI", 0 },    { "FOUR_PI", 0 },
+    { "m",      MassBit },
+    { "pos",    PhaseSpaceBit },    { "x",    PhaseSpaceBit },
+    { "y",      PhaseSpaceBit },    { "z",    PhaseSpaceBit },
+    { "r",      PhaseSpaceBit },    { "r2",   PhaseSpaceBit },
+    { "vel",    PhaseSpaceBit },    { "vx",   PhaseSpaceBit },
+    { "vy",     PhaseSpaceBit },    { "vz",   PhaseSpaceBit },
+    { "v",      PhaseSpaceBit },    { "v2",   PhaseSpaceBit },
+    { "vr",     PhaseSpaceBit },    { "vr2",  PhaseSpaceBit },
+    { "vt",     PhaseSpaceBit },    { "vt2",  PhaseSpaceBit },
+    { "vp",     PhaseSpaceBit },    { "ekin", PhaseSpaceBit },
+    { "jx",     PhaseSpaceBit },    { "jy",   PhaseSpaceBit },
+    { "jz",     PhaseSpaceBit },    { "jtot", PhaseSpaceBit },
+    { "ra",     PhaseSpaceBit },    { "dec",  PhaseSpaceBit },
+    { "glon",   PhaseSpaceBit },    { "glat", PhaseSpaceBit },
+    { "mul",    PhaseSpaceBit },    { "mub",  PhaseSpaceBit },
+    { "xsky",   PhaseSpaceBit },    { "ysky", PhaseSpaceBit },
+    { "phi",    PotentialBit },
+    { "etot",   PotentialBit | PhaseSpaceBit },
+    { "ax",     AccelerationBit },  { "ay",   AccelerationBit },
+    { "az",     AccelerationBit },
+    { "ar",     AccelerationBit | PhaseSpaceBit },
+    { "aux",    AuxBit },
+    { "key",    KeyBit },
+    { "dens",   DensBit },
+    { "eps",    EpsBit },
+    { NULL,     0 },
+};
+
+int btbits(string expr)
+{
+    char name[SHORT_FNAMELEN];
+    char *cp = expr;
+    int i, n, bits = 0;
+
+    while (*cp) {
+        if (isdigit(*cp) || *cp == '.') {          /* skip numbers, incl. 1e-3 */
+            while (isalnum(*cp) || *cp == '.' ||
+                   ((*cp == '-' || *cp == '+') && (cp[-1] == 'e' || cp[-1] == 'E')))
+                cp++;
+        } else if (isalpha(*cp) || *cp == '_') {   /* a name */
+            for (n = 0; isalnum(*cp) || *cp == '_'; cp++)
+                if (n < SHORT_FNAMELEN-1) name[n++] = *cp;
+            name[n] = 0;
+            while (isspace(*cp))
+                cp++;
+            if (*cp == '(')                         /* a (math) function call */
+                continue;
+            for (i = 0; btvars[i].name != NULL; i++)
+                if (streq(name, btvars[i].name))
+                    break;
+            if (btvars[i].name == NULL) {
+                dprintf(1,"btbits: %s unknown in %s, need all items\n",name,expr);
+                return ~0;
+            }
+            bits |= btvars[i].bits;
+        } else
+            cp++;
+    }
+    dprintf(1,"btbits: %s -> 0x%x\n",expr,bits);
+    return bits;
+}
+
 /*
  * DEFPATH: list of directories to search for body-trans functions,
  * used only if the environment variable BTRPATH is not set.
@@ -135,17 +222,29 @@ local int  Qflock = 0;			/* used for file locking */
 
 local int pid_counter = 0;
 
+local unsigned int bthash(string expr)     /* FNV-1a, for a function name */
+{
+    unsigned int h = 2166136261U;
+
+    while (*expr) {
+        h ^= (unsigned char) *expr++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
 local proc bodytrans(string type, string expr, string fname)
      /* string type;                    type of function to return */
      /* string expr;                    name or C expression */
      /* string fname;                   optional filename for object file */
 {
-    char file[256], func[256], name[256], cmmd[512];
-    char *sname, *cp, *cflags;
+    char file[256], func[256], name[256], cmmd[512], sfunc[32];
+    char *sname, *cp;
     string btrpath;
     string fullfile, hexpr;
     stream cdstr;
     proc result;
+    bool Qsave = TRUE;
 
 #if defined(LOADOBJ3)
     dprintf(1,"bodytrans: V3 .so for %s\n",expr);
@@ -155,6 +254,11 @@ local proc bodytrans(string type, string expr, string fname)
     dprintf(1,"bodytrans: V2 .o for %s\n",expr);
 #endif
 
+    if (fname == NULL || *fname == 0) {     /* try the interpreter first */
+        result = btexpr(type, expr);
+        if (result != NULL)
+            return result;
+    }
     if (! havesyms) {
         mysymbols(getargv0());
         ini_bt();
@@ -201,9 +305,15 @@ local proc bodytrans(string type, string expr, string fname)
         sprintf(func, "%s", cp);               /* generic symbol name */
         mapsys(func);                                     /* remap it */
     } else {                                           /* make a file */
+        if ((fname == NULL || *fname == 0) && getenv("BTRCC") == NULL)
+            error("bodytrans: cannot interpret expr=%s; set $BTRCC to compile it with cc",
+                  expr);
+#if defined(LOADOBJ3)
+        Qsave = (fname != NULL && *fname != 0);   /* else the objcache keeps it */
+#endif
         dprintf(0, "[bodytrans_new: invoking cc");
 #if defined(SAVE_OBJ)
-        dprintf(0, " +saving .o]\n");
+        dprintf(0, Qsave ? " +saving .o]\n" : "]\n");
 #else
         dprintf(0, "]\n");
 #endif
@@ -213,6 +323,12 @@ local proc bodytrans(string type, string expr, string fname)
             sprintf(name, "bt%c_%d%d", type[0], getpid(), pid_counter++); /* temp name */
         dprintf(2,"bodytrans: base name = %s\n",name);
 
+#if defined(LOADOBJ3)
+        if (!Qsave) {                       /* no need to name it in BTNAMES */
+            sprintf(sfunc, "bt%c__%08x", type[0], bthash(expr));
+            sname = sfunc;
+        } else
+#endif
 	sname = put_bt(expr, type[0], fname);	/* saved function name */
 	sprintf(func,  "%s", sname);            /* general symbol name */
         mapsys(func);                                      /* remap it */
@@ -223,10 +339,22 @@ local proc bodytrans(string type, string expr, string fname)
         fprintf(cdstr, "%s %s(Body *b,real t,int i)\n", type, sname);/* use generic name */
         fprintf(cdstr, "{\n    return (%s);\n}\n", expr);
         fclose(cdstr);
-	cflags = getenv("CFLAGS");
 #if defined(LOADOBJ3)
-        sprintf(cmmd, "cd /tmp;make -f $NEMOLIB/Makefile.lib %s.so > %s.log 2>&1",name,name);
-#elif defined(LOADOBJDLL)
+        fullfile = objcache(file);		/* compiled once, shared by all */
+        (void) unlink(file);
+        if (fullfile == NULL) {
+#if defined(SAVE_OBJ)
+            if (Qsave) {
+                sprintf(cmmd,"rm -f %s",edbbak);    /* end file locking */
+                (void)system(cmmd);
+            }
+#endif
+            error("bodytrans(): could not compile expr=%s",expr);
+        }
+        strcpy(file, fullfile);
+#else
+        char *cflags = getenv("CFLAGS");
+#if defined(LOADOBJDLL)
         sprintf(cmmd, "cd /tmp;cc -I$NEMOINC  -I$NEMOLIB %s -shared  %s.c -o  %s.dll",
 		(cflags==NULL) ? "" : cflags,name,name);
 #else
@@ -241,9 +369,7 @@ local proc bodytrans(string type, string expr, string fname)
 #endif
             error("bodytrans(): could not compile expr=%s",expr);
 	}
-#if defined(LOADOBJ3)
-        sprintf(file, "/tmp/%s.so", name);
-#elif defined(LOADOBJDLL)
+#if defined(LOADOBJDLL)
         sprintf(file, "/tmp/%s.dll", name);
 #else
 	sprintf(cmmd,"ldso /tmp/%s",name);
@@ -251,15 +377,16 @@ local proc bodytrans(string type, string expr, string fname)
 	if (system(cmmd) != 0)
 		error("bodytrans: could not move link files");
         sprintf(file, "/tmp/%s.o", name);
+#endif
 #endif
         loadobj(file);
 
 #if defined(SAVE_OBJ)
-        if (!Qflock) {      /* copy when no file locking encountered */
+        if (Qsave && !Qflock) {  /* copy when no file locking encountered */
 #if defined(LOADOBJ3)
             sprintf(cmmd, 
-	     "cp /tmp/%s.so $NEMOOBJ/bodytrans/%s.so;chmod a+rw %s;chmod a+r $NEMOOBJ/bodytrans/%s.so; rm /tmp/%s.*",
-	     name,sname,edbbak,sname,name);
+	     "cp %s $NEMOOBJ/bodytrans/%s.so;chmod a+rw %s;chmod a+r $NEMOOBJ/bodytrans/%s.so",
+	     file,sname,edbbak,sname);
 #elif defined(LOADOBJDLL)
             sprintf(cmmd, 
              "cp /tmp/%s.dll $NEMOOBJ/bodytrans/%s.dll;chmod a+rw %s;chmod a+r $NEMOOBJ/bodytrans/%s.dll; rm /tmp/%s.*",
@@ -560,7 +687,7 @@ string defv[] = {
     "alias=\n		Filename to save expression in (bt<TYPE>_<ALIAS>)",
     "btnames=\n		BTNAMES filename to regenerate .so files",
     "show=f\n           show all existing bodytrans in the system",
-    "VERSION=3.3a\n	23-jan-2021 PJT",
+    "VERSION=4.0\n	18-oct-2026 PJT",
     NULL,
 };
 
@@ -0,0 +1,926 @@
+/*
+ * BTEXPR.C: interpreter for bodytrans(5NEMO) expressions, so that
+ * btrtrans() and btitrans() need not run the C compiler.
+ *
+ * public routines:
+ *      proc btexpr(type, expr)    function for expr, or NULL if not understood
+ *      void btreval(f, btab, n, t, i0, res)   f for n bodies at once
+ *      void btieval(f, btab, n, t, i0, res)
+ *      void btmeval(f, nf, btab, n, t, i0, res)  nf functions at once
+ *
+ *  The expression is parsed (once) into a small stack code, which is then
+ *  compiled into register code (see bt_compile) that is run each time the
+ *  function is called.  Understood is the C subset that
+ *  bodytrans expressions are written in:
+ *	numbers, the body variables (m x y z vx vy vz phi ax ay az aux key
+ *	dens eps) and t and i, the named transformations of bodytrans(5NEMO)
+ *	(r vr etot glon ...) which are expanded in line, constants (PI ...),
+ *	math functions, the + - * / % arithmetic, comparison, logical
+ *	and ?: operators, and (int) and (real) casts.
+ *  Integer arithmetic follows C, e.g. i/2 and i%2 are integer operations.
+ *  Both sides of ?: (and && ||) are always evaluated, which is harmless
+ *  since expressions have no side effects.
+ *  Anything else (user functions, Pos(b)[0], ...) returns NULL, and the
+ *  caller falls back to loading or compiling the expression.
+ *
+ *  Since the bodytrans interface hands out plain function pointers, a
+ *  fixed table of MAXBTEXPR (real and int) stub functions is used, each
+ *  of which runs its own program.
+ *
+ *  18-oct-2026  created, to avoid cc in bodytrans()            PJT
+ *  18-oct-2026  btreval/btieval: evaluate over arrays of bodies PJT
+ *  18-oct-2026  register code with constant folding and common
+ *               subexpressions; btmeval fuses several expressions PJT
+ */
+
+#include <stdinc.h>
+#include <strlib.h>
+#include <ctype.h>
+#include <bodytransc.h>
+
+/* opcodes of the stack code */
+
+#define BT_CONST   1	/* push c */
+#define BT_VAR     2	/* push body variable arg */
+#define BT_TIME    3	/* push t */
+#define BT_INDEX   4	/* push i */
+#define BT_ADD     5
+#define BT_SUB     6
+#define BT_MUL     7
+#define BT_DIV     8
+#define BT_IDIV    9	/* int / int */
+#define BT_IMOD   10	/* int % int */
+#define BT_NEG    11
+#define BT_NOT    12
+#define BT_LT     13
+#define BT_LE     14
+#define BT_GT     15
+#define BT_GE     16
+#define BT_EQ     17
+#define BT_NE     18
+#define BT_AND    19
+#define BT_OR     20
+#define BT_SEL    21	/* a ? b : c */
+#define BT_INT    22	/* (int) cast: truncate */
+#define BT_FN1    23	/* fn1[arg](a) */
+#define BT_FN2    24	/* fn2[arg](a,b) */
+
+/* body variables */
+
+#define BV_M       0
+#define BV_X       1
+#define BV_Y       2
+#define BV_Z       3
+#define BV_VX      4
+#define BV_VY      5
+#define BV_VZ      6
+#define BV_PHI     7
+#define BV_AX      8
+#define BV_AY      9
+#define BV_AZ     10
+#define BV_AUX    11
+#define BV_KEY    12
+#define BV_DENS   13
+#define BV_EPS    14
+
+#define T_INT   1	/* types of (sub)expressions */
+#define T_REAL  2
+
+#define MAXBTEXPR  64	/* number of expressions that can be interpreted */
+#define BTSTACK    32	/* maximum stack depth of an expression */
+#define BTBLOCK    64	/* bodies done at a time by btreval */
+#define MAXNEST     8	/* nesting of named transformations */
+
+typedef struct {
+    int    op;
+    int    arg;
+    double c;
+    int    src[3];		/* operands: nodes, then registers */
+    int    dst;			/* result register */
+} btinstr;
+
+typedef struct {
+    string   expr;		/* the expression */
+    btinstr *pcode;		/* the parsed stack code */
+    int      npcode, maxpcode;
+    int      depth, maxdepth;	/* its stack use */
+    btinstr *code;		/* the register code that is run */
+    int      ncode, nreg;
+    int      nout, *out;	/* registers with the result(s) */
+    int     *memb;		/* fused programs: btprogs[] of the results */
+} btprog;
+
+/* what the parser knows */
+
+local struct { string name; int var; int type; } btvar[] = {
+    { "m",    BV_M,    T_REAL },
+    { "x",    BV_X,    T_REAL },    { "y",    BV_Y,    T_REAL },
+    { "vx",   BV_VX,   T_REAL },    { "vy",   BV_VY,   T_REAL },
+    { "ax",   BV_AX,   T_REAL },    { "ay",   BV_AY,   T_REAL },
+#if defined(THREEDIM)
+    { "z",    BV_Z,    T_REAL },
+    { "vz",   BV_VZ,   T_REAL },
+    { "az",   BV_AZ,   T_REAL },
+#endif
+    { "phi",  BV_PHI,  T_REAL },
+    { "aux",  BV_AUX,  T_REAL },
+    { "key",  BV_KEY,  T_INT  },
+    { "dens", BV_DENS, T_REAL },
+    { "eps",  BV_EPS,  T_REAL },
+    { NULL,   0,       0 },
+};
+
+local struct { string name; double val; int type; } btconst[] = {
+    { "PI",      PI,      T_REAL },
+    { "TWO_PI",  TWO_PI,  T_REAL },
+    { "FOUR_PI", FOUR_PI, T_REAL },
+    { "HALF_PI", HALF_PI, T_REAL },
+    { "DR2D",    DR2D,    T_REAL },
+    { "DD2R",    DD2R,    T_REAL },
+    { "TRUE",    1,       T_INT  },
+    { "FALSE",   0,       T_INT  },
+    { "NDIM",    NDIM,    T_INT  },
+    { NULL,      0,       0 },
+};
+
+/* the named transformations, as in $NEMO/src/nbody/cores/bodysub */
+
+local struct { string name; string text; } btnamed[] = {
+#if defined(THREEDIM)
+    { "r",    "sqrt(x*x + y*y + z*z)" },
+    { "v",    "sqrt(vx*vx + vy*vy + vz*vz)" },
+    { "vr",   "(x*vx + y*vy + z*vz) / sqrt(x*x + y*y + z*z)" },
+    { "vt",   "sqrt((vx*vx + vy*vy + vz*vz) - sqr(x*vx + y*vy + z*vz) / (x*x + y*y + z*z))" },
+    { "vp",   "sqrt(((vx*vx + vy*vy + vz*vz) - sqr(x*vx + y*vy + z*vz) / (x*x + y*y + z*z))"
+              " / (x*x + y*y + z*z))" },
+    { "ekin", "0.5*(vx*vx + vy*vy + vz*vz)" },
+    { "etot", "phi + 0.5*(vx*vx + vy*vy + vz*vz)" },
+    { "jx",   "y*vz - z*vy" },
+    { "jy",   "z*vx - x*vz" },
+    { "jz",   "x*vy - y*vx" },
+    { "jtot", "sqrt(sqr(x*vy - y*vx) + sqr(y*vz - z*vy) + sqr(z*vx - x*vz))" },
+    { "ar",   "(x*ax + y*ay + z*az) / sqrt(x*x + y*y + z*z)" },
+    { "glat", "atan2(z,sqrt(x*x+y*y))*180.0/PI" },
+    { "xsky", "atan2(x,z)*180.0/PI" },
+    { "ysky", "atan2(y,z)*180.0/PI" },
+    { "mul",  "sqrt(x*x+y*y) > 0 && sqrt(x*x+y*y+z*z) > 0 ?"
+              " (x*vy-y*vx)/(sqrt(x*x+y*y)*sqrt(x*x+y*y+z*z)) : 0.0" },
+    { "mub",  "sqrt(x*x+y*y) > 0 && sqrt(x*x+y*y+z*z) > 0 ?"
+              " (vz*sqrt(x*x+y*y)-z*(y*vy+x*vx)/sqrt(x*x+y*y))"
+              "/(sqrt(x*x+y*y+z*z)*sqrt(x*x+y*y+z*z)) : 0.0" },
+#else
+    { "r",    "sqrt(x*x + y*y)" },
+#endif
+    { "r2",   "sqrt(x*x + y*y)" },
+    { "v2",   "sqrt(vx*vx + vy*vy)" },
+    { "vr2",  "(x*vx + y*vy) / sqrt(x*x + y*y)" },
+    { "vt2",  "sqrt((vx*vx + vy*vy) - sqr(x*vx + y*vy) / (x*x + y*y))" },
+    { "glon", "atan2(y,x)*180.0/PI" },
+    { "ra",   "-x*180.0/PI" },
+    { "dec",  "y*180.0/PI" },
+    { NULL,   NULL },
+};
+
+local double bt_sqr(double a)            { return a*a; }
+local double bt_qbe(double a)            { return a*a*a; }
+local double bt_dex(double a)            { return exp(M_LN10*a); }
+local double bt_min(double a, double b)  { return a < b ? a : b; }
+local double bt_max(double a, double b)  { return a > b ? a : b; }
+
+#define FN_SQRT  0	/* btfn1[] entry of sqrt */
+
+local struct { string name; double (*fn)(double); } btfn1[] = {
+    { "sqrt",  sqrt },   { "exp",   exp },    { "log",   log },
+    { "log10", log10 },  { "sin",   sin },    { "cos",   cos },
+    { "tan",   tan },    { "asin",  asin },   { "acos",  acos },
+    { "atan",  atan },   { "sinh",  sinh },   { "cosh",  cosh },
+    { "tanh",  tanh },   { "fabs",  fabs },   { "abs",   fabs },
+    { "floor", floor },  { "ceil",  ceil },   { "cbrt",  cbrt },
+    { "erf",   erf },    { "erfc",  erfc },   { "sqr",   bt_sqr },
+    { "qbe",   bt_qbe }, { "dex",   bt_dex },   { "rint",  rint },
+    { NULL,    NULL },
+};
+
+local struct { string name; double (*fn)(double, double); } btfn2[] = {
+    { "atan2", atan2 },  { "pow",   pow },    { "fmod",  fmod },
+    { "hypot", hypot },  { "MIN",   bt_min }, { "MAX",   bt_max },
+    { NULL,    NULL },
+};
+
+/*
+ * THE PARSER: recursive descent in C precedence order, generating code
+ * as it goes. Each parse function returns the type of its (sub)expression,
+ * or 0 on an error.
+ */
+
+typedef struct {
+    char   *cp;			/* where we are in the text */
+    btprog *bp;			/* program being generated */
+    int     nest;		/* depth of named transformations */
+} btparser;
+
+local int bt_ternary(btparser *ps);
+
+local void bt_emit(btparser *ps, int op, int arg, double c, int push)
+{
+    btprog *bp = ps->bp;
+
+    if (bp->npcode == bp->maxpcode) {
+	bp->maxpcode = 2*bp->maxpcode + 16;
+	bp->pcode = (btinstr *) reallocate(bp->pcode, bp->maxpcode * sizeof(btinstr));
+    }
+    bp->pcode[bp->npcode].op = op;
+    bp->pcode[bp->npcode].arg = arg;
+    bp->pcode[bp->npcode].c = c;
+    bp->npcode++;
+    bp->depth += push;		/* net effect on the stack */
+    if (bp->depth > bp->maxdepth)
+	bp->maxdepth = bp->depth;
+}
+
+local void bt_space(btparser *ps)
+{
+    while (isspace(*ps->cp))
+	ps->cp++;
+}
+
+local bool bt_match(btparser *ps, string tok)	/* skip tok if next */
+{
+    int n = strlen(tok);
+
+    bt_space(ps);
+    if (strncmp(ps->cp, tok, n) != 0)
+	return FALSE;
+    if (n == 1 && strchr("<>=!&|", tok[0]) && ps->cp[1] &&
+	  strchr("=&|", ps->cp[1]))		/* < is not <=, & is not && */
+	return FALSE;
+    ps->cp += n;
+    return TRUE;
+}
+
+local int bt_name(btparser *ps, char *name)	/* read an identifier */
+{
+    int n = 0;
+
+    bt_space(ps);
+    if (!isalpha(*ps->cp) && *ps->cp != '_')
+	return 0;
+    while ((isalnum(*ps->cp) || *ps->cp == '_') && n < 31)
+	name[n++] = *ps->cp++;
+    name[n] = 0;
+    return (isalnum(*ps->cp) || *ps->cp == '_') ? 0 : n;
+}
+
+local int bt_number(btparser *ps)
+{
+    char *end, *cp;
+    double val;
+    int type = T_INT;
+
+    val = strtod(ps->cp, &end);
+    if (end == ps->cp)
+	return 0;
+    for (cp = ps->cp; cp < end; cp++)
+	if (*cp == '.' || *cp == 'e' || *cp == 'E' || *cp == 'p' || *cp == 'P')
+	    type = T_REAL;
+    if (type == T_INT)				/* 010 is octal, 0x10 hex */
+	val = (double) strtol(ps->cp, &end, 0);
+    ps->cp = end;
+    if (isalnum(*ps->cp) || *ps->cp == '_' || *ps->cp == '.')
+	return 0;				/* no suffixes */
+    bt_emit(ps, BT_CONST, 0, val, 1);
+    return type;
+}
+
+local int bt_call(btparser *ps, string name)
+{
+    int k, t1, t2;
+
+    for (k = 0; btfn1[k].name != NULL; k++)
+	if (streq(name, btfn1[k].name)) {
+	    if ((t1 = bt_ternary(ps)) == 0 || !bt_match(ps, ")"))
+		return 0;
+	    if (streq(name, "abs")) {		/* int abs(int) */
+		if (t1 == T_REAL)
+		    bt_emit(ps, BT_INT, 0, 0.0, 0);
+		bt_emit(ps, BT_FN1, k, 0.0, 0);
+		return T_INT;
+	    }
+	    bt_emit(ps, BT_FN1, k, 0.0, 0);
+	    return T_REAL;
+	}
+    for (k = 0; btfn2[k].name != NULL; k++)
+	if (streq(name, btfn2[k].name)) {
+	    if ((t1 = bt_ternary(ps)) == 0 || !bt_match(ps, ",") ||
+		(t2 = bt_ternary(ps)) == 0 || !bt_match(ps, ")"))
+		return 0;
+	    bt_emit(ps, BT_FN2, k, 0.0, -1);
+	    if (name[0] == 'M' && t1 == T_INT && t2 == T_INT)
+		return T_INT;			/* MIN/MAX macros */
+	    return T_REAL;
+	}
+    dprintf(1,"btexpr: unknown function %s\n", name);
+    return 0;
+}
+
+local int bt_primary(btparser *ps)
+{
+    char name[32], *save;
+    int k, type;
+
+    bt_space(ps);
+    if (isdigit(*ps->cp) || *ps->cp == '.')
+	return bt_number(ps);
+    if (bt_match(ps, "(")) {
+	if ((type = bt_ternary(ps)) == 0 || !bt_match(ps, ")"))
+	    return 0;
+	return type;
+    }
+    if (bt_name(ps, name) == 0)
+	return 0;
+    if (bt_match(ps, "("))
+	return bt_call(ps, name);
+    if (streq(name, "t")) {
+	bt_emit(ps, BT_TIME, 0, 0.0, 1);
+	return T_REAL;
+    }
+    if (streq(name, "i")) {
+	bt_emit(ps, BT_INDEX, 0, 0.0, 1);
+	return T_INT;
+    }
+    for (k = 0; btvar[k].name != NULL; k++)
+	if (streq(name, btvar[k].name)) {
+	    bt_emit(ps, BT_VAR, btvar[k].var, 0.0, 1);
+	    return btvar[k].type;
+	}
+    for (k = 0; btconst[k].name != NULL; k++)
+	if (streq(name, btconst[k].name)) {
+	    bt_emit(ps, BT_CONST, 0, btconst[k].val, 1);
+	    return btconst[k].type;
+	}
+    for (k = 0; btnamed[k].name != NULL; k++)
+	if (streq(name, btnamed[k].name)) {
+	    if (ps->nest == MAXNEST)
+		return 0;
+	    save = ps->cp;			/* parse its text in line */
+	    ps->cp = btnamed[k].text;
+	    ps->nest++;
+	    type = bt_ternary(ps);
+	    bt_space(ps);
+	    if (*ps->cp != 0)
+		type = 0;
+	    ps->nest--;
+	    ps->cp = save;
+	    return type;
+	}
+    dprintf(1,"btexpr: unknown name %s\n", name);
+    return 0;
+}
+
+local int bt_unary(btparser *ps)
+{
+    char *save;
+    int type;
+
+    bt_space(ps);
+    if (bt_match(ps, "-")) {
+	if ((type = bt_unary(ps)) != 0)
+	    bt_emit(ps, BT_NEG, 0, 0.0, 0);
+	return type;
+    }
+    if (bt_match(ps, "+"))
+	return bt_unary(ps);
+    if (bt_match(ps, "!")) {
+	if (bt_unary(ps) == 0)
+	    return 0;
+	bt_emit(ps, BT_NOT, 0, 0.0, 0);
+	return T_INT;
+    }
+    save = ps->cp;
+    if (bt_match(ps, "(")) {			/* a cast ? */
+	if (bt_match(ps, "int") && bt_match(ps, ")")) {
+	    if (bt_unary(ps) == 0)
+		return 0;
+	    bt_emit(ps, BT_INT, 0, 0.0, 0);
+	    return T_INT;
+	}
+	ps->cp = save + 1;
+	if ((bt_match(ps, "real") || bt_match(ps, "double") ||
+	     bt_match(ps, "float")) && bt_match(ps, ")"))
+	    return bt_unary(ps) ? T_REAL : 0;
+	ps->cp = save;
+    }
+    return bt_primary(ps);
+}
+
+local int bt_binary(btparser *ps, int level);
+
+/* binary operators by precedence level, lowest first */
+
+local struct { string tok; int op; int level; } btops[] = {
+    { "||", BT_OR,  0 },
+    { "&&", BT_AND, 1 },
+    { "==", BT_EQ,  2 },  { "!=", BT_NE,  2 },
+    { "<=", BT_LE,  3 },  { ">=", BT_GE,  3 },
+    { "<",  BT_LT,  3 },  { ">",  BT_GT,  3 },
+    { "+",  BT_ADD, 4 },  { "-",  BT_SUB, 4 },
+    { "*",  BT_MUL, 5 },  { "/",  BT_DIV, 5 },  { "%",  BT_IMOD, 5 },
+    { NULL, 0,      0 },
+};
+
+#define BTLEVELS 6
+
+local int bt_binary(btparser *ps, int level)
+{
+    int k, t1, t2, op;
+
+    if (level == BTLEVELS)
+	return bt_unary(ps);
+    if ((t1 = bt_binary(ps, level+1)) == 0)
+	return 0;
+    for (;;) {
+	for (k = 0; btops[k].tok != NULL; k++)
+	    if (btops[k].level == level && bt_match(ps, btops[k].tok))
+		break;
+	if (btops[k].tok == NULL)
+	    return t1;
+	if ((t2 = bt_binary(ps, level+1)) == 0)
+	    return 0;
+	op = btops[k].op;
+	if (op == BT_IMOD && (t1 != T_INT || t2 != T_INT))
+	    return 0;				/* C: % only on ints */
+	if (op == BT_DIV && t1 == T_INT && t2 == T_INT)
+	    op = BT_IDIV;
+	bt_emit(ps, op, 0, 0.0, -1);
+	if (level < 4)
+	    t1 = T_INT;				/* logical and comparison */
+	else if (t2 == T_REAL)
+	    t1 = T_REAL;
+    }
+}
+
+local int bt_ternary(btparser *ps)
+{
+    int t0, t1, t2;
+
+    if ((t0 = bt_binary(ps, 0)) == 0)
+	return 0;
+    if (!bt_match(ps, "?"))
+	return t0;
+    if ((t1 = bt_ternary(ps)) == 0 || !bt_match(ps, ":") ||
+	(t2 = bt_ternary(ps)) == 0)
+	return 0;
+    bt_emit(ps, BT_SEL, 0, 0.0, -2);
+    return (t1 == T_REAL || t2 == T_REAL) ? T_REAL : T_INT;
+}
+
+/*
+ * BT_EXEC: do one instruction for n consecutive bodies btab, with indices
+ * i0, i0+1, ...: s = a op b (or a ? b : c).  Each operand is a row of n
+ * values, and each instruction a simple loop over the row, which the
+ * compiler can vectorize.
+ */
+
+#define EACH    for (k = 0; k < n; k++)
+
+local void bt_exec(btinstr *ip, double * restrict s, double *a, double *b,
+		   double *c, Body *btab, int n, real t, int i0)
+{
+    Body *bp = btab;
+    int k;
+
+    switch (ip->op) {
+    case BT_CONST:  EACH s[k] = ip->c;		break;
+    case BT_TIME:   EACH s[k] = t;		break;
+    case BT_INDEX:  EACH s[k] = i0 + k;		break;
+    case BT_VAR:
+	switch (ip->arg) {
+	case BV_M:    EACH s[k] = Mass(bp+k);	break;
+	case BV_X:    EACH s[k] = Pos(bp+k)[0];	break;
+	case BV_Y:    EACH s[k] = Pos(bp+k)[1];	break;
+	case BV_VX:   EACH s[k] = Vel(bp+k)[0];	break;
+	case BV_VY:   EACH s[k] = Vel(bp+k)[1];	break;
+	case BV_AX:   EACH s[k] = Acc(bp+k)[0];	break;
+	case BV_AY:   EACH s[k] = Acc(bp+k)[1];	break;
+#if defined(THREEDIM)
+	case BV_Z:    EACH s[k] = Pos(bp+k)[2];	break;
+	case BV_VZ:   EACH s[k] = Vel(bp+k)[2];	break;
+	case BV_AZ:   EACH s[k] = Acc(bp+k)[2];	break;
+#endif
+	case BV_PHI:  EACH s[k] = Phi(bp+k);	break;
+	case BV_AUX:  EACH s[k] = Aux(bp+k);	break;
+	case BV_KEY:  EACH s[k] = Key(bp+k);	break;
+	case BV_DENS: EACH s[k] = Dens(bp+k);	break;
+	case BV_EPS:  EACH s[k] = Eps(bp+k);	break;
+	default:      error("btrun: bad variable %d", ip->arg);
+	}
+	break;
+    case BT_ADD:  EACH s[k] = a[k] + b[k];		break;
+    case BT_SUB:  EACH s[k] = a[k] - b[k];		break;
+    case BT_MUL:  EACH s[k] = a[k] * b[k];		break;
+    case BT_DIV:  EACH s[k] = a[k] / b[k];		break;
+    case BT_IDIV:				/* (no SIGFPE for /0 here) */
+	EACH s[k] = b[k] == 0 ? 0.0 : (double) ((long) a[k] / (long) b[k]);
+	break;
+    case BT_IMOD:
+	EACH s[k] = b[k] == 0 ? 0.0 : (double) ((long) a[k] % (long) b[k]);
+	break;
+    case BT_LT:   EACH s[k] = a[k] <  b[k];		break;
+    case BT_LE:   EACH s[k] = a[k] <= b[k];		break;
+    case BT_GT:   EACH s[k] = a[k] >  b[k];		break;
+    case BT_GE:   EACH s[k] = a[k] >= b[k];		break;
+    case BT_EQ:   EACH s[k] = a[k] == b[k];		break;
+    case BT_NE:   EACH s[k] = a[k] != b[k];		break;
+    case BT_AND:  EACH s[k] = a[k] != 0 && b[k] != 0;	break;
+    case BT_OR:   EACH s[k] = a[k] != 0 || b[k] != 0;	break;
+    case BT_NEG:  EACH s[k] = -a[k];			break;
+    case BT_NOT:  EACH s[k] = a[k] == 0;			break;
+    case BT_INT:  EACH s[k] = (double) (long) a[k];	break;
+    case BT_FN1:
+	if (ip->arg == FN_SQRT)			/* common enough to inline */
+	    EACH s[k] = sqrt(a[k]);
+	else
+	    EACH s[k] = (*btfn1[ip->arg].fn)(a[k]);
+	break;
+    case BT_FN2:  EACH s[k] = (*btfn2[ip->arg].fn)(a[k], b[k]);	break;
+    case BT_SEL:  EACH s[k] = a[k] != 0 ? b[k] : c[k];	break;
+    default:
+	error("btrun: bad opcode %d", ip->op);
+    }
+}
+
+local int bt_nargs(int op)
+{
+    switch (op) {
+    case BT_CONST: case BT_VAR: case BT_TIME: case BT_INDEX:
+	return 0;
+    case BT_NEG: case BT_NOT: case BT_INT: case BT_FN1:
+	return 1;
+    case BT_SEL:
+	return 3;
+    default:
+	return 2;
+    }
+}
+
+/*
+ * BT_COMPILE: compile the stack code of nprog programs into the register
+ * code of bp, which then has nprog results.  Every instruction becomes a
+ * node of an expression graph, in which
+ *	- operations on constants are done here (constant folding), e.g.
+ *	  the 180.0/PI in glon,
+ *	- an operation on the same operands as an earlier one is not done
+ *	  again (common subexpressions), e.g. the x*x+y*y+z*z in vr, or
+ *	  the r that several expressions share,
+ *	- and nodes not needed for any result are dropped.
+ * Registers are reused after the last use of their node.  Returns FALSE
+ * if more than maxreg registers would be needed.
+ */
+
+local bool bt_compile(btprog *bp, btprog **progs, int nprog, int maxreg)
+{
+    btinstr *node, *code, cand, *ip;
+    int *stack, *out, *live, *last, *reg, *freereg;
+    int ntot = 0, nnode = 0, ncode = 0, nfree = 0, nreg = 0;
+    int i, j, k, p, sp, narg;
+    double v[3];
+
+    for (p = 0; p < nprog; p++)
+	ntot += progs[p]->npcode;
+    node  = (btinstr *) allocate(ntot * sizeof(btinstr));
+    stack = (int *) allocate(ntot * sizeof(int));
+    out   = (int *) allocate(nprog * sizeof(int));
+    for (p = 0; p < nprog; p++) {		/* build the graph */
+	sp = 0;
+	for (ip = progs[p]->pcode; ip < progs[p]->pcode + progs[p]->npcode; ip++) {
+	    cand = *ip;
+	    narg = bt_nargs(ip->op);
+	    sp -= narg;
+	    for (j = 0; j < 3; j++)
+		cand.src[j] = j < narg ? stack[sp+j] : 0;
+	    for (j = 0; j < narg; j++)
+		if (node[cand.src[j]].op != BT_CONST)
+		    break;
+	    if (narg > 0 && j == narg) {	/* fold */
+		for (j = 0; j < narg; j++)
+		    v[j] = node[cand.src[j]].c;
+		bt_exec(&cand, &cand.c, &v[0], &v[1], &v[2], NULL, 1, 0.0, 0);
+		cand.op = BT_CONST;
+		cand.arg = 0;
+		cand.src[0] = cand.src[1] = cand.src[2] = 0;
+		narg = 0;
+	    }
+	    for (i = 0; i < nnode; i++)		/* done before ? */
+		if (node[i].op == cand.op && node[i].arg == cand.arg &&
+		    memcmp(&node[i].c, &cand.c, sizeof(double)) == 0 &&
+		    memcmp(node[i].src, cand.src, sizeof(cand.src)) == 0)
+		    break;
+	    if (i == nnode)
+		node[nnode++] = cand;
+	    stack[sp++] = i;
+	}
+	if (sp != 1)
+	    error("bt_compile: stack error (%d) in %s", sp, progs[p]->expr);
+	out[p] = stack[0];
+    }
+
+    live = (int *) allocate(3 * nnode * sizeof(int));
+    last = live + nnode;
+    reg  = last + nnode;
+    freereg = stack;
+    for (p = 0; p < nprog; p++) {		/* results live to the end */
+	live[out[p]] = 1;
+	last[out[p]] = nnode;
+    }
+    for (i = nnode-1; i >= 0; i--)		/* find the nodes needed */
+	if (live[i])
+	    for (j = 0; j < bt_nargs(node[i].op); j++) {
+		k = node[i].src[j];
+		live[k] = 1;
+		if (last[k] < i)
+		    last[k] = i;
+	    }
+    code = (btinstr *) allocate(nnode * sizeof(btinstr));
+    for (i = 0; i < nnode; i++) {		/* and give them registers */
+	if (!live[i])
+	    continue;
+	reg[i] = nfree > 0 ? freereg[--nfree] : nreg++;
+	code[ncode] = node[i];
+	code[ncode].dst = reg[i];
+	for (j = 0; j < bt_nargs(node[i].op); j++) {
+	    k = node[i].src[j];
+	    code[ncode].src[j] = reg[k];
+	    if (last[k] == i) {			/* last use: free it */
+		last[k] = -1;
+		freereg[nfree++] = reg[k];
+	    }
+	}
+	ncode++;
+    }
+    for (p = 0; p < nprog; p++)
+	out[p] = reg[out[p]];
+    free(node);
+    free(stack);
+    free(live);
+    if (nreg > maxreg) {
+	free(code);
+	free(out);
+	return FALSE;
+    }
+    bp->code = code;
+    bp->ncode = ncode;
+    bp->nreg = nreg;
+    bp->nout = nprog;
+    bp->out = out;
+    return TRUE;
+}
+
+/*
+ * BTRUN: run the register code of a program for n consecutive bodies
+ * btab, with indices i0, i0+1, ...  The registers reg need room for
+ * bp->nreg rows of n; results are left in the rows bp->out[].
+ */
+
+#define ROW(j)  (reg + (j)*n)
+
+local void btrun(btprog *bp, Body *btab, int n, real t, int i0, double *reg)
+{
+    btinstr *ip, *end = bp->code + bp->ncode;
+
+    for (ip = bp->code; ip < end; ip++)
+	bt_exec(ip, ROW(ip->dst), ROW(ip->src[0]), ROW(ip->src[1]),
+		ROW(ip->src[2]), btab, n, t, i0);
+}
+
+/*
+ * the stubs handed out as rproc_body and iproc_body functions
+ */
+
+local btprog *btprogs[MAXBTEXPR];
+local int nbtprogs = 0;
+
+local double bteval1(btprog *bp, Body *b, real t, int i)
+{
+    double reg[BTSTACK];
+
+    btrun(bp, b, 1, t, i, reg);
+    return reg[bp->out[0]];
+}
+
+#define BTSTUB(j,d) \
+  local real btxr_##j##d(Body *b, real t, int i) \
+    { return (real) bteval1(btprogs[8*j+d], b, t, i); } \
+  local int  btxi_##j##d(Body *b, real t, int i) \
+    { return (int) bteval1(btprogs[8*j+d], b, t, i); }
+#define BTSTUB8(j) BTSTUB(j,0) BTSTUB(j,1) BTSTUB(j,2) BTSTUB(j,3) \
+                   BTSTUB(j,4) BTSTUB(j,5) BTSTUB(j,6) BTSTUB(j,7)
+#define BTLIST8(p,j) p##j##0, p##j##1, p##j##2, p##j##3, \
+                     p##j##4, p##j##5, p##j##6, p##j##7
+
+BTSTUB8(0) BTSTUB8(1) BTSTUB8(2) BTSTUB8(3)
+BTSTUB8(4) BTSTUB8(5) BTSTUB8(6) BTSTUB8(7)
+
+local rproc_body btxr[MAXBTEXPR] = {
+    BTLIST8(btxr_,0), BTLIST8(btxr_,1), BTLIST8(btxr_,2), BTLIST8(btxr_,3),
+    BTLIST8(btxr_,4), BTLIST8(btxr_,5), BTLIST8(btxr_,6), BTLIST8(btxr_,7),
+};
+
+local iproc_body btxi[MAXBTEXPR] = {
+    BTLIST8(btxi_,0), BTLIST8(btxi_,1), BTLIST8(btxi_,2), BTLIST8(btxi_,3),
+    BTLIST8(btxi_,4), BTLIST8(btxi_,5), BTLIST8(btxi_,6), BTLIST8(btxi_,7),
+};
+
+/*
+ * BTEXPR: return a real ("real") or int ("int") valued function
+ * for expr, or NULL if the expression is not understood (or too many
+ * expressions are in use already). Both share the same program.
+ */
+
+proc btexpr(string type, string expr)
+{
+    btparser ps;
+    btprog *bp;
+    int k;
+
+    for (k = 0; k < nbtprogs; k++)		/* seen before? */
+	if (streq(btprogs[k]->expr, expr))
+	    break;
+    if (k == nbtprogs) {
+	if (nbtprogs == MAXBTEXPR) {
+	    dprintf(1,"btexpr: more than %d expressions\n", MAXBTEXPR);
+	    return NULL;
+	}
+	bp = (btprog *) allocate(sizeof(btprog));
+	ps.cp = expr;
+	ps.bp = bp;
+	ps.nest = 0;
+	bp->expr = expr;
+	if (bt_ternary(&ps) == 0 || (bt_space(&ps), *ps.cp != 0) ||
+	      !bt_compile(bp, &bp, 1, BTSTACK)) {
+	    dprintf(1,"btexpr: cannot interpret %s\n", expr);
+	    free(bp->pcode);
+	    free(bp);
+	    return NULL;
+	}
+	bp->expr = scopy(expr);
+	btprogs[nbtprogs++] = bp;
+	dprintf(1,"btexpr: %s: %d instructions, %d after folding, %d registers\n",
+		expr, bp->npcode, bp->ncode, bp->nreg);
+    }
+    return type[0] == 'i' ? (proc) btxi[k] : (proc) btxr[k];
+}
+
+/*
+ * BTREVAL, BTIEVAL: evaluate a function f obtained from btrtrans or
+ * btitrans for the n bodies btab[0..n-1], which have indices i0, i0+1, ..,
+ * into res[0..n-1].  Interpreted expressions are run a block of bodies
+ * at a time, and the blocks are shared out over the np= threads; other
+ * (loaded) functions are simply called for each body.
+ */
+
+#define MINPAR  (16*BTBLOCK)	/* fewer bodies are not worth the threads */
+
+local int btfind(proc f, proc *stubs)		/* index of f, or -1 */
+{
+    int k;
+
+    for (k = 0; k < nbtprogs; k++)
+	if (stubs[k] == f)
+	    return k;
+    return -1;
+}
+
+void btreval(rproc_body f, Body *btab, int n, real t, int i0, real *res)
+{
+    int i, k, nb, j = btfind((proc) f, (proc *) btxr);
+    btprog *bp = j < 0 ? NULL : btprogs[j];
+    double stk[BTSTACK*BTBLOCK], *s;
+
+    if (bp == NULL) {
+	for (i = 0; i < n; i++)
+	    res[i] = (*f)(btab+i, t, i0+i);
+	return;
+    }
+#if _OPENMP
+#pragma omp parallel for schedule(static) private(stk,s,k,nb) if (n > MINPAR)
+#endif
+    for (i = 0; i < n; i += BTBLOCK) {
+	nb = MIN(BTBLOCK, n-i);
+	btrun(bp, btab+i, nb, t, i0+i, stk);
+	s = stk + bp->out[0]*nb;
+	for (k = 0; k < nb; k++)
+	    res[i+k] = (real) s[k];
+    }
+}
+
+void btieval(iproc_body f, Body *btab, int n, real t, int i0, int *res)
+{
+    int i, k, nb, j = btfind((proc) f, (proc *) btxi);
+    btprog *bp = j < 0 ? NULL : btprogs[j];
+    double stk[BTSTACK*BTBLOCK], *s;
+
+    if (bp == NULL) {
+	for (i = 0; i < n; i++)
+	    res[i] = (*f)(btab+i, t, i0+i);
+	return;
+    }
+#if _OPENMP
+#pragma omp parallel for schedule(static) private(stk,s,k,nb) if (n > MINPAR)
+#endif
+    for (i = 0; i < n; i += BTBLOCK) {
+	nb = MIN(BTBLOCK, n-i);
+	btrun(bp, btab+i, nb, t, i0+i, stk);
+	s = stk + bp->out[0]*nb;
+	for (k = 0; k < nb; k++)
+	    res[i+k] = (int) s[k];
+    }
+}
+
+/*
+ * BTMEVAL: evaluate the nf functions f[] from btrtrans for the n bodies
+ * btab[0..n-1] into res[0..nf-1][0..n-1], as nf calls to btreval would.
+ * The interpreted expressions are fused into one program (see bt_compile),
+ * which computes their common subexpressions only once, in a single pass
+ * over the bodies.  Fused programs are kept for the next call.
+ */
+
+#define MAXFUSED  8
+
+local btprog *btfused[MAXFUSED];	/* the fused programs made so far */
+local int nbtfused = 0;
+
+local btprog *btfuse(int *memb, int nm)
+{
+    btprog *bp, *progs[MAXBTEXPR];
+    int j, k;
+
+    for (k = 0; k < nbtfused; k++) {
+	bp = btfused[k];
+	if (bp->nout != nm)
+	    continue;
+	for (j = 0; j < nm; j++)
+	    if (bp->memb[j] != memb[j])
+		break;
+	if (j == nm)
+	    return bp;
+    }
+    bp = (btprog *) allocate(sizeof(btprog));
+    for (j = 0; j < nm; j++)
+	progs[j] = btprogs[memb[j]];
+    if (!bt_compile(bp, progs, nm, MAXBTEXPR*BTSTACK))
+	error("btmeval: cannot fuse %d expressions", nm);
+    bp->memb = (int *) allocate(nm * sizeof(int));
+    memcpy(bp->memb, memb, nm * sizeof(int));
+    if (nbtfused == MAXFUSED) {			/* forget the oldest */
+	free(btfused[0]->code);
+	free(btfused[0]->out);
+	free(btfused[0]->memb);
+	free(btfused[0]);
+	memmove(btfused, btfused+1, (MAXFUSED-1) * sizeof(btprog *));
+	nbtfused--;
+    }
+    btfused[nbtfused++] = bp;
+    dprintf(1,"btmeval: %d expressions fused into %d instructions, %d registers\n",
+	    nm, bp->ncode, bp->nreg);
+    return bp;
+}
+
+void btmeval(rproc_body *f, int nf, Body *btab, int n, real t, int i0, real **res)
+{
+    int memb[MAXBTEXPR], slot[MAXBTEXPR];
+    int i, j, k, nb, nm = 0;
+    btprog *bp;
+    double *reg, *s;
+
+    for (j = 0; j < nf; j++) {
+	k = btfind((proc) f[j], (proc *) btxr);
+	if (k < 0 || nm == MAXBTEXPR)		/* not interpreted */
+	    btreval(f[j], btab, n, t, i0, res[j]);
+	else {
+	    memb[nm] = k;
+	    slot[nm++] = j;
+	}
+    }
+    if (nm == 0)
+	return;
+    bp = btfuse(memb, nm);
+#if _OPENMP
+#pragma omp parallel private(reg,s,i,j,k,nb) if (n > MINPAR)
+#endif
+    {
+	reg = (double *) allocate(bp->nreg * BTBLOCK * sizeof(double));
+#if _OPENMP
+#pragma omp for schedule(static)
+#endif
+	for (i = 0; i < n; i += BTBLOCK) {
+	    nb = MIN(BTBLOCK, n-i);
+	    btrun(bp, btab+i, nb, t, i0+i, reg);
+	    for (j = 0; j < nm; j++) {
+		s = reg + bp->out[j]*nb;
+		for (k = 0; k < nb; k++)
+		    res[slot[j]][i+k] = (real) s[k];
+	    }
+	}
+	free(reg);
+    }
+}
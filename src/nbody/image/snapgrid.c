@@ -30,6 +30,10 @@
  *       2-mar-11   5.3 implemented h3,h4 as moment -3 and -4
  *      18-may-12   5.4 added smoothing in VZ (szvar)
  *     13-feb-2013  6.0 units changed on a cube (now density instead of surface brightness?)
+ *     18-oct-2026  6.2 evaluate the expressions in chunks of bodies (btreval)
+ *     18-oct-2026  6.3 X and Y gridding by histogram(), for a chunk at a time;
+ *                      bodies exactly on the outer edge are now included
+ *     18-oct-2026  6.4 times= seeks via the item index, if there is one
  *
  * Todo: - mean=t may not be correct for nz>1 
  *       - hermite h3 and h4 for proper kinemetry
@@ -48,8 +52,10 @@
 #include <snapshot/body.h>      /* snapshot's */
 #include <snapshot/snapshot.h>
 #include <snapshot/get_snap.c>
+#include <bodytransc.h>
 
 #include <image.h>              /* images */
+#include <histogram.h>
 
 string defv[] = {		/* keywords/default values/help */
 	"in=???\n			  input filename (a snapshot)",
@@ -77,7 +83,7 @@ string defv[] = {		/* keywords/default values/help */
 	"stack=f\n			  Stack all selected snapshots?",
 	"integrate=f\n                    Sum or Integrate along 'dvar'?",
 	"proj=\n                          Sky projection (SIN, TAN, ARC, NCP, GLS, CAR, MER, AIT)",
-	"VERSION=6.1a\n			  9-feb-2024 PJT",
+	"VERSION=6.4\n			  18-oct-2026 PJT",
 	NULL,
 };
 
@@ -102,18 +108,19 @@ local string times;
 		/* IMAGE INTERFACE */
 local imageptr  iptr=NULL, iptr0=NULL, iptr1=NULL, iptr2=NULL, iptr3=NULL, iptr4=NULL;
 local int    nx,ny,nz;			     /* map-size */
+local Histogram xygrid;                     /* X-Y cells of the map */
 local real   xrange[3], yrange[3], zrange[3];      /* range of cube */
 local real   xbeam, ybeam, zbeam;                  /* >0 if convolution beams */
 local int    xedge, yedge, zedge;                  /* check if infinite edges */
 
 local string xvar, yvar, zvar;  	/* expression for axes */
 local string xlab, ylab, zlab;          /* labels for output */
-local rproc  xfunc, yfunc, zfunc;	/* bodytrans expression evaluator for axes */
+local rproc_body xfunc, yfunc, zfunc;	/* bodytrans expression evaluator for axes */
 local string *evar;
-local rproc  efunc[MAXVAR];
+local rproc_body efunc[MAXVAR];
 local int    nvar;			/* number of evar's present */
 local string dvar, tvar, svar, szvar;
-local rproc  dfunc, tfunc, sfunc, szfunc;
+local rproc_body dfunc, tfunc, sfunc, szfunc;
 
 local int    moment;	                /* moment to take in velocity */
 local real   zsig;			/* positive if convolution in Z used */
@@ -131,7 +138,6 @@ local string proj;
 local double xref, yref, xrefpix, yrefpix, xinc, yinc, rot;
 
 extern string  *burststring(string,string);
-extern rproc   btrtrans(string);
 
 
 local void setparams(void);
@@ -143,8 +149,6 @@ local void bin_data(int ivar);
 local void free_snap(void);
 local void los_data(void);
 local void rescale_data(int ivar);
-local int xbox(real x);
-local int ybox(real y);
 local int zbox(real z);
 local real odepth(real tau);
 local void setaxis(string rexp, real range[3], int n, int *edge, real *beam);
@@ -259,6 +263,10 @@ void setparams()
 
     }
 
+    ini_histogram(&xygrid, 2);                  /* the X and Y cells */
+    uniform_histogram(&xygrid, 0, nx, MIN(xrange[0],xrange[1]), MAX(xrange[0],xrange[1]));
+    uniform_histogram(&xygrid, 1, ny, MIN(yrange[0],yrange[1]), MAX(yrange[0],yrange[1]));
+
     setaxis(getparam("zrange"), zrange, nz, &zedge, &zbeam);
     if (zbeam > 0.0) {                          /* with convolve */
         zsig = zbeam;                           /* beam */
@@ -328,6 +336,11 @@ int read_snap()
 {		
     for(;;) {		
         get_history(instr);
+        if (!streq(times,"all") &&      /* jump to the next in range */
+            get_index_seek(instr, SnapShotTag, times, TIMEFUZZ) == 0) {
+            bits = 0;
+            break;
+        }
         get_snap(instr,&btab,&nobj,&tnow,&bits);
         if (bits==0) 
             break;           /* no snapshot at all */
@@ -464,6 +477,36 @@ local Point **map =NULL;
 local int pcomp(Point **a, Point **b);
 //local int pcomp(void *, void *);
 
+/*
+ * The expressions are evaluated for a chunk of NCHUNK bodies at a time
+ */
+
+#define NCHUNK 4096
+
+local real xval[NCHUNK], yval[NCHUNK], zval[NCHUNK], fval[NCHUNK];
+local real tval[NCHUNK], dval[NCHUNK], sval[NCHUNK];
+local long cval[NCHUNK];                /* X-Y cell, < 0 if outside */
+
+local void eval_chunk(int ivar, Body *bp, int n, int i0)
+{
+    int i;
+
+    btreval(xfunc, bp, n, tnow, i0, xval);
+    btreval(yfunc, bp, n, tnow, i0, yval);
+    btreval(zfunc, bp, n, tnow, i0, zval);
+    btreval(efunc[ivar], bp, n, tnow, i0, fval);
+    if (Qdepth || Qint) {
+        btreval(tfunc, bp, n, tnow, i0, tval);
+        btreval(dfunc, bp, n, tnow, i0, dval);
+    }
+    if (Qsmooth)
+        btreval(sfunc, bp, n, tnow, i0, sval);
+    if (Qwcs)                           /* convert to an astronomical WCS, if requested */
+        for (i=0; i<n; i++)
+            wcs(&xval[i],&yval[i]);
+    index_histogram(&xygrid, n, xval, yval, NULL, cval);
+}
+
 void bin_data(int ivar)
 {
     real brightness, cell_factor, x, y, z, z0, t,sum;
@@ -505,28 +548,30 @@ void bin_data(int ivar)
 
 		/* big loop: walk through all particles and accumulate ccd data */
     for (i=0, bp=btab; i<nobj; i++, bp++) {
-        x = xfunc(bp,tnow,i);            /* transform */
-	y = yfunc(bp,tnow,i);
-	if (Qwcs) wcs(&x,&y);            /* convert to an astronomical WCS, if requested */
-        z = zfunc(bp,tnow,i);
-        flux = efunc[ivar](bp,tnow,i);
+        if (i % NCHUNK == 0)             /* transform the next chunk */
+            eval_chunk(ivar, bp, MIN(NCHUNK, nobj-i), i);
+        j = i % NCHUNK;
+        x = xval[j];
+	y = yval[j];
+        z = zval[j];
+        flux = fval[j];
         if (Qdepth || Qint) {
-            emtau = odepth( tfunc(bp,tnow,i) );
-            depth = dfunc(bp,tnow,i);
+            emtau = odepth( tval[j] );
+            depth = dval[j];
 	}
         if (Qsmooth) {
-            twosqs = sfunc(bp,tnow,i);
+            twosqs = sval[j];
             twosqs = 2.0 * sqr(twosqs);
         }
 
-	ix0 = xbox(x);                  /* direct gridding in X and Y */
-	iy0 = ybox(y);
-
-
-	if (ix0<0 || iy0<0) {           /* outside area (>= nx,ny never occurs */
+	if (cval[j] < 0) {              /* outside area */
 	    noutxy++;
 	    continue;
 	}
+	ix0 = cval[j] % nx;             /* direct gridding in X and Y */
+	iy0 = cval[j] / nx;
+	if (xrange[2] < 0) ix0 = nx-1-ix0;
+	if (yrange[2] < 0) iy0 = ny-1-iy0;
         if (z<zmin || z>zmax) {         /* initial check in Z */
             noutz++;
             continue;
@@ -891,30 +936,6 @@ void rescale_data(int ivar)
  *	allows edges at infinity
  */
 
-int xbox(real x)
-{
-    if (xrange[0] < xrange[1]) {
-        if (xrange[0]<x && x<xrange[1])
-            return (int)floor((x-xrange[0])/xrange[2]);
-    } else if (xrange[1] < xrange[0]) {
-        if (xrange[1]<x && x<xrange[0])
-            return (int)floor((x-xrange[0])/xrange[2]);
-    } 
-    return -1;
-}
-
-int ybox(real y)
-{
-    if (yrange[0] < yrange[1]) {
-        if (yrange[0]<y && y<yrange[1])
-            return (int)floor((y-yrange[0])/yrange[2]);
-    } else if (yrange[1] < yrange[0]) {
-        if (yrange[1]<y && y<yrange[0])
-            return (int)floor((y-yrange[0])/yrange[2]);
-    } 
-    return -1;
-}
-
 int zbox(real z)
 {
     if (zedge==0x03)			/* Both edges at infinity */
@@ -10,6 +10,8 @@
  *      10-mar-04  V1.4  add log=                                       pjt
  *      27-jul-05   1.5  added sort=                                    pjt
  *       1-apr-21   1.6  deal with no masses in snapshot for Tjeerd     pjt
+ *      18-oct-26   1.7  only read the items needed                     pjt
+ *      18-oct-26   1.8  evaluate sort= for all bodies at once          pjt
  *
  *  Bug: if the massfractions are too close such that there
  *       are bins withouth mass, this algorithm fails
@@ -32,7 +34,7 @@ string defv[] = {
     "tab=f\n			Full table of r,m(r) ? ",
     "log=f\n                    Print radii in log10() ? ",
     "sort=r\n                   Observerble to sort masses by",
-    "VERSION=1.6\n              1-apr-2021 PJT",
+    "VERSION=1.8\n              18-oct-2026 PJT",
     NULL,
 };
 
@@ -58,6 +60,7 @@ void nemo_main()
     rproc_body sortptr;
 
     sortptr = btrtrans(getparam("sort"));
+    get_snap_mask = MassBit | PhaseSpaceBit | btbits(getparam("sort"));
     
     nfract = nemoinpr(getparam("fraction"),mf,MFRACT);
     if (nfract<1) error("Illegal or bad parsed fraction=%s",
@@ -120,9 +123,12 @@ void snapsort(Body *btab, int nbody, real tsnap, rproc_body sortptr)
 {
     int i;
     Body *b;
+    real *r = (real *) allocate(nbody*sizeof(real));
 
+    btreval(sortptr, btab, nbody, tsnap, 0, r);
     for (i = 0, b = btab; i < nbody; i++, b++)
-      Aux(b) = sortptr(b,tsnap,i);
+      Aux(b) = r[i];
+    free(r);
     qsort(btab, nbody, sizeof(Body), rank_aux);
 }
 
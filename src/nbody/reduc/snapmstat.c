@@ -11,6 +11,7 @@
  *	15-mar-95  V1.2  default not sorted by mass, output format	PJT
  *       6-feb-2010  V2.0  also report a select= type for glnemo2       PJT
  *                         default for sort=f
+ *      18-oct-2026  V2.2  read only the masses, in batches if not sorted  PJT
  */
 
 #include <stdinc.h>
@@ -21,6 +22,7 @@
 
 #include <snapshot/snapshot.h>	
 #include <snapshot/barebody.h>  /* not a full body needed */
+#define GET_SNAP_CURSOR         /* get_snap_open/next/close */
 #include <snapshot/get_snap.c>
 
 string defv[] = {
@@ -28,7 +30,8 @@ string defv[] = {
     "sort=f\n       Sort masses before processing?",    
     "species=100\n  Maximum number of species",
     "show=f\n       Show only the select= for glnemo2",
-    "VERSION=2.1\n  28-nov-2023 PJT",
+    "batch=65536\n  Number of bodies read at a time if not sorted",
+    "VERSION=2.2\n  18-oct-2026 PJT",
     NULL,
 };
 
@@ -42,7 +45,7 @@ void nemo_main(void)
 {
     stream instr;
     real   mold, tsnap, mtot, mcum;
-    int    i, iold, icum, nbody, bits, nspecies, maxspecies, scount;
+    int    i, iold, icum, nbody, bits, nspecies, maxspecies, scount, nb, nbatch;
     bool   Qsort = getbparam("sort");
     bool   Qshow = getbparam("show");
     Body *btab = NULL, *bp;
@@ -51,22 +54,35 @@ void nemo_main(void)
     maxspecies = getiparam("species");
     nsp = (int *) allocate(maxspecies * sizeof(int));
 
+    nbatch = getiparam("batch");
+    if (nbatch < 1) error("batch=%d must be positive",nbatch);
+
     instr = stropen(getparam("in"), "r");
     get_history(instr);
     if (!get_tag_ok(instr, SnapShotTag))
 	error("Not a snapshot");
-    get_snap(instr, &btab, &nbody, &tsnap, &bits);
-    if ((bits & MassBit) == 0)
-	error("No masses");
-    if (Qsort)
+    get_snap_mask = MassBit;
+    if (Qsort) {                    /* sorting needs all masses at once */
+        get_snap(instr, &btab, &nbody, &tsnap, &bits);
+        if ((bits & MassBit) == 0)
+            error("No masses");
         snapsort(btab,nbody);
+        nb = nbody;
+    } else {                        /* else one batch at a time */
+        get_snap_open(instr, &nbody, &tsnap, &bits, "all");
+        if ((bits & MassBit) == 0)
+            error("No masses");
+        btab = (Body *) allocate(nbatch * sizeof(Body));
+        nb = get_snap_next(instr, btab, nbatch);
+    }
 
     mold = Mass(btab);      /* set first mass */
     mtot = mold;
     mcum = mold;
     iold = 0;
     scount = -1;
-    for (i=0, bp = btab; bp < btab+nbody; i++, bp++) {
+    for (i=0; nb > 0; nb = Qsort ? 0 : get_snap_next(instr, btab, nbatch))
+      for (bp = btab; bp < btab+nb; i++, bp++) {
         if (Mass(bp) != mold) {
 	  if (!Qshow) printf("%d %d:%d  = %d Mass= %g TotMas= %g CumMas= %g\n",
 			     scount+1, iold, i-1, i-iold,mold, mtot, mcum);
@@ -81,7 +97,9 @@ void nemo_main(void)
             mtot += Mass(bp);
             mcum += Mass(bp);
         }
-    }
+      }
+    if (!Qsort)
+        get_snap_close(instr);
     if (!Qshow) printf("%d %d:%d = %d Mass= %g TotMas= %g CumMas= %g\n",
 		       scount+1, iold, i-1, i-iold, mold, mtot, mcum);
     nsp[scount+1] = i-iold;
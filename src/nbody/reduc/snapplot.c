@@ -24,6 +24,9 @@
  *          c 7-oct-02  atof->natof					  pjt
  *      V3.5  9-oct-03  finally able to read the new snapshot(5NEMO) style PJT
  *      V3.5b  11-oct-21 C99 build                                         PPT
+ *      V3.6  18-oct-26 evaluate expressions once for all bodies (btreval)  pjt
+ *      V3.7  18-oct-26 times= seeks via the item index, if there is one    pjt
+ *      V3.8  18-oct-26 evaluate in chunks of bodies, no full body table    pjt
  */
 
 #include <stdinc.h>
@@ -33,6 +36,7 @@
 #include <filefn.h>
 #include <snapshot/snapshot.h>
 #include <snapshot/body.h>
+#include <bodytransc.h>
 #include <loadobj.h>
 #include <yapp.h>
 #include <axis.h>
@@ -70,7 +74,7 @@ string defv[] = {
 #endif
     "frame=\n			  base filename for rasterfiles(5)",
     "trak=\n                      alternative for trakplot (t|f)",
-    "VERSION=3.5b\n		  14-oct-2021 PPT",
+    "VERSION=3.8\n		  18-oct-2026 PJT",
     NULL,
 };
 
@@ -84,11 +88,11 @@ local bool trakflag;			/* if TRUE, plot trajectories */
 local string input, times;
 local stream instr;
 local string xvar, yvar;
-local btrproc xfunc, yfunc;
+local rproc_body xfunc, yfunc;
 local string xlabel, ylabel;
 local string visib, psize, color;
-local btiproc vfunc;
-local btrproc pfunc, cfunc;
+local iproc_body vfunc;
+local rproc_body pfunc, cfunc;
 local string frame;
 local bool fillcircle;
 local bool formal;
@@ -341,6 +345,9 @@ bool scansnap(void)
     success = FALSE;
     while (! success) {
 	get_history(instr);
+	if (! streq(times, "all") &&		/* jump to the next in range */
+	      get_index_seek(instr, SnapShotTag, times, TIMEFUZZ) == 0)
+	    return (FALSE);
 	if (! get_tag_ok(instr, SnapShotTag))
 	    return (FALSE);
 	get_set(instr, SnapShotTag);
@@ -487,50 +494,87 @@ void setticks(real tiks[], int *ntik, string tikstr)
 #endif
 }
 
+/*
+ * The bodies are copied, and their expressions evaluated (btreval), a
+ * chunk of NCHUNK bodies at a time, for each visibility layer in turn.
+ */
+
+#define NCHUNK 4096
+
+local Body btab[NCHUNK];
+local real xval[NCHUNK], yval[NCHUNK], pval[NCHUNK];
+local int  vval[NCHUNK];
+#ifdef COLOR
+local real cval[NCHUNK];
+#endif
+
+local int eval_chunk(int i0, int n, real t, int visnow, int *vismax)
+{
+    real *mp, *psp, *pp, *ap, *acp;
+    int i, nvis = 0;
+    Body *b;
+
+    mp  = (massptr != NULL ? massptr + i0 : NULL);   /* set data pointers   */
+    psp = phaseptr + 2*NDIM*i0;
+    pp  = (phiptr != NULL ? phiptr + i0 : NULL);
+    ap  = (auxptr != NULL ? auxptr + i0 : NULL);
+    acp = (accptr != NULL ? accptr + NDIM*i0 : NULL);
+    for (i = 0, b = btab; i < n; i++, b++) {   /* copy the chunk of bodies */
+	Mass(b) = (mp != NULL ? *mp++ : 0.0);
+						/*   set mass if supplied   */
+	SETV(Pos(b), psp);                      /*   always set position    */
+	psp += NDIM;                            /*   and advance p.s. ptr   */
+	SETV(Vel(b), psp);                      /*   always set velocity    */
+	psp += NDIM;                            /*   and advance ptr        */
+	Phi(b) = (pp != NULL ? *pp++ : 0.0);
+	Aux(b) = (ap != NULL ? *ap++ : 0.0);
+	if (acp) {
+	    SETV(Acc(b),acp);                   /*   set accel's            */
+	    acp += NDIM;                        /*   and advance ptr        */
+	} else
+	    CLRV(Acc(b));                       /*   zero unsupported fields*/
+	Key(b) = 0;
+    }
+    btieval(vfunc, btab, n, t, i0, vval);       /* evaluate visibility      */
+    for (i = 0; i < n; i++) {
+	*vismax = MAX(*vismax, vval[i]);        /*   remember how hi to go  */
+	if (vval[i] == visnow) nvis++;
+    }
+    if (nvis == 0) return 0;                    /* nothing in this layer    */
+    btreval(xfunc, btab, n, t, i0, xval);       /* x,y coords and point     */
+    btreval(yfunc, btab, n, t, i0, yval);       /* size of the chunk        */
+    btreval(pfunc, btab, n, t, i0, pval);
+#ifdef COLOR
+    btreval(cfunc, btab, n, t, i0, cval);
+#endif
+    return nvis;
+}
+
 void plotsnap()
 {
-    real t, *mp, *psp, *pp, *ap, *acp;
-    int vismax, visnow, i, vis, icol;
+    real t;
+    int vismax, visnow, i, i0, n, icol;
     real psz, col, x, y;
-    Body b;
 
-    t = (timeptr != NULL ? *timeptr : 0.0);	/* get current time value   */
-    CLRV(Acc(&b));				/* zero unsupported fields  */
-    Key(&b) = 0;
+    t = (timeptr != NULL ? *timeptr : 0.0);     /* get current time value   */
     visnow = vismax = 0;
-    do {					/* loop painting layers     */
-	visnow++;				/*   make next layer visib. */
-	mp  = massptr;				/*   (re)set data pointers  */
-	psp = phaseptr;
-	pp  = phiptr;
-	ap  = auxptr;
-	acp = accptr;
-	for (i = 0; i < nbody; i++) {		/*   loop over all bodies   */
-	    Mass(&b) = (mp != NULL ? *mp++ : 0.0);
-						/*     set mass if supplied */
-	    SETV(Pos(&b), psp);			/*     always set position  */
-	    psp += NDIM;			/*     and advance p.s. ptr */
-	    SETV(Vel(&b), psp);			/*     always set velocity  */
-	    psp += NDIM;			/*     and advance ptr      */
-	    Phi(&b) = (pp != NULL ? *pp++ : 0.0);	
-	    Aux(&b) = (ap != NULL ? *ap++ : 0.0);
-	    if (acp) {				
-	    	SETV(Acc(&b),acp);		/*     set accel's          */	
-	    	acp += NDIM;			/*     and advance ptr      */
-	    }
-	    					/*     set phi,aux if given */
-	    vis = (*vfunc)(&b, t, i);		/*     evaluate visibility  */
-	    vismax = MAX(vismax, vis);		/*     remember how hi to go*/
-	    if (vis == visnow) {		/*     if body is visible   */
-		x = xtrans((*xfunc)(&b, t, i));	/*       evaluate x,y coords*/
-		y = ytrans((*yfunc)(&b, t, i));
+    do {                                        /* loop painting layers     */
+	visnow++;                               /*   make next layer visib. */
+	for (i0 = 0; i0 < nbody; i0 += NCHUNK) {  /* loop over all chunks   */
+	    n = MIN(NCHUNK, nbody - i0);
+	    if (eval_chunk(i0, n, t, visnow, &vismax) == 0)
+		continue;
+	    for (i = 0; i < n; i++) {           /*   loop over its bodies   */
+		if (vval[i] != visnow)          /*     if body is visible   */
+		    continue;
+		x = xtrans(xval[i]);            /*       transform x,y      */
+		y = ytrans(yval[i]);
 		if (xbox[0] < x && x < xbox[1] && ybox[0] < y && y < ybox[1]) {
-		    psz = (*pfunc)(&b, t, i);	/*         eval point size  */
+		    psz = pval[i];              /*         point size       */
 #ifdef COLOR
-		    col = (*cfunc)(&b, t, i);
-                    col = (col - crange[0])/(crange[1] - crange[0]);
+		    col = (cval[i] - crange[0])/(crange[1] - crange[0]);
 		    icol = 1 + (plncolors() - 2) *
-			         MAX(0.0, MIN(1.0, col));
+				 MAX(0.0, MIN(1.0, col));
 		    plcolor(icol);
 #endif
 		    if (psz == 0.0)
@@ -554,7 +598,7 @@ void plotsnap()
     plcolor(32767);				/* reset to white */
 #endif
 }
-
+
 #ifdef HACKTRACK
 
 #define X0  -0.61
@@ -20,6 +20,10 @@
  *      31-dec-02       V2.1 gcc3/SINGLEPREC             pjt
  *       4-sep-03       V2.2 allow CSV output based      pjt
  *      24-feb-04       V2.4 add newline=t               pjt
+ *      18-oct-26       V2.5 read in batches of bodies (batch=), and only
+ *                           the items needed for options=   pjt
+ *      18-oct-26       V2.6 evaluate the options a batch at a time  pjt
+ *      18-oct-26       V2.7 all options in one fused pass (btmeval)  pjt
  */
 
 #include <stdinc.h>
@@ -31,6 +35,7 @@
 
 #include <snapshot/snapshot.h>	
 #include <snapshot/body.h>
+#define GET_SNAP_CURSOR
 #include <snapshot/get_snap.c>
 #include <bodytransc.h>
 
@@ -45,7 +50,8 @@ string defv[] = {
     "newline=f\n                add newline in the header?",
     "csv=f\n                    Use Comma Separated Values format",
     "comment=f\n                Add table columns as common, instead of debug",
-    "VERSION=2.4\n		24-feb-04 PJT",
+    "batch=65536\n              Number of bodies read at a time (separ= reads all)",
+    "VERSION=2.7\n		18-oct-26 PJT",
     NULL,
 };
 
@@ -58,17 +64,18 @@ extern string *burststring(string,string);
 void nemo_main()
 {
     stream instr, tabstr;
-    real   tsnap, dr, aux;
+    real   tsnap, dr;
     string times;
     Body *btab = NULL, *bp, *bq;
     bool   Qsepar, Qhead = getbparam("header");
     bool   Qcsv = getbparam("csv");
     bool   Qcomment = getbparam("comment");
     bool   Qnewline = getbparam("newline");
-    int i, n, nbody, bits, nsep, isep, nopt, ParticlesBit;
+    int i, k, n, nbody, bits, nsep, isep, nopt, ParticlesBit, nb, nbatch;
     char fmt[20],*pfmt;
     string *opt;
     rproc_body fopt[MAXOPT];
+    real *col[MAXOPT];
 
     ParticlesBit = (MassBit | PhaseSpaceBit | PotentialBit | AccelerationBit |
             AuxBit | KeyBit | DensBit | EpsBit);
@@ -76,14 +83,18 @@ void nemo_main()
 
     opt = burststring(getparam("options"),", ");
     nopt = 0;					/* count options */
+    get_snap_mask = 0;
     while (opt[nopt]) {				/* scan through options */
         fopt[nopt] = btrtrans(opt[nopt]);
+        get_snap_mask |= btbits(opt[nopt]);	/* items needed */
         nopt++;
         if (nopt==MAXOPT) {
             dprintf(0,"\n\nMaximum number of options = %d exhausted\n",MAXOPT);
             break;
         }
     }
+    if (get_snap_mask == 0)			/* e.g. options=i: count all */
+        get_snap_mask = ~0;
     if (Qcomment) {
       printf("# ");
       for (i=0; i<nopt; i++)
@@ -111,8 +122,11 @@ void nemo_main()
     if (nsep) {
       dprintf(1,"Printing log10 of every %d-th PP distance\n",nsep);
       Qsepar=TRUE;
+      get_snap_mask |= PhaseSpaceBit;
     } else
       Qsepar=FALSE;
+    nbatch = getiparam("batch");
+    if (nbatch < 1) error("batch=%d must be positive",nbatch);
 
 
     get_history(instr);                 /* read history */
@@ -121,30 +135,39 @@ void nemo_main()
 	get_history(instr);
         if (!get_tag_ok(instr, SnapShotTag))
             break;                                  /* done with work */
-#if 0
-        get_snap(instr, &btab, &nbody, &tsnap, &bits);
-        if (!streq(times,"all") && !within(tsnap,times,0.0001))
-            continue;                   /* skip work on this snapshot */
-#else
-        get_snap_by_t(instr, &btab, &nbody, &tsnap, &bits, times);	
-#endif
-        if ( (bits & ParticlesBit) == 0)
-            continue;                   /* skip work, only diagnostics here */
 	if (!Qsepar) {				/* printf options */
+	    if (!get_snap_open(instr, &nbody, &tsnap, &bits, times))
+	        break;
+	    if ( (bits & ParticlesBit) == 0) {
+	        get_snap_close(instr);
+	        continue;               /* skip work, only diagnostics here */
+	    }
 	    if (Qhead) {
 	      fprintf(tabstr,"%d ",nbody);
 	      if (Qnewline) fprintf(tabstr,"\n");
 	      fprintf(tabstr,"%g\n",tsnap);
 	    }
-            for (bp = btab, i=0; bp < btab+nbody; bp++, i++) {
-                for (n=0; n<nopt; n++) {
-                    aux = fopt[n](bp,tsnap,i);
-		    if (Qcsv && n>0) fprintf(tabstr,",");
-                    fprintf(tabstr,fmt,aux);
-                }
-                fprintf(tabstr,"\n");
-            }
+	    if (btab == NULL) {
+	        btab = (Body *) allocate(nbatch * sizeof(Body));
+	        for (n=0; n<nopt; n++)
+	            col[n] = (real *) allocate(nbatch * sizeof(real));
+	    }
+	    i = 0;
+	    while ((nb = get_snap_next(instr, btab, nbatch)) > 0) {
+	        btmeval(fopt, nopt, btab, nb, tsnap, i, col);	/* all columns */
+	        for (k=0; k<nb; k++, i++) {
+	            for (n=0; n<nopt; n++) {
+		        if (Qcsv && n>0) fprintf(tabstr,",");
+	                fprintf(tabstr,fmt,col[n][k]);
+	            }
+	            fprintf(tabstr,"\n");
+	        }
+	    }
+	    get_snap_close(instr);
         } else {
+            get_snap_by_t(instr, &btab, &nbody, &tsnap, &bits, times);
+            if ( (bits & ParticlesBit) == 0)
+                continue;               /* skip work, only diagnostics here */
             isep=nsep;
             for (bp=btab+1; bp<btab+nbody; bp++)
                 for (bq=btab; bq<bp; bq++) {
@@ -4,8 +4,10 @@
  *    mkplummer p6 1000000 massname='n(m)' massrange=1,2
  *    time snapbench p6 'mass=3.1415'   bodytrans=f iter=10
  *    time snapbench p6 'mass=3.1415*m' bodytrans=f iter=10  
+ *    time snapbench p6 'mass=3.1415*m' batch=t iter=10
  *  
  *     13-mar-05  Created after Walter's comment at Vegas05          PJT
+ *     18-oct-26  V1.1 added batch=                                  PJT
  */
 #include <stdinc.h>
 #include <getparam.h>
@@ -16,14 +18,16 @@
 #include <snapshot/body.h>
 #include <snapshot/get_snap.c>
 #include <snapshot/put_snap.c>
+#include <bodytransc.h>
 
 string defv[] = {
     "in=???\n		      input (snapshot) file",
     "mass=1\n		      expression for new masses",
     "bodytrans=t\n            Use bodytrans",
+    "batch=f\n                Use bodytrans on all bodies at once (btreval)",
     "iter=10\n                Number of iterations to test",
     "out=\n                   output (snapshot) file, if needed",
-    "VERSION=1.0\n            13-mar-05 PJT",
+    "VERSION=1.1\n            18-oct-26 PJT",
     NULL,
 };
 
@@ -36,10 +40,10 @@ extern double frandom(double, double, rproc);
 nemo_main()
 {
     stream instr, outstr;
-    real   tsnap, mscale;
+    real   tsnap, mscale, *mass;
     Body  *btab = NULL, *bp;
     int i, j, n, nbody, nbodymass, bits, bitsmass, seed;
-    rproc  bfunc, btrtrans();
+    rproc_body bfunc;
 
     instr = stropen(getparam("in"), "r");
     outstr = hasvalue("out") ? stropen(getparam("out"),"w") : NULL;
@@ -51,7 +55,17 @@ nemo_main()
       error("not a snapshot");
     get_snap(instr, &btab, &nbody, &tsnap, &bits);
 
-    if (getbparam("bodytrans")) {
+    if (getbparam("batch")) {
+      dprintf(0,"bodytrans batch scaling, iter=%d\n",n);
+      bfunc = btrtrans(getparam("mass"));
+      mass = (real *) allocate(nbody*sizeof(real));
+      for (j=0; j<n; j++) {
+	btreval(bfunc, btab, nbody, tsnap, 0, mass);
+	for (bp=btab, i=0; i<nbody; bp++,i++)
+	  Mass(bp) = mass[i];
+      }
+      free(mass);
+    } else if (getbparam("bodytrans")) {
       dprintf(0,"bodytrans scaling, iter=%d\n",n);
       bfunc = btrtrans(getparam("mass"));     /* use bodytrans expression */
 
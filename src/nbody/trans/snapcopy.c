@@ -9,6 +9,7 @@
  *      13-feb-04       V1.1f    silenced more compiler warnings (shetty bug?)
  *      15-nov-06        1.2    set time to 0 if it was absent     PJT/AP
  *    27-dec-2019        1.3    special case body= selection
+ *    18-oct-2026        2.1    a long body count (SnapCount)              PJT
  *
  *	BUG: should optionally copy other sets within the snapshot
  *	     set, e.g. diagnostics and story
@@ -20,6 +21,7 @@
 #include <filestruct.h>
 #include <history.h>
 				/* new filestruct */
+#define SnapCount long
 #include <snapshot/snapshot.h>	
 #include <snapshot/body.h>
 #include <snapshot/get_snap.c>
@@ -35,7 +37,7 @@ string defv[] = {
     "precision=double\n Precision of results to store (double/single) [unused]",
     "keep=all\n         Items to copy in snapshot",
     "i=-1\n             Select one body to select (overrides select=)",
-    "VERSION=2.0a\n     8-aug-2022 PJT",
+    "VERSION=2.1\n      18-oct-2026 PJT",
     NULL,
 };
 
@@ -50,7 +52,8 @@ void nemo_main(void)
     real   tsnap;
     string times, precision, keep;
     Body   *btab = NULL, *bpi, *bpo;
-    int    i, nbody, nout, nreject, bitsi, bitso, vis, visnow, vismax;
+    long   i, nbody, nout, nreject;
+    int    bitsi, bitso, vis, visnow, vismax;
     int    isnap = 0;
     bool   Qall;
     int    ibody = getiparam("i");
@@ -114,8 +117,8 @@ void nemo_main(void)
 	  do {				/* loop through all particles */
 	    visnow++;
             for (bpi = btab, i=0; i<nbody; bpi++,i++) {
-	      vis = (*sfunc)(bpi, tsnap, i);
-	      dprintf(2,"sfunc [%d] = %d\n",i,vis);
+	      vis = (*sfunc)(bpi, tsnap, (int) i);
+	      dprintf(2,"sfunc [%ld] = %d\n",i,vis);
 	      vismax = MAX(vismax,vis);
 	      if (vis==visnow)
 		Key(bpi) = 1;
@@ -143,7 +146,7 @@ void nemo_main(void)
             } else
                 bitsi = bitso;      
             put_snap(outstr, &btab, &nout, &tsnap, &bitsi);
-            dprintf (1,"Snapshot time=%f copied %d particles\n",
+            dprintf (1,"Snapshot time=%f copied %ld particles\n",
 				tsnap,nout);
         } else
            dprintf(0,"No particles to copy at tsnap=%f\n",tsnap);
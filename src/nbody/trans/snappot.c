@@ -2,6 +2,7 @@
  *  SNAPPOT:    add a potential force/acc to a snapshot
  *
  *  25-mar-05   Created         Peter Teuben
+ *  18-oct-26   V1.1  all bodies in one potential_double_n call   PJT
  *
  */
 
@@ -26,7 +27,7 @@ string defv[] = {
   "potpars=\n           parameters to potential",
   "potfile=\n           optional filename to potential",
   "times=all\n          Which times to work on",
-  "VERSION=1.0\n	4-apr-97 pjt",
+  "VERSION=1.1\n	18-oct-2026 pjt",
   NULL,
 };
 
@@ -42,18 +43,17 @@ void nemo_main(void)
   real   tsnap;
   string times;
   Body *btab = NULL, *bp;
-  int nbody, bits;
-  potproc_real pot;
+  int nbody, bits, i, k;
+  potproc_double_n pot;
   real ome,ome2,half_ome2,two_ome;
 
-  vector lacc,lpos;
-  real   lphi;
-  int    ndim=NDIM;
+  double *lpos = NULL, *lacc = NULL, *lphi = NULL, ltime;
+  int    ndim=NDIM, nmax = 0;
 
 
   times = getparam("times");
 
-  pot = get_potential (getparam("potname"),
+  pot = get_potential_double_n (getparam("potname"),
 		       getparam("potpars"), 
 		       getparam("potfile"));
   ome = get_pattern();     /* pattern speed first par of potential */
@@ -79,18 +79,27 @@ void nemo_main(void)
     else if (!streq(times,"all") && !within(tsnap, times, TIMEFUZZ))
       continue;		/* however skip this snapshot */
     dprintf (1,"Snapshot time=%f shifting\n",tsnap);
-    for (bp = btab; bp < btab+nbody; bp++) {
-      SETV(lpos,Pos(bp));
-      (*pot)(&ndim,lpos,lacc,&lphi,&tsnap);
+    if (nbody > nmax) {		/* positions and forces by coordinate */
+      nmax = nbody;
+      lpos = (double *) reallocate(lpos, ndim*nmax*sizeof(double));
+      lacc = (double *) reallocate(lacc, ndim*nmax*sizeof(double));
+      lphi = (double *) reallocate(lphi, nmax*sizeof(double));
+    }
+    for (bp = btab, i = 0; bp < btab+nbody; bp++, i++)
+      for (k = 0; k < ndim; k++)
+	lpos[k*nbody+i] = Pos(bp)[k];
+    ltime = tsnap;
+    (*pot)(&ndim,&nbody,lpos,lacc,lphi,&ltime);
 
+    for (bp = btab, i = 0; bp < btab+nbody; bp++, i++) {
       if (ome!=0.0) {
-	lphi -= half_ome2*(sqr(lpos[0])+sqr(lpos[1]));
-	lacc[0] += ome2*lpos[0] + two_ome*Vel(bp)[1];
-	lacc[1] += ome2*lpos[1] - two_ome*Vel(bp)[0];
+	lphi[i] -= half_ome2*(sqr(lpos[i])+sqr(lpos[nbody+i]));
+	lacc[i]       += ome2*lpos[i]       + two_ome*Vel(bp)[1];
+	lacc[nbody+i] += ome2*lpos[nbody+i] - two_ome*Vel(bp)[0];
       }
-
-      Phi(bp) = lphi;
-      SETV(Acc(bp),lacc);
+      Phi(bp) = lphi[i];
+      for (k = 0; k < ndim; k++)
+	Acc(bp)[k] = lacc[k*nbody+i];
     }
     bits |= (PotentialBit|AccelerationBit|TimeBit);
     put_snap(outstr, &btab, &nbody, &tsnap, &bits);
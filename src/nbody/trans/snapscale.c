@@ -20,6 +20,7 @@
  *       8-oct-01        3.2    add Dens and Eps
  *       8-aug-05           a   fix aux normalization 
  *       1-dec-05           b   fix softening and density scaling
+ *      18-oct-26        3.3    use the SoaBody layout                     PJT
  */
 
 #include <stdinc.h>
@@ -28,7 +29,7 @@
 #include <filestruct.h>
 
 #include <snapshot/snapshot.h>	
-#include <snapshot/body.h>
+#include <snapshot/soabody.h>
 #include <snapshot/get_snap.c>
 #include <snapshot/put_snap.c>
 
@@ -45,7 +46,7 @@ string defv[] = {
     "dscale=1\n     Dens scale factor",
     "escale=1\n     Eps scale factor",
     "times=all\n    Times to select snapshots from",
-    "VERSION=3.2b\n 1-dec-05 PJT",
+    "VERSION=3.3\n  18-oct-2026 PJT",
     NULL,
 };
 
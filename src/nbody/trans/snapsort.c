@@ -10,6 +10,7 @@
  *     1-nov-07       a  bug when Aux is present                    pjt
  *    29-feb-08          fix a memory leak on btab                  jcl
  *    19-Jun-09          fix a bug when Aux is present              jcl
+ *    18-oct-26   V1.7   rank evaluated for all bodies at once      pjt
  */
 
 #include <stdinc.h>
@@ -29,7 +30,7 @@ string defv[] = {
     "rank=r\n	        Value used in ranking particles",
     "times=all\n        Range of times to process ",
     "sort=qsort\n       Sort mode {qsort;...}",
-    "VERSION=1.6\n      11-oct-2023 PJT ",
+    "VERSION=1.7\n      18-oct-2026 PJT ",
     NULL,
 };
 
@@ -90,7 +91,7 @@ void snapsort(
 {
     int i;
     Body *b;
-    real *aux;
+    real *aux, *r;
 
     if (Qaux) {  /* make backup copy of Aux */
       aux = (real *) allocate(nbody*sizeof(real));
@@ -101,11 +102,12 @@ void snapsort(
       for (i = 0, b = btab; i < nbody; i++, b++)
 	Key(b) = i;
     }
-    
 
-    for (i = 0, b = btab; i < nbody; i++, b++) {
-	Aux(b) = (rank)(b, tsnap, i);
-    }
+    r = (real *) allocate(nbody*sizeof(real));
+    btreval(rank, btab, nbody, tsnap, 0, r);
+    for (i = 0, b = btab; i < nbody; i++, b++)
+	Aux(b) = r[i];
+    free(r);
     (mysort)(btab, nbody, sizeof(Body), rank_aux);
 
     if (Qaux) {   /* stuff it back */
@@ -0,0 +1,424 @@
+/*
+ *  ORBENS:   integrate an ensemble of orbits in a fixed potential
+ *
+ *	Initial conditions come from a snapshot or a table. The orbits
+ *	are advanced a block of nblock at a time, so the potential is
+ *	called for a whole block of positions (see potential(3NEMO)),
+ *	and blocks are spread over np= threads.  The output is a
+ *	snapshot every nsave steps, and/or a table with statistics
+ *	accumulated over all steps for each orbit, so orbits are never
+ *	stored step by step.
+ *
+ *	18-oct-2026	V1.0  created				PJT
+ *	18-oct-2026	V1.1  in= is opened once, so in=- and pipes work	PJT
+ */
+
+#include <stdinc.h>
+#include <getparam.h>
+#include <vectmath.h>
+#include <filestruct.h>
+#include <history.h>
+#include <table.h>
+#include <potential.h>
+
+#include <snapshot/snapshot.h>
+#include <snapshot/body.h>
+#include <snapshot/get_snap.c>
+
+string defv[] = {
+    "in=???\n             Initial conditions (snapshot, or table)",
+    "out=\n               Output snapshots, every nsave steps",
+    "stat=\n              Output table of statistics per orbit",
+    "potname=???\n        Name of potential(5), or a sum a+b+..",
+    "potpars=\n           Parameters of potential",
+    "potfile=\n           Extra data-file for potential",
+    "xvar=1,2,3,4,5,6\n   Columns for x,y,z,vx,vy,vz if in= is a table",
+    "dt=0.01\n            Timestep",
+    "nsteps=1000\n        Number of steps",
+    "tstop=\n             If given, this overrides nsteps=",
+    "nsave=100\n          Steps between output snapshots",
+    "mode=leapfrog\n      Integration method (leapfrog, rk4)",
+    "nblock=1024\n        Orbits advanced together",
+    "VERSION=1.1\n        18-oct-2026 PJT",
+    NULL,
+};
+
+string usage = "integrate an ensemble of orbits in a fixed potential";
+
+#ifndef HUGE
+#  define HUGE 1.0e20
+#endif
+
+#define NSTAT 8		/* statistics per orbit */
+#define NWORK 26	/* work space per orbit in a block */
+
+local potptr pot;		/* the potential */
+local int    norb;		/* number of orbits */
+local double *pos, *vel;	/* x[k*norb+i], for k=0,1,2 */
+local double *acc, *phi;	/* forces and potential at pos */
+local real   *mass = NULL;	/* masses, if in= had them */
+local double tnow, dt;
+local double omega, omega2, tomega;	/* pattern speed */
+local bool   Qrk4;
+local int    nblock;
+
+/* statistics per orbit: E0, max |E-E0|, sum of Jz and Jz^2, rmin, rmax,
+ * max |z|, number of steps sampled */
+local double *st[NSTAT];
+
+local bool is_snapshot(stream);
+local void read_snapshot(stream);
+local void read_table(stream);
+local void advance(int);
+local void block_step(int, int, double *);
+local void block_force(int, double *, double *, double *, double *, double);
+local double energy(int, int, double *, double *, double *);
+local void accum_stats(int, int, double *, double *, double *);
+local void write_snapshot(stream);
+local void write_stats(stream);
+
+void nemo_main(void)
+{
+    stream instr, outstr = NULL, statstr = NULL;
+    int nsteps, nsave, n, k;
+    string mode;
+
+    dt = getdparam("dt");
+    if (hasvalue("tstop"))
+        nsteps = (int) (getdparam("tstop")/dt + 0.5);
+    else
+        nsteps = getiparam("nsteps");
+    nsave = getiparam("nsave");
+    nblock = getiparam("nblock");
+    if (nsave < 1) nsave = 1;
+    if (nblock < 1) error("nblock=%d must be positive",nblock);
+    mode = getparam("mode");
+    if (streq(mode,"rk4"))
+        Qrk4 = TRUE;
+    else if (streq(mode,"leapfrog"))
+        Qrk4 = FALSE;
+    else
+        error("mode=%s: must be leapfrog or rk4",mode);
+    if (!hasvalue("out") && !hasvalue("stat"))
+        error("No output: out= and/or stat= needed");
+
+    instr = stropen(getparam("in"),"r");
+    if (is_snapshot(instr))
+        read_snapshot(instr);
+    else
+        read_table(instr);
+    strclose(instr);
+    dprintf(1,"%d orbits, starting at t=%g\n",norb,tnow);
+
+    pot = newpotential(getparam("potname"),getparam("potpars"),getparam("potfile"));
+    if (pot == NULL) error("No potential");
+    omega = pot->omega;
+    omega2 = omega*omega;
+    tomega = 2*omega;
+    if (omega != 0) dprintf(0,"Pattern speed=%g\n",omega);
+
+    acc = (double *) allocate(3*norb*sizeof(double));
+    phi = (double *) allocate(norb*sizeof(double));
+    for (k=0; k<NSTAT; k++)
+        st[k] = (double *) allocate(norb*sizeof(double));
+
+    if (hasvalue("out")) {
+        outstr = stropen(getparam("out"),"w");
+        put_history(outstr);
+    }
+    advance(0);			/* forces and stats at the start */
+    if (outstr) write_snapshot(outstr);
+    if (outstr == NULL) nsave = nsteps;	/* all in one go */
+    for (n=0; n<nsteps; n+=nsave) {
+        advance(MIN(nsave,nsteps-n));
+        if (outstr) write_snapshot(outstr);
+    }
+    if (outstr) strclose(outstr);
+    if (hasvalue("stat")) {
+        statstr = stropen(getparam("stat"),"w");
+        write_stats(statstr);
+        strclose(statstr);
+    }
+}
+
+/*
+ * is_snapshot: peek if the stream is a structured file, without losing
+ * input: a file is rewound after qsf(), from a pipe only the first byte
+ * is looked at, the low byte (0222) all magic numbers have in common,
+ * which is where a structured file from a little endian machine starts
+ */
+
+local bool is_snapshot(stream instr)
+{
+    bool q;
+    int c;
+
+    if (fseek(instr, 0L, SEEK_CUR) == 0) {
+        q = qsf(instr);
+        rewind(instr);
+        return q;
+    }
+    c = getc(instr);
+    ungetc(c, instr);
+    return c == 0222;
+}
+
+/* read_snapshot: the first snapshot with phase space coordinates */
+
+local void read_snapshot(stream instr)
+{
+    Body *btab = NULL, *bp;
+    int nbody, bits, i, k;
+    real tsnap;
+
+    get_history(instr);
+    for (;;) {
+        get_history(instr);
+        if (!get_tag_ok(instr, SnapShotTag))
+            error("%s: no snapshot with phase space coordinates",getparam("in"));
+        get_snap(instr, &btab, &nbody, &tsnap, &bits);
+        if (bits & PhaseSpaceBit) break;
+    }
+    norb = nbody;
+    tnow = (bits & TimeBit) ? tsnap : 0.0;
+    pos = (double *) allocate(3*norb*sizeof(double));
+    vel = (double *) allocate(3*norb*sizeof(double));
+    if (bits & MassBit) mass = (real *) allocate(norb*sizeof(real));
+    for (bp = btab, i = 0; i < norb; bp++, i++) {
+        for (k=0; k<NDIM; k++) {
+            pos[k*norb+i] = Pos(bp)[k];
+            vel[k*norb+i] = Vel(bp)[k];
+        }
+        if (mass) mass[i] = Mass(bp);
+    }
+    free(btab);
+}
+
+/* read_table: x,y,z,vx,vy,vz from the xvar= columns */
+
+local void read_table(stream instr)
+{
+    int col[6], ncol, i, k;
+    tableptr tptr;
+    mdarray2 d;
+
+    ncol = nemoinpi(getparam("xvar"),col,6);
+    if (ncol != 6) error("xvar= needs 6 columns, x,y,z,vx,vy,vz");
+    tptr = table_open(instr,0);
+    d = table_md2cr(tptr, 6, col, 0, 0);
+    norb = table_nrows(tptr);
+    tnow = 0.0;
+    pos = (double *) allocate(3*norb*sizeof(double));
+    vel = (double *) allocate(3*norb*sizeof(double));
+    for (k=0; k<3; k++)
+        for (i=0; i<norb; i++) {
+            pos[k*norb+i] = d[k][i];
+            vel[k*norb+i] = d[k+3][i];
+        }
+    free_mdarray2(d,6,norb);
+    table_close(tptr);
+}
+
+/*
+ * advance: all orbits nstep steps, a block at a time, over np= threads;
+ * nstep=0 just computes the forces and starts the statistics
+ */
+
+local void advance(int nstep)
+{
+    int nb = (norb + nblock - 1)/nblock;
+
+#if _OPENMP
+#pragma omp parallel
+#endif
+    {
+        double *work = (double *) allocate(NWORK*nblock*sizeof(double));
+        int b;
+
+#if _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (b=0; b<nb; b++)
+            block_step(b, nstep, work);
+        free(work);
+    }
+    tnow += nstep*dt;
+}
+
+/*
+ * block_step: advance the orbits of block b by nstep steps, in work,
+ * which has room for NWORK values per orbit
+ */
+
+local void block_step(int b, int nstep, double *work)
+{
+    int i0 = b*nblock, m = MIN(nblock, norb-i0), i, k, n;
+    double *x = work, *v = x+3*m, *a = v+3*m, *p = a+3*m;
+    double *xt = p+m, *vt = xt+3*m, *at = vt+3*m;	/* rk4 only */
+    double *dx = at+3*m, *dv = dx+3*m, *pt = dv+3*m;
+    double t = tnow, dt2 = 0.5*dt, dt6 = dt/6.0, xn, vn;
+
+    for (k=0; k<3; k++)
+        for (i=0; i<m; i++) {
+            x[k*m+i] = pos[k*norb+i0+i];
+            v[k*m+i] = vel[k*norb+i0+i];
+        }
+    if (nstep == 0) {			/* start */
+        block_force(m, x, v, a, p, t);
+        for (i=0; i<m; i++) {
+            st[0][i0+i] = energy(m, i, x, v, p);
+            st[1][i0+i] = st[2][i0+i] = st[3][i0+i] = 0.0;
+            st[4][i0+i] = HUGE;
+            st[5][i0+i] = st[6][i0+i] = st[7][i0+i] = 0.0;
+        }
+        accum_stats(i0, m, x, v, p);
+    } else {
+        for (k=0; k<3; k++)
+            for (i=0; i<m; i++)
+                a[k*m+i] = acc[k*norb+i0+i];
+        for (i=0; i<m; i++)
+            p[i] = phi[i0+i];
+    }
+
+    for (n=0; n<nstep; n++) {
+        if (Qrk4) {			/* classic Runge-Kutta */
+            for (i=0; i<3*m; i++) {
+                dx[i] = v[i];
+                dv[i] = a[i];
+                xt[i] = x[i] + dt2*v[i];
+                vt[i] = v[i] + dt2*a[i];
+            }
+            block_force(m, xt, vt, at, pt, t+dt2);
+            for (i=0; i<3*m; i++) {
+                dx[i] += 2*vt[i];
+                dv[i] += 2*at[i];
+                xn = x[i] + dt2*vt[i];
+                vn = v[i] + dt2*at[i];
+                xt[i] = xn;
+                vt[i] = vn;
+            }
+            block_force(m, xt, vt, at, pt, t+dt2);
+            for (i=0; i<3*m; i++) {
+                dx[i] += 2*vt[i];
+                dv[i] += 2*at[i];
+                xn = x[i] + dt*vt[i];
+                vn = v[i] + dt*at[i];
+                xt[i] = xn;
+                vt[i] = vn;
+            }
+            block_force(m, xt, vt, at, pt, t+dt);
+            for (i=0; i<3*m; i++) {
+                x[i] += dt6*(dx[i] + vt[i]);
+                v[i] += dt6*(dv[i] + at[i]);
+            }
+            block_force(m, x, v, a, p, t+dt);
+        } else {			/* kick-drift-kick leapfrog */
+            for (i=0; i<3*m; i++) {
+                v[i] += dt2*a[i];
+                x[i] += dt*v[i];
+            }
+            block_force(m, x, v, a, p, t+dt);
+            for (i=0; i<3*m; i++)
+                v[i] += dt2*a[i];
+        }
+        t += dt;
+        accum_stats(i0, m, x, v, p);
+    }
+    for (k=0; k<3; k++)
+        for (i=0; i<m; i++) {
+            pos[k*norb+i0+i] = x[k*m+i];
+            vel[k*norb+i0+i] = v[k*m+i];
+            acc[k*norb+i0+i] = a[k*m+i];
+        }
+    for (i=0; i<m; i++)
+        phi[i0+i] = p[i];
+}
+
+/* block_force: forces (incl. those of the rotating frame) and potential */
+
+local void block_force(int m, double *x, double *v, double *a, double *p, double t)
+{
+    int i;
+
+    evalpotential(pot, 3, m, x, a, p, t);
+    if (omega == 0.0) return;
+    for (i=0; i<m; i++) {
+        a[i]   += omega2*x[i]   + tomega*v[m+i];
+        a[m+i] += omega2*x[m+i] - tomega*v[i];
+    }
+}
+
+/* energy: (Jacobi) energy of orbit i of a block of m */
+
+local double energy(int m, int i, double *x, double *v, double *p)
+{
+    return 0.5*(v[i]*v[i] + v[m+i]*v[m+i] + v[2*m+i]*v[2*m+i]) + p[i]
+           - 0.5*omega2*(x[i]*x[i] + x[m+i]*x[m+i]);
+}
+
+local void accum_stats(int i0, int m, double *x, double *v, double *p)
+{
+    double de, jz, r;
+    int i;
+
+    for (i=0; i<m; i++) {
+        de = ABS(energy(m, i, x, v, p) - st[0][i0+i]);
+        jz = x[i]*v[m+i] - x[m+i]*v[i];
+        r = sqrt(x[i]*x[i] + x[m+i]*x[m+i] + x[2*m+i]*x[2*m+i]);
+        st[1][i0+i] = MAX(st[1][i0+i], de);
+        st[2][i0+i] += jz;
+        st[3][i0+i] += jz*jz;
+        st[4][i0+i] = MIN(st[4][i0+i], r);
+        st[5][i0+i] = MAX(st[5][i0+i], r);
+        st[6][i0+i] = MAX(st[6][i0+i], ABS(x[2*m+i]));
+        st[7][i0+i] += 1.0;
+    }
+}
+
+local void write_snapshot(stream outstr)
+{
+    real *phase = (real *) allocate(2*NDIM*norb*sizeof(real));
+    real *pot = (real *) allocate(norb*sizeof(real));
+    real tsnap = tnow;
+    int i, k, cs = CSCode(Cartesian, NDIM, 2);
+
+    for (i=0; i<norb; i++) {
+        for (k=0; k<NDIM; k++) {
+            phase[(2*i)*NDIM+k]   = pos[k*norb+i];
+            phase[(2*i+1)*NDIM+k] = vel[k*norb+i];
+        }
+        pot[i] = phi[i] - 0.5*omega2*(pos[i]*pos[i] + pos[norb+i]*pos[norb+i]);
+    }
+    put_set(outstr, SnapShotTag);
+     put_set(outstr, ParametersTag);
+      put_data(outstr, NobjTag, IntType, &norb, 0);
+      put_data(outstr, TimeTag, RealType, &tsnap, 0);
+     put_tes(outstr, ParametersTag);
+     put_set(outstr, ParticlesTag);
+      put_data(outstr, CoordSystemTag, IntType, &cs, 0);
+      if (mass) put_data(outstr, MassTag, RealType, mass, norb, 0);
+      put_data(outstr, PhaseSpaceTag, RealType, phase, norb, 2, NDIM, 0);
+      put_data(outstr, PotentialTag, RealType, pot, norb, 0);
+     put_tes(outstr, ParticlesTag);
+    put_tes(outstr, SnapShotTag);
+    free(phase);
+    free(pot);
+}
+
+local void write_stats(stream statstr)
+{
+    double e0, jm, js, n;
+    int i;
+
+    fprintf(statstr,"# i E0 dE/E0 Jz sigma(Jz) rmin rmax zmax\n");
+    for (i=0; i<norb; i++) {
+        e0 = st[0][i];
+        n = st[7][i];
+        jm = st[2][i]/n;
+        js = st[3][i]/n - jm*jm;
+        js = js > 0 ? sqrt(js) : 0.0;
+        fprintf(statstr,"%d %.8g %g %.8g %g %g %g %g\n", i+1, e0,
+                e0 != 0 ? st[1][i]/ABS(e0) : st[1][i],
+                jm, js, st[4][i], st[5][i], st[6][i]);
+    }
+}
@@ -11,6 +11,7 @@
  *                      version for the new potproc interface       wd
  *      sep-2004        replaced call to sqr(A) with A*A
  *                      sqr() is bullshit and should never be used! wd
+ *      oct-2026        potential_double_n for arrays of positions  pjt
  */
 
 /*CTEX
@@ -34,6 +35,7 @@
 
  
 #include <stdinc.h>                     /* standard Nemo include */
+#include <potential_n.h>
 
 local real omega = 0.0;         /* pattern speed */
 local real hmass = 1.0;		/* total mass */
@@ -85,3 +87,34 @@ void potential_float  (int *ndim,
 		       float *pot,
 		       float *time) POT
 #undef POT
+
+void potential_double_n (int *ndim,
+			 int *n,
+			 double *pos,
+			 double *acc,
+			 double *pot,
+			 double *time)
+{
+    int    i, nn = *n;
+    double *x = pos, *y = pos+nn, *z = pos+2*nn;
+    double *ax = acc, *ay = acc+nn, *az = acc+2*nn;
+
+    if (*ndim != 3) {
+	potential_n_points(ndim,n,pos,acc,pot,time);
+	return;
+    }
+#if _OPENMP
+#pragma omp simd
+#endif
+    for (i=0; i<nn; i++) {
+        double r2, r, f;
+        r2 = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+        r = sqrt(r2);
+        f = 1.0/(r+a);
+        pot[i] = -hmass * f;
+        f = (r2==0.0) ? 0.0 : pot[i] * f / r;   /* as potential_double */
+        ax[i] = x[i] * f;
+        ay[i] = y[i] * f;
+        az[i] = z[i] * f;
+    }
+}
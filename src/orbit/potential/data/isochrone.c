@@ -6,6 +6,7 @@
  *	mar-92  happy gcc2.0	PJT
  *	oct-93  get_pattern()	PJT
  *      sep-04  float/double	PJT
+ *      oct-26  potential_double_n	PJT
  */
 
 /*CTEX
@@ -16,6 +17,7 @@
  
 #include  <stdinc.h>
 #include <potential_float.h>
+#include <potential_n.h>
 
 local double omega = 0.0;           /* just put to zero until implemented */
 local double iso_mass = 1.0;
@@ -58,3 +60,27 @@ void potential_double (int *ndim,double *pos,double *acc,double *pot,double *tim
         acc[i] = tmp*pos[i];
 	
 }
+
+void potential_double_n (int *ndim,int *n,double *pos,double *acc,double *pot,double *time)
+{
+    int    i, nn = *n;
+    double *x = pos, *y = pos+nn, *z = pos+2*nn;
+    double *ax = acc, *ay = acc+nn, *az = acc+2*nn;
+
+    if (*ndim != 3) {
+	potential_n_points(ndim,n,pos,acc,pot,time);
+	return;
+    }
+#if _OPENMP
+#pragma omp simd
+#endif
+    for (i=0; i<nn; i++) {
+        double a, tmp;
+        a = sqrt(iso_radius2 + x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+        pot[i] = -iso_mass / (iso_radius + a);
+        tmp = pot[i] / (a * (iso_radius + a));
+        ax[i] = tmp*x[i];
+        ay[i] = tmp*y[i];
+        az[i] = tmp*z[i];
+    }
+}
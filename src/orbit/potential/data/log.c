@@ -3,6 +3,7 @@
  *	dec-93    allowed r_c=0 exception, by setting v_0^2 = 2*m_c
  *      jun-01    stdinc.h
  *      sep-04    double/float
+ *      oct-26    potential_double_n for arrays of positions
  */
 
 /*CTEX
@@ -27,6 +28,7 @@
 
 #include <stdinc.h>
 #include <potential_float.h>
+#include <potential_n.h>
 
 /* default parameters */
 
@@ -84,3 +86,27 @@ void potential_double (int *ndim, double *pos, double *acc, double *pot, double
     for (i=0; i<*ndim; i++)
         acc[i] = f*pos[i]*iq2[i];
 }
+
+void potential_double_n (int *ndim, int *n, double *pos, double *acc, double *pot, double *time)
+{
+    int i, nn = *n;
+    double *x = pos, *y = pos+nn, *z = pos+2*nn;
+    double *ax = acc, *ay = acc+nn, *az = acc+2*nn;
+
+    if (*ndim != 3) {
+	potential_n_points(ndim,n,pos,acc,pot,time);
+	return;
+    }
+#if _OPENMP
+#pragma omp simd
+#endif
+    for (i=0; i<nn; i++) {
+	double rad, f;
+	rad = rc2 + x[i]*x[i]*iq2[0] + y[i]*y[i]*iq2[1] + z[i]*z[i]*iq2[2];
+	pot[i] = mor * log(rad);
+	f = -2.0*mor/rad;
+	ax[i] = f*x[i]*iq2[0];
+	ay[i] = f*y[i]*iq2[1];
+	az[i] = f*z[i]*iq2[2];
+    }
+}
@@ -19,6 +19,7 @@
  *  7-mar-92 merged sun and 3b1 versions once more			 pjt
  *    oct-93 get_pattern
  *    dec-2023   re-arranged parameters as omega,mass,a,b to be consistent    PJT
+ *    oct-2026   potential_double_n for arrays of positions                  PJT
  *
  */
 
@@ -35,6 +36,7 @@
 
 #include <stdinc.h>
 #include <potential_float.h>
+#include <potential_n.h>
 
 local double omega = 0.0;		/* pattern speed */
 local double miya_mass = 1.0;
@@ -88,3 +90,32 @@ void potential_double(int *ndim,double *pos,double *acc,double *pot,double *time
         acc[Z] *= (miya_ascal+qpar)/qpar;
 
 }
+
+void potential_double_n(int *ndim,int *n,double *pos,double *acc,double *pot,double *time)
+{
+    int i, nn = *n;
+    double *px = pos+X*nn, *py = pos+Y*nn, *pz = pos+Z*nn;
+    double *ax = acc+X*nn, *ay = acc+Y*nn, *az = acc+Z*nn;
+    double b2 = miya_bscal*miya_bscal;
+
+    if (*ndim != 3) {
+	potential_n_points(ndim,n,pos,acc,pot,time);
+	return;
+    }
+#if _OPENMP
+#pragma omp simd
+#endif
+    for (i=0; i<nn; i++) {
+	double qpar, spar, rcyl, tmp;
+	rcyl = sqrt(px[i]*px[i] + py[i]*py[i]);
+	qpar = sqrt(pz[i]*pz[i] + b2);
+	spar = sqrt(rcyl*rcyl + (miya_ascal+qpar)*(miya_ascal+qpar));
+	pot[i] = - miya_mass / spar;
+	tmp = pot[i] / (spar*spar);
+	ax[i] = tmp*px[i];
+	ay[i] = tmp*py[i];
+	az[i] = tmp*pz[i];
+	if (miya_ascal > 0.0)
+	    az[i] *= (miya_ascal+qpar)/qpar;
+    }
+}
@@ -25,6 +25,7 @@
  * 0.1   18-nov-2002    converted from C++ to C                           WD   |
  * 0.2   24-may-2005    bit more dprintf() output                        PJT   |
  * 0.3    7-apr-2009    add shapes to play with non-spherical            PJT   |
+ * 0.4   18-oct-2026    potential_double_n for arrays of positions       PJT   |
  *                                                                             |
  *----------------------------------------------------------------------------*/
 
@@ -42,6 +43,7 @@
  * $$
  */
 #include <stdinc.h>
+#include <potential_n.h>
 
 static double a,ia,fac,qb,qc,iq2,iq3;
 
@@ -84,3 +86,28 @@ POTENTIAL(double)
 
 #undef POTENTIAL
 //------------------------------------------------------------------------------
+void potential_double_n(int*NDIM, int*N, double*X, double*F, double*P, double*T) {
+  int i, n = *N;
+  double *x = X, *y = X+n, *z = X+2*n, *fx = F, *fy = F+n, *fz = F+2*n;
+  if(*NDIM != 3) {
+    potential_n_points(NDIM,N,X,F,P,T);
+    return;
+  }
+#if _OPENMP
+#pragma omp simd
+#endif
+  for(i=0; i<n; i++) {
+    double r,fr,ir;
+    r  = sqrt(x[i]*x[i] + y[i]*y[i]*iq2 + z[i]*z[i]*iq3);
+    ir = 1./r;
+    fr = log(1+ia*r) * ir;
+    P[i] =-fac*fr;
+    fr*= ir;
+    fr-= ir/(r+a);
+    fr*=-fac*ir;
+    fx[i] = fr * x[i];
+    fy[i] = fr * y[i]*iq2;
+    fz[i] = fr * z[i]*iq3;
+  }
+}
+//------------------------------------------------------------------------------
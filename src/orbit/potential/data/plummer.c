@@ -2,6 +2,7 @@
  * plummer.c:  (spherical) plummer potential
  *
  *	sep-2001	provide both a _double and _float version for the new potproc interface
+ *	oct-2026	potential_double_n for arrays of positions
  *
  */
 
@@ -19,6 +20,7 @@
   
 #include <stdinc.h>
 #include <vectmath.h>	/* define DIMensionality */
+#include <potential_n.h>
  
 local double omega = 0.0;
 local double plummer_mass = 1.0;
@@ -99,3 +101,35 @@ void potential_float (int *ndim,float *pos,float *acc,float *pot,float *time)
 #endif
 }
 
+void potential_double_n (int *ndim,int *n,double *pos,double *acc,double *pot,double *time)
+{
+    int i, nn = *n;
+    double *x = pos, *y = pos+nn, *z = pos+2*nn;
+    double *ax = acc, *ay = acc+nn, *az = acc+2*nn;
+
+    if (*ndim != 3) {
+	potential_n_points(ndim,n,pos,acc,pot,time);
+	return;
+    }
+#if _OPENMP
+#pragma omp simd
+#endif
+    for (i=0; i<nn; i++) {
+	double tmp, p;
+#if defined(TWODIM)
+	tmp = 1.0/(r2 + x[i]*x[i] + y[i]*y[i]);
+#else
+	tmp = 1.0/(r2 + x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+#endif
+	p = -sqrt(tmp);
+	tmp *= p * plummer_mass;
+	pot[i] = p * plummer_mass;
+	ax[i] = tmp*x[i];
+	ay[i] = tmp*y[i];
+#if defined(TWODIM)
+	az[i] = 0.0;
+#else
+	az[i] = tmp*z[i];
+#endif
+    }
+}
@@ -0,0 +1,506 @@
+/*
+ * tabulate.c:  any potential, sampled on a grid at startup and
+ *		interpolated from then on
+ *
+ *	18-oct-2026	created, for expensive potentials		PJT
+ *	18-oct-2026	check the size of a saved grid before using it	PJT
+ */
+
+/*CTEX
+ *	{\bf potname=tabulate
+ *       potpars={\it $\Omega,R_{max},z_{max},tol,ndim,a,save$}
+ *	 potfile={\it name:pars[:file]}}
+ *
+ * The potential {\it name} with parameters {\it pars} (and its own
+ * potfile {\it file}, if any) is sampled on a grid, on which
+ * the potential and forces are interpolated with cubic polynomials.
+ * With $ndim=2$ (the default) the potential must be axisymmetric,
+ * and the grid is in $(R,z)$, with $R<R_{max}$ and $|z|<z_{max}$,
+ * with $ndim=3$ it is in $(x,y,z)$ with $|x|,|y|<R_{max}$.
+ * Each axis is uniform in $u={\rm asinh}(x/a)$, i.e. linear
+ * within the scale length $a$ and logarithmic outside, and the number
+ * of grid points is doubled until the relative error in potential and
+ * forces, measured halfway between grid points, is below $tol$.
+ * Outside the grid the potential itself is used.
+ * With $save=1$ the grid is kept in the NEMO cache, and later runs
+ * with the same potential and parameters read it from there.
+ * Defaults: $R_{max}=10, z_{max}=R_{max}, tol=10^{-5}, ndim=2,
+ * a=R_{max}/20, save=0$.  The potential is taken at time 0, and
+ * its pattern speed is used if $\Omega=0$.
+ */
+
+#include <stdinc.h>
+#include <strlib.h>
+#include <loadobj.h>
+#include <potential.h>
+#include <unistd.h>
+
+#define NSTART  17		/* initial grid points per axis */
+#define NMAX2  1025		/* largest grid per axis: (R,z) */
+#define NMAX3   129		/*                      (x,y,z) */
+#define NCHECK 20000		/* points used to check the grid */
+#define NPROBE  8		/* points whose values are part of the key */
+
+local double omega = 0.0;
+local double rmax = 10.0;
+local double zmax = 0.0;	/* 0: same as rmax */
+local double tol = 1e-5;
+local int    mode = 2;		/* 2: (R,z)   3: (x,y,z) */
+local double scale = 0.0;	/* 0: rmax/20 */
+local int    save = 0;
+
+local potptr inner = NULL;	/* the potential being tabulated */
+local int    naxis;		/* 2 or 3 axes */
+local int    nu[3];		/* grid points per axis */
+local double umin[3], umax[3], du[3];
+local int    nq;		/* values per grid point: pot, then forces */
+local double *tab = NULL;
+local int    nmax;		/* largest grid per axis */
+
+local void   make_grid(int);
+local void   fill_grid(void);
+local double check_grid(void);
+local bool   tab_eval(double, double, double, double *, double *);
+local void   exact(int, double *, double *, double *);
+local string table_name(string);
+local bool   read_table(string);
+local void   write_table(string);
+local string part(string, int);
+
+void inipotential (int *npar, double *par, string name)
+{
+    string iname, ipars, ifile, fname = NULL;
+    int n = *npar;
+    double err;
+
+    if (n>0) omega = par[0];
+    if (n>1) rmax = par[1];
+    if (n>2) zmax = par[2];
+    if (n>3) tol = par[3];
+    if (n>4) mode = (int) par[4];
+    if (n>5) scale = par[5];
+    if (n>6) save = (int) par[6];
+    if (n>7) warning("tabulate: npar=%d only 7 parameters accepted",n);
+    if (zmax <= 0) zmax = rmax;
+    if (scale <= 0) scale = rmax/20;
+    if (mode != 2 && mode != 3)
+	error("tabulate: ndim=%d, must be 2 (R,z) or 3 (x,y,z)",mode);
+    if (name == NULL || *name == 0)
+	error("tabulate: potfile=name:pars[:file] of the potential needed");
+
+    iname = part(name,0);
+    ipars = part(name,1);
+    ifile = part(name,2);
+    if (inner) freepotential(inner);
+    inner = newpotential(iname, ipars, ifile);
+    if (inner == NULL)
+	error("tabulate: bad potfile=%s",name);
+    if (omega == 0.0) omega = inner->omega;
+
+    dprintf (1,"INIPOTENTIAL Tabulate: %s %s %s\n",iname,ipars,ifile);
+    dprintf (1,"  Parameters : Pattern Speed = %f\n",omega);
+    dprintf (1,"  rmax, zmax, tol, ndim, scale = %g %g %g %d %g\n",
+	     rmax, zmax, tol, mode, scale);
+
+    naxis = mode;
+    nq = mode == 2 ? 3 : 4;
+    nmax = mode == 2 ? NMAX2 : NMAX3;
+    if (save) {
+	fname = table_name(name);
+	if (read_table(fname)) {
+	    dprintf(1,"tabulate: grid of %d x %d x %d read from %s\n",
+		    nu[0], nu[1], naxis==3 ? nu[2] : 1, fname);
+	    par[0] = omega;
+	    return;
+	}
+    }
+    for (n = NSTART; ; n = 2*n-1) {		/* refine until good enough */
+	make_grid(n);
+	fill_grid();
+	err = check_grid();
+	dprintf(1,"tabulate: %d points per axis, error %g\n",n,err);
+	if (err <= tol) break;
+	if (2*n-1 > nmax) {
+	    warning("tabulate: error %g > tol=%g with the largest grid (%d)",
+		    err, tol, n);
+	    break;
+	}
+    }
+    if (save) write_table(fname);
+    par[0] = omega;
+}
+
+void potential_double (int *ndim,double *pos,double *acc,double *pot,double *time)
+{
+    double z = *ndim > 2 ? pos[2] : 0.0, a[3];
+    int k;
+
+    if (tab_eval(pos[0], pos[1], z, pot, a)) {
+	for (k=0; k<*ndim; k++) acc[k] = a[k];
+	return;
+    }
+    evalpotential(inner, *ndim, 1, pos, acc, pot, 0.0);
+}
+
+void potential_double_n (int *ndim,int *n,double *pos,double *acc,double *pot,double *time)
+{
+    double p[3], a[3];
+    int i, k, nn = *n;
+
+    for (i=0; i<nn; i++) {
+	for (k=0; k<*ndim; k++) p[k] = pos[k*nn+i];
+	potential_double(ndim, p, a, &pot[i], time);
+	for (k=0; k<*ndim; k++) acc[k*nn+i] = a[k];
+    }
+}
+
+void potential_float (int *ndim,float *pos,float *acc,float *pot,float *time)
+{
+    double p[3], a[3], phi, t = *time;
+    int k;
+
+    for (k=0; k<*ndim; k++) p[k] = pos[k];
+    potential_double(ndim, p, a, &phi, &t);
+    for (k=0; k<*ndim; k++) acc[k] = a[k];
+    *pot = phi;
+}
+
+/*
+ * the grid: axis k has nu[k] points, uniform in u = asinh(x/scale)
+ */
+
+local void make_grid(int n)
+{
+    int k;
+    size_t ntab;
+
+    umax[0] = asinh(rmax/scale);
+    umin[0] = naxis == 2 ? 0.0 : -umax[0];
+    umax[1] = naxis == 2 ? asinh(zmax/scale) : umax[0];
+    umin[1] = -umax[1];
+    umax[2] = asinh(zmax/scale);
+    umin[2] = -umax[2];
+    for (k=0, ntab=nq; k<naxis; k++) {
+	nu[k] = n;
+	du[k] = (umax[k]-umin[k])/(n-1);
+	ntab *= n;
+    }
+    if (tab) free(tab);
+    tab = (double *) allocate(ntab * sizeof(double));
+}
+
+local double coord(double u)
+{
+    return scale * sinh(u);
+}
+
+/* exact: evaluate the potential for n points in (R,z) or (x,y,z) */
+
+local void exact(int n, double *pos, double *acc, double *pot)
+{
+    double *p = pos;
+    int i;
+
+    if (naxis == 2) {			/* (R,z) -> (R,0,z) */
+	p = (double *) allocate(3*n*sizeof(double));
+	for (i=0; i<n; i++) {
+	    p[i]     = pos[i];
+	    p[n+i]   = 0.0;
+	    p[2*n+i] = pos[n+i];
+	}
+    }
+    evalpotential(inner, 3, n, p, acc, pot, 0.0);
+    if (naxis == 2) {			/* keep aR and az */
+	for (i=0; i<n; i++)
+	    acc[n+i] = acc[2*n+i];
+	free(p);
+    }
+}
+
+local void fill_grid(void)
+{
+    int i, j, k, n, m, nz = naxis==3 ? nu[2] : 1;
+    double *pos, *acc, *pot;
+
+    n = nu[0]*nu[1]*nz;
+    pos = (double *) allocate(3*n*sizeof(double));
+    acc = (double *) allocate(3*n*sizeof(double));
+    pot = (double *) allocate(n*sizeof(double));
+    for (i=0, m=0; i<nu[0]; i++)
+	for (j=0; j<nu[1]; j++)
+	    for (k=0; k<nz; k++, m++) {
+		pos[m]   = coord(umin[0] + i*du[0]);
+		pos[n+m] = coord(umin[1] + j*du[1]);
+		if (naxis == 3) pos[2*n+m] = coord(umin[2] + k*du[2]);
+	    }
+    exact(n, pos, acc, pot);
+    for (m=0; m<n; m++) {
+	tab[m*nq] = pot[m];
+	for (k=1; k<nq; k++)
+	    tab[m*nq+k] = acc[(k-1)*n+m];
+    }
+    free(pos);
+    free(acc);
+    free(pot);
+}
+
+/*
+ * check_grid: the largest relative error in potential or force (the
+ * latter relative to the force there, or the typical force |pot|/rmax
+ * if larger) halfway between grid points; up to NCHECK cells
+ */
+
+local double check_grid(void)
+{
+    int i, m, k, ncell = 1, n, stride;
+    double *pos, *acc, *pot, x[3], p, a[3], f, ferr, err = 0.0;
+
+    for (k=0; k<naxis; k++) ncell *= nu[k]-1;
+    stride = ncell > NCHECK ? ncell/NCHECK : 1;
+    n = ncell/stride;
+    pos = (double *) allocate(3*n*sizeof(double));
+    acc = (double *) allocate(3*n*sizeof(double));
+    pot = (double *) allocate(n*sizeof(double));
+    for (i=0; i<n; i++) {
+	m = i*stride;
+	for (k=naxis-1; k>=0; k--) {
+	    pos[k*n+i] = coord(umin[k] + (m % (nu[k]-1) + 0.5)*du[k]);
+	    m /= nu[k]-1;
+	}
+    }
+    exact(n, pos, acc, pot);
+    for (i=0; i<n; i++) {
+	x[0] = pos[i];
+	x[1] = naxis == 3 ? pos[n+i] : 0.0;
+	x[2] = pos[(naxis-1)*n+i];
+	if (!tab_eval(x[0], x[1], x[2], &p, a)) continue;
+	if (naxis == 2) a[1] = a[2];		/* aR, az at y=0 */
+	if (pot[i] != 0.0)
+	    err = MAX(err, ABS(p-pot[i])/ABS(pot[i]));
+	for (k=0, f=0, ferr=0; k<nq-1; k++) {
+	    f += acc[k*n+i]*acc[k*n+i];
+	    ferr += (a[k]-acc[k*n+i])*(a[k]-acc[k*n+i]);
+	}
+	f = MAX(sqrt(f), ABS(pot[i])/rmax);
+	if (f > 0) err = MAX(err, sqrt(ferr)/f);
+    }
+    free(pos);
+    free(acc);
+    free(pot);
+    return err;
+}
+
+/*
+ * lagrange: weights of the cubic through 4 grid points for position s
+ * (in grid units), returns the first of them
+ */
+
+local int lagrange(int k, double x, double *w)
+{
+    double s = (asinh(x/scale) - umin[k])/du[k], t;
+    int i = (int) floor(s) - 1;
+
+    if (i < 0) i = 0;
+    if (i > nu[k]-4) i = nu[k]-4;
+    t = s - i;
+    w[0] = -(t-1)*(t-2)*(t-3)/6;
+    w[1] =  t*(t-2)*(t-3)/2;
+    w[2] = -t*(t-1)*(t-3)/2;
+    w[3] =  t*(t-1)*(t-2)/6;
+    return i;
+}
+
+/*
+ * tab_eval: interpolate potential and forces at (x,y,z), or return FALSE
+ * if outside the grid
+ */
+
+local bool tab_eval(double x, double y, double z, double *pot, double *acc)
+{
+    double w[3][4], v[4], r, f;
+    int i0[3], i, j, k, q, m;
+
+    if (naxis == 2) {
+	r = sqrt(x*x+y*y);
+	if (r > rmax || ABS(z) > zmax) return FALSE;
+	i0[0] = lagrange(0, r, w[0]);
+	i0[1] = lagrange(1, z, w[1]);
+	for (q=0; q<3; q++) v[q] = 0.0;
+	for (i=0; i<4; i++)
+	    for (j=0; j<4; j++) {
+		m = ((i0[0]+i)*nu[1] + i0[1]+j)*3;
+		f = w[0][i]*w[1][j];
+		for (q=0; q<3; q++) v[q] += f*tab[m+q];
+	    }
+	*pot = v[0];
+	acc[0] = r > 0 ? v[1]*x/r : 0.0;
+	acc[1] = r > 0 ? v[1]*y/r : 0.0;
+	acc[2] = v[2];
+	return TRUE;
+    }
+    if (ABS(x) > rmax || ABS(y) > rmax || ABS(z) > zmax) return FALSE;
+    i0[0] = lagrange(0, x, w[0]);
+    i0[1] = lagrange(1, y, w[1]);
+    i0[2] = lagrange(2, z, w[2]);
+    for (q=0; q<4; q++) v[q] = 0.0;
+    for (i=0; i<4; i++)
+	for (j=0; j<4; j++)
+	    for (k=0; k<4; k++) {
+		m = (((i0[0]+i)*nu[1] + i0[1]+j)*nu[2] + i0[2]+k)*4;
+		f = w[0][i]*w[1][j]*w[2][k];
+		for (q=0; q<4; q++) v[q] += f*tab[m+q];
+	    }
+    *pot = v[0];
+    for (q=0; q<3; q++) acc[q] = v[q+1];
+    return TRUE;
+}
+
+/*
+ * saved grids: named by a hash (FNV-1a) of the potfile, the grid
+ * parameters and the potential at a few points, so a changed potential
+ * gets a new grid
+ */
+
+local unsigned long long hash(unsigned long long h, void *buf, size_t n)
+{
+    unsigned char *cp = (unsigned char *) buf;
+
+    while (n--) {
+	h ^= *cp++;
+	h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+local string table_name(string spec)
+{
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    double par[5], pos[3*NPROBE], acc[3*NPROBE], pot[NPROBE];
+    char name[256];
+    string dir, fname;
+    int i;
+
+    h = hash(h, spec, strlen(spec)+1);
+    par[0] = rmax; par[1] = zmax; par[2] = tol; par[3] = mode; par[4] = scale;
+    h = hash(h, par, sizeof(par));
+    for (i=0; i<NPROBE; i++) {
+	pos[i]          = rmax*(i+1)/(NPROBE+1);
+	pos[NPROBE+i]   = 0.3*pos[i];
+	pos[2*NPROBE+i] = zmax*(NPROBE-i)/(NPROBE+1);
+    }
+    evalpotential(inner, 3, NPROBE, pos, acc, pot, 0.0);
+    h = hash(h, acc, sizeof(acc));
+    h = hash(h, pot, sizeof(pot));
+    dir = cachedir("pot");
+    sprintf(name, "%016llx.tab", h);
+    fname = (string) allocate(strlen(dir)+strlen(name)+2);
+    sprintf(fname, "%s/%s", dir, name);
+    free(dir);
+    return fname;
+}
+
+typedef struct {
+    char magic[8];
+    int naxis, nq, nu[3];
+    double umin[3], umax[3];
+} table_header;
+
+/*
+ * good_header: a grid file is only used if its grid is one this run
+ * could have made: the same axes, one of the refined sizes up to nmax,
+ * and the same extent of each axis
+ */
+
+local bool good_header(table_header *hdr)
+{
+    int k, n;
+
+    if (strncmp(hdr->magic, "NEMOTAB", 8) != 0 ||
+	hdr->naxis != naxis || hdr->nq != nq)
+	return FALSE;
+    for (n = NSTART; n < hdr->nu[0] && n <= nmax; n = 2*n-1)
+	;
+    if (n != hdr->nu[0] || n > nmax)
+	return FALSE;
+    make_grid(NSTART);				/* axes of this run */
+    for (k=0; k<naxis; k++)
+	if (hdr->nu[k] != n || hdr->umin[k] != umin[k] || hdr->umax[k] != umax[k])
+	    return FALSE;
+    return TRUE;
+}
+
+local bool read_table(string fname)
+{
+    table_header hdr;
+    size_t ntab;
+    FILE *fp;
+    int k;
+
+    if ((fp = fopen(fname, "r")) == NULL) return FALSE;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || !good_header(&hdr)) {
+	fclose(fp);
+	warning("tabulate: ignoring bad grid file %s", fname);
+	return FALSE;
+    }
+    make_grid(hdr.nu[0]);
+    for (k=0, ntab=nq; k<naxis; k++) ntab *= nu[k];
+    if (fread(tab, sizeof(double), ntab, fp) != ntab || getc(fp) != EOF) {
+	fclose(fp);
+	warning("tabulate: grid file %s has the wrong size", fname);
+	return FALSE;
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+local void write_table(string fname)
+{
+    table_header hdr;
+    char tmp[512];
+    size_t ntab;
+    FILE *fp;
+    int k;
+
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, "NEMOTAB");
+    hdr.naxis = naxis;
+    hdr.nq = nq;
+    for (k=0, ntab=nq; k<naxis; k++) {
+	hdr.nu[k] = nu[k];
+	hdr.umin[k] = umin[k];
+	hdr.umax[k] = umax[k];
+	ntab *= nu[k];
+    }
+    sprintf(tmp, "%.480s.%d", fname, (int) getpid());
+    if ((fp = fopen(tmp, "w")) == NULL) {
+	warning("tabulate: cannot write %s", tmp);
+	return;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(tab, sizeof(double), ntab, fp) != ntab ||
+	fclose(fp) != 0) {
+	warning("tabulate: error writing %s", tmp);
+	unlink(tmp);
+	return;
+    }
+    if (rename(tmp, fname) < 0)		/* appears complete, or not */
+	warning("tabulate: cannot rename %s", tmp);
+    dprintf(1,"tabulate: grid saved in %s\n",fname);
+}
+
+/* part: field i of name:pars:file, "" if not present */
+
+local string part(string s, int i)
+{
+    string e, f;
+
+    for (; i > 0 && *s; s++)
+	if (*s == ':') i--;
+    if (i > 0) return scopy("");
+    e = strchr(s, ':');
+    if (e == NULL) return scopy(s);
+    f = (string) allocate(e-s+1);
+    strncpy(f, s, e-s);
+    f[e-s] = 0;
+    return f;
+}
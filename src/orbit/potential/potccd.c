@@ -13,6 +13,7 @@
  *	22-oct-02       also allow ar,at                                pjt
  *      16-mar-2021     axis=1 proper WCS                               PJT
  *       9-jan-2022     fix Xref for axis=1                             pjt
+ *      18-oct-2026     a row of pixels per potential_double_n call     PJT
  */
 
 #include <stdinc.h>
@@ -34,7 +35,7 @@ string defv[] = {
     "omega=\n       Use this instead of any returned pattern speed",
     "ndim=3\n       Poisson map using 2D or 3D derivatives",
     "nder=1\n       1: use force der   2: use twice potential der for density",
-    "VERSION=2.2a\n 9-jan-2022 PJT",
+    "VERSION=2.3\n  18-oct-2026 PJT",
     NULL,
 };
 
@@ -45,12 +46,23 @@ string usage = "Create potential or density image from a NEMO potential";
 # define MAXPT 10000
 #endif
 
-local potproc_double mypot;    /* pointer to potential calculator function */
+local potproc_double_n mypot;  /* pointer to potential calculator function */
+
+/*
+ * a row of nx positions, by coordinate:  x[0..nx-1] y[..] z[..],
+ * with their forces and potentials
+ */
+local void eval_row(int nx, double *pos, double *acc, double *pot, double time)
+{
+    int maxdim = 3;
+
+    (*mypot)(&maxdim,&nx,pos,acc,pot,&time);
+}
 
 void nemo_main(void)
 {
     int    nx,ny,nz, ix,iy,iz;
-    double pos[3],acc[3],pot,den,dr,time;
+    double *pos, *acc, *pot, *dpos, *dacc, *dpot, dr, time;
     double xarr[MAXPT],yarr[MAXPT],zarr[MAXPT];
     double omega, dmin=0, dmax=0;
     string mode = getparam("mode");
@@ -99,7 +111,7 @@ void nemo_main(void)
       if (dr < 0) error("Need to supply a small positive value for dr=");
     } else
       error("bad mode=%s; allowed are: ax,ay,az,ar,at,den",mode);
-    mypot = get_potential(getparam("potname"), 
+    mypot = get_potential_double_n(getparam("potname"), 
 			  getparam("potpars"), 
 			  getparam("potfile"));
 			  
@@ -135,63 +147,67 @@ void nemo_main(void)
       Zref(iptr) = 0.0;
     }
 
+    pos  = (double *) allocate(maxdim*nx*sizeof(double));
+    acc  = (double *) allocate(maxdim*nx*sizeof(double));
+    pot  = (double *) allocate(nx*sizeof(double));
+    dpos = (double *) allocate(maxdim*nx*sizeof(double));
+    dacc = (double *) allocate(maxdim*nx*sizeof(double));
+    dpot = (double *) allocate(nx*sizeof(double));
+    for (ix=0; ix<nx; ix++)
+      pos[ix] = xarr[ix];
+
     for (iz=0; iz<nz; iz++) {
-      pos[2] = zarr[iz];
       for (iy=0; iy<ny; iy++) {
-	pos[1] = yarr[iy];
 	for (ix=0; ix<nx; ix++) {
-	  pos[0] = xarr[ix];
-	  (*mypot)(&maxdim,pos,acc,&pot,&time);
-	  if (dr > 0.0) {                                 /* Poisson */
-	    if (nder==1) {
-	      den = 0.0;
-	      for (idim=0; idim<ndim; idim++) {
-		pos[idim] += dr;
-		(*mypot)(&maxdim,pos,acc,&pot,&time);
-		den -= acc[idim];
-		pos[idim] -= 2*dr;
-		(*mypot)(&maxdim,pos,acc,&pot,&time);
-		den += acc[idim];
-		pos[idim] += dr;
-	      }
+	  pos[nx+ix] = yarr[iy];
+	  pos[2*nx+ix] = zarr[iz];
+	}
+	eval_row(nx,pos,acc,pot,time);
+	if (dr > 0.0) {                                   /* Poisson */
+	  for (ix=0; ix<nx; ix++)
+	    dpot[ix] = (nder==1 ? 0.0 : -2*ndim*pot[ix]);     /* density */
+	  for (idim=0; idim<ndim; idim++) {
+	    double *p = dpos + idim*nx, *a = dacc + idim*nx, *q = pos + idim*nx;
+	    memcpy(dpos, pos, maxdim*nx*sizeof(double));
+	    for (ix=0; ix<nx; ix++) p[ix] = q[ix] + dr;
+	    eval_row(nx,dpos,dacc,acc,time);     /* acc is free now: as pot */
+	    for (ix=0; ix<nx; ix++)
+	      dpot[ix] += (nder==1 ? -a[ix] : acc[ix]);
+	    for (ix=0; ix<nx; ix++) p[ix] = q[ix] + dr - 2*dr;
+	    eval_row(nx,dpos,dacc,acc,time);
+	    for (ix=0; ix<nx; ix++)
+	      dpot[ix] += (nder==1 ? a[ix] : acc[ix]);
+	  }
+	  for (ix=0; ix<nx; ix++)
+	    pot[ix] = (nder==1 ? dpot[ix]/dr : dpot[ix]/dr/dr);
+	} else
+	  for (ix=0; ix<nx; ix++) {
+	    double px = pos[ix], py = pos[nx+ix], ax = acc[ix], ay = acc[nx+ix];
+	    if (idx==0) {                                   /* Potential */
+	      if (omega != 0.0)
+		pot[ix] -= 0.5*sqr(omega)*(sqr(px)+sqr(py));
+	    } else if (idx < 4) {
+	      pot[ix] = acc[(idx-1)*nx+ix];
 	    } else {
-	      den = -2*ndim*pot;
-	      for (idim=0; idim<ndim; idim++) {
-		pos[idim] += dr;
-		(*mypot)(&maxdim,pos,acc,&pot,&time);
-		den += pot;
-		pos[idim] -= 2*dr;
-		(*mypot)(&maxdim,pos,acc,&pot,&time);
-		den += pot;
-		pos[idim] += dr;
-	      }
-	      den = den/dr;
+	      /* 2D only */
+	      real vv,vr,rr;
+	      vv = ax*ax + ay*ay;
+	      vr = ax*px + ay*py;
+	      rr = px*px + py*py;
+	      if (idx == 4)
+		pot[ix] = vr/sqrt(rr);
+	      else
+		pot[ix] = sqrt(vv-vr*vr/rr);
 	    }
-	    pot = den/dr;
-	  } else if (idx==0) {                                        /* Potential */
-	    if (omega != 0.0) {
-	      pot -= 0.5*sqr(omega)*(sqr(pos[0])+sqr(pos[1]));
-	    }
-	  } else if (idx < 4) {
-	    pot = acc[idx-1];
-	  } else {
-	    /* 2D only */
-	    real vv,vr,rr;
-	    vv = acc[0]*acc[0] + acc[1]*acc[1];
-	    vr = acc[0]*pos[0] + acc[1]*pos[1];
-	    rr = pos[0]*pos[0] + pos[1]*pos[1];
-	    if (idx == 4)
-	      pot = vr/sqrt(rr);
-	    else
-	      pot = sqrt(vv-vr*vr/rr);
 	  }
-	  CubeValue(iptr,ix,iy,iz) = pot;
+	for (ix=0; ix<nx; ix++) {
+	  CubeValue(iptr,ix,iy,iz) = pot[ix];
 	  if (first) {
-	    dmin = dmax = pot;
+	    dmin = dmax = pot[ix];
 	    first = 0;
 	  } else {
-	    dmin = MIN(dmin, pot);
-	    dmax = MAX(dmax, pot);
+	    dmin = MIN(dmin, pot[ix]);
+	    dmax = MAX(dmax, pot[ix]);
 	  }
 	}
       }
@@ -39,6 +39,11 @@
  *      14-jul-05         d made dummy functions global, for new (FC4) linker 
  *      18-sep-08         e make 'r' == SINGLEPREC? 'f' : 'd'              WD
  *      10-jan-22     V5.5  implement a set_potential()                    PJT
+ *      18-oct-26     V5.6  compile .c files into the objcache(3NEMO)          PJT
+ *      18-oct-26     V5.7  get_potential_double_n, for arrays of positions    PJT
+ *      18-oct-26     V6.0  newpotential() contexts, composite potname=a+b+c   PJT
+ *                          fixed $NEMO default path when no $POTPATH
+ *      18-oct-26     V6.1  potential_points, the one per position loop         PJT
  *------------------------------------------------------------------------------
  */
 
@@ -46,15 +51,27 @@
 #include  <getparam.h>
 #include  <loadobj.h>
 #include  <filefn.h>
+#include  <strlib.h>
 #include  <potential.h>
 
 #define MAXPAR 64
+#define MAXOBJ 64       /* different objects for newpotential             */
+#define NBLOCK 256      /* positions per block when summing components   */
+
+#ifdef SINGLEPREC
+#define REAL_TYPE 'f'
+#else
+#define REAL_TYPE 'd'
+#endif
 
 local double local_par[MAXPAR]; /* NOTE: first par reserved for pattern speed*/
 local int  local_npar=0;        /* actual used number of par's               */
 local real local_omega=0;	/* pattern speed                             */
 local proc l_potential=NULL;    /* actual storage of pointer to exter worker */
 local proc l_inipotential=NULL; /* actual storage of pointer to exter inits  */
+local proc l_potential_n=NULL;  /* potential_double_n, if present            */
+local potproc_double l_potential_1=NULL;  /* used by potential_n_points()   */
+local potptr l_composite=NULL;  /* potname=a+b+.. in the classic interface  */
 local bool Qfortran = FALSE;    /* was a fortran routine used ? -- a hack -- */
 local bool first = TRUE;        /* see if first time called for mysymbols()  */
 
@@ -63,6 +80,21 @@ void potential_dummy_for_c(void);
 /* forward declarations */
 
 local proc load_potential(string, string, string, char); /* load by name    */
+local proc load_composite(string, string, string, char);
+local void composite_double(const int *, const double *, double *, double *,
+			    const double *);
+local void composite_double_n(const int *, const int *, const double *,
+			      double *, double *, const double *);
+local int  get_parameters(string, double *);
+local string find_object(string);
+local proc find_symbols(string, string, char, proc *, proc *, bool *);
+local void init_potential(string, proc, bool, int *, double *, string);
+local potptr new_component(potptr, int);
+local int  object_copy(string);
+local int  nfields(string, char);
+local string field(string, int, char);
+local void potential_n_points(const int *, const int *, const double *,
+			      double *, double *, const double *);
 
 /*-----------------------------------------------------------------------------
  *  get_potential --  returns the pointer ptr to the function which carries out
@@ -93,6 +125,53 @@ potproc_float  get_potential_float(string potname, string potpars, string potfil
     return (potproc_float) l_potential;
 }
 
+/*-----------------------------------------------------------------------------
+ *  get_potential_double_n -- as get_potential_double, but the returned
+ *		function evaluates n positions in one call. Potentials which
+ *		do not provide potential_double_n get a generic version that
+ *		calls their potential_double for each position.
+ *-----------------------------------------------------------------------------
+ */
+potproc_double_n get_potential_double_n(string potname, string potpars, string potfile)
+{
+    if (potname == NULL || *potname == 0)	/* if no name provided */
+        return NULL;				/* return no potential */
+    l_potential = load_potential(potname, potpars, potfile,'d');
+    if (l_potential_n) {
+        dprintf(1,"get_potential_double_n: using potential_double_n\n");
+        return (potproc_double_n) l_potential_n;
+    }
+    l_potential_1 = (potproc_double) l_potential;
+    return potential_n_points;
+}
+
+/*-----------------------------------------------------------------------------
+ *  potential_points -- n positions, stored as in potential_double_n, one
+ *		at a time with pot; for potentials without an array version,
+ *		see also <potential_n.h>
+ *-----------------------------------------------------------------------------
+ */
+void potential_points(potproc_double pot, const int *ndim, const int *n,
+		      const double *pos, double *acc, double *phi,
+		      const double *time)
+{
+    double p[3], a[3];
+    int i, k, nn = *n;
+
+    for (i=0; i<nn; i++) {
+	for (k=0; k<*ndim; k++) p[k] = pos[k*nn+i];
+	(*pot)(ndim,p,a,&phi[i],time);
+	for (k=0; k<*ndim; k++) acc[k*nn+i] = a[k];
+    }
+}
+
+local void potential_n_points(const int *ndim, const int *n, const double *pos,
+			      double *acc, double *pot, const double *time)
+{
+    potential_points(l_potential_1,ndim,n,pos,acc,pot,time);
+}
+}
+
 /*-----------------------------------------------------------------------------
  *  get_inipotential --  returns the pointer ptr to the last inipotential
  *          function which initializes the potential
@@ -135,25 +214,92 @@ void set_pattern(real omega)
  */
 local proc load_potential(string fname, string parameters, string dataname, char type)
 {
-    char  name[256], cmd[256], path[256], pname[32];
-    char  *fullname, *nemopath, *potpath;
+    string fullname;
     proc  pot, ini_pot;
-    int never=0;
-
-    if (parameters!=NULL && *parameters!=0) {              /* get parameters */
-	local_npar = nemoinpd(parameters,local_par,MAXPAR);
-        if (local_npar>MAXPAR)
-            error ("get_potential: potential has too many parameters (%d)",
-                            local_npar);
-        if (local_npar<0)
-            warning("get_potential: parsing error in: %s",parameters);
-    } else
-        local_npar=0;
+
+    if (strchr(fname,'+'))                     /* a sum of potentials */
+        return load_composite(fname, parameters, dataname, type);
+
+    local_npar = get_parameters(parameters, local_par);
     if (local_npar > 0 && local_par[0] != 0.0) { /* aid multiple potentials */
         local_omega = local_par[0];
         dprintf(1,"get_potential: setting local_omega = %g\n",local_omega);
     }
 
+    fullname = find_object(fname);
+    loadobj(fullname);
+    pot = find_symbols(fname, fullname, type, &l_potential_n, &ini_pot, &Qfortran);
+    init_potential(fname, ini_pot, Qfortran, &local_npar, local_par, dataname);
+    free(fullname);
+
+    l_potential = pot;            /* save these two for later references */
+    l_inipotential = ini_pot;
+    if (local_npar > 0 && local_par[0] != local_omega) {
+    	local_omega = local_par[0];
+    	dprintf(1,"get_potential: modified omega=%g\n",local_omega);
+    }
+    if (pot==NULL) potential_dummy_for_c();    /* should never be called */
+    return pot;
+}
+
+/*
+ *  load_composite -- the classic interface for potname=a+b+..: a composite
+ *	potential context, evaluated by the local composite_ functions.
+ */
+local proc load_composite(string fname, string parameters, string dataname, char type)
+{
+    char search_type = type=='r' ? REAL_TYPE : type;
+
+    if (search_type != 'd')
+        error("get_potential: composite potential %s only in double",fname);
+    if (l_composite) freepotential(l_composite);
+    l_composite = newpotential(fname, parameters, dataname);
+    local_omega = l_composite->omega;
+    l_potential_n = (proc) composite_double_n;
+    l_inipotential = NULL;
+    return (proc) composite_double;
+}
+
+local void composite_double(const int *ndim, const double *pos, double *acc,
+			    double *pot, const double *time)
+{
+    evalpotential(l_composite, *ndim, 1, pos, acc, pot, *time);
+}
+
+local void composite_double_n(const int *ndim, const int *n, const double *pos,
+			      double *acc, double *pot, const double *time)
+{
+    evalpotential(l_composite, *ndim, *n, pos, acc, pot, *time);
+}
+
+/*
+ *  get_parameters -- parse potpars into par[], returns their number
+ */
+local int get_parameters(string parameters, double *par)
+{
+    int npar;
+
+    if (parameters==NULL || *parameters==0)
+        return 0;
+    npar = nemoinpd(parameters,par,MAXPAR);
+    if (npar>MAXPAR)
+        error ("get_potential: potential has too many parameters (%d)",npar);
+    if (npar<0) {
+        warning("get_potential: parsing error in: %s",parameters);
+        npar = 0;
+    }
+    return npar;
+}
+
+/*
+ *  find_object -- return the (allocated) name of the shared object for
+ *	potential fname, compiling fname.c if need be.
+ */
+local string find_object(string fname)
+{
+    char  name[256], path[256];
+    char  *fullname, *nemopath, *potpath;
+
     if (first) {
         mysymbols(getparam("argv0"));      /* get symbols for this program */
         first = FALSE;			   /* and tell it we've initialized */
@@ -163,7 +309,7 @@ local proc load_potential(string fname, string parameters, string dataname, char
        potpath = path;
        strcpy (path,".");
        nemopath = getenv("NEMO");
-       if (nemopath==NULL) {
+       if (nemopath!=NULL) {
 	 strcat(path,":");
 	 strcat (path,nemopath);
 	 strcat (path,"/obj/potential");		/* ".:$NEMO/obj/potential" */
@@ -174,24 +320,30 @@ local proc load_potential(string fname, string parameters, string dataname, char
     fullname = pathfind (potpath, name);
     if (fullname!=NULL) {			/* .o found !! */
         dprintf (2,"Attempt to load potential from %s\n",name);
-    	loadobj(fullname);
-    } else {					/* no .o found */
-	strcpy (path,".");	/* just look in current directory */
-	strcpy (name,fname);
-	strcat (name,".c");
-	if (pathfind(".",name)==NULL)
-	    error("get_potential: no potential %s found",name);
-	dprintf (0,"[Compiling potential %s]\n",name);	
-	sprintf (cmd,"make -f $NEMOLIB/Makefile.lib %s.so",name);
-	dprintf (1,"%s\n",cmd);
-	if (system(cmd)!=0)
-	    error ("Error in compiling potential file");
-	strcpy (name,fname);
-	strcat (name,".so");
-	fullname = name;	/* or use: findpath ? */
-	loadobj (name);
+        return scopy(fullname);
     }
+    strcpy (name,fname);			/* no .o found */
+    strcat (name,".c");			/* just look in current directory */
+    if (pathfind(".",name)==NULL)
+        error("get_potential: no potential %s found",name);
+    fullname = objcache(name);		/* compiled once, shared by all */
+    if (fullname==NULL)
+        error ("Error in compiling potential file");
+    return fullname;
+}
 
+/*
+ *  find_symbols -- find the potential routine of the requested type in the
+ *	object loaded last, and the optional potential_double_n and
+ *	inipotential.
+ */
+local proc find_symbols(string fname, string fullname, char type,
+			proc *pot_n, proc *ini, bool *fortran)
+{
+    char  pname[32];
+    proc  pot = NULL, ini_pot;
+
+    *fortran = FALSE;
     /*
      * changed code 17/05/02 WD
      * debugged     18/09/08 WD
@@ -215,18 +367,12 @@ local proc load_potential(string fname, string parameters, string dataname, char
     strcat(pname,"_");								\
     pot = (proc) findfn (pname);           /*     try F77-routine       */	\
     if (pot)                               /*     found!                */ 	\
-      Qfortran = TRUE;	 	     /*       must be F77 then    */ 		\
+      *fortran = TRUE;	 	     /*       must be F77 then    */ 		\
   }                                        /*   <                       */ 	\
   if(pot) dprintf(1,"\"%s\" loaded from file \"%s\"\n",POTENTIAL,fullname);	\
 }
 
-    char search_type = type=='r'?
-#ifdef SINGLEPREC
-      'f'
-#else
-      'd'
-#endif
-      : type;
+    char search_type = type=='r' ? REAL_TYPE : type;
 
     if(search_type=='f') {                   /* IF type=f                 */
       FIND("potential_float");               /*   try "potential_float"   */
@@ -247,6 +393,12 @@ local proc load_potential(string fname, string parameters, string dataname, char
       error("Couldn't find a suitable potential for type %c in %s",type,fname);
       return NULL;
     }
+    *pot_n = NULL;
+    if (search_type=='d' && !*fortran) {     /* optional array version */
+      strcpy(pname,"potential_double_n");
+      mapsys(pname);
+      *pot_n = (proc) findfn (pname);
+    }
 
     strcpy(pname,"inipotential");
     mapsys(pname);
@@ -266,29 +418,215 @@ local proc load_potential(string fname, string parameters, string dataname, char
             }
         }
     }
+    *ini = ini_pot;
+    return pot;
+}
+
+/*
+ *  init_potential -- call inipotential, if present
+ */
+local void init_potential(string fname, proc ini_pot, bool fortran,
+			  int *npar, double *par, string dataname)
+{
     if (ini_pot)
-        if (!Qfortran)
-            (*ini_pot)(&local_npar,local_par,dataname); 	/* C */
+        if (!fortran)
+            (*ini_pot)(npar,par,dataname); 			/* C */
         else {
             if (dataname==NULL)
-                (*ini_pot)(&local_npar,local_par,dataname,0);   /* F77 */
+                (*ini_pot)(npar,par,dataname,0);   		/* F77 */
             else
-                (*ini_pot)(&local_npar,local_par,dataname,strlen(dataname)); /* F77 */
+                (*ini_pot)(npar,par,dataname,strlen(dataname)); /* F77 */
 
         }
     else {
         printf ("Warning: inipotential(_) not present in %s", fname);
         printf (",default taken\n");
     }
-    l_potential = pot;            /* save these two for later references */
-    l_inipotential = ini_pot;
-    if (local_npar > 0 && local_par[0] != local_omega) {
-    	local_omega = local_par[0];
-    	dprintf(1,"get_potential: modified omega=%g\n",local_omega);
+}
+
+/*-----------------------------------------------------------------------------
+ *  newpotential -- a potential context: a potential with its own copy of
+ *		the object file, so any number of them can be used side by
+ *		side, with different parameters.  potname=a+b+.. gives the sum
+ *		of potentials, with potpars and potfile separated by ';'.
+ *		Not thread safe, but evalpotential is, if the potential's
+ *		own routines are.
+ *  evalpotential -- n positions, stored as in potential_double_n
+ *  freepotential -- release a context (the object stays loaded)
+ *-----------------------------------------------------------------------------
+ */
+potptr newpotential(string potname, string potpars, string potfile)
+{
+    potptr p;
+    string fullname, copy;
+    proc   pot, pot_n, ini_pot;
+    bool   fortran;
+    int    i;
+
+    if (potname == NULL || *potname == 0)
+        return NULL;
+    p = (potptr) allocate(sizeof(pot_context));
+    p->name = scopy(potname);
+    p->pars = scopy(potpars ? potpars : "");
+    p->file = scopy(potfile ? potfile : "");
+    p->ncomp = 0;
+    p->comp = NULL;
+    p->omega = 0.0;
+    if (strchr(potname,'+')) {
+        p->ncomp = nfields(potname,'+');
+        p->comp = (potptr *) allocate(p->ncomp * sizeof(potptr));
+        for (i=0; i<p->ncomp; i++) {
+            p->comp[i] = new_component(p, i);
+            if (p->comp[i]->omega == 0.0) continue;
+            if (p->omega != 0.0 && p->omega != p->comp[i]->omega)
+                warning("newpotential: %s: pattern speeds %g and %g, using %g",
+                        potname, p->omega, p->comp[i]->omega, p->omega);
+            else
+                p->omega = p->comp[i]->omega;
+        }
+        p->pot = NULL;
+        p->pot_n = NULL;
+        p->npar = 0;
+        p->par = NULL;
+        return p;
     }
-    if (pot==NULL) potential_dummy_for_c();    /* should never be called */
-    return pot;
+    p->par = (double *) allocate(MAXPAR * sizeof(double));
+    p->npar = get_parameters(p->pars, p->par);
+    fullname = find_object(potname);
+    copy = objreplica(fullname, object_copy(fullname));
+    loadobj(copy);
+    pot = find_symbols(potname, copy, 'd', &pot_n, &ini_pot, &fortran);
+    init_potential(potname, ini_pot, fortran, &p->npar, p->par, p->file);
+    p->pot = (potproc_double) pot;
+    p->pot_n = (potproc_double_n) pot_n;
+    if (p->npar > 0) p->omega = p->par[0];
+    dprintf(1,"newpotential: %s from %s omega=%g\n",potname,copy,p->omega);
+    free(fullname);
+    free(copy);
+    return p;
+}
+
+local potptr new_component(potptr p, int i)
+{
+    string name, pars, file;
+    potptr c;
+
+    name = field(p->name, i, '+');
+    pars = field(p->pars, i, ';');
+    file = field(p->file, i, ';');
+    if (*name == 0)
+        error("newpotential: empty component %d in %s",i+1,p->name);
+    if (strchr(name,'+'))
+        error("newpotential: %s",name);		/* cannot happen */
+    c = newpotential(name, pars, file);
+    free(name);
+    free(pars);
+    free(file);
+    return c;
+}
+
+/* object_copy -- number the copies made of each object, 1,2,... */
+
+local int object_copy(string fullname)
+{
+    permanent string objs[MAXOBJ];
+    permanent int ncopy[MAXOBJ];
+    permanent int nobj = 0;
+    int i;
+
+    for (i=0; i<nobj; i++)
+        if (streq(objs[i],fullname))
+            return ++ncopy[i];
+    if (nobj == MAXOBJ)
+        error("newpotential: too many different potentials (%d)",MAXOBJ);
+    objs[nobj] = scopy(fullname);
+    ncopy[nobj] = 1;
+    return ncopy[nobj++];
+}
+
+/* nfields, field -- the number of sep separated fields in s, and a copy
+ *                   of field i (0,1,..), "" if s has fewer            */
+
+local int nfields(string s, char sep)
+{
+    int n = 1;
+
+    for (; *s; s++)
+        if (*s == sep) n++;
+    return n;
+}
+
+local string field(string s, int i, char sep)
+{
+    string e, f;
+
+    for (; i > 0 && *s; s++)
+        if (*s == sep) i--;
+    if (i > 0) return scopy("");
+    e = strchr(s, sep);
+    if (e == NULL) return scopy(s);
+    f = (string) allocate(e-s+1);
+    strncpy(f, s, e-s);
+    f[e-s] = 0;
+    return f;
 }
+
+local void eval_component(potptr p, int ndim, int n, const double *pos,
+			  double *acc, double *pot, double time)
+{
+    if (p->pot_n)
+        (*p->pot_n)(&ndim, &n, pos, acc, pot, &time);
+    else
+        potential_points(p->pot, &ndim, &n, pos, acc, pot, &time);
+}
+
+void evalpotential(potptr p, int ndim, int n, const double *pos,
+		   double *acc, double *pot, double time)
+{
+    double bpos[3*NBLOCK], bacc[3*NBLOCK], bpot[NBLOCK];
+    int i, i0, k, c, m;
+
+    if (ndim < 1 || ndim > 3)
+        error("evalpotential: ndim=%d not supported",ndim);
+    if (p->ncomp == 0) {
+        eval_component(p, ndim, n, pos, acc, pot, time);
+        return;
+    }
+    for (i0=0; i0<n; i0+=NBLOCK) {       /* sum, a block at a time */
+        m = MIN(NBLOCK, n-i0);
+        for (k=0; k<ndim; k++)
+            for (i=0; i<m; i++) {
+                bpos[k*m+i] = pos[k*n+i0+i];
+                acc[k*n+i0+i] = 0.0;
+            }
+        for (i=0; i<m; i++)
+            pot[i0+i] = 0.0;
+        for (c=0; c<p->ncomp; c++) {
+            eval_component(p->comp[c], ndim, m, bpos, bacc, bpot, time);
+            for (k=0; k<ndim; k++)
+                for (i=0; i<m; i++)
+                    acc[k*n+i0+i] += bacc[k*m+i];
+            for (i=0; i<m; i++)
+                pot[i0+i] += bpot[i];
+        }
+    }
+}
+
+void freepotential(potptr p)
+{
+    int i;
+
+    if (p == NULL) return;
+    for (i=0; i<p->ncomp; i++)
+        freepotential(p->comp[i]);
+    if (p->comp) free(p->comp);
+    if (p->par) free(p->par);
+    free(p->name);
+    free(p->pars);
+    free(p->file);
+    free(p);
+}
+
 /* endof: potential.c */
  
 /******   now some junk needed to force linker to load some extra ******/